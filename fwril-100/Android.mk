@@ -3,22 +3,40 @@
 # XXX using libutils for simulator build only...
 #
 LOCAL_PATH:= $(call my-dir)
-include $(CLEAR_VARS)
-
-LOCAL_MODULE:= libril-fusion-100
-LOCAL_MODULE_TAGS := debug
 
-LOCAL_SRC_FILES:= \
+# driver sources, also linked into the host benchmark in tools/
+fw100_ril_src_files := \
     fw100-ril.c	\
     fw100-ril-rqst.c \
     fw100-ril-data.c \
     fw100-ril-timer.c \
     fw100-ril-utils.c \
     fw100-ril-gps.c \
+    fw100-ril-sched.c \
+    fw100-ril-metrics.c \
+    fw100-ril-trace.c \
+    fw100-ril-schema.c \
+    fw100-ril-ppp.c \
+    fw100-ril-dialer.c \
+    fw100-ril-netlink.c \
+    fw100-ril-failcause.c \
+    fw100-ril-keeper.c \
+    fw100-ril-linkmon.c \
+    fw100-ril-usage.c \
     atchannel.c \
+    atschema.c \
+    atcapture.c \
     misc.c \
     at_tok.c \
-    rilinfo.c
+    rilinfo.c \
+    rillog.c
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE:= libril-fusion-100
+LOCAL_MODULE_TAGS := debug
+
+LOCAL_SRC_FILES:= $(fw100_ril_src_files)
 
 LOCAL_SHARED_LIBRARIES := \
     libcutils libutils libnetutils libril
@@ -57,3 +75,6 @@ else
   LOCAL_PRELINK_MODULE := false
   include $(BUILD_EXECUTABLE)
 endif
+
+# host tools
+include $(LOCAL_PATH)/tools/Android.mk
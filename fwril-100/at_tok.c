@@ -188,3 +188,195 @@ int at_tok_hasmore(char **p_cur)
 }
 
 
+/**
+ * Splits an AT response line into fields in one pass
+ * Fields follow the first ':' and are separated by ','.  Leading
+ * white space is skipped, a quoted field is the text between the
+ * quotes, anything after the closing quote up to the ',' is ignored.
+ * Fields past AT_TOK_MAX_FIELDS are not recorded.
+ * returns the field count, or -1 if there is no prefix
+ */
+int at_tok_fields(ATTokFields *p_fields, const char *line)
+{
+    const char *p;
+    const char *start;
+    int len;
+    int n = 0;
+
+    p_fields->line = line;
+    p_fields->count = 0;
+
+    if (line == NULL) {
+        return -1;
+    }
+
+    p = strchr(line, ':');
+
+    if (p == NULL) {
+        return -1;
+    }
+
+    p++;
+
+    while (*p != '\0' && isspace(*p)) {
+        p++;
+    }
+
+    if (*p == '\0') {
+        return 0;
+    }
+
+    for (;;) {
+        while (*p == ' ') {
+            p++;
+        }
+
+        if (*p == '"') {
+            start = ++p;
+            while (*p != '\0' && *p != '"') {
+                p++;
+            }
+            len = p - start;
+            while (*p != '\0' && *p != ',') {
+                p++;
+            }
+        } else {
+            start = p;
+            while (*p != '\0' && *p != ',') {
+                p++;
+            }
+            len = p - start;
+        }
+
+        if (n < AT_TOK_MAX_FIELDS) {
+            p_fields->off[n] = (unsigned short)(start - line);
+            p_fields->len[n] = (unsigned short)len;
+            n++;
+        }
+
+        if (*p == '\0') {
+            break;
+        }
+        p++;
+    }
+
+    p_fields->count = n;
+
+    return n;
+}
+
+/**
+ * Parses field i as an integer in base 10 or 16, like strtol it
+ * stops at the first character that is not a digit.  Base 16
+ * accepts a 0x prefix and keeps the low 32 bits.
+ * returns 0 on success and -1 on fail
+ */
+static int at_tok_field_base(const ATTokFields *p_fields, int i, int *p_out,
+                             int base)
+{
+    const char *p;
+    const char *end;
+    unsigned int val = 0;
+    int neg = 0;
+    int digits = 0;
+    int c;
+
+    if (i < 0 || i >= p_fields->count) {
+        return -1;
+    }
+
+    p = p_fields->line + p_fields->off[i];
+    end = p + p_fields->len[i];
+
+    while (p < end && isspace(*p)) {
+        p++;
+    }
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+
+    if (base == 16 && end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+        p += 2;
+    }
+
+    for (; p < end; p++, digits++) {
+        c = *p;
+        if (c >= '0' && c <= '9') {
+            c -= '0';
+        } else if (base == 16 && (c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            c = (c | 0x20) - 'a' + 10;
+        } else {
+            break;
+        }
+        val = val * base + c;
+    }
+
+    if (digits == 0) {
+        return -1;
+    }
+
+    *p_out = neg ? -(int)val : (int)val;
+
+    return 0;
+}
+
+/**
+ * Parses field i as a base 10 integer
+ * returns 0 on success and -1 on fail
+ */
+int at_tok_field_int(const ATTokFields *p_fields, int i, int *p_out)
+{
+    return at_tok_field_base(p_fields, i, p_out, 10);
+}
+
+/**
+ * Parses field i as a base 16 integer
+ * returns 0 on success and -1 on fail
+ */
+int at_tok_field_hex(const ATTokFields *p_fields, int i, int *p_out)
+{
+    return at_tok_field_base(p_fields, i, p_out, 16);
+}
+
+/**
+ * Copies field i, quotes removed, into buf truncated to size
+ * returns the field length, or -1 if there is no field i
+ */
+int at_tok_field_str(const ATTokFields *p_fields, int i, char *buf, size_t size)
+{
+    int len;
+    size_t n;
+
+    if (i < 0 || i >= p_fields->count) {
+        return -1;
+    }
+
+    len = p_fields->len[i];
+
+    if (size > 0) {
+        n = ((size_t)len < size) ? (size_t)len : size - 1;
+        memcpy(buf, p_fields->line + p_fields->off[i], n);
+        buf[n] = '\0';
+    }
+
+    return len;
+}
+
+/**
+ * Returns field i in place, quotes removed and not terminated,
+ * with its length in *p_len, or NULL if there is no field i
+ */
+const char *at_tok_field(const ATTokFields *p_fields, int i, int *p_len)
+{
+    if (i < 0 || i >= p_fields->count) {
+        return NULL;
+    }
+
+    if (p_len != NULL) {
+        *p_len = p_fields->len[i];
+    }
+
+    return p_fields->line + p_fields->off[i];
+}
@@ -18,6 +18,8 @@
 #ifndef AT_TOK_H
 #define AT_TOK_H 1
 
+#include <stddef.h>
+
 int at_tok_start(char **p_cur);
 int at_tok_nextint(char **p_cur, int *p_out);
 int at_tok_nexthexint(char **p_cur, int *p_out);
@@ -27,4 +29,24 @@ int at_tok_nextstr(char **p_cur, char **out);
 
 int at_tok_hasmore(char **p_cur);
 
+/* Indexed tokenizer.  at_tok_fields scans a response line once and
+   records where each field after the "prefix:" starts, so any field
+   can be read directly without walking the ones before it.  The line
+   is not modified and must outlive the ATTokFields. */
+
+#define AT_TOK_MAX_FIELDS 32
+
+typedef struct {
+    const char *line;
+    int count;
+    unsigned short off[AT_TOK_MAX_FIELDS];
+    unsigned short len[AT_TOK_MAX_FIELDS];
+} ATTokFields;
+
+int at_tok_fields(ATTokFields *p_fields, const char *line);
+int at_tok_field_int(const ATTokFields *p_fields, int i, int *p_out);
+int at_tok_field_hex(const ATTokFields *p_fields, int i, int *p_out);
+int at_tok_field_str(const ATTokFields *p_fields, int i, char *buf, size_t size);
+const char *at_tok_field(const ATTokFields *p_fields, int i, int *p_len);
+
 #endif /*AT_TOK_H */
@@ -0,0 +1,345 @@
+/**
+ * \file atcapture.c
+ * \brief AT channel traffic capture
+ *
+ * Each direction has its own single producer, single consumer byte
+ * ring: the reader thread is the only RX producer and TX producers
+ * are serialized by the atchannel command mutex.  Producers never
+ * block, a record that does not fit is dropped and the loss is
+ * reported in the next record.  The writer thread merges both rings
+ * in timestamp order into the trace file.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "AT"
+#include <utils/Log.h>
+
+#include <telephony/ril.h>
+
+#include <atcapture.h>
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+// per direction ring size, must be a power of 2
+#define AT_CAP_RING_SIZE	0x8000
+#define AT_CAP_RING_MASK	(AT_CAP_RING_SIZE - 1)
+
+// writer wakes at this interval, or when a ring is half full
+#define AT_CAP_FLUSH_MSEC	1000
+
+typedef struct at_cap_ring
+{
+	volatile unsigned int head;	// producer
+	volatile unsigned int tail;	// consumer
+	unsigned int lost;		// producer, drops since last record
+	unsigned int dropped;		// producer, total drops
+	unsigned char buf[AT_CAP_RING_SIZE];
+} at_cap_ring_t;
+
+volatile int at_capture_enabled = 0;
+
+static at_cap_ring_t s_ring[2];
+static unsigned int s_bytes;
+
+static pthread_t s_tid;
+static int s_running;
+static volatile int s_stop;
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+
+static char s_path[128];
+static int s_maxBytes;
+static int s_maxFiles;
+static FILE *s_file;
+static int s_fileBytes;
+
+static uint64_t monoUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void ringPut(at_cap_ring_t *r, unsigned int pos, const void *src, int len)
+{
+	unsigned int off = pos & AT_CAP_RING_MASK;
+	unsigned int first = AT_CAP_RING_SIZE - off;
+
+	if (first > (unsigned int)len) first = len;
+	memcpy(r->buf + off, src, first);
+	memcpy(r->buf, (const char *)src + first, len - first);
+}
+
+static void ringGet(at_cap_ring_t *r, unsigned int pos, void *dst, int len)
+{
+	unsigned int off = pos & AT_CAP_RING_MASK;
+	unsigned int first = AT_CAP_RING_SIZE - off;
+
+	if (first > (unsigned int)len) first = len;
+	memcpy(dst, r->buf + off, first);
+	memcpy((char *)dst + first, r->buf, len - first);
+}
+
+/**
+ *  \brief copy AT channel bytes into the capture ring
+ *  called through AT_DUMP only when at_capture_enabled
+ *
+ *  \param dir - AT_CAP_RX or AT_CAP_TX
+ *  \param buf - bytes
+ *  \param len - byte count, -1 for strlen
+ */
+void atCaptureWrite(int dir, const char *buf, int len)
+{
+	at_cap_ring_t *r = &s_ring[dir];
+	at_cap_rec_hdr_t hdr;
+	unsigned int used;
+
+	if (len < 0) len = strlen(buf);
+	if (len > 0xffff) len = 0xffff;
+
+	used = r->head - r->tail;
+	if (used + sizeof(hdr) + len > AT_CAP_RING_SIZE) {
+		r->lost++;
+		r->dropped++;
+		return;
+	}
+
+	hdr.usec = monoUsec();
+	hdr.len = len;
+	hdr.dir = dir;
+	hdr.flags = 0;
+	hdr.lost = r->lost;
+	r->lost = 0;
+
+	ringPut(r, r->head, &hdr, sizeof(hdr));
+	ringPut(r, r->head + sizeof(hdr), buf, len);
+	__sync_synchronize();
+	r->head += sizeof(hdr) + len;
+
+	// kick writer early rather than drop
+	if (used < AT_CAP_RING_SIZE / 2
+		&& used + sizeof(hdr) + len >= AT_CAP_RING_SIZE / 2)
+		pthread_cond_signal(&s_cond);
+}
+
+/**
+ *  \brief open trace file, writing file header
+ *  \return 0 OK, -1 error
+ */
+static int openTrace(void)
+{
+	at_cap_file_hdr_t hdr;
+	struct timeval tv;
+
+	s_file = fopen(s_path, "wb");
+	if (NULL == s_file) {
+		LOGE("%s:%d cannot open %s %s", __FUNCTION__, __LINE__,
+			s_path, strerror(errno));
+		return -1;
+	}
+
+	gettimeofday(&tv, NULL);
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, AT_CAP_MAGIC, sizeof(hdr.magic));
+	hdr.version = AT_CAP_VERSION;
+	hdr.pid = getpid();
+	hdr.monoUsec = monoUsec();
+	hdr.wallUsec = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+	fwrite(&hdr, sizeof(hdr), 1, s_file);
+	s_fileBytes = sizeof(hdr);
+
+	return 0;
+}
+
+/**
+ *  \brief rotate path to path.1 .. path.<maxFiles-1> and reopen
+ */
+static int rotateTrace(void)
+{
+	char from[sizeof(s_path) + 12];		// ".<int>"
+	char to[sizeof(s_path) + 12];
+	int i;
+
+	fclose(s_file);
+	s_file = NULL;
+
+	for (i = s_maxFiles - 1; i > 0; i--) {
+		if (i > 1)
+			snprintf(from, sizeof(from), "%s.%d", s_path, i - 1);
+		else
+			snprintf(from, sizeof(from), "%s", s_path);
+		snprintf(to, sizeof(to), "%s.%d", s_path, i);
+		rename(from, to);
+	}
+
+	return openTrace();
+}
+
+/**
+ *  \brief move one record from ring to trace file
+ */
+static void writeRecord(at_cap_ring_t *r, at_cap_rec_hdr_t *hdr)
+{
+	char data[256];
+	unsigned int pos = r->tail + sizeof(*hdr);
+	int left = hdr->len;
+	int n;
+
+	if (NULL != s_file && s_fileBytes + (int)sizeof(*hdr) + left > s_maxBytes)
+		rotateTrace();
+
+	if (NULL != s_file) {
+		fwrite(hdr, sizeof(*hdr), 1, s_file);
+		while (left > 0) {
+			n = (left > (int)sizeof(data)) ? (int)sizeof(data) : left;
+			ringGet(r, pos, data, n);
+			fwrite(data, n, 1, s_file);
+			pos += n;
+			left -= n;
+		}
+		s_fileBytes += sizeof(*hdr) + hdr->len;
+	}
+
+	s_bytes += hdr->len;
+	__sync_synchronize();
+	r->tail += sizeof(*hdr) + hdr->len;
+}
+
+/**
+ *  \brief drain both rings, oldest record first
+ */
+static void drain(void)
+{
+	at_cap_rec_hdr_t hdr[2];
+	int have[2];
+	int i;
+
+	for (;;) {
+		for (i = 0; i < 2; i++) {
+			have[i] = (s_ring[i].head != s_ring[i].tail);
+			if (have[i]) {
+				__sync_synchronize();
+				ringGet(&s_ring[i], s_ring[i].tail, &hdr[i], sizeof(hdr[i]));
+			}
+		}
+
+		if (have[0] && have[1])
+			i = (hdr[0].usec <= hdr[1].usec) ? 0 : 1;
+		else if (have[0] || have[1])
+			i = have[0] ? 0 : 1;
+		else
+			break;
+
+		writeRecord(&s_ring[i], &hdr[i]);
+	}
+
+	if (NULL != s_file) fflush(s_file);
+}
+
+/**
+ *  \brief trace writer thread
+ */
+static void *writerLoop(void *arg)
+{
+	pthread_mutex_lock(&s_mutex);
+	while (!s_stop) {
+		fw100CondWaitUntil(&s_cond, &s_mutex, fw100NowMsec() + AT_CAP_FLUSH_MSEC);
+
+		pthread_mutex_unlock(&s_mutex);
+		drain();
+		pthread_mutex_lock(&s_mutex);
+	}
+	pthread_mutex_unlock(&s_mutex);
+
+	drain();
+	if (NULL != s_file) fclose(s_file);
+	s_file = NULL;
+
+	return NULL;
+}
+
+/**
+ *  \brief start capture to trace file
+ *
+ *  \param path - trace file, rotated to path.1 ..
+ *  \param maxBytes - rotate when file reaches this size
+ *  \param maxFiles - number of files kept including path
+ *  \return 0 OK, -1 error
+ */
+int atCaptureStart(const char *path, int maxBytes, int maxFiles)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&s_mutex);
+	if (s_running) goto done;
+
+	snprintf(s_path, sizeof(s_path), "%s", path);
+	s_maxBytes = maxBytes;
+	s_maxFiles = (maxFiles < 1) ? 1 : maxFiles;
+
+	ret = -1;
+	if (openTrace() < 0) goto done;
+
+	s_stop = 0;
+	if (pthread_create(&s_tid, NULL, writerLoop, NULL) != 0) {
+		fclose(s_file);
+		s_file = NULL;
+		goto done;
+	}
+	s_running = 1;
+	at_capture_enabled = 1;
+	ret = 0;
+	LOGI("%s capture to %s", __FUNCTION__, s_path);
+
+done:
+	pthread_mutex_unlock(&s_mutex);
+	return ret;
+}
+
+/**
+ *  \brief stop capture, flushing rings and closing trace file
+ */
+void atCaptureStop(void)
+{
+	pthread_mutex_lock(&s_mutex);
+	if (!s_running) {
+		pthread_mutex_unlock(&s_mutex);
+		return;
+	}
+	at_capture_enabled = 0;
+	s_stop = 1;
+	s_running = 0;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_mutex);
+
+	pthread_join(s_tid, NULL);
+	LOGI("%s capture stopped", __FUNCTION__);
+}
+
+/**
+ *  \brief captured and dropped counts
+ */
+void atCaptureStats(unsigned int *bytes, unsigned int *dropped)
+{
+	*bytes = s_bytes;
+	*dropped = s_ring[AT_CAP_RX].dropped + s_ring[AT_CAP_TX].dropped;
+}
@@ -0,0 +1,53 @@
+/**
+ *
+ * \file atcapture.h
+ * \brief AT channel traffic capture include file
+ *
+ * Every byte read from and written to the AT channel is passed to
+ * AT_DUMP.  When capture is enabled the bytes are copied with a
+ * monotonic timestamp into a per direction ring, and a writer thread
+ * appends them to a binary trace file with size based rotation.
+ * When capture is disabled AT_DUMP is a single flag test.
+ *
+ * Use fwril-100/tools/at-trace-decode to convert trace files to
+ * logcat style text.
+ */
+
+#ifndef _atcapture_h_included
+#define _atcapture_h_included
+
+#include <stdint.h>
+
+// trace file layout, native byte order
+#define AT_CAP_MAGIC	"FWATCAP1"
+#define AT_CAP_VERSION	1
+
+#define AT_CAP_RX	0 // modem to host
+#define AT_CAP_TX	1 // host to modem
+
+typedef struct at_cap_file_hdr
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t pid;
+	uint64_t monoUsec;	// monotonic time at file open
+	uint64_t wallUsec;	// wall clock time at file open
+} at_cap_file_hdr_t;
+
+typedef struct at_cap_rec_hdr
+{
+	uint64_t usec;		// monotonic
+	uint16_t len;		// data bytes following header
+	uint8_t dir;		// AT_CAP_RX, AT_CAP_TX
+	uint8_t flags;		// reserved
+	uint32_t lost;		// records dropped before this one
+} at_cap_rec_hdr_t;
+
+extern volatile int at_capture_enabled;
+
+void atCaptureWrite(int dir, const char *buf, int len);
+int  atCaptureStart(const char *path, int maxBytes, int maxFiles);
+void atCaptureStop(void);
+void atCaptureStats(unsigned int *bytes, unsigned int *dropped);
+
+#endif // _atcapture_h_included
@@ -19,12 +19,14 @@
 #include "at_tok.h"
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <pthread.h>
 #include <ctype.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
@@ -32,6 +34,7 @@
 #define LOG_NDEBUG 0
 #define LOG_TAG "AT"
 #include <utils/Log.h>
+#include <rillog.h>
 
 #ifdef HAVE_ANDROID_OS
 /* for IOCTL's */
@@ -64,15 +67,6 @@ static int s_ackPowerIoctl; /* true if TTY has android byte-count
                                 handshake for low power*/
 static int s_readCount = 0;
 
-#if AT_DEBUG
-void  AT_DUMP(const char*  prefix, const char*  buff, int  len)
-{
-    if (len < 0)
-        len = strlen(buff);
-    LOGD("%.*s", len, buff);
-}
-#endif
-
 /*
  * for current pending command
  * these are protected by s_commandmutex
@@ -87,13 +81,63 @@ static const char *s_smsPDU = NULL;
 static ATResponse *sp_response = NULL;
 
 static void (*s_onTimeout)(void) = NULL;
+static void (*s_onCommandComplete)(const char *command, int err,
+                long long startUsec, long long endUsec) = NULL;
+static volatile int s_queueDepth;
 static void (*s_onReaderClosed)(void) = NULL;
 static int s_readerClosed;
+static int s_readerRunning;
+static int s_closePipe[2] = { -1, -1 };  /* at_close wakes the reader */
+static long long s_commandTimeoutMsec;
+
+static const ATChannelIo s_sysIo = { read, write };
+static const ATChannelIo *s_io = &s_sysIo;
+
+/* command template output, protected by s_commandmutex */
+static char s_commandBuf[MAX_AT_RESPONSE+1];
+
+/*
+ * Response pool.  Responses and short lines are taken from these
+ * static arrays so a steady stream of commands does not touch the
+ * heap; a line too long for a pool buffer, or an empty pool, falls
+ * back to malloc.  at_response_free tells them apart by address.
+ * Protected by s_poolMutex, responses are freed on any thread.
+ */
+#define AT_POOL_RESPONSES   8
+#define AT_POOL_LINES       32
+#define AT_POOL_LINE_SIZE   128
+#define AT_POOL_FINAL_SIZE  32
+
+typedef struct {
+    ATResponse response;
+    char finalBuf[AT_POOL_FINAL_SIZE];
+} ATPoolResponse;
+
+typedef struct {
+    ATLine line;
+    char buf[AT_POOL_LINE_SIZE];
+} ATPoolLine;
+
+static pthread_mutex_t s_poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static ATPoolResponse s_poolResponses[AT_POOL_RESPONSES];
+static ATPoolLine s_poolLines[AT_POOL_LINES];
+static ATPoolResponse *s_freeResponses[AT_POOL_RESPONSES];
+static ATPoolLine *s_freeLines[AT_POOL_LINES];
+static int s_nFreeResponses = -1;  /* -1 until the free lists are built */
+static int s_nFreeLines;
 
 static void onReaderClosed();
 static int writeCtrlZ (const char *s);
 static int writeline (const char *s);
 
+static long long monotonicUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 #ifndef USE_NP
 static void setTimespecRelative(struct timespec *p_ts, long long msec)
 {
@@ -106,6 +150,10 @@ static void setTimespecRelative(struct timespec *p_ts, long long msec)
        a relative time again */
     p_ts->tv_sec = tv.tv_sec + (msec / 1000);
     p_ts->tv_nsec = (tv.tv_usec + (msec % 1000) * 1000L ) * 1000L;
+    if (p_ts->tv_nsec >= 1000000000L) {
+        p_ts->tv_sec++;
+        p_ts->tv_nsec -= 1000000000L;
+    }
 }
 #endif /*USE_NP*/
 
@@ -124,14 +172,68 @@ static void sleepMsec(long long msec)
 
 
 
-/** add an intermediate response to sp_response*/
-static void addIntermediate(const char *line)
+/** assumes s_poolMutex is held */
+static void poolInit()
+{
+    int i;
+
+    if (s_nFreeResponses >= 0) return;
+
+    for (i = 0 ; i < AT_POOL_RESPONSES ; i++) {
+        s_freeResponses[i] = &s_poolResponses[i];
+    }
+    for (i = 0 ; i < AT_POOL_LINES ; i++) {
+        s_freeLines[i] = &s_poolLines[i];
+    }
+    s_nFreeResponses = AT_POOL_RESPONSES;
+    s_nFreeLines = AT_POOL_LINES;
+}
+
+static int isPoolResponse(const ATResponse *p_response)
 {
+    return (const char *)p_response >= (const char *)s_poolResponses
+        && (const char *)p_response < (const char *)(s_poolResponses + AT_POOL_RESPONSES);
+}
+
+static int isPoolLine(const ATLine *p_line)
+{
+    return (const char *)p_line >= (const char *)s_poolLines
+        && (const char *)p_line < (const char *)(s_poolLines + AT_POOL_LINES);
+}
+
+/** a line from the pool holding a copy of line, malloc if it does not fit */
+static ATLine *lineNew(const char *line)
+{
+    ATPoolLine *p_pool = NULL;
     ATLine *p_new;
+    size_t len = strlen(line);
 
-    p_new = (ATLine  *) malloc(sizeof(ATLine));
+    if (len < AT_POOL_LINE_SIZE) {
+        pthread_mutex_lock(&s_poolMutex);
+        poolInit();
+        if (s_nFreeLines > 0) {
+            p_pool = s_freeLines[--s_nFreeLines];
+        }
+        pthread_mutex_unlock(&s_poolMutex);
+    }
 
+    if (p_pool != NULL) {
+        memcpy(p_pool->buf, line, len + 1);
+        p_pool->line.line = p_pool->buf;
+        return &p_pool->line;
+    }
+
+    p_new = (ATLine  *) malloc(sizeof(ATLine));
     p_new->line = strdup(line);
+    return p_new;
+}
+
+/** add an intermediate response to sp_response*/
+static void addIntermediate(const char *line)
+{
+    ATLine *p_new;
+
+    p_new = lineNew(line);
 
     /* note: this adds to the head of the list, so the list
        will be in reverse order of lines received. the order is flipped
@@ -226,7 +328,14 @@ static int isSMSUnsolicited(const char *line)
 /** assumes s_commandmutex is held */
 static void handleFinalResponse(const char *line)
 {
-    sp_response->finalResponse = strdup(line);
+    ATPoolResponse *p_pool = (ATPoolResponse *)sp_response;
+
+    if (isPoolResponse(sp_response) && strlen(line) < AT_POOL_FINAL_SIZE) {
+        strcpy(p_pool->finalBuf, line);
+        sp_response->finalResponse = p_pool->finalBuf;
+    } else {
+        sp_response->finalResponse = strdup(line);
+    }
 
     pthread_cond_signal(&s_commandcond);
 }
@@ -332,6 +441,7 @@ static char * findNextEOL(char *cur)
 static const char *readline()
 {
     ssize_t count;
+    struct pollfd pfd[2];
 
     char *p_read = NULL;
     char *p_eol = NULL;
@@ -378,8 +488,22 @@ static const char *readline()
             p_read = s_ATBuffer;
         }
 
+        /* wait for input or at_close, a close does not wake a read */
+        pfd[0].fd = s_fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = s_closePipe[0];
+        pfd[1].events = POLLIN;
         do {
-            count = read(s_fd, p_read,
+            count = poll(pfd, 2, -1);
+        } while (count < 0 && errno == EINTR);
+
+        if (pfd[1].revents != 0 || s_readerClosed > 0) {
+            LOGD("atchannel: reader closed");
+            return NULL;
+        }
+
+        do {
+            count = s_io->read(s_fd, p_read,
                             MAX_AT_RESPONSE - (p_read - s_ATBuffer));
         } while (count < 0 && errno == EINTR);
 
@@ -413,7 +537,11 @@ static const char *readline()
     s_ATBufferCur = p_eol + 1; /* this will always be <= p_read,    */
                               /* and there will be a \0 at *p_read */
 
-    LOGD("AT< %s\n", ret);
+    // deferred, nmea sentences are logged under their own subsystem
+    if (ret[0] == '$')
+        RLOG_STR(RLOG_SS_GPS, RLOG_DEBUG, "AT< %s\n", ret, p_eol - ret);
+    else
+        RLOG_STR(RLOG_SS_AT, RLOG_DEBUG, "AT< %s\n", ret, p_eol - ret);
     return ret;
 }
 
@@ -447,13 +575,13 @@ static void *readerLoop(void *arg)
         }
 
         if(isSMSUnsolicited(line)) {
-            char *line1;
+            static char line1[MAX_AT_RESPONSE+1];
             const char *line2;
 
             // The scope of string returned by 'readline()' is valid only
             // till next call to 'readline()' hence making a copy of line
-            // before calling readline again.
-            line1 = strdup(line);
+            // before calling readline again.  Reader thread only.
+            strcpy(line1, line);
             line2 = readline();
 
             if (line2 == NULL) {
@@ -463,7 +591,6 @@ static void *readerLoop(void *arg)
             if (s_unsolHandler != NULL) {
                 s_unsolHandler (line1, line2);
             }
-            free(line1);
         } else {
             processLine(line);
         }
@@ -479,6 +606,11 @@ static void *readerLoop(void *arg)
 
     onReaderClosed();
 
+    pthread_mutex_lock(&s_commandmutex);
+    s_readerRunning = 0;
+    pthread_cond_broadcast(&s_commandcond);
+    pthread_mutex_unlock(&s_commandmutex);
+
     return NULL;
 }
 
@@ -499,14 +631,14 @@ static int writeline (const char *s)
         return AT_ERROR_CHANNEL_CLOSED;
     }
 
-    LOGD("AT> %s\n", s);
+    RLOG_STR(RLOG_SS_AT, RLOG_DEBUG, "AT> %s\n", s, len);
 
-    AT_DUMP( ">> ", s, strlen(s) );
+    AT_DUMP( ">> ", s, len );
 
     /* the main string */
     while (cur < len) {
         do {
-            written = write (s_fd, s + cur, len - cur);
+            written = s_io->write (s_fd, s + cur, len - cur);
         } while (written < 0 && errno == EINTR);
 
         if (written < 0) {
@@ -518,8 +650,9 @@ static int writeline (const char *s)
 
     /* the \r  */
 
+    AT_DUMP( ">> ", "\r", 1 );
     do {
-        written = write (s_fd, "\r" , 1);
+        written = s_io->write (s_fd, "\r" , 1);
     } while ((written < 0 && errno == EINTR) || (written == 0));
 
     if (written < 0) {
@@ -538,14 +671,14 @@ static int writeCtrlZ (const char *s)
         return AT_ERROR_CHANNEL_CLOSED;
     }
 
-    LOGD("AT> %s^Z\n", s);
+    RLOG_STR(RLOG_SS_AT, RLOG_DEBUG, "AT> %s^Z\n", s, len);
 
-    AT_DUMP( ">* ", s, strlen(s) );
+    AT_DUMP( ">* ", s, len );
 
     /* the main string */
     while (cur < len) {
         do {
-            written = write (s_fd, s + cur, len - cur);
+            written = s_io->write (s_fd, s + cur, len - cur);
         } while (written < 0 && errno == EINTR);
 
         if (written < 0) {
@@ -557,8 +690,9 @@ static int writeCtrlZ (const char *s)
 
     /* the ^Z  */
 
+    AT_DUMP( ">* ", "\032", 1 );
     do {
-        written = write (s_fd, "\032" , 1);
+        written = s_io->write (s_fd, "\032" , 1);
     } while ((written < 0 && errno == EINTR) || (written == 0));
 
     if (written < 0) {
@@ -589,15 +723,40 @@ int at_open(int fd, ATUnsolHandler h)
     int ret;
     pthread_t tid;
     pthread_attr_t attr;
+    char drain[16];
+
+    if (s_closePipe[0] < 0) {
+        if (pipe(s_closePipe) < 0) {
+            LOGE("atchannel: pipe %s", strerror(errno));
+            return -1;
+        }
+        fcntl(s_closePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(s_closePipe[1], F_SETFL, O_NONBLOCK);
+    }
+
+    /* the previous reader shares the line buffer and a command from
+       before the close may still hold sp_response, let both go first */
+    pthread_mutex_lock(&s_commandmutex);
+    while (s_readerRunning || sp_response != NULL) {
+        pthread_cond_wait(&s_commandcond, &s_commandmutex);
+    }
+
+    while (read(s_closePipe[0], drain, sizeof(drain)) > 0);
+
+    s_ATBufferCur = s_ATBuffer;
+    *s_ATBufferCur = '\0';
 
     s_fd = fd;
     s_unsolHandler = h;
     s_readerClosed = 0;
+    s_readerRunning = 1;
 
     s_responsePrefix = NULL;
     s_smsPDU = NULL;
     sp_response = NULL;
 
+    pthread_mutex_unlock(&s_commandmutex);
+
     /* Android power control ioctl */
 #ifdef HAVE_ANDROID_OS
 #ifdef OMAP_CSMI_POWER_CONTROL
@@ -637,8 +796,9 @@ int at_open(int fd, ATUnsolHandler h)
 
     ret = pthread_create(&s_tid_reader, &attr, readerLoop, &attr);
 
-    if (ret < 0) {
+    if (ret != 0) {
         perror ("pthread_create");
+        s_readerRunning = 0;
         return -1;
     }
 
@@ -649,33 +809,55 @@ int at_open(int fd, ATUnsolHandler h)
 /* FIXME is it ok to call this from the reader and the command thread? */
 void at_close()
 {
-    if (s_fd >= 0) {
-        close(s_fd);
-    }
-    s_fd = -1;
-
     pthread_mutex_lock(&s_commandmutex);
 
     s_readerClosed = 1;
 
-    pthread_cond_signal(&s_commandcond);
+    pthread_cond_broadcast(&s_commandcond);
 
     pthread_mutex_unlock(&s_commandmutex);
 
-    /* the reader thread should eventually die */
+    /* wake the reader out of poll, it exits before at_open starts another */
+    if (s_closePipe[1] >= 0) {
+        write(s_closePipe[1], "c", 1);
+    }
+
+    if (s_fd >= 0) {
+        close(s_fd);
+    }
+    s_fd = -1;
 }
 
 static ATResponse * at_response_new()
 {
-    return (ATResponse *) calloc(1, sizeof(ATResponse));
+    ATPoolResponse *p_pool = NULL;
+
+    pthread_mutex_lock(&s_poolMutex);
+    poolInit();
+    if (s_nFreeResponses > 0) {
+        p_pool = s_freeResponses[--s_nFreeResponses];
+    }
+    pthread_mutex_unlock(&s_poolMutex);
+
+    if (p_pool == NULL) {
+        return (ATResponse *) calloc(1, sizeof(ATResponse));
+    }
+
+    memset(&p_pool->response, 0, sizeof(p_pool->response));
+    return &p_pool->response;
 }
 
 void at_response_free(ATResponse *p_response)
 {
     ATLine *p_line;
+    int pooled;
 
     if (p_response == NULL) return;
 
+    pooled = isPoolResponse(p_response);
+
+    pthread_mutex_lock(&s_poolMutex);
+
     p_line = p_response->p_intermediates;
 
     while (p_line != NULL) {
@@ -684,12 +866,28 @@ void at_response_free(ATResponse *p_response)
         p_toFree = p_line;
         p_line = p_line->p_next;
 
-        free(p_toFree->line);
-        free(p_toFree);
+        if (isPoolLine(p_toFree)) {
+            s_freeLines[s_nFreeLines++] = (ATPoolLine *)p_toFree;
+        } else {
+            free(p_toFree->line);
+            free(p_toFree);
+        }
+    }
+
+    if (pooled) {
+        if (p_response->finalResponse
+            != ((ATPoolResponse *)p_response)->finalBuf) {
+            free (p_response->finalResponse);
+        }
+        s_freeResponses[s_nFreeResponses++] = (ATPoolResponse *)p_response;
     }
 
-    free (p_response->finalResponse);
-    free (p_response);
+    pthread_mutex_unlock(&s_poolMutex);
+
+    if (!pooled) {
+        free (p_response->finalResponse);
+        free (p_response);
+    }
 }
 
 /**
@@ -728,8 +926,8 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
 #endif /*USE_NP*/
 
     if(sp_response != NULL) {
-        err = AT_ERROR_COMMAND_PENDING;
-        goto error;
+        /* another thread is waiting for its response, leave it alone */
+        return AT_ERROR_COMMAND_PENDING;
     }
 
     err = writeline (command);
@@ -785,32 +983,147 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
 error:
     clearPendingCommand();
 
+    if (s_readerClosed > 0) {
+        /* at_open may be waiting for this command to finish */
+        pthread_cond_broadcast(&s_commandcond);
+    }
+
     return err;
 }
 
+/**
+ * Format a command template into buf
+ * slots are %d and %x (int), %c (int as a character), %s (string)
+ * and %% for a literal %
+ *
+ * returns the command length, -1 if it does not fit or a slot is unknown
+ */
+static int formatTemplate(char *buf, size_t size, const char *format,
+                    va_list args)
+{
+    static const char s_hex[] = "0123456789abcdef";
+    char digits[12];
+    const char *src;
+    const char *p;
+    size_t cur = 0;
+    size_t len;
+    unsigned int u;
+    int n;
+    int val;
+
+    for (p = format ; *p != '\0' ; p++) {
+        n = 0;
+        if (*p != '%') {
+            digits[0] = *p;
+            src = digits;
+            len = 1;
+        } else switch (*++p) {
+            case 'd':
+            case 'x':
+                val = va_arg(args, int);
+                u = (*p == 'd' && val < 0) ? 0U - (unsigned int)val
+                                           : (unsigned int)val;
+                do {
+                    digits[sizeof(digits) - ++n] =
+                        (*p == 'd') ? (char)('0' + u % 10) : s_hex[u & 0xf];
+                    u = (*p == 'd') ? u / 10 : u >> 4;
+                } while (u != 0);
+                if (*p == 'd' && val < 0) {
+                    digits[sizeof(digits) - ++n] = '-';
+                }
+                src = digits + sizeof(digits) - n;
+                len = n;
+                break;
+
+            case 'c':
+                digits[0] = (char)va_arg(args, int);
+                src = digits;
+                len = 1;
+                break;
+
+            case 's':
+                src = va_arg(args, const char *);
+                if (src == NULL) return -1;
+                len = strlen(src);
+                break;
+
+            case '%':
+                src = p;
+                len = 1;
+                break;
+
+            default:
+                LOGE("bad command template slot in %s", format);
+                return -1;
+        }
+
+        if (cur + len >= size) return -1;
+        memcpy(buf + cur, src, len);
+        cur += len;
+    }
+
+    buf[cur] = '\0';
+    return (int)cur;
+}
+
 /**
  * Internal send_command implementation
  *
+ * with a template the command is formatted from tmpl and args into
+ * s_commandBuf once the channel is held, command is ignored
+ *
  * timeoutMsec == 0 means infinite timeout
  */
-static int at_send_command_full (const char *command, ATCommandType type,
+static int at_send_command_tmpl (const char *command,
+                    const ATCommandTemplate *tmpl, va_list *p_args,
+                    ATCommandType type,
                     const char *responsePrefix, const char *smspdu,
                     long long timeoutMsec, ATResponse **pp_outResponse)
 {
     int err;
 
+    long long startUsec = 0;
+
     if (0 != pthread_equal(s_tid_reader, pthread_self())) {
         /* cannot be called from reader thread */
         return AT_ERROR_INVALID_THREAD;
     }
 
+    if (timeoutMsec == 0) {
+        timeoutMsec = s_commandTimeoutMsec;
+    }
+
+    __sync_fetch_and_add(&s_queueDepth, 1);
     pthread_mutex_lock(&s_commandmutex);
 
-    err = at_send_command_full_nolock(command, type,
+    if (s_onCommandComplete != NULL) {
+        startUsec = monotonicUsec();
+    }
+
+    if (tmpl != NULL) {
+        /* the template, not the arguments, names the command for the
+           complete callback */
+        command = tmpl->format;
+        if (formatTemplate(s_commandBuf, sizeof(s_commandBuf),
+                    tmpl->format, *p_args) < 0) {
+            err = AT_ERROR_GENERIC;
+        } else {
+            err = at_send_command_full_nolock(s_commandBuf, type,
+                    responsePrefix, smspdu,
+                    timeoutMsec, pp_outResponse);
+        }
+    } else {
+        err = at_send_command_full_nolock(command, type,
                     responsePrefix, smspdu,
                     timeoutMsec, pp_outResponse);
+    }
 
     pthread_mutex_unlock(&s_commandmutex);
+    __sync_fetch_and_sub(&s_queueDepth, 1);
+
+    if (s_onCommandComplete != NULL) {
+        s_onCommandComplete(command, err, startUsec, monotonicUsec());
+    }
 
     if (err == AT_ERROR_TIMEOUT && s_onTimeout != NULL) {
         s_onTimeout();
@@ -819,6 +1132,80 @@ static int at_send_command_full (const char *command, ATCommandType type,
     return err;
 }
 
+/**
+ * Internal send_command implementation
+ *
+ * timeoutMsec == 0 means infinite timeout
+ */
+static int at_send_command_full (const char *command, ATCommandType type,
+                    const char *responsePrefix, const char *smspdu,
+                    long long timeoutMsec, ATResponse **pp_outResponse)
+{
+    return at_send_command_tmpl(command, NULL, NULL, type,
+                    responsePrefix, smspdu, timeoutMsec, pp_outResponse);
+}
+
+/**
+ * Internal template send, SINGLELINE and NUMERIC templates must
+ * get an intermediate response as for at_send_command_singleline
+ */
+static int at_send_template_full (const ATCommandTemplate *tmpl,
+                    const char *pdu, ATResponse **pp_outResponse,
+                    va_list *p_args)
+{
+    int err;
+
+    err = at_send_command_tmpl(NULL, tmpl, p_args, tmpl->type,
+                    tmpl->responsePrefix, pdu, 0, pp_outResponse);
+
+    if (err == 0 && pp_outResponse != NULL
+        && (tmpl->type == SINGLELINE || tmpl->type == NUMERIC)
+        && (*pp_outResponse)->success > 0
+        && (*pp_outResponse)->p_intermediates == NULL
+    ) {
+        /* successful command must have an intermediate response */
+        at_response_free(*pp_outResponse);
+        *pp_outResponse = NULL;
+        return AT_ERROR_INVALID_RESPONSE;
+    }
+
+    return err;
+}
+
+/**
+ * Issue a command built from a template and its slot arguments
+ * pp_outResponse can be NULL, as for at_send_command
+ */
+int at_send_template (const ATCommandTemplate *tmpl,
+                    ATResponse **pp_outResponse, ...)
+{
+    va_list args;
+    int err;
+
+    va_start(args, pp_outResponse);
+    err = at_send_template_full(tmpl, NULL, pp_outResponse, &args);
+    va_end(args);
+
+    return err;
+}
+
+/**
+ * Issue a template command followed by an SMS PDU, as for
+ * at_send_command_sms
+ */
+int at_send_template_sms (const ATCommandTemplate *tmpl, const char *pdu,
+                    ATResponse **pp_outResponse, ...)
+{
+    va_list args;
+    int err;
+
+    va_start(args, pp_outResponse);
+    err = at_send_template_full(tmpl, pdu, pp_outResponse, &args);
+    va_end(args);
+
+    return err;
+}
+
 
 /**
  * Issue a single normal AT command with no intermediate response expected
@@ -928,6 +1315,28 @@ void at_set_on_timeout(void (*onTimeout)(void))
     s_onTimeout = onTimeout;
 }
 
+/** This callback is invoked on the command thread */
+void at_set_on_command_complete(void (*onComplete)(const char *command,
+                                int err, long long startUsec, long long endUsec))
+{
+    s_onCommandComplete = onComplete;
+}
+
+int at_get_queue_depth(void)
+{
+    return s_queueDepth;
+}
+
+void at_set_command_timeout(long long timeoutMsec)
+{
+    s_commandTimeoutMsec = timeoutMsec;
+}
+
+void at_set_channel_io(const ATChannelIo *io)
+{
+    s_io = (io != NULL) ? io : &s_sysIo;
+}
+
 /**
  *  This callback is invoked on the reader thread (like ATUnsolHandler)
  *  when the input stream closes before you call at_close
@@ -22,14 +22,15 @@
 extern "C" {
 #endif
 
-/* define AT_DEBUG to send AT traffic to /tmp/radio-at.log" */
-#define AT_DEBUG  0
+#include <sys/types.h>
 
-#if AT_DEBUG
-extern void  AT_DUMP(const char* prefix, const char*  buff, int  len);
-#else
-#define  AT_DUMP(prefix,buff,len)  do{}while(0)
-#endif
+/* AT traffic capture, enabled at run time, see atcapture.h */
+#include <atcapture.h>
+
+#define  AT_DUMP(prefix,buff,len)  do { \
+    if (__builtin_expect(at_capture_enabled, 0)) \
+        atCaptureWrite((prefix)[0] == '<' ? AT_CAP_RX : AT_CAP_TX, buff, len); \
+    } while(0)
 
 #define AT_ERROR_GENERIC -1
 #define AT_ERROR_COMMAND_PENDING -2
@@ -87,6 +88,30 @@ void at_set_on_timeout(void (*onTimeout)(void));
    channel is already closed */
 void at_set_on_reader_closed(void (*onClose)(void));
 
+/* This callback is invoked on the command thread after each command
+   completes, with monotonic usec times from when the command was
+   written to when the final response (or error) was seen */
+void at_set_on_command_complete(void (*onComplete)(const char *command,
+                                int err, long long startUsec, long long endUsec));
+
+/* number of commands issued and waiting for or holding the channel */
+int at_get_queue_depth(void);
+
+/* Timeout applied to commands sent without one of their own.
+   0, the default, waits forever for the final response.
+   On expiry the on_timeout callback runs as for any other timeout */
+void at_set_command_timeout(long long timeoutMsec);
+
+/* Channel read and write calls, replaceable for fault injection
+   and simulation.  Called with the channel fd like read(2) and
+   write(2); NULL restores the plain system calls */
+typedef struct {
+    ssize_t (*read)(int fd, void *buf, size_t count);
+    ssize_t (*write)(int fd, const void *buf, size_t count);
+} ATChannelIo;
+
+void at_set_channel_io(const ATChannelIo *io);
+
 int at_send_command_singleline (const char *command,
                                 const char *responsePrefix,
                                  ATResponse **pp_outResponse);
@@ -107,6 +132,22 @@ int at_send_command_sms (const char *command, const char *pdu,
                             const char *responsePrefix,
                             ATResponse **pp_outResponse);
 
+/* A command with a fixed format and typed argument slots, formatted
+   into the channel command buffer once the channel is held, so no
+   command string is allocated.  Slots are %d and %x (int), %c (int
+   as a character) and %s (const char *); %% is a literal % */
+typedef struct {
+    const char *format;         /* eg "AT+CMGD=%d" */
+    ATCommandType type;
+    const char *responsePrefix; /* NULL for NO_RESULT and NUMERIC */
+} ATCommandTemplate;
+
+int at_send_template (const ATCommandTemplate *tmpl,
+                            ATResponse **pp_outResponse, ...);
+
+int at_send_template_sms (const ATCommandTemplate *tmpl, const char *pdu,
+                            ATResponse **pp_outResponse, ...);
+
 void at_response_free(ATResponse *p_response);
 
 typedef enum {
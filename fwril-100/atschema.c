@@ -0,0 +1,135 @@
+/**
+ * \file atschema.c
+ * \brief declarative AT response schemas
+ *
+ * One parser for every schema: the line is split once by
+ * at_tok_fields, then each field in the table is converted and
+ * stored at its struct offset.  Nothing is allocated.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "AT"
+#include <utils/Log.h>
+
+#include <atchannel.h>
+#include <at_tok.h>
+#include <atschema.h>
+
+/**
+ * \brief fill a struct from a response line
+ *
+ * \param schema - response schema
+ * \param line - response line including the prefix
+ * \param out - struct the schema fields point into
+ *
+ * \return
+ * 0 OK
+ * AT_SCHEMA_ERROR_PARSE prefix or a required field does not match
+ */
+int at_schema_parse(const ATSchema *schema, const char *line, void *out)
+{
+    ATTokFields f;
+    const ATSchemaField *field;
+    char *member;
+    int val;
+    int err;
+    int i;
+
+    if (NULL == line) return AT_SCHEMA_ERROR_PARSE;
+
+    if (schema->prefix[0] != '\0'
+        && strncmp(line, schema->prefix, strlen(schema->prefix)))
+        goto error;
+
+    if (at_tok_fields(&f, line) < 0) goto error;
+
+    for (i = 0; i < schema->nFields; i++) {
+        field = &schema->fields[i];
+        member = (char *)out + field->offset;
+
+        switch (field->type) {
+            case AT_SCHEMA_STR:
+                err = at_tok_field_str(&f, field->index, member, field->size);
+                break;
+
+            case AT_SCHEMA_HEX:
+                err = at_tok_field_hex(&f, field->index, &val);
+                break;
+
+            case AT_SCHEMA_BOOL:
+                err = at_tok_field_int(&f, field->index, &val);
+                if (err == 0 && val != 0 && val != 1) err = -1;
+                break;
+
+            default:
+                err = at_tok_field_int(&f, field->index, &val);
+                break;
+        }
+
+        if (err < 0) {
+            if (field->optional) continue;
+            LOGD("%s %s field %d bad: %s", __FUNCTION__, schema->name,
+                field->index, line);
+            return AT_SCHEMA_ERROR_PARSE;
+        }
+
+        if (field->type != AT_SCHEMA_STR) {
+            if (field->size != sizeof(int)) {
+                LOGE("%s %s field %d member is not an int", __FUNCTION__,
+                    schema->name, field->index);
+                return AT_SCHEMA_ERROR_PARSE;
+            }
+            memcpy(member, &val, sizeof(int));
+        }
+    }
+
+    return 0;
+
+error:
+    LOGD("%s %s no prefix: %s", __FUNCTION__, schema->name, line);
+    return AT_SCHEMA_ERROR_PARSE;
+}
+
+/**
+ * \brief send the schema command and fill a struct from the response
+ * must be called on a command thread, like at_send_command
+ *
+ * \param schema - response schema
+ * \param out - struct the schema fields point into
+ *
+ * \return
+ * 0 OK
+ * AT_ERROR_* command not completed
+ * AT_SCHEMA_ERROR_FAILED modem answered with an error
+ * AT_SCHEMA_ERROR_PARSE response does not match
+ */
+int at_schema_query(const ATSchema *schema, void *out)
+{
+    ATResponse *p_response = NULL;
+    int err;
+
+    err = at_send_command_singleline(schema->command, schema->prefix,
+        &p_response);
+    if (err < 0) goto done;
+
+    if (p_response->success == 0) {
+        err = AT_SCHEMA_ERROR_FAILED;
+        goto done;
+    }
+
+    err = at_schema_parse(schema, p_response->p_intermediates->line, out);
+
+done:
+    at_response_free(p_response);
+    return err;
+}
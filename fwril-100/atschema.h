@@ -0,0 +1,77 @@
+/**
+ *
+ * \file atschema.h
+ * \brief declarative AT response schemas include file
+ *
+ * A single line response is declared once as a command, a prefix and
+ * typed fields, each mapped by position onto a member of a C struct:
+ *
+ *   typedef struct { int roam; int protocol; } sysinfo_t;
+ *
+ *   AT_SCHEMA(s_sysinfo, "AT^SYSINFO", "^SYSINFO:",
+ *       AT_FIELD_INT(sysinfo_t, roam, 2),
+ *       AT_FIELD_INT(sysinfo_t, protocol, 3));
+ *
+ *   err = at_schema_query(&s_sysinfo, &sysinfo);
+ *
+ * The macros build a constant field table.  at_schema_parse splits
+ * the line once with at_tok_fields and fills every member by index.
+ * at_schema_query sends the command and frees the response before it
+ * returns, so the caller never holds an ATResponse.  String fields
+ * are copied into char arrays in the struct.  Members not named by a
+ * field, and optional fields that are missing, keep their value.
+ */
+
+#ifndef _atschema_h_included
+#define _atschema_h_included
+
+#include <stddef.h>
+
+// at_schema_query / at_schema_parse errors, AT_ERROR_* otherwise
+#define AT_SCHEMA_ERROR_FAILED	-20 // final response was not OK
+#define AT_SCHEMA_ERROR_PARSE	-21 // line does not match the schema
+
+typedef enum {
+	AT_SCHEMA_INT,		// int, base 10
+	AT_SCHEMA_HEX,		// int, base 16
+	AT_SCHEMA_BOOL,		// int, 0 or 1
+	AT_SCHEMA_STR		// char array, quotes removed
+} ATSchemaType;
+
+typedef struct {
+	unsigned char type;	// ATSchemaType
+	unsigned char index;	// field position after the prefix
+	unsigned char optional;	// missing or bad field is not an error
+	unsigned short offset;	// struct member offset
+	unsigned short size;	// struct member size
+} ATSchemaField;
+
+typedef struct {
+	const char *name;
+	const char *command;
+	const char *prefix;
+	const ATSchemaField *fields;
+	int nFields;
+} ATSchema;
+
+#define AT_MEMBER_SIZE(type, member)	sizeof(((type *)0)->member)
+
+#define AT_FIELD(kind, opt, type, member, idx) \
+	{ kind, idx, opt, offsetof(type, member), AT_MEMBER_SIZE(type, member) }
+
+#define AT_FIELD_INT(type, member, idx)		AT_FIELD(AT_SCHEMA_INT, 0, type, member, idx)
+#define AT_FIELD_HEX(type, member, idx)		AT_FIELD(AT_SCHEMA_HEX, 0, type, member, idx)
+#define AT_FIELD_BOOL(type, member, idx)	AT_FIELD(AT_SCHEMA_BOOL, 0, type, member, idx)
+#define AT_FIELD_STR(type, member, idx)		AT_FIELD(AT_SCHEMA_STR, 0, type, member, idx)
+#define AT_FIELD_INT_OPT(type, member, idx)	AT_FIELD(AT_SCHEMA_INT, 1, type, member, idx)
+#define AT_FIELD_STR_OPT(type, member, idx)	AT_FIELD(AT_SCHEMA_STR, 1, type, member, idx)
+
+#define AT_SCHEMA(name, command, prefix, ...) \
+	static const ATSchemaField name##Fields[] = { __VA_ARGS__ }; \
+	const ATSchema name = { #name, command, prefix, name##Fields, \
+		sizeof(name##Fields) / sizeof(name##Fields[0]) }
+
+int at_schema_parse(const ATSchema *schema, const char *line, void *out);
+int at_schema_query(const ATSchema *schema, void *out);
+
+#endif // _atschema_h_included
@@ -16,8 +16,12 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <net/if.h>
+#include <net/route.h>
+#include <netinet/in.h>
 #include <pthread.h>
 #include <signal.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -41,76 +45,132 @@
 // build options
 #define BUILD_DEBUG_1	0
 
-/* For interface polling */
-extern int ifc_init(void);
-extern int ifc_get_info(const char *name, unsigned int *addr, unsigned int *mask, unsigned int *flags);
-extern int ifc_get_default_route(const char *ifname);
+// data call context, one per data port, see fw100DataInit.  context
+// 0 is cid 1, ppp0, the AT port's modem.  the keeper, pre-warm and
+// link monitor follow it, and ctx->inDataCall and the ctx addresses
+// mirror it
+typedef struct {
+    int index;                      // context, ppp unit and link
+    int cid;
+    const char *path;               // data port, NULL not configured
+    const char *devname;
+    char ifname[IFNAMSIZ];
+    int state;                      // DATA_STATE_*
+    char localIP[64];
+    char gateway[64];
+
+    // SETUP_DATA_CALL in progress, completed by the link listener or
+    // the timeout task.  the generation tells a stale timeout from a
+    // later setup.  held with s_setupMutex
+    RIL_Token setupToken;
+    int setupGeneration;
+    long long setupStartUsec;
+
+    // link came up since pppd was started, a pppd exit is a drop
+    int linkSeen;
+
+    // DEACTIVATE_DATA_CALL teardown, held with s_teardownMutex
+    int teardownState;
+    int teardownGeneration;
+    long long teardownStartUsec;
+} dataCall_t;
+
+static dataCall_t s_calls[DATA_MAX_CONTEXTS];
+
+// scheduler one-shot param, context and generation
+#define DATA_PARAM(dc, generation) \
+    ((void *)((unsigned long)(generation) * DATA_MAX_CONTEXTS + (dc)->index))
+#define DATA_PARAM_CALL(param)       (&s_calls[(unsigned long)(param) % DATA_MAX_CONTEXTS])
+#define DATA_PARAM_GENERATION(param) ((int)((unsigned long)(param) / DATA_MAX_CONTEXTS))
+
+static pthread_mutex_t s_setupMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// link started ahead of SETUP_DATA_CALL, see fw100DataPrewarm.  held
+// with s_setupMutex, a setup claims it
+#define PREWARM_NONE        0
+#define PREWARM_WARMING     1   // pppd started, link not up yet
+#define PREWARM_UP          2   // link up, not reported to the framework
+
+static int s_prewarmState;
+static int s_prewarmGeneration;
+static long long s_prewarmStartUsec;
+static long long s_prewarmUpUsec;
+static long long s_setupPrewarmUsec;    // pre-warm start of the pending setup, 0 cold
+static long long s_setupPrewarmUpUsec;
+static int s_prewarmDetached;           // pppd without default route and system dns
+static fw100PrewarmStats_t s_prewarmStats;
+
+// DEACTIVATE_DATA_CALL teardown, driven by NO CARRIER, pppd exit,
+// ppp<n> down and a deadline for each step
+#define TEARDOWN_IDLE       0
+#define TEARDOWN_HANGUP     1   // ATH sent, waiting for NO CARRIER or pppd exit
+#define TEARDOWN_TERM       2   // SIGTERM sent, waiting for pppd exit
+#define TEARDOWN_KILL       3   // SIGKILL sent, waiting for pppd exit
+#define TEARDOWN_LINKDOWN   4   // pppd gone, waiting for ppp0 down
+
+#define TEARDOWN_EV_NOCARRIER   0
+#define TEARDOWN_EV_PPPEXIT     1
+#define TEARDOWN_EV_LINKDOWN    2
+#define TEARDOWN_EV_DEADLINE    3
+
+static pthread_mutex_t s_teardownMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void teardownEvent(dataCall_t *dc, int event, int generation);
 
 /**
- * \brief check the ppp link status
+ * \brief pppd runs a context, by its arguments or its tty
+ * pppd unit <n> as fw100PppStart runs it, call <devname> as rild ran
+ * it before, or the dialed data port on its standard input
  *
- * \param: ifname - name if interface "ppp0"
- * \param: max_retry - retry limit, 1 second retry cycle
- * \param: addr - returned ip address binary
- * \param: mask - returned netmask binary
- * \param: flags - returned flags binary
+ * \param pid - /proc entry
  *
- * \return: 
- * 0 : link up
- * -1: link not up
+ * \return 1 the context's, 0 not
  */
-static int poll_ppp_linkstate(const char *ifname, int max_retry,
-    unsigned int *addr, unsigned int *mask, unsigned int *gway, unsigned int *flags)
+static int pppdOwnsContext(const char *pid, const dataCall_t *dc)
 {
-    int i;
-    int ret;
-    int tmp;
+    char filename[64];
+    char cmdline[512];
+    char unit[8];
+    char *arg;
+    char *prev = "";
+    int fd;
+    int n;
 
-    if (ifc_init())
+    snprintf(filename, sizeof(filename), "/proc/%s/fd/0", pid);
+    n = readlink(filename, cmdline, sizeof(cmdline) - 1);
+    if (n > 0)
     {
-        LOGE("%s: ifc_init error\n", __FUNCTION__);
-        return -1;
+        cmdline[n] = '\0';
+        if (!strcmp(cmdline, dc->path)) return 1;
     }
 
-    for(i = 0; i < max_retry; i++)
-    {
-        *flags = 0;
-        if (ifc_get_info(ifname, addr, mask, flags))
-        {
-            LOGW("%s: ifc_get_info retry count=%d\n", __FUNCTION__, i);
-            continue;
-        }
-        if(*flags & 0x1)
-        {
-            ret = 0;  // OK
-            break;
-        }
-        sleep(1);
-    }
+    snprintf(filename, sizeof(filename), "/proc/%s/cmdline", pid);
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    n = read(fd, cmdline, sizeof(cmdline) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    cmdline[n] = '\0';
 
-    if (i >= max_retry) 
+    // NUL separated
+    snprintf(unit, sizeof(unit), "%d", dc->index);
+    for (arg = cmdline; arg < cmdline + n; arg += strlen(arg) + 1)
     {
-        ret = -1;  // not up
-	return ret;
-    } 
-
-    // now get default gateway.  returns zero on undefined
-    tmp = ifc_get_default_route(ifname);
-    *gway = tmp;
-
-    return ret;
+        if (!strcmp(prev, "unit")) return !strcmp(arg, unit);
+        if (!strcmp(arg, dc->devname)) return 1;
+        prev = arg;
+    }
+    return 0;
 }
 
 /**
- * \brief search process list by name and return PID if found
- *
- * \param: void
+ * \brief search the process list for the pppd of a context
  *
  * \return: 
- * -1: process name not found
+ * -1: not found
  * >0 : PID
  */
-static int findPidByName(char* pidName)
+static int findPppd(const dataCall_t *dc)
 {
     int pid = -1;
     DIR *dir;
@@ -122,7 +182,6 @@ static int findPidByName(char* pidName)
         LOGE("%s cannot open /proc\n", __FUNCTION__);
         return -1;
     }
-    LOGD("findPidByName: finding %s", pidName);
 
     while ((next = readdir(dir)) != NULL) {
         FILE *status;
@@ -150,9 +209,9 @@ static int findPidByName(char* pidName)
 
         /* Buffer should contain a string like "Name:   binary_name" */
         sscanf(buffer, "%*s %s", name);
-        if (strcmp(name, pidName) == 0) {
+        if (strcmp(name, "pppd") == 0 && pppdOwnsContext(next->d_name, dc)) {
             pid = strtol(next->d_name, NULL, 0);
-            LOGD("findPidByName: pppd pid is %d", pid);
+            LOGD("%s %s pppd pid is %d", __FUNCTION__, dc->ifname, pid);
             break;
         }
     }
@@ -162,16 +221,136 @@ static int findPidByName(char* pidName)
 }
 
 /** 
- * \brief find pppd PID and kill it
+ * \brief pppd of a context this rild did not start
+ * e.g. one left running by a previous rild, whose exit is not seen.
+ * only with a single context, the others are always our own.  walks
+ * /proc, so never with a data mutex held
  *
+ * \return pid, -1 none
  */
-static void killPppd()
+static int findOrphanPppd(const dataCall_t *dc)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+
+    if (dc->index || ctx->s_data_count > 1) return -1;
+    return findPppd(dc);
+}
+
+/**
+ * \brief signal an orphaned cid 1 pppd, does not wait
+ */
+static void signalOrphanPppd(dataCall_t *dc, int sig)
 {
     pid_t pid;
-    pid = findPidByName("pppd");
+
+    pid = findOrphanPppd(dc);
     if (pid > 0) {
-        kill(pid, SIGTERM);
+        kill(pid, sig);
+    }
+}
+
+/**
+ * \brief next generation, never 0 and small enough for DATA_PARAM
+ */
+static int dataNextGeneration(int generation)
+{
+    generation = (generation + 1) & 0xffffff;
+    return generation ? generation : 1;
+}
+
+/**
+ * \brief set a context's state, cid 1 is mirrored in the session context
+ */
+static void dataCallSetState(dataCall_t *dc, int state)
+{
+    dc->state = state;
+    if (0 == dc->index) fw100GetSessionCtx()->inDataCall = state;
+}
+
+/**
+ * \brief record the link address of a context
+ *
+ * \param link - link state, NULL clears the local address
+ */
+static void dataCallSetAddress(dataCall_t *dc, const fw100LinkState_t *link)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+
+    if (NULL == link)
+    {
+        memset(dc->localIP, 0, sizeof(dc->localIP));
+    }
+    else
+    {
+        inet_ntop(AF_INET, &link->addr, dc->localIP, sizeof(dc->localIP));
+        // ppp default route is a device route, the peer is the gateway
+        inet_ntop(AF_INET, link->gway ? &link->gway : &link->peer,
+            dc->gateway, sizeof(dc->gateway));
     }
+
+    if (dc->index) return;
+    snprintf(ctx->dataCallLocalIP, sizeof(ctx->dataCallLocalIP), "%s", dc->localIP);
+    snprintf(ctx->dataCallGateway, sizeof(ctx->dataCallGateway), "%s", dc->gateway);
+}
+
+/**
+ * \brief context by cid
+ * \return context, NULL none configured
+ */
+static dataCall_t *dataCallByCid(int cid)
+{
+    if (cid < 1 || cid > DATA_MAX_CONTEXTS) return NULL;
+    if (NULL == s_calls[cid - 1].path) return NULL;
+    return &s_calls[cid - 1];
+}
+
+/**
+ * \brief start pppd for a context
+ * the first data port may be dialed by chat, the others are always
+ * dialed by the driver, see etc/ppp/peers/fw100-dialer
+ *
+ * \param options - PPP_OPT_*
+ *
+ * \return 0 started, dialing or already running, -1 error
+ */
+static int dataPppStart(dataCall_t *dc, int options)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    int dial = ctx->dataDialer || dc->index;
+
+    return fw100PppStart(dc->index, dc->devname, dial ? dc->path : NULL, options);
+}
+
+/**
+ * \brief RIL_Data_Call_Response for each context
+ *
+ * \param list - returned responses, DATA_MAX_CONTEXTS
+ *
+ * \return number of contexts
+ */
+static int dataCallList(RIL_Data_Call_Response *list)
+{
+    dataCall_t *dc;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < DATA_MAX_CONTEXTS; i++)
+    {
+        dc = &s_calls[i];
+        if (NULL == dc->path) continue;
+
+        memset(&list[n], 0, sizeof(list[n]));
+        list[n].cid = dc->cid;
+        if (DATA_STATE_CONNECTED == dc->state)
+        {
+            list[n].active  = 2;
+            list[n].type    = "PPP";
+            list[n].apn     = "internet";
+            list[n].address = dc->localIP;
+        }
+        n++;
+    }
+    return n;
 }
 
 /**
@@ -203,30 +382,872 @@ static void killPppd()
  */
 void requestDataCallList(void *data, size_t datalen, RIL_Token t)
 {
-    RIL_Data_Call_Response response;
+    RIL_Data_Call_Response list[DATA_MAX_CONTEXTS];
+    int n;
+
+    // every context, active or not
+    n = dataCallList(list);
+
+    RIL_onRequestComplete(t, RIL_E_SUCCESS, (void *) list, n * sizeof(list[0]));
+    return;
+
+error:
+    RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+}
+
+/**
+ * \brief teardown step deadline, scheduler thread
+ * param is the context and step generation, a later step is left alone
+ */
+static void teardownDeadline(void *param)
+{
+    teardownEvent(DATA_PARAM_CALL(param), TEARDOWN_EV_DEADLINE, DATA_PARAM_GENERATION(param));
+}
+
+/**
+ * \brief enter a teardown step, assumes s_teardownMutex is held
+ */
+static void teardownEnter(dataCall_t *dc, int state, int deadlineMsec)
+{
+    dc->teardownState = state;
+    dc->teardownGeneration = dataNextGeneration(dc->teardownGeneration);
+    fw100SchedOnce("teardown", teardownDeadline, DATA_PARAM(dc, dc->teardownGeneration),
+        deadlineMsec, 0);
+}
+
+/**
+ * \brief pppd is gone, wait for ppp<n> down, assumes s_teardownMutex is held
+ * \return 1 link already down, 0 waiting
+ */
+static int teardownLinkDown(dataCall_t *dc)
+{
+    if (!fw100LinkGet(dc->index, NULL)) return 1;
+
+    teardownEnter(dc, TEARDOWN_LINKDOWN, PPP_LINK_DOWN_MSEC);
+    return 0;
+}
+
+/**
+ * \brief report a finished teardown, scheduler thread
+ */
+static void teardownReport(void *param)
+{
     fw100SessionCtx_t *ctx = fw100GetSessionCtx();
 
-    memset((void *) &response, 0, sizeof(response));
-    if (ctx->inDataCall)
+    rilWriteStatus(ctx, RIL_STATUS_FILEPATH);
+
+    RIL_onUnsolicitedResponse ( RIL_UNSOL_RESPONSE_NETWORK_STATE_CHANGED, 
+      NULL, 0);
+}
+
+/**
+ * \brief teardown finished
+ * the status file and network state are reported from the scheduler
+ * thread, whichever thread saw the last event
+ */
+static void teardownDone(dataCall_t *dc)
+{
+    fw100TraceSpan("data", "teardown", dc->teardownStartUsec, fw100NowUsec(), dc->ifname);
+    LOGD("%s cid %d data call down in %lld msec", __FUNCTION__, dc->cid,
+        (fw100NowUsec() - dc->teardownStartUsec) / 1000);
+
+    dataCallSetAddress(dc, NULL);
+    fw100SchedOnce("teardownreport", teardownReport, NULL, 0, 0);
+}
+
+/**
+ * \brief advance the teardown state machine
+ * runs on whichever thread saw the event: AT reader, pppd reaper,
+ * netlink listener or scheduler
+ *
+ * \param dc - context
+ * \param event - TEARDOWN_EV_*
+ * \param generation - step generation for TEARDOWN_EV_DEADLINE
+ */
+static void teardownEvent(dataCall_t *dc, int event, int generation)
+{
+    int done = 0;
+    int sig = 0;            // supervised pppd, signalled after unlock
+    int orphan = 0;         // pppd this rild did not start
+
+    pthread_mutex_lock(&s_teardownMutex);
+
+    if (TEARDOWN_EV_DEADLINE == event && generation != dc->teardownGeneration)
+        goto unlock;
+
+    switch (dc->teardownState)
     {
-        response.cid    = 1;
-        response.active = 2;
-        response.type   = "PPP";
-        response.apn    = "internet";
-        response.address = ctx->dataCallLocalIP;
+        case TEARDOWN_HANGUP:
+            if (TEARDOWN_EV_LINKDOWN == event) break;
+            if (TEARDOWN_EV_PPPEXIT == event)
+            {
+                done = teardownLinkDown(dc);
+                break;
+            }
+            // carrier dropped, or no hangup seen in time.  an exit
+            // after this snapshot is seen as TEARDOWN_EV_PPPEXIT
+            if (fw100PppRunning(dc->index))
+            {
+                sig = SIGTERM;
+                teardownEnter(dc, TEARDOWN_TERM, PPP_STOP_TERM_MSEC);
+            }
+            else
+            {
+                orphan = 1;
+                done = teardownLinkDown(dc);
+            }
+            break;
+
+        case TEARDOWN_TERM:
+        case TEARDOWN_KILL:
+            if (TEARDOWN_EV_PPPEXIT == event)
+            {
+                done = teardownLinkDown(dc);
+                break;
+            }
+            if (TEARDOWN_EV_DEADLINE != event) break;
+            if (TEARDOWN_TERM == dc->teardownState && fw100PppRunning(dc->index))
+            {
+                LOGW("%s pppd no exit after %d msec, SIGKILL", __FUNCTION__,
+                    PPP_STOP_TERM_MSEC);
+                sig = SIGKILL;
+                teardownEnter(dc, TEARDOWN_KILL, PPP_STOP_KILL_MSEC);
+                break;
+            }
+            if (TEARDOWN_KILL == dc->teardownState)
+                LOGE("%s pppd not reaped", __FUNCTION__);
+            done = teardownLinkDown(dc);
+            break;
+
+        case TEARDOWN_LINKDOWN:
+            if (TEARDOWN_EV_LINKDOWN == event)
+            {
+                done = 1;
+            }
+            else if (TEARDOWN_EV_DEADLINE == event)
+            {
+                LOGW("%s %s still up %d msec after pppd exit", __FUNCTION__,
+                    dc->ifname, PPP_LINK_DOWN_MSEC);
+                done = 1;
+            }
+            break;
+
+        default:
+            break;
     }
+
+    if (done)
+    {
+        // stale deadlines see a new generation
+        dc->teardownState = TEARDOWN_IDLE;
+        dc->teardownGeneration = dataNextGeneration(dc->teardownGeneration);
+    }
+
+unlock:
+    pthread_mutex_unlock(&s_teardownMutex);
+
+    if (sig) fw100PppSignal(dc->index, sig);
+    if (orphan) signalOrphanPppd(dc, SIGTERM);
+    if (done) teardownDone(dc);
+}
+
+/**
+ * \brief start a teardown, waiting for the hangup
+ * \return 1 teardown already in progress, 0 started
+ */
+static int teardownBegin(dataCall_t *dc)
+{
+    int busy;
+
+    pthread_mutex_lock(&s_teardownMutex);
+    busy = (TEARDOWN_IDLE != dc->teardownState);
+    if (!busy)
+    {
+        dc->teardownStartUsec = fw100NowUsec();
+        teardownEnter(dc, TEARDOWN_HANGUP, PPP_HANGUP_MSEC);
+    }
+    pthread_mutex_unlock(&s_teardownMutex);
+
+    return busy;
+}
+
+/**
+ * \brief hang up the modem for a teardown begun with teardownBegin
+ * not on the AT reader thread
+ */
+static void teardownHangup(dataCall_t *dc)
+{
+    ATResponse *p_response = NULL;
+
+    // no AT channel to the modem of another data port.  pppd drops
+    // DTR when it stops, which hangs up
+    if (dc->index)
+    {
+        teardownEvent(dc, TEARDOWN_EV_NOCARRIER, 0);
+        return;
+    }
+
+    at_send_command("ATH", &p_response);
+    if (p_response != NULL && p_response->finalResponse != NULL
+        && !strcmp(p_response->finalResponse, "NO CARRIER"))
+        fw100DataNoCarrier();
+    at_response_free(p_response);
+
+    if (!fw100PppRunning(dc->index))
+    {
+        // nothing to wait for
+        if (findOrphanPppd(dc) < 0) teardownEvent(dc, TEARDOWN_EV_PPPEXIT, 0);
+    }
+    else if (!fw100PppPid(dc->index))
+    {
+        // still dialing the data port, which ATH does not reach.  the
+        // cancelled dial is reported as the pppd exit
+        fw100PppSignal(dc->index, SIGTERM);
+    }
+}
+
+/**
+ * \brief teardown in progress
+ */
+static int teardownActive(dataCall_t *dc)
+{
+    int active;
+
+    pthread_mutex_lock(&s_teardownMutex);
+    active = (TEARDOWN_IDLE != dc->teardownState);
+    pthread_mutex_unlock(&s_teardownMutex);
+
+    return active;
+}
+
+/**
+ * \brief NO CARRIER from the modem, AT reader thread
+ * the AT port's modem carries cid 1
+ */
+void fw100DataNoCarrier(void)
+{
+    teardownEvent(&s_calls[0], TEARDOWN_EV_NOCARRIER, 0);
+}
+
+/**
+ * \brief restart the cid 1 data call, its link passes no traffic
+ * hangs up as DEACTIVATE_DATA_CALL does, but the call is reported
+ * lost when ppp0 goes down, so the framework or the keeper dials
+ * again.  not on the AT reader thread
+ */
+void fw100DataRestart(void)
+{
+    dataCall_t *dc = &s_calls[0];
+
+    if (teardownBegin(dc)) return;
+
+    LOGW("%s restarting data call", __FUNCTION__);
+    fw100FailRecord(FAIL_STAGE_DROP, -1);
+    teardownHangup(dc);
+}
+
+/**
+ * \brief a data call is being brought up
+ * a SETUP_DATA_CALL is pending, or pppd is dialing or negotiating
+ * before its link came up, as for a keeper redial or a pre-warm
+ * \return 1 pending, 0 none
+ */
+int fw100DataDialPending(void)
+{
+    int pending = 0;
+    int i;
+
+    pthread_mutex_lock(&s_setupMutex);
+    for (i = 0; i < DATA_MAX_CONTEXTS; i++)
+    {
+        if (NULL != s_calls[i].setupToken) pending = 1;
+    }
+    pthread_mutex_unlock(&s_setupMutex);
+
+    for (i = 0; !pending && i < DATA_MAX_CONTEXTS; i++)
+    {
+        if (NULL == s_calls[i].path || s_calls[i].linkSeen) continue;
+        if (!teardownActive(&s_calls[i]) && fw100PppRunning(i))
+            pending = 1;
+    }
+    return pending;
+}
+
+/**
+ * \brief take the pending SETUP_DATA_CALL token of a context
+ *
+ * \param generation - only this setup, 0 whichever is pending
+ *
+ * \return token, NULL none pending
+ */
+static RIL_Token setupClaim(dataCall_t *dc, int generation)
+{
+    RIL_Token t;
+
+    pthread_mutex_lock(&s_setupMutex);
+    t = dc->setupToken;
+    if (generation && generation != dc->setupGeneration) t = NULL;
+    if (NULL != t) dc->setupToken = NULL;
+    pthread_mutex_unlock(&s_setupMutex);
+
+    return t;
+}
+
+/**
+ * \brief give a claimed pre-warmed link the default route and dns
+ * pppd was started with nodefaultroute, and ip-up-ppp leaves net.dns*
+ * alone while PREWARM_PROPERTY is 1.  ip-up-ppp sets the per
+ * interface dns before it reads the property, so one of the two sets
+ * the system dns whichever runs last
+ */
+static void prewarmAttach(dataCall_t *dc)
+{
+    char dns[PROPERTY_VALUE_MAX];
+    struct rtentry rt;
+    int attach;
+    int fd;
+
+    if (dc->index) return;
+
+    pthread_mutex_lock(&s_setupMutex);
+    attach = s_prewarmDetached;
+    s_prewarmDetached = 0;
+    pthread_mutex_unlock(&s_setupMutex);
+
+    if (!attach) return;
+
+    property_set(PREWARM_PROPERTY, "0");
+    property_get("net." PPP_IFNAME ".dns1", dns, "");
+    if (dns[0]) property_set("net.dns1", dns);
+    property_get("net." PPP_IFNAME ".dns2", dns, "");
+    if (dns[0]) property_set("net.dns2", dns);
+
+    // as pppd defaultroute, any destination through the interface
+    memset(&rt, 0, sizeof(rt));
+    ((struct sockaddr_in *)&rt.rt_dst)->sin_family = AF_INET;
+    ((struct sockaddr_in *)&rt.rt_genmask)->sin_family = AF_INET;
+    rt.rt_flags = RTF_UP;
+    rt.rt_dev = dc->ifname;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || (ioctl(fd, SIOCADDRT, &rt) < 0 && EEXIST != errno))
+        LOGW("%s default route %s %s", __FUNCTION__, dc->ifname, strerror(errno));
     else
+        LOGD("%s %s default route and dns", __FUNCTION__, dc->ifname);
+    if (fd >= 0) close(fd);
+}
+
+/**
+ * \brief record SETUP_DATA_CALL time to response, and the bring up
+ * time a pre-warmed link saved
+ * a claimed pre-warm is a hit once its link is up.  the saving is the
+ * pre-warm head start: up to the link coming up, or up to the request
+ * when the link was still coming up.  only cid 1 is pre-warmed
+ */
+static void setupRecordPrewarm(dataCall_t *dc)
+{
+    long long now = fw100NowUsec();
+    long long saved;
+
+    if (dc->index) return;
+
+    pthread_mutex_lock(&s_setupMutex);
+    if (s_setupPrewarmUsec)
     {
-        response.cid    = 1;
-        response.active = 0;
+        saved = dc->setupStartUsec;
+        if (s_setupPrewarmUpUsec && s_setupPrewarmUpUsec < saved)
+            saved = s_setupPrewarmUpUsec;
+        saved -= s_setupPrewarmUsec;
+        s_prewarmStats.hits++;
+        s_prewarmStats.lastSavedUsec = saved;
+        s_prewarmStats.savedTotalUsec += saved;
+        s_prewarmStats.hitSetupTotalUsec += now - dc->setupStartUsec;
+        s_setupPrewarmUsec = 0;
     }
+    else
+    {
+        s_prewarmStats.coldSetups++;
+        s_prewarmStats.coldSetupTotalUsec += now - dc->setupStartUsec;
+    }
+    pthread_mutex_unlock(&s_setupMutex);
+}
+
+/**
+ * \brief complete SETUP_DATA_CALL, the link is up with an address
+ */
+static void setupComplete(dataCall_t *dc, RIL_Token t, const fw100LinkState_t *link)
+{
+    char tmp[128];
+    char cid[8];
+    char key[PROPERTY_KEY_MAX];
+    char dns[PROPERTY_VALUE_MAX];
+    char *response[5];
 
-    RIL_onRequestComplete(t, RIL_E_SUCCESS, (void *) &response, sizeof(response));
+    fw100TraceSpan("data", "link up", dc->setupStartUsec, fw100NowUsec(), dc->ifname);
+    setupRecordPrewarm(dc);
+    prewarmAttach(dc);
 
-error:
+    dataCallSetState(dc, DATA_STATE_CONNECTED);
+    dataCallSetAddress(dc, link);
+
+    snprintf(cid, sizeof(cid), "%d", dc->cid);
+    memset(response, 0, sizeof(response));
+    response[0] = cid;
+    response[1] = dc->ifname;
+    response[2] = dc->localIP;
+
+    // per interface, set by /etc/ppp/ip-up-ppp
+    tmp[0]= 0;
+    snprintf(key, sizeof(key), "net.%s.dns1", dc->ifname);
+    property_get(key, dns, "0");
+    strncpy(tmp, dns, sizeof(tmp));
+    snprintf(key, sizeof(key), "net.%s.dns2", dc->ifname);
+    property_get(key, dns, "0");
+    strncat(tmp, " ", sizeof(tmp));
+    strncat(tmp, dns, sizeof(tmp));
+    response[3] = tmp;
+
+    // this property doesn't work when set in /etc/ppp/ip-up-ppp
+    // permission error
+    // property_get("net.remote-ip", gw, "0");
+
+    response[4] = dc->gateway;
+
+    LOGD("%s success cid=%s name=%s ip=%s dns=%s gw=%s", 
+        __FUNCTION__, 
+        response[0], 
+        response[1], 
+        response[2], 
+        response[3], 
+        response[4]);
+
+    RIL_onRequestComplete(t, RIL_E_SUCCESS, response, sizeof(response));
+}
+
+/**
+ * \brief SETUP_DATA_CALL deadline, scheduler thread
+ * param is the context and setup generation, a later setup is left alone
+ */
+static void setupTimeout(void *param)
+{
+    dataCall_t *dc = DATA_PARAM_CALL(param);
+    RIL_Token t = setupClaim(dc, DATA_PARAM_GENERATION(param));
+
+    if (NULL == t) return;
+
+    LOGW("%s %s not up after %d msec", __FUNCTION__, dc->ifname, PPP_LINK_UP_MSEC);
+    fw100FailRecord(FAIL_STAGE_SETUP, -1);
+    fw100TraceSpan("data", "link timeout", dc->setupStartUsec, fw100NowUsec(), dc->ifname);
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
 }
 
+/**
+ * \brief context for a SETUP_DATA_CALL, assumes s_setupMutex is held
+ * the first idle context, cid 1 first.  a single context that is not
+ * idle is answered again when up, as before there were contexts
+ *
+ * \return context, NULL none idle or setup already in progress
+ */
+static dataCall_t *setupPick(void)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    dataCall_t *dc;
+    int i;
+
+    for (i = 0; i < DATA_MAX_CONTEXTS; i++)
+    {
+        dc = &s_calls[i];
+        if (NULL == dc->path || NULL != dc->setupToken) continue;
+        if (DATA_STATE_CONNECTED == dc->state || teardownActive(dc)) continue;
+        return dc;
+    }
+
+    // another setup would answer with a cid already in use
+    if (ctx->s_data_count > 1) return NULL;
+
+    dc = &s_calls[0];
+    return (NULL == dc->setupToken) ? dc : NULL;
+}
+
+/**
+ * \brief pre-warmed link came up, netlink listener thread
+ * \return 1 pre-warming, 0 otherwise
+ */
+static int prewarmLinkUp(void)
+{
+    int warm;
+    int up = 0;
+
+    pthread_mutex_lock(&s_setupMutex);
+    warm = (PREWARM_NONE != s_prewarmState);
+    if (PREWARM_WARMING == s_prewarmState)
+    {
+        s_prewarmState = PREWARM_UP;
+        s_prewarmUpUsec = fw100NowUsec();
+        up = 1;
+    }
+    pthread_mutex_unlock(&s_setupMutex);
+
+    if (up)
+    {
+        fw100TraceSpan("data", "prewarm", s_prewarmStartUsec, fw100NowUsec(), PPP_IFNAME);
+        LOGD("%s %s pre-warmed in %lld msec", __FUNCTION__, PPP_IFNAME,
+            (s_prewarmUpUsec - s_prewarmStartUsec) / 1000);
+    }
+    return warm;
+}
+
+/**
+ * \brief cid 1 pppd exited, or a pre-warm did not start
+ */
+static void prewarmLost(void)
+{
+    int detached;
+
+    pthread_mutex_lock(&s_setupMutex);
+    if (PREWARM_NONE != s_prewarmState)
+    {
+        LOGD("%s pre-warmed link lost", __FUNCTION__);
+        s_prewarmState = PREWARM_NONE;
+    }
+    detached = s_prewarmDetached;
+    s_prewarmDetached = 0;
+    pthread_mutex_unlock(&s_setupMutex);
+
+    // the next pppd sets the system dns again
+    if (detached) property_set(PREWARM_PROPERTY, "0");
+}
+
+/**
+ * \brief take the pre-warmed link for a setup, assumes s_setupMutex
+ * \return 1 claimed, 0 none
+ */
+static int prewarmClaim(void)
+{
+    if (PREWARM_NONE == s_prewarmState)
+    {
+        s_setupPrewarmUsec = 0;
+        return 0;
+    }
+
+    s_setupPrewarmUsec = s_prewarmStartUsec;
+    s_setupPrewarmUpUsec = (PREWARM_UP == s_prewarmState) ? s_prewarmUpUsec : 0;
+    s_prewarmState = PREWARM_NONE;
+    s_prewarmGeneration++;
+    return 1;
+}
+
+/**
+ * \brief drop an unclaimed pre-warmed link
+ * hangs up and waits for ppp0 down as DEACTIVATE_DATA_CALL does, not
+ * on the AT reader thread
+ *
+ * \param generation - only this pre-warm, 0 whichever is up
+ */
+static void prewarmRelease(int generation)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    int release;
+    int keep = 0;
+
+    pthread_mutex_lock(&s_setupMutex);
+    release = (PREWARM_NONE != s_prewarmState)
+        && (!generation || generation == s_prewarmGeneration);
+    if (release)
+    {
+        s_prewarmState = PREWARM_NONE;
+        s_prewarmGeneration++;
+        // the keeper holds the link now
+        if (ctx->dataCallIsAutomatic) keep = 1;
+        else s_prewarmStats.expired++;
+    }
+    pthread_mutex_unlock(&s_setupMutex);
+
+    // reported as any link, when up now or by dataLinkChanged later
+    if (keep && fw100LinkGet(PPP_UNIT_PRIMARY, NULL)) prewarmAttach(&s_calls[0]);
+
+    if (!release || keep) return;
+
+    LOGD("%s dropping unclaimed pre-warmed link", __FUNCTION__);
+
+    // as DEACTIVATE_DATA_CALL, the modem is left online otherwise
+    if (!teardownBegin(&s_calls[0])) teardownHangup(&s_calls[0]);
+}
+
+/**
+ * \brief unclaimed pre-warm deadline, scheduler thread
+ * param is the pre-warm generation, a claimed or later one is left alone
+ */
+static void prewarmIdle(void *param)
+{
+    prewarmRelease((int)(long)param);
+}
+
+/**
+ * \brief start or drop a pre-warmed data link
+ * called on screen state and registration changes.  With DataPrewarm
+ * in the control file, pppd is started once the modem is registered,
+ * and with the screen on unless DataPrewarm=Always, so a following
+ * SETUP_DATA_CALL is answered from the link already up.  The link is
+ * not reported to the framework until a setup claims it, and is
+ * dropped if unclaimed after PREWARM_IDLE_MSEC or the policy no longer
+ * holds.  The always on keeper needs no pre-warm.  Only cid 1, on the
+ * AT port's modem, is pre-warmed.
+ */
+void fw100DataPrewarm(void)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    dataCall_t *dc = &s_calls[0];
+    int want;
+    int generation;
+    int rc;
+
+    want = (PREWARM_OFF != ctx->dataPrewarm)
+        && !ctx->dataCallIsAutomatic
+        && ctx->networkRegistered
+        && (PREWARM_ALWAYS == ctx->dataPrewarm || SCREEN_IS_ON == ctx->screenState);
+
+    if (!want)
+    {
+        prewarmRelease(0);
+        return;
+    }
+
+    // a data call, setup or teardown under way needs no pre-warm
+    if (DATA_STATE_CONNECTED == dc->state || teardownActive(dc)
+        || fw100PppPid(dc->index) > 0 || fw100LinkGet(dc->index, NULL))
+        return;
+
+    pthread_mutex_lock(&s_setupMutex);
+    want = (NULL == dc->setupToken) && (PREWARM_NONE == s_prewarmState);
+    if (want)
+    {
+        s_prewarmState = PREWARM_WARMING;
+        if (0 == ++s_prewarmGeneration) s_prewarmGeneration = 1;
+        generation = s_prewarmGeneration;
+        s_prewarmStartUsec = fw100NowUsec();
+        s_prewarmUpUsec = 0;
+        s_prewarmStats.starts++;
+        s_prewarmDetached = 1;
+    }
+    pthread_mutex_unlock(&s_setupMutex);
+
+    if (!want) return;
+
+    // no default route or system dns until a setup claims the link
+    property_set(PREWARM_PROPERTY, "1");
+    rc = dataPppStart(dc, PPP_OPT_NODEFAULTROUTE);
+    if (rc < 0)
+    {
+        LOGW("%s error starting pppd call %s", __FUNCTION__, dc->devname);
+        prewarmLost();
+        return;
+    }
+    LOGD("%s pre-warming %s", __FUNCTION__, PPP_IFNAME);
+
+    fw100SchedOnce("prewarmidle", prewarmIdle, (void *)(long)generation,
+        PREWARM_IDLE_MSEC, 0);
+}
+
+/**
+ * \brief pre-warm statistics
+ */
+void fw100DataPrewarmStats(fw100PrewarmStats_t *stats)
+{
+    pthread_mutex_lock(&s_setupMutex);
+    *stats = s_prewarmStats;
+    pthread_mutex_unlock(&s_setupMutex);
+}
+
+/**
+ * \brief report every context with RIL_UNSOL_DATA_CALL_LIST_CHANGED
+ */
+static void dataCallListChanged(void)
+{
+    RIL_Data_Call_Response list[DATA_MAX_CONTEXTS];
+    int n;
+
+    n = dataCallList(list);
+    RIL_onUnsolicitedResponse (RIL_UNSOL_DATA_CALL_LIST_CHANGED, 
+      (void *) list, n * sizeof(list[0]));
+}
+
+/**
+ * \brief link state handler, netlink listener thread
+ * completes a pending SETUP_DATA_CALL when the link comes up, and
+ * reports a data call coming up, changing address or going down
+ * outside a request with RIL_UNSOL_DATA_CALL_LIST_CHANGED
+ *
+ * \param link - context index, the link is ppp<link>
+ */
+static void dataLinkChanged(int link, const fw100LinkState_t *state, unsigned int changed)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    dataCall_t *dc = &s_calls[link];
+    RIL_Token t;
+
+    // the keeper and link monitor follow cid 1
+    if (0 == dc->index)
+    {
+        fw100KeeperLink(state->up && state->addr);
+        fw100LinkMonLink(state->up && state->addr);
+    }
+
+    if (state->up && state->addr)
+    {
+        dc->linkSeen = 1;
+
+        // going down, not a new data call
+        if (teardownActive(dc)) return;
+
+        t = setupClaim(dc, 0);
+        if (NULL != t)
+        {
+            setupComplete(dc, t, state);
+            return;
+        }
+
+        // pre-warmed, reported when a setup claims it
+        if (0 == dc->index && prewarmLinkUp()) return;
+        prewarmAttach(dc);
+
+        // link is up, changed state or address?
+        if (dc->state == DATA_STATE_CONNECTED && !(changed & LINK_CHANGED_ADDR))
+        {
+            dataCallSetAddress(dc, state);
+            return;
+        }
+
+        dataCallSetState(dc, DATA_STATE_CONNECTED);
+        dataCallSetAddress(dc, state);
+        dataCallListChanged();
+
+        LOGD("%s %s is UP ipaddr=%s", __FUNCTION__, dc->ifname, dc->localIP);
+        // update ril status 
+        rilWriteStatus(ctx, RIL_STATUS_FILEPATH);
+        return;
+    }
+
+    teardownEvent(dc, TEARDOWN_EV_LINKDOWN, 0);
+
+    // link is down.  changed state?
+    if (dc->state == DATA_STATE_CONNECTED)
+    {
+        dataCallSetState(dc, DATA_STATE_DISCONNECTED);
+        dataCallSetAddress(dc, NULL);
+        dataCallListChanged();
+
+        LOGD("%s %s is DOWN", __FUNCTION__, dc->ifname);
+        // update ril status 
+        rilWriteStatus(ctx, RIL_STATUS_FILEPATH);
+    }
+}
+
+/**
+ * \brief pppd exit handler, reaper thread
+ *
+ * \param unit - ppp unit, the context index
+ */
+static void dataPppExit(int unit, int status)
+{
+    dataCall_t *dc = &s_calls[unit];
+    RIL_Token t;
+    int linkSeen;
+
+    linkSeen = dc->linkSeen;
+    dc->linkSeen = 0;
+
+    if (0 == dc->index) prewarmLost();
+
+    // stopped by the teardown, not a failure
+    if (teardownActive(dc))
+    {
+        teardownEvent(dc, TEARDOWN_EV_PPPEXIT, 0);
+        if (0 == dc->index) fw100KeeperPppExit();
+        return;
+    }
+
+    // setup fails now rather than at the deadline
+    t = setupClaim(dc, 0);
+    if (NULL != t)
+    {
+        fw100FailRecord(FAIL_STAGE_SETUP, status);
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+    }
+    else
+    {
+        fw100FailRecord(linkSeen ? FAIL_STAGE_DROP : FAIL_STAGE_SETUP, status);
+    }
+
+    // redial backoff sees the cause just recorded
+    if (0 == dc->index) fw100KeeperPppExit();
+}
+
+/**
+ * \brief set up the data call contexts and start the link listener,
+ * once from mainLoop
+ * one context per -d data port, cid N on ppp<N-1>
+ *
+ * \return 0 OK, -1 error
+ */
+int fw100DataInit(void)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    const char *ifnames[DATA_MAX_CONTEXTS];
+    dataCall_t *dc;
+    int i;
+
+    for (i = 0; i < DATA_MAX_CONTEXTS; i++)
+    {
+        dc = &s_calls[i];
+        dc->index = i;
+        dc->cid = i + 1;
+        ifnames[i] = NULL;
+        if (i >= ctx->s_data_count || NULL == ctx->s_data_paths[i]) continue;
+
+        dc->path = ctx->s_data_paths[i];
+        dc->devname = i ? trim_path(dc->path) : ctx->s_data_devname;
+        snprintf(dc->ifname, sizeof(dc->ifname), PPP_IFNAME_FMT, i);
+        ifnames[i] = dc->ifname;
+        LOGD("%s cid %d %s on %s", __FUNCTION__, dc->cid, dc->ifname, dc->path);
+    }
+
+    fw100PppSetExitFunc(dataPppExit);
+    return fw100LinkStart(ifnames, DATA_MAX_CONTEXTS, dataLinkChanged);
+}
+
+/**
+ * \brief data call contexts, for the status file
+ *
+ * \param list - returned contexts
+ * \param max - list size
+ *
+ * \return number of contexts
+ */
+int fw100DataContexts(fw100DataContext_t *list, int max)
+{
+    dataCall_t *dc;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < DATA_MAX_CONTEXTS && n < max; i++)
+    {
+        dc = &s_calls[i];
+        if (NULL == dc->path) continue;
+
+        memset(&list[n], 0, sizeof(list[n]));
+        list[n].cid = dc->cid;
+        list[n].path = dc->path;
+        strncpy(list[n].ifname, dc->ifname, sizeof(list[n].ifname) - 1);
+        list[n].state = dc->state;
+        strncpy(list[n].localIP, dc->localIP, sizeof(list[n].localIP) - 1);
+        strncpy(list[n].gateway, dc->gateway, sizeof(list[n].gateway) - 1);
+        list[n].pppPid = fw100PppPid(dc->index);
+        n++;
+    }
+    return n;
+}
+
 /**
  * \brief packet data setup request
  * system/bin/pppd sets up the data call
@@ -271,72 +1292,59 @@ error:
 void requestSetupDataCallEVDO(void *data, size_t datalen, RIL_Token t)
 {
     int rc;
-    char tmp[128];
-    char dns[64];
-    char gw[64];
-    char *response[5];
+    int generation = 0;
+    int claimed = 0;
+    dataCall_t *dc;
+    fw100LinkState_t link;
     fw100SessionCtx_t *ctx = fw100GetSessionCtx();
-    unsigned int addr;
-    unsigned int gway;
-    unsigned int mask;
-    unsigned int flags;
-
-    #if PLATFORM_X86
-    sprintf(tmp,"/usr/sbin/pppd debug call %s", ctx->s_data_devname);
-    #else
-    sprintf(tmp,"/system/bin/pppd call %s", ctx->s_data_devname);
-    #endif
-    rc = system(tmp);
-    if (rc < 0)  
+    long long start;
+
+    pthread_mutex_lock(&s_setupMutex);
+    dc = setupPick();
+    if (NULL != dc && NULL == dc->setupToken && !teardownActive(dc))
     {
-    	LOGD("%s:%d error %s %s", __FUNCTION__, __LINE__, strerror(errno), tmp);
+        claimed = 1;
+        dc->setupToken = t;
+        dc->setupGeneration = dataNextGeneration(dc->setupGeneration);
+        generation = dc->setupGeneration;
+        dc->setupStartUsec = fw100NowUsec();
+        if (0 == dc->index && !prewarmClaim() && PREWARM_OFF != ctx->dataPrewarm)
+            s_prewarmStats.misses++;
+    }
+    pthread_mutex_unlock(&s_setupMutex);
+
+    if (!claimed)
+    {
+        LOGW("%s %s", __FUNCTION__,
+            (NULL == dc) ? "no idle data context" : "data call teardown in progress");
         goto error;
     }
-    LOGD("%s started %s", __FUNCTION__, tmp);
-    
-    // may take a long time to put up data call
-    // allow 30 seconds retry
-    rc = poll_ppp_linkstate("ppp0", 30, &addr, &mask, &gway, &flags);
-    if (!rc) 
-    {
-        ctx->inDataCall = DATA_STATE_CONNECTED;
-        
-        memset(response, 0, sizeof(response));
-        response[0] = "1";
-
-        response[1] = "ppp0";
-
-	inet_ntop(AF_INET, &addr, ctx->dataCallLocalIP, sizeof(ctx->dataCallLocalIP));
-	inet_ntop(AF_INET, &gway, ctx->dataCallGateway, sizeof(ctx->dataCallGateway));
-
-        response[2] = ctx->dataCallLocalIP;
-
-	tmp[0]= 0;
-        property_get("net.dns1", dns, "0");
-	strncpy(tmp, dns, sizeof(tmp));
-        property_get("net.dns2", dns, "0");
-	strncat(tmp, " ", sizeof(tmp));
-	strncat(tmp, dns, sizeof(tmp));
-        response[3] = tmp;
-
-	// this property doesn't work when set in /etc/ppp/ip-up-ppp
-	// permission error
-        // property_get("net.remote-ip", gw, "0");
-
-        response[4] = ctx->dataCallGateway;
-
-        LOGD("%s success cid=%s name=%s ip=%s dns=%s gw=%s", 
-		__FUNCTION__, 
-		response[0], 
-		response[1], 
-		response[2], 
-		response[3], 
-		response[4]);
-
-        RIL_onRequestComplete(t, RIL_E_SUCCESS, response, sizeof(response));
+
+    start = fw100NowUsec();
+    rc = dataPppStart(dc, 0);
+    fw100TraceSpan("data", "pppd", start, fw100NowUsec(), dc->devname);
+    if (rc < 0)  
+    {
+    	LOGD("%s:%d error starting pppd call %s", __FUNCTION__, __LINE__, dc->devname);
+        t = setupClaim(dc, generation);
+        if (NULL != t) goto error;
+        return;
+    }
+    LOGD("%s cid %d started pppd call %s", __FUNCTION__, dc->cid, dc->devname);
+
+    // completed by dataLinkChanged once IPCP is done, or here when
+    // the link was already up
+    if (fw100LinkGet(dc->index, &link))
+    {
+        t = setupClaim(dc, generation);
+        if (NULL != t) setupComplete(dc, t, &link);
         return;
     }
 
+    fw100SchedOnce("datasetup", setupTimeout, DATA_PARAM(dc, generation),
+        PPP_LINK_UP_MSEC, 0);
+    return;
+
 error:
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
 }
@@ -357,8 +1365,9 @@ error:
  */
 void requestDeactivateDataCallEVDO(void *data, size_t datalen, RIL_Token t)
 {
-    char exitstatus[4] = {0};
-    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    RIL_Token setup;
+    int busy;
+    dataCall_t *dc = NULL;
 
     char *cid = ((char **)data)[0];
     if(cid == NULL)
@@ -366,19 +1375,35 @@ void requestDeactivateDataCallEVDO(void *data, size_t datalen, RIL_Token t)
         LOGE("No target cid");
         /* goto error; */
     }
+    else
+    {
+        dc = dataCallByCid(atoi(cid));
+    }
 
-    at_send_command("ATH", NULL);
-    sleep(2);
+    // no or unknown cid, cid 1 as before contexts.  with several
+    // there is no call to tear down
+    if (NULL == dc && fw100GetSessionCtx()->s_data_count > 1)
+    {
+        LOGW("%s unknown cid %s", __FUNCTION__, (NULL == cid) ? "none" : cid);
+        RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+        return;
+    }
+    if (NULL == dc) dc = &s_calls[0];
+
+    // setup still waiting for the link fails now
+    setup = setupClaim(dc, 0);
+    if (NULL != setup) RIL_onRequestComplete(setup, RIL_E_GENERIC_FAILURE, NULL, 0);
 
-    killPppd();
+    busy = teardownBegin(dc);
 
-    ctx->inDataCall = DATA_STATE_DISCONNECTED;
-   
+    dataCallSetState(dc, DATA_STATE_DISCONNECTED);
+
+    // NO CARRIER, pppd exit and ppp<n> down complete the teardown
+    // after the request has returned
     RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
-    sleep(2);
+    if (busy) return;
 
-    RIL_onUnsolicitedResponse ( RIL_UNSOL_RESPONSE_NETWORK_STATE_CHANGED, 
-      NULL, 0);
+    teardownHangup(dc);
 
     return;
 
@@ -409,8 +1434,8 @@ void requestDataCallFailCause(void *data, size_t datalen, RIL_Token t)
 {
     int response = 0;
 
-    // FIXME add detail test pppd exit status
-    response = PDP_FAIL_ERROR_UNSPECIFIED;
+    // mapped from pppd exit and ^CEND, see fw100-ril-failcause.c
+    response = fw100FailLastCause();
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(int));
 
@@ -436,57 +1461,14 @@ void requestDataCallFailCause(void *data, size_t datalen, RIL_Token t)
 int pppAutomatic()
 {
     int rc;
-    unsigned int addr;
-    unsigned int mask;
-    unsigned int flags;
-    unsigned int gway;
-    char tmp[128];
-    RIL_Data_Call_Response response;
-    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    long long start;
+    dataCall_t *dc = &s_calls[0];
 
-    memset((void *) &response, 0, sizeof(response));
+    // link up and down are reported by dataLinkChanged as they happen
+    if (fw100LinkGet(dc->index, NULL)) return 0;
 
-    // check status of pppd
-    // may take a long time to put up data call
-    // allow 30 seconds retry
-    rc = poll_ppp_linkstate("ppp0", 30, &addr, &mask, &gway, &flags);
-    if (!rc) 
-    {
-        // link is up, changed state?
-        if (ctx->inDataCall != DATA_STATE_CONNECTED)
-        {
-        	ctx->inDataCall = DATA_STATE_CONNECTED;
-	        inet_ntop(AF_INET, &addr, ctx->dataCallLocalIP, sizeof(ctx->dataCallLocalIP));
-                response.cid     = 1;
-                response.active  = 2;
-                response.type    = "IP";
-                response.apn     = ctx->carrier;
-                response.address = ctx->dataCallLocalIP;
-                RIL_onUnsolicitedResponse (RIL_UNSOL_DATA_CALL_LIST_CHANGED, 
-                  (void *) &response, sizeof(response));
-        
-                LOGD("%s ppp0 is UP ipaddr=%s", __FUNCTION__, ctx->dataCallLocalIP);
-                // update ril status 
-                rilWriteStatus(ctx, RIL_STATUS_FILEPATH);
-        }
-
-        return 0;
-    }
-
-    // link is down.  changed state?
-    if (ctx->inDataCall == DATA_STATE_CONNECTED)
-    {
-        ctx->inDataCall = DATA_STATE_DISCONNECTED;
-        memset(ctx->dataCallLocalIP, 0, sizeof(ctx->dataCallLocalIP));
-        response.cid    = 1;
-        response.active = 0;
-                RIL_onUnsolicitedResponse (RIL_UNSOL_DATA_CALL_LIST_CHANGED, 
-                  (void *) &response, sizeof(response));
-
-        LOGD("%s ppp0 is DOWN", __FUNCTION__);
-        // update ril status 
-        rilWriteStatus(ctx, RIL_STATUS_FILEPATH);
-    }
+    // pppd still negotiating
+    if (fw100PppPid(dc->index)) return 0;
 
     #if 0
     // experimental.  seems to automatically restart on 
@@ -494,18 +1476,15 @@ int pppAutomatic()
     rc = property_set("ctl.start", "ppp_start");
     #endif
 
-    #if PLATFORM_X86
-    sprintf(tmp,"/usr/sbin/pppd debug call %s", ctx->s_data_devname);
-    #else
-    sprintf(tmp,"/system/bin/pppd call %s", ctx->s_data_devname);
-    #endif
-    rc = system(tmp);
+    start = fw100NowUsec();
+    rc = dataPppStart(dc, 0);
+    fw100TraceSpan("data", "pppd", start, fw100NowUsec(), dc->devname);
     if (rc < 0)  
     {
-    	LOGD("%s:%d error %s %s", __FUNCTION__, __LINE__, strerror(errno), tmp);
+    	LOGD("%s:%d error starting pppd call %s", __FUNCTION__, __LINE__, dc->devname);
         goto error;
     }
-    LOGD("%s started %s", __FUNCTION__, tmp);
+    LOGD("%s started pppd call %s", __FUNCTION__, dc->devname);
     
     return 0;
 
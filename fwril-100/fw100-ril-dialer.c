@@ -0,0 +1,246 @@
+/**
+ * \file fw100-ril-dialer.c
+ * \brief data port dialer
+ *
+ * Runs the dial sequence of /etc/ppp/peers/ttyUSB0_chat in the driver
+ * instead of pppd spawning chat: ATZ, AT if ATZ goes unanswered, then
+ * ATDT#777 until CONNECT.  Each step has its own deadline, a modem
+ * answer in the abort list ends the dial at once.  The connected tty
+ * is handed to pppd as its standard input, see fw100-ril-ppp.c.
+ *
+ * Dial to CONNECT time is measured per attempt and recorded in the
+ * metrics AT series and the status file.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+// cancel is checked this often while waiting for the modem
+#define DIAL_POLL_MSEC  100
+
+extern int configure_modem_fd(int fd, const char *devname, int options);
+
+typedef struct {
+    const char *send;
+    const char *retry;      // sent once more when the first wait times out
+    const char *expect;
+    int msec;               // per send deadline
+} dialStep_t;
+
+static const dialStep_t s_dialSteps[] = {
+    { "ATZ",      "AT", "OK",      DIAL_STEP_MSEC },
+    { "ATDT#777", NULL, "CONNECT", DIAL_CONNECT_MSEC },
+};
+
+static const char *s_dialAborts[] = {
+    "NO CARRIER", "ERROR", "NO DIALTONE", "BUSY", "NO ANSWER"
+};
+
+static const char *s_dialResultNames[] = {
+    "connect", "open", "io", "timeout", "abort", "cancel"
+};
+
+static pthread_mutex_t s_dialMutex = PTHREAD_MUTEX_INITIALIZER;
+static fw100DialStats_t s_dialStats;
+
+/**
+ * \brief send one command and wait for the expected answer
+ *
+ * \return 0 expected answer, DIAL_ERR_* otherwise
+ */
+static int dialExpect(int fd, const char *send, const char *expect, int msec,
+    volatile int *cancel, char *abort, int abortLen)
+{
+    char buf[256];
+    char cmd[32];
+    struct pollfd pfd;
+    long long deadline;
+    long long left;
+    int len = 0;
+    int n;
+    unsigned int i;
+
+    tcflush(fd, TCIFLUSH);
+    n = snprintf(cmd, sizeof(cmd), "%s\r", send);
+    if (write(fd, cmd, n) != n)
+    {
+        LOGE("%s write %s %s", __FUNCTION__, send, strerror(errno));
+        return DIAL_ERR_IO;
+    }
+
+    deadline = fw100NowMsec() + msec;
+    for (;;)
+    {
+        if (NULL != cancel && *cancel) return DIAL_ERR_CANCEL;
+
+        left = deadline - fw100NowMsec();
+        if (left <= 0) return DIAL_ERR_TIMEOUT;
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        n = poll(&pfd, 1, (left < DIAL_POLL_MSEC) ? (int)left : DIAL_POLL_MSEC);
+        if (n < 0 && errno != EINTR) return DIAL_ERR_IO;
+        if (n <= 0) continue;
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) return DIAL_ERR_IO;
+
+        // answers are matched anywhere in what has arrived, as chat does
+        if (len >= (int)sizeof(buf) - 1)
+        {
+            memmove(buf, buf + sizeof(buf) / 2, len - sizeof(buf) / 2);
+            len -= sizeof(buf) / 2;
+        }
+        n = read(fd, buf + len, sizeof(buf) - 1 - len);
+        if (n < 0 && errno != EINTR && errno != EAGAIN) return DIAL_ERR_IO;
+        if (n <= 0) continue;
+        len += n;
+        buf[len] = '\0';
+
+        #if BUILD_DEBUG_1
+        LOGD("%s %s: %s", __FUNCTION__, send, buf);
+        #endif
+
+        if (strstr(buf, expect)) return 0;
+        for (i = 0; i < sizeof(s_dialAborts) / sizeof(s_dialAborts[0]); i++)
+        {
+            if (strstr(buf, s_dialAborts[i]))
+            {
+                strncpy(abort, s_dialAborts[i], abortLen - 1);
+                abort[abortLen - 1] = '\0';
+                return DIAL_ERR_ABORT;
+            }
+        }
+    }
+}
+
+/**
+ * \brief record an attempt
+ */
+static void dialRecord(int result, long long connectUsec, const char *abort)
+{
+    pthread_mutex_lock(&s_dialMutex);
+    s_dialStats.attempts++;
+    s_dialStats.lastResult = result;
+    snprintf(s_dialStats.lastAbort, sizeof(s_dialStats.lastAbort), "%s", abort);
+    if (DIAL_OK == result)
+    {
+        s_dialStats.connects++;
+        s_dialStats.lastConnectUsec = connectUsec;
+        s_dialStats.connectTotalUsec += connectUsec;
+    }
+    pthread_mutex_unlock(&s_dialMutex);
+}
+
+/**
+ * \brief dial the data port
+ * runs on its own thread, the caller may set *cancel to stop it
+ *
+ * \param path - data port, e.g. /dev/ttyUSB0
+ * \param cancel - asserted to abandon the dial, may be NULL
+ *
+ * \return
+ * connected fd, the caller owns it
+ * DIAL_ERR_* error
+ */
+int fw100Dial(const char *path, volatile int *cancel)
+{
+    char abort[16] = "";
+    const dialStep_t *step;
+    long long start = 0;
+    long long end = 0;
+    unsigned int i;
+    int rc = 0;
+    int fd;
+
+    fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        LOGE("%s open %s %s", __FUNCTION__, path, strerror(errno));
+        rc = DIAL_ERR_OPEN;
+        goto done;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (configure_modem_fd(fd, path, 0) < 0)
+    {
+        rc = DIAL_ERR_IO;
+        goto done;
+    }
+
+    for (i = 0; i < sizeof(s_dialSteps) / sizeof(s_dialSteps[0]); i++)
+    {
+        step = &s_dialSteps[i];
+        start = fw100NowUsec();
+        rc = dialExpect(fd, step->send, step->expect, step->msec, cancel,
+            abort, sizeof(abort));
+        if (DIAL_ERR_TIMEOUT == rc && NULL != step->retry)
+        {
+            rc = dialExpect(fd, step->retry, step->expect, step->msec, cancel,
+                abort, sizeof(abort));
+        }
+        end = fw100NowUsec();
+        fw100MetricsDial(step->send, rc, start, end);
+        if (rc < 0)
+        {
+            LOGW("%s %s %s %s", __FUNCTION__, step->send,
+                fw100DialResultName(rc), abort);
+            goto done;
+        }
+    }
+
+    // start is the ATD of the last step
+    fw100TraceSpan("data", "dial", start, end, path);
+    LOGD("%s %s CONNECT in %lld msec", __FUNCTION__, path, (end - start) / 1000);
+
+done:
+    dialRecord(rc, (rc == 0) ? end - start : 0, abort);
+    if (rc < 0 && fd >= 0) close(fd);
+    return (rc < 0) ? rc : fd;
+}
+
+/**
+ * \brief dial result name
+ */
+const char *fw100DialResultName(int result)
+{
+    if (result > 0 || -result >= (int)(sizeof(s_dialResultNames) / sizeof(s_dialResultNames[0])))
+        return "unknown";
+    return s_dialResultNames[-result];
+}
+
+/**
+ * \brief dial statistics
+ */
+void fw100DialStats(fw100DialStats_t *stats)
+{
+    pthread_mutex_lock(&s_dialMutex);
+    *stats = s_dialStats;
+    pthread_mutex_unlock(&s_dialMutex);
+}
@@ -0,0 +1,298 @@
+/**
+ * \file fw100-ril-failcause.c
+ * \brief data call fail cause mapping and history
+ *
+ * A data call failure is explained by the pppd exit code and, when
+ * the modem reported one during the bring up shortly before, the
+ * ^CEND end status and call control cause.  pppd runs the chat script, so a failed chat
+ * shows up as pppd exit 8.  The mapped cause answers
+ * LAST_DATA_CALL_FAIL_CAUSE and is kept with its inputs in a small
+ * history for the status file and the retry policy.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// pppd exit codes, pppd/pppd.h
+#define PPP_EXIT_OK                 0
+#define PPP_EXIT_CONNECT_FAILED     8   // chat script failed
+#define PPP_EXIT_NEGOTIATION_FAILED 10
+#define PPP_EXIT_PEER_AUTH_FAILED   11
+#define PPP_EXIT_PEER_DEAD          15
+#define PPP_EXIT_HANGUP             16
+#define PPP_EXIT_LOOPBACK           17
+#define PPP_EXIT_AUTH_TOPEER_FAILED 19
+#define PPP_EXIT_CNID_AUTH_FAILED   21
+
+typedef struct {
+    int code;
+    int cause;
+} failMap_t;
+
+// pppd exit code to cause, codes not listed are unspecified
+static const failMap_t s_pppExitMap[] = {
+    { PPP_EXIT_CONNECT_FAILED,     PDP_FAIL_ACTIVATION_REJECT_UNSPECIFIED },
+    { PPP_EXIT_NEGOTIATION_FAILED, PDP_FAIL_PROTOCOL_ERRORS },
+    { PPP_EXIT_PEER_AUTH_FAILED,   PDP_FAIL_USER_AUTHENTICATION },
+    { PPP_EXIT_PEER_DEAD,          PDP_FAIL_REGISTRATION_FAIL },    // link lost
+    { PPP_EXIT_HANGUP,             PDP_FAIL_REGISTRATION_FAIL },    // carrier lost
+    { PPP_EXIT_LOOPBACK,           PDP_FAIL_PROTOCOL_ERRORS },
+    { PPP_EXIT_AUTH_TOPEER_FAILED, PDP_FAIL_USER_AUTHENTICATION },
+    { PPP_EXIT_CNID_AUTH_FAILED,   PDP_FAIL_USER_AUTHENTICATION },
+};
+
+// ^CEND end status to cause
+static const failMap_t s_endStatusMap[] = {
+    { 21,  PDP_FAIL_REGISTRATION_FAIL },             // no service
+    { 23,  PDP_FAIL_INSUFFICIENT_RESOURCES },        // intercept
+    { 24,  PDP_FAIL_INSUFFICIENT_RESOURCES },        // reorder
+    { 26,  PDP_FAIL_SERVICE_OPTION_NOT_SUPPORTED },  // service option rejected
+    { 34,  PDP_FAIL_REGISTRATION_FAIL },             // RUIM not present
+    { 106, PDP_FAIL_INSUFFICIENT_RESOURCES },
+    { 107, PDP_FAIL_SERVICE_OPTION_NOT_SUPPORTED },
+    { 108, PDP_FAIL_NSAPI_IN_USE },
+};
+
+// ^CEND call control cause, TS 24.008 10.5.4.11, to cause
+static const failMap_t s_ccCauseMap[] = {
+    { 8,   PDP_FAIL_OPERATOR_BARRED },               // operator determined barring
+    { 34,  PDP_FAIL_INSUFFICIENT_RESOURCES },        // no circuit available
+    { 38,  PDP_FAIL_SERVICE_OPTION_OUT_OF_ORDER },   // network out of order
+    { 41,  PDP_FAIL_INSUFFICIENT_RESOURCES },        // temporary failure
+    { 42,  PDP_FAIL_INSUFFICIENT_RESOURCES },        // switching congestion
+    { 44,  PDP_FAIL_INSUFFICIENT_RESOURCES },        // channel unavailable
+    { 47,  PDP_FAIL_INSUFFICIENT_RESOURCES },        // resources unavailable
+    { 50,  PDP_FAIL_SERVICE_OPTION_NOT_SUBSCRIBED }, // facility not subscribed
+    { 57,  PDP_FAIL_SERVICE_OPTION_NOT_SUBSCRIBED }, // bearer not authorized
+    { 58,  PDP_FAIL_SERVICE_OPTION_OUT_OF_ORDER },   // bearer not available
+    { 63,  PDP_FAIL_SERVICE_OPTION_OUT_OF_ORDER },   // service not available
+    { 65,  PDP_FAIL_SERVICE_OPTION_NOT_SUPPORTED },  // bearer not implemented
+    { 69,  PDP_FAIL_SERVICE_OPTION_NOT_SUPPORTED },  // facility not implemented
+    { 79,  PDP_FAIL_SERVICE_OPTION_NOT_SUPPORTED },  // service not implemented
+    { 95,  PDP_FAIL_PROTOCOL_ERRORS },               // invalid message
+    { 96,  PDP_FAIL_PROTOCOL_ERRORS },               // invalid mandatory information
+    { 97,  PDP_FAIL_PROTOCOL_ERRORS },               // message type not implemented
+    { 98,  PDP_FAIL_PROTOCOL_ERRORS },               // message not compatible
+    { 99,  PDP_FAIL_PROTOCOL_ERRORS },               // element not implemented
+    { 100, PDP_FAIL_PROTOCOL_ERRORS },               // conditional element error
+    { 101, PDP_FAIL_PROTOCOL_ERRORS },               // message not compatible with state
+    { 111, PDP_FAIL_PROTOCOL_ERRORS },               // protocol error, unspecified
+};
+
+// retrying these cannot succeed, the framework stops
+static const int s_permanentCauses[] = {
+    PDP_FAIL_OPERATOR_BARRED,
+    PDP_FAIL_MISSING_UKNOWN_APN,
+    PDP_FAIL_UNKNOWN_PDP_ADDRESS_TYPE,
+    PDP_FAIL_USER_AUTHENTICATION,
+    PDP_FAIL_ACTIVATION_REJECT_GGSN,
+    PDP_FAIL_SERVICE_OPTION_NOT_SUPPORTED,
+    PDP_FAIL_SERVICE_OPTION_NOT_SUBSCRIBED,
+    PDP_FAIL_NSAPI_IN_USE,
+    PDP_FAIL_PROTOCOL_ERRORS,
+};
+
+#define ARRAY_LEN(a)    (sizeof(a) / sizeof((a)[0]))
+
+static pthread_mutex_t s_failMutex = PTHREAD_MUTEX_INITIALIZER;
+static fw100CallEnd_t s_callEnd;
+static long long s_callEndMsec;     // 0 none seen
+static fw100FailEntry_t s_history[FAIL_HISTORY_MAX];
+static unsigned int s_failCount;    // total, s_history is a ring
+
+/**
+ * \brief look up a code in a map
+ * \return cause, PDP_FAIL_ERROR_UNSPECIFIED not listed
+ */
+static int failLookup(const failMap_t *map, int n, int code)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (map[i].code == code) return map[i].cause;
+    }
+    return PDP_FAIL_ERROR_UNSPECIFIED;
+}
+
+/**
+ * \brief ^CEND from the modem, AT reader thread
+ * ^CEND:<call id>,<duration>,<end status>[,<cc cause>]
+ * kept only while a data call is being brought up, an end of a
+ * voice call or an established session explains no setup failure
+ */
+void fw100FailCallEnd(const char *line)
+{
+    fw100CallEnd_t end;
+
+    memset(&end, 0, sizeof(end));
+    end.ccCause = -1;
+    if (at_schema_parse(&fw100SchemaCend, line, &end) < 0) return;
+
+    if (!fw100DataDialPending())
+    {
+        LOGD("%s call %d end status %d, no data call pending", __FUNCTION__,
+            end.callId, end.endStatus);
+        return;
+    }
+
+    pthread_mutex_lock(&s_failMutex);
+    s_callEnd = end;
+    s_callEndMsec = fw100NowMsec();
+    pthread_mutex_unlock(&s_failMutex);
+
+    LOGD("%s call %d end status %d cc cause %d", __FUNCTION__,
+        end.callId, end.endStatus, end.ccCause);
+}
+
+/**
+ * \brief map a failure to a cause, assumes s_failMutex is held
+ * a recent call end explains the failure better than the pppd exit,
+ * except an authentication failure
+ */
+static int failMap(fw100FailEntry_t *e)
+{
+    int cause = PDP_FAIL_ERROR_UNSPECIFIED;
+    int i;
+
+    if (e->pppStatus != -1 && WIFEXITED(e->pppStatus))
+    {
+        cause = failLookup(s_pppExitMap, ARRAY_LEN(s_pppExitMap),
+            WEXITSTATUS(e->pppStatus));
+        if (PDP_FAIL_USER_AUTHENTICATION == cause) return cause;
+    }
+
+    if (e->ccCause >= 0)
+    {
+        i = failLookup(s_ccCauseMap, ARRAY_LEN(s_ccCauseMap), e->ccCause);
+        if (PDP_FAIL_ERROR_UNSPECIFIED != i) return i;
+    }
+
+    if (e->endStatus >= 0)
+    {
+        i = failLookup(s_endStatusMap, ARRAY_LEN(s_endStatusMap), e->endStatus);
+        if (PDP_FAIL_ERROR_UNSPECIFIED != i) return i;
+    }
+
+    return cause;
+}
+
+/**
+ * \brief record a data call failure
+ *
+ * \param stage - FAIL_STAGE_*
+ * \param pppStatus - pppd wait status, -1 pppd did not exit
+ *
+ * \return mapped cause, RIL_LastDataCallActivateFailCause
+ */
+int fw100FailRecord(int stage, int pppStatus)
+{
+    fw100FailEntry_t *e;
+    long long now = fw100NowMsec();
+
+    pthread_mutex_lock(&s_failMutex);
+
+    e = &s_history[s_failCount % FAIL_HISTORY_MAX];
+    memset(e, 0, sizeof(*e));
+    e->msec = now;
+    e->stage = stage;
+    e->pppStatus = pppStatus;
+    e->endStatus = -1;
+    e->ccCause = -1;
+    // a ^CEND seen during the bring up explains this setup only
+    if (FAIL_STAGE_SETUP == stage && s_callEndMsec &&
+        now - s_callEndMsec <= FAIL_CEND_WINDOW_MSEC)
+    {
+        e->endStatus = s_callEnd.endStatus;
+        e->ccCause = s_callEnd.ccCause;
+        s_callEndMsec = 0;
+    }
+    e->cause = failMap(e);
+    s_failCount++;
+
+    pthread_mutex_unlock(&s_failMutex);
+
+    LOGW("%s %s cause 0x%x ppp %d end status %d cc cause %d", __FUNCTION__,
+        (FAIL_STAGE_DROP == stage) ? "drop" : "setup", e->cause,
+        (pppStatus != -1 && WIFEXITED(pppStatus)) ? WEXITSTATUS(pppStatus) : -1,
+        e->endStatus, e->ccCause);
+
+    return e->cause;
+}
+
+/**
+ * \brief cause of the most recent failure
+ * \return RIL_LastDataCallActivateFailCause, unspecified before any
+ */
+int fw100FailLastCause(void)
+{
+    int cause = PDP_FAIL_ERROR_UNSPECIFIED;
+
+    pthread_mutex_lock(&s_failMutex);
+    if (s_failCount)
+        cause = s_history[(s_failCount - 1) % FAIL_HISTORY_MAX].cause;
+    pthread_mutex_unlock(&s_failMutex);
+
+    return cause;
+}
+
+/**
+ * \brief retrying cannot help
+ * \return 1 permanent, 0 transient
+ */
+int fw100FailIsPermanent(int cause)
+{
+    int i;
+
+    for (i = 0; i < (int)ARRAY_LEN(s_permanentCauses); i++)
+    {
+        if (s_permanentCauses[i] == cause) return 1;
+    }
+    return 0;
+}
+
+/**
+ * \brief copy the failure history, most recent first
+ *
+ * \param entries - returned entries
+ * \param max - entries room
+ * \param total - returned failures since start, may be NULL
+ *
+ * \return number of entries copied
+ */
+int fw100FailHistory(fw100FailEntry_t *entries, int max, unsigned int *total)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&s_failMutex);
+    while (n < max && n < FAIL_HISTORY_MAX && (unsigned int)n < s_failCount)
+    {
+        entries[n] = s_history[(s_failCount - 1 - n) % FAIL_HISTORY_MAX];
+        n++;
+    }
+    if (NULL != total) *total = s_failCount;
+    pthread_mutex_unlock(&s_failMutex);
+
+    return n;
+}
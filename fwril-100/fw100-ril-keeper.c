@@ -0,0 +1,406 @@
+/**
+ * \file fw100-ril-keeper.c
+ * \brief always on data session keeper
+ *
+ * With DataCallIsAutomatic in the control file and the module
+ * activated, the keeper holds the cid 1 data session, ppp0, up
+ * without the Android data stack.  It dials with pppAutomatic, learns the outcome from
+ * the link listener and the pppd reaper, and redials after an
+ * exponential backoff with jitter.  Every wait is a scheduler
+ * one-shot, nothing sleeps.
+ *
+ * Link health is checked on the modem timer from the ppp0 counters.
+ * Transmit with no receive for KEEPER_RX_IDLE_MSEC is a dead link and
+ * pppd is restarted.  A link idle for KEEPER_PROBE_IDLE_MSEC is sent
+ * a DNS query, so a dead link is found even when nothing is sent.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+static const char *s_keeperStateNames[] = { "off", "idle", "dialing", "up" };
+
+static pthread_mutex_t s_keeperMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_keeperState;           // KEEPER_*
+static int s_keeperGeneration;      // tells a stale one-shot
+static int s_keeperAttempts;        // failed dials since the last stable session
+static long long s_keeperDialDueMsec;
+static fw100KeeperStats_t s_keeperStats;
+
+// link health, valid while up
+static unsigned long long s_rxBytes;
+static unsigned long long s_txBytes;
+static long long s_rxMsec;          // last receive
+static long long s_txMsec;          // last transmit
+static long long s_unansweredMsec;  // first transmit since the last receive, 0 none
+static long long s_probeMsec;       // last probe
+
+static void keeperDialTask(void *param);
+static void keeperDeadlineTask(void *param);
+
+/**
+ * \brief next generation, assumes s_keeperMutex is held
+ */
+static int keeperNextGeneration(void)
+{
+    if (0 == ++s_keeperGeneration) s_keeperGeneration = 1;
+    return s_keeperGeneration;
+}
+
+/**
+ * \brief redial delay, exponential with jitter
+ * half the delay is fixed and half random, so a fleet that lost
+ * service together does not redial together
+ */
+static int keeperBackoff(int attempts, int permanent)
+{
+    long long delay = KEEPER_BACKOFF_MIN_MSEC;
+    int i;
+
+    if (permanent) return KEEPER_BACKOFF_MAX_MSEC;
+
+    for (i = 1; i < attempts && delay < KEEPER_BACKOFF_MAX_MSEC; i++)
+        delay *= 2;
+    if (delay > KEEPER_BACKOFF_MAX_MSEC) delay = KEEPER_BACKOFF_MAX_MSEC;
+
+    return (int)(delay / 2 + lrand48() % (delay / 2 + 1));
+}
+
+/**
+ * \brief schedule the next dial, assumes s_keeperMutex is held
+ */
+static void keeperScheduleDial(int delayMsec)
+{
+    s_keeperState = KEEPER_IDLE;
+    s_keeperDialDueMsec = fw100NowMsec() + delayMsec;
+    fw100SchedOnce("keeperdial", keeperDialTask, (void *)(long)keeperNextGeneration(),
+        delayMsec, 0);
+
+    LOGD("%s redial in %d msec, attempt %d", __FUNCTION__, delayMsec, s_keeperAttempts + 1);
+}
+
+/**
+ * \brief session is up, assumes s_keeperMutex is held
+ */
+static void keeperUp(long long now)
+{
+    s_keeperState = KEEPER_UP;
+    keeperNextGeneration();
+    s_keeperStats.sessionStartMsec = now;
+
+    s_rxBytes = s_txBytes = 0;
+    s_rxMsec = s_txMsec = s_probeMsec = now;
+    s_unansweredMsec = 0;
+}
+
+/**
+ * \brief session is down, assumes s_keeperMutex is held
+ */
+static void keeperDown(long long now)
+{
+    int permanent;
+    long long up;
+
+    if (KEEPER_UP == s_keeperState)
+    {
+        up = now - s_keeperStats.sessionStartMsec;
+        s_keeperStats.upTotalMsec += up;
+        s_keeperStats.sessionStartMsec = 0;
+        s_keeperStats.downSinceMsec = now;
+        // a session that held resets the backoff
+        if (up >= KEEPER_STABLE_MSEC) s_keeperAttempts = 0;
+    }
+
+    permanent = fw100FailIsPermanent(fw100FailLastCause());
+    s_keeperAttempts++;
+    keeperScheduleDial(keeperBackoff(s_keeperAttempts, permanent));
+}
+
+/**
+ * \brief dial when the backoff expires, scheduler thread
+ */
+static void keeperDialTask(void *param)
+{
+    int generation = (int)(long)param;
+    int rc;
+
+    pthread_mutex_lock(&s_keeperMutex);
+    if (generation != s_keeperGeneration || KEEPER_IDLE != s_keeperState)
+    {
+        pthread_mutex_unlock(&s_keeperMutex);
+        return;
+    }
+    s_keeperState = KEEPER_DIALING;
+    s_keeperStats.dials++;
+    generation = keeperNextGeneration();
+    pthread_mutex_unlock(&s_keeperMutex);
+
+    rc = pppAutomatic();
+
+    pthread_mutex_lock(&s_keeperMutex);
+    if (generation == s_keeperGeneration)
+    {
+        if (rc < 0)
+        {
+            keeperDown(fw100NowMsec());
+        }
+        else if (fw100LinkGet(PPP_UNIT_PRIMARY, NULL))
+        {
+            // already up, there will be no link event
+            keeperUp(fw100NowMsec());
+        }
+        else
+        {
+            fw100SchedOnce("keeperdeadline", keeperDeadlineTask, (void *)(long)generation,
+                PPP_LINK_UP_MSEC, 0);
+        }
+    }
+    pthread_mutex_unlock(&s_keeperMutex);
+}
+
+/**
+ * \brief dial did not bring the link up, scheduler thread
+ * pppd is stopped, its exit schedules the redial
+ */
+static void keeperDeadlineTask(void *param)
+{
+    int generation = (int)(long)param;
+
+    pthread_mutex_lock(&s_keeperMutex);
+    if (generation != s_keeperGeneration || KEEPER_DIALING != s_keeperState)
+    {
+        pthread_mutex_unlock(&s_keeperMutex);
+        return;
+    }
+
+    LOGW("%s %s not up after %d msec", __FUNCTION__, PPP_IFNAME, PPP_LINK_UP_MSEC);
+    if (!fw100PppSignal(PPP_UNIT_PRIMARY, SIGTERM)) keeperDown(fw100NowMsec());
+    pthread_mutex_unlock(&s_keeperMutex);
+}
+
+/**
+ * \brief link state from the netlink listener
+ * \param up - link up with an address
+ */
+void fw100KeeperLink(int up)
+{
+    long long now = fw100NowMsec();
+    long long reconnect;
+
+    pthread_mutex_lock(&s_keeperMutex);
+
+    if (KEEPER_OFF == s_keeperState) goto done;
+
+    if (up && KEEPER_UP != s_keeperState)
+    {
+        reconnect = now - s_keeperStats.downSinceMsec;
+        s_keeperStats.reconnects++;
+        s_keeperStats.lastReconnectMsec = reconnect;
+        s_keeperStats.reconnectTotalMsec += reconnect;
+        keeperUp(now);
+
+        LOGD("%s session up after %lld msec", __FUNCTION__, reconnect);
+    }
+    else if (!up && KEEPER_UP == s_keeperState)
+    {
+        LOGD("%s session down after %lld msec", __FUNCTION__,
+            now - s_keeperStats.sessionStartMsec);
+        keeperDown(now);
+    }
+
+done:
+    pthread_mutex_unlock(&s_keeperMutex);
+}
+
+/**
+ * \brief pppd exited, reaper thread
+ */
+void fw100KeeperPppExit(void)
+{
+    pthread_mutex_lock(&s_keeperMutex);
+    if (KEEPER_UP == s_keeperState || KEEPER_DIALING == s_keeperState)
+        keeperDown(fw100NowMsec());
+    pthread_mutex_unlock(&s_keeperMutex);
+}
+
+/**
+ * \brief send a DNS query for the root name servers
+ * the answer, or an ICMP error, is receive traffic on a live link
+ */
+static void keeperProbe(void)
+{
+    // id 0x4657, recursion desired, one question: . NS IN
+    static const unsigned char query[] = {
+        0x46, 0x57, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x02, 0x00, 0x01
+    };
+    char dns[PROPERTY_VALUE_MAX];
+    struct sockaddr_in sa;
+    int fd;
+
+    property_get("net.dns1", dns, "");
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(53);
+    if (!inet_aton(dns, &sa.sin_addr)) return;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return;
+    if (sendto(fd, query, sizeof(query), MSG_DONTWAIT, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+        LOGD("%s %s %s", __FUNCTION__, dns, strerror(errno));
+    close(fd);
+}
+
+/**
+ * \brief check link health, assumes s_keeperMutex is held
+ * \return 1 link is dead, 0 OK
+ */
+static int keeperCheckLink(long long now)
+{
+    unsigned long long rx;
+    unsigned long long tx;
+
+    if (fw100LinkReadCounter("rx_bytes", &rx) < 0
+        || fw100LinkReadCounter("tx_bytes", &tx) < 0)
+        return 0;
+
+    if (rx != s_rxBytes)
+    {
+        s_rxBytes = rx;
+        s_rxMsec = now;
+        s_unansweredMsec = 0;
+    }
+    if (tx != s_txBytes)
+    {
+        s_txBytes = tx;
+        s_txMsec = now;
+        if (!s_unansweredMsec && s_txMsec > s_rxMsec) s_unansweredMsec = now;
+    }
+
+    if (s_unansweredMsec && now - s_unansweredMsec >= KEEPER_RX_IDLE_MSEC)
+    {
+        LOGW("%s nothing received for %lld msec of transmit", __FUNCTION__,
+            now - s_unansweredMsec);
+        return 1;
+    }
+
+    if (now - s_rxMsec >= KEEPER_PROBE_IDLE_MSEC && now - s_txMsec >= KEEPER_PROBE_IDLE_MSEC
+        && now - s_probeMsec >= KEEPER_PROBE_IDLE_MSEC)
+    {
+        s_probeMsec = now;
+        keeperProbe();
+    }
+
+    return 0;
+}
+
+/**
+ * \brief keeper poll, modem timer
+ * starts and stops the keeper with the control file setting, and
+ * checks the health of a session that is up
+ *
+ * \param enable - keep a session up
+ */
+void fw100KeeperPoll(int enable)
+{
+    long long now = fw100NowMsec();
+    int dead = 0;
+
+    pthread_mutex_lock(&s_keeperMutex);
+
+    if (!enable)
+    {
+        if (KEEPER_OFF != s_keeperState)
+        {
+            LOGD("%s stopped", __FUNCTION__);
+            if (KEEPER_UP == s_keeperState)
+                s_keeperStats.upTotalMsec += now - s_keeperStats.sessionStartMsec;
+            s_keeperStats.enabledTotalMsec += now - s_keeperStats.enabledSinceMsec;
+            s_keeperState = KEEPER_OFF;
+            keeperNextGeneration();
+        }
+        goto done;
+    }
+
+    if (KEEPER_OFF == s_keeperState)
+    {
+        LOGD("%s started", __FUNCTION__);
+        srand48(getpid() ^ now);
+        s_keeperStats.enabledSinceMsec = now;
+        s_keeperStats.downSinceMsec = now;
+        s_keeperAttempts = 0;
+        if (fw100LinkGet(PPP_UNIT_PRIMARY, NULL))
+            keeperUp(now);
+        else
+            keeperScheduleDial(0);
+        goto done;
+    }
+
+    if (KEEPER_UP == s_keeperState && keeperCheckLink(now))
+    {
+        s_keeperStats.deadLinks++;
+        dead = 1;
+    }
+
+done:
+    pthread_mutex_unlock(&s_keeperMutex);
+
+    // pppd exit brings the session down and schedules the redial
+    if (dead) fw100PppSignal(PPP_UNIT_PRIMARY, SIGTERM);
+}
+
+/**
+ * \brief keeper statistics
+ * time totals include the current session and enabled period
+ *
+ * \param stats - returned statistics
+ *
+ * \return state name
+ */
+const char *fw100KeeperStats(fw100KeeperStats_t *stats)
+{
+    long long now = fw100NowMsec();
+    const char *name;
+
+    pthread_mutex_lock(&s_keeperMutex);
+    *stats = s_keeperStats;
+    if (KEEPER_OFF != s_keeperState)
+        stats->enabledTotalMsec += now - s_keeperStats.enabledSinceMsec;
+    if (KEEPER_UP == s_keeperState)
+        stats->upTotalMsec += now - s_keeperStats.sessionStartMsec;
+    stats->nextDialMsec = (KEEPER_IDLE == s_keeperState) ? s_keeperDialDueMsec - now : -1;
+    name = s_keeperStateNames[s_keeperState];
+    pthread_mutex_unlock(&s_keeperMutex);
+
+    return name;
+}
@@ -0,0 +1,301 @@
+/**
+ * \file fw100-ril-linkmon.c
+ * \brief ppp0 throughput and stall monitor
+ *
+ * While ppp0 is up a scheduler task samples the interface counters in
+ * /sys/class/net/ppp0/statistics every LINKMON_PERIOD_MSEC.  The last
+ * LINKMON_WINDOW samples give the moving window throughput.  No task
+ * runs, and nothing wakes, while the link is down.
+ *
+ * A stall is packets sent for LINKMON_STALL_MSEC with nothing
+ * received.  pppd's own LCP echo is effectively off
+ * (lcp-echo-interval 65535), so with LinkStallReconnect in the control
+ * file a stall restarts the data call at once, see fw100DataRestart.
+ * Each sample also feeds the usage accounting in fw100-ril-usage.c.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+#define LINKMON_SYSFS_STATS "/sys/class/net/" PPP_IFNAME "/statistics/"
+
+typedef struct {
+    long long msec;
+    fw100LinkCounters_t c;
+} linkSample_t;
+
+static pthread_mutex_t s_linkMonMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_linkMonTask = -1;      // scheduler task id, -1 link down
+static linkSample_t s_samples[LINKMON_WINDOW];
+static unsigned int s_nSamples;     // total this session, s_samples is a ring
+static long long s_flatSinceMsec;   // first transmit with receive flat, 0 none
+static unsigned long long s_flatTxPackets;
+static int s_stalled;               // reported, until receive resumes
+static int s_ifindex;               // ppp0 of this session
+static fw100LinkMonStats_t s_linkMonStats;
+
+/**
+ * \brief read a ppp0 counter
+ *
+ * \param name - counter file, e.g. rx_bytes
+ * \param value - returned counter
+ *
+ * \return 0 OK, -1 no interface
+ */
+int fw100LinkReadCounter(const char *name, unsigned long long *value)
+{
+    char path[96];
+    char buf[32];
+    int fd;
+    int n;
+
+    snprintf(path, sizeof(path), LINKMON_SYSFS_STATS "%s", name);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    *value = strtoull(buf, NULL, 10);
+
+    return 0;
+}
+
+/**
+ * \brief read all ppp0 counters
+ * \return 0 OK, -1 no interface
+ */
+static int linkReadCounters(fw100LinkCounters_t *c)
+{
+    if (fw100LinkReadCounter("rx_bytes", &c->rxBytes) < 0) return -1;
+    if (fw100LinkReadCounter("tx_bytes", &c->txBytes) < 0) return -1;
+    if (fw100LinkReadCounter("rx_packets", &c->rxPackets) < 0) return -1;
+    if (fw100LinkReadCounter("tx_packets", &c->txPackets) < 0) return -1;
+    fw100LinkReadCounter("rx_errors", &c->rxErrors);
+    fw100LinkReadCounter("tx_errors", &c->txErrors);
+    fw100LinkReadCounter("rx_dropped", &c->rxDropped);
+    fw100LinkReadCounter("tx_dropped", &c->txDropped);
+
+    return 0;
+}
+
+/**
+ * \brief a 32 bit counter from a link message, past a 64 bit sample
+ * \return the counter, the sample when the message is older
+ */
+static unsigned long long linkExtend(unsigned long long sample, unsigned long long low)
+{
+    unsigned int ahead = (unsigned int)low - (unsigned int)sample;
+
+    if (ahead >= 0x80000000u) return sample;
+    return sample + ahead;
+}
+
+/**
+ * \brief counters of the last link message when newer than the last
+ * sample, assumes s_linkMonMutex is held
+ * once ppp0 is gone sysfs has nothing, its final counters are in the
+ * message that deleted it
+ */
+static void linkLastCounters(void)
+{
+    fw100LinkCounters_t *c = &s_linkMonStats.counters;
+    fw100LinkCounters_t m;
+
+    if (fw100LinkGetCounters(PPP_UNIT_PRIMARY, &m) < 0 || m.ifindex != s_ifindex) return;
+
+    c->rxBytes = linkExtend(c->rxBytes, m.rxBytes);
+    c->txBytes = linkExtend(c->txBytes, m.txBytes);
+    c->rxPackets = linkExtend(c->rxPackets, m.rxPackets);
+    c->txPackets = linkExtend(c->txPackets, m.txPackets);
+    c->rxErrors = linkExtend(c->rxErrors, m.rxErrors);
+    c->txErrors = linkExtend(c->txErrors, m.txErrors);
+    c->rxDropped = linkExtend(c->rxDropped, m.rxDropped);
+    c->txDropped = linkExtend(c->txDropped, m.txDropped);
+}
+
+/**
+ * \brief bytes per second between two samples
+ */
+static unsigned int linkRate(unsigned long long from, unsigned long long to, long long msec)
+{
+    if (msec <= 0 || to < from) return 0;
+    return (unsigned int)((to - from) * 1000 / msec);
+}
+
+/**
+ * \brief take a sample, assumes s_linkMonMutex is held
+ * \return 1 stalled now, 0 otherwise
+ */
+static int linkSample(long long now)
+{
+    linkSample_t *s;
+    linkSample_t *prev = NULL;
+    linkSample_t *first;
+    fw100LinkCounters_t c;
+    unsigned int rate;
+
+    memset(&c, 0, sizeof(c));
+    if (linkReadCounters(&c) < 0) return 0;
+    c.ifindex = s_ifindex;
+
+    if (s_nSamples) prev = &s_samples[(s_nSamples - 1) % LINKMON_WINDOW];
+    s = &s_samples[s_nSamples % LINKMON_WINDOW];
+    s->msec = now;
+    s->c = c;
+    s_nSamples++;
+
+    s_linkMonStats.samples++;
+    s_linkMonStats.counters = c;
+
+    // oldest sample in the window
+    first = &s_samples[(s_nSamples < LINKMON_WINDOW) ? 0 : s_nSamples % LINKMON_WINDOW];
+    s_linkMonStats.rxBps = linkRate(first->c.rxBytes, c.rxBytes, now - first->msec);
+    s_linkMonStats.txBps = linkRate(first->c.txBytes, c.txBytes, now - first->msec);
+
+    if (NULL == prev) return 0;
+
+    rate = linkRate(prev->c.rxBytes, c.rxBytes, now - prev->msec);
+    if (rate > s_linkMonStats.rxPeakBps) s_linkMonStats.rxPeakBps = rate;
+    rate = linkRate(prev->c.txBytes, c.txBytes, now - prev->msec);
+    if (rate > s_linkMonStats.txPeakBps) s_linkMonStats.txPeakBps = rate;
+
+    // anything received clears a stall
+    if (c.rxPackets != prev->c.rxPackets)
+    {
+        s_flatSinceMsec = 0;
+        s_stalled = 0;
+        return 0;
+    }
+
+    if (c.txPackets != prev->c.txPackets && !s_flatSinceMsec)
+    {
+        s_flatSinceMsec = prev->msec;
+        s_flatTxPackets = prev->c.txPackets;
+    }
+
+    if (!s_flatSinceMsec || s_stalled) return 0;
+    if (now - s_flatSinceMsec < LINKMON_STALL_MSEC) return 0;
+    if (c.txPackets - s_flatTxPackets < LINKMON_STALL_TX_PACKETS) return 0;
+
+    s_stalled = 1;
+    s_linkMonStats.stalls++;
+    s_linkMonStats.lastStallMsec = now;
+    LOGW("%s %s stalled, %llu packets sent and nothing received in %lld msec",
+        __FUNCTION__, PPP_IFNAME, c.txPackets - s_flatTxPackets, now - s_flatSinceMsec);
+
+    return 1;
+}
+
+/**
+ * \brief sample task, scheduler thread
+ */
+static void linkMonTask(void *param)
+{
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
+    int stalled = 0;
+
+    // usage is updated in order with link up and down
+    pthread_mutex_lock(&s_linkMonMutex);
+    if (s_linkMonTask >= 0)
+    {
+        stalled = linkSample(fw100NowMsec());
+        fw100UsageUpdate(&s_linkMonStats.counters, 1);
+    }
+    if (stalled && ctx->linkStallReconnect) s_linkMonStats.stallReconnects++;
+    pthread_mutex_unlock(&s_linkMonMutex);
+
+    #if BUILD_DEBUG_1
+    LOGD("%s rx %u tx %u Bps", __FUNCTION__, s_linkMonStats.rxBps, s_linkMonStats.txBps);
+    #endif
+
+    // rather than wait for the far end to give up
+    if (stalled && ctx->linkStallReconnect) fw100DataRestart();
+}
+
+/**
+ * \brief link up or down, netlink listener thread
+ * starts sampling with the link and stops it when the link goes
+ *
+ * \param up - link up with an address
+ */
+void fw100LinkMonLink(int up)
+{
+    int task = -1;
+    long long now = fw100NowMsec();
+
+    pthread_mutex_lock(&s_linkMonMutex);
+
+    if (up && s_linkMonTask < 0)
+    {
+        // a new pppd starts the counters from zero
+        s_nSamples = 0;
+        s_flatSinceMsec = 0;
+        s_stalled = 0;
+        s_linkMonStats.up = 1;
+        s_linkMonStats.rxBps = 0;
+        s_linkMonStats.txBps = 0;
+        s_linkMonStats.rxPeakBps = 0;
+        s_linkMonStats.txPeakBps = 0;
+        memset(&s_linkMonStats.counters, 0, sizeof(s_linkMonStats.counters));
+        s_ifindex = if_nametoindex(PPP_IFNAME);
+        s_linkMonStats.counters.ifindex = s_ifindex;
+        linkSample(now);
+        s_linkMonTask = fw100SchedAdd("linkmon", linkMonTask, NULL,
+            LINKMON_PERIOD_MSEC, LINKMON_SLACK_MSEC);
+        fw100UsageUpdate(&s_linkMonStats.counters, 1);
+    }
+    else if (!up && s_linkMonTask >= 0)
+    {
+        // last counters, from the link message when ppp0 is gone
+        linkSample(now);
+        linkLastCounters();
+        fw100UsageUpdate(&s_linkMonStats.counters, 0);
+        task = s_linkMonTask;
+        s_linkMonTask = -1;
+        s_linkMonStats.up = 0;
+        s_linkMonStats.rxBps = 0;
+        s_linkMonStats.txBps = 0;
+    }
+
+    pthread_mutex_unlock(&s_linkMonMutex);
+
+    if (task >= 0) fw100SchedCancel(task);
+}
+
+/**
+ * \brief link monitor statistics
+ * counters and peaks are of the current or last session
+ */
+void fw100LinkMonStats(fw100LinkMonStats_t *stats)
+{
+    pthread_mutex_lock(&s_linkMonMutex);
+    *stats = s_linkMonStats;
+    pthread_mutex_unlock(&s_linkMonMutex);
+}
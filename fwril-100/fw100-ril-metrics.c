@@ -0,0 +1,508 @@
+/**
+ * \file fw100-ril-metrics.c
+ * \brief latency histograms and live metrics socket
+ *
+ * Latency is recorded in log-linear histograms, one series per AT
+ * command prefix, per RIL request ID, per unsolicited line prefix
+ * and per data port dial step.  Each power of 2 is split in METRICS_HIST_SUB buckets so
+ * percentiles are within 25% at any scale, with fixed memory and
+ * an increment per sample.
+ *
+ * A local UNIX socket serves the series and session gauges to
+ * other processes.  A client connects, writes one request line and
+ * reads until close:
+ *   metrics    Prometheus text exposition format
+ *   snapshot   binary fw100MetricsSnapHdr_t + fw100MetricsSeries_t[]
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#ifdef HAVE_ANDROID_OS
+#include <private/android_filesystem_config.h>
+#endif
+
+#include <fw100-ril.h>
+#include <rilinfo.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+// series table, entries are appended and never removed
+static fw100MetricsSeries_t s_series[METRICS_MAX_SERIES];
+static volatile int s_nSeries;
+static unsigned char s_requestSlot[RRI_RQST_TABLE_SIZE]; // slot + 1
+static pthread_mutex_t s_seriesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static fw100SessionCtx_t *s_ctx;
+static long long s_startMsec;
+
+/**
+ * \brief histogram bucket for a sample
+ * values below METRICS_HIST_SUB are exact, above that each power of
+ * 2 is divided in METRICS_HIST_SUB linear steps
+ */
+static int histBucket(unsigned int usec)
+{
+    int e;
+
+    if (usec < METRICS_HIST_SUB) return usec;
+
+    e = 31 - __builtin_clz(usec);
+    return (e - 1) * METRICS_HIST_SUB + ((usec >> (e - 2)) & (METRICS_HIST_SUB - 1));
+}
+
+/**
+ * \brief largest sample value counted in bucket idx
+ */
+static unsigned int histBucketHigh(int idx)
+{
+    int e;
+    unsigned long long low;
+
+    if (idx < METRICS_HIST_SUB) return idx;
+
+    e = idx / METRICS_HIST_SUB + 1;
+    low = (unsigned long long)(METRICS_HIST_SUB + idx % METRICS_HIST_SUB) << (e - 2);
+    return (unsigned int)(low + (1ULL << (e - 2)) - 1);
+}
+
+static void histAdd(fw100Hist_t *h, unsigned int usec, int err)
+{
+    __sync_fetch_and_add(&h->bucket[histBucket(usec)], 1);
+    __sync_fetch_and_add(&h->sumUsec, usec);
+    if (err) __sync_fetch_and_add(&h->errors, 1);
+    if (usec > h->maxUsec) h->maxUsec = usec;
+    __sync_fetch_and_add(&h->count, 1);
+}
+
+/**
+ * \brief find or append a series
+ * lookup is lock free, append is serialized
+ *
+ * \return series index, or -1 if the table is full
+ */
+static int seriesGet(int kind, int id, const char *name)
+{
+    int i;
+    int n = s_nSeries;
+    fw100MetricsSeries_t *ser;
+
+    for (i = 0; i < n; i++) {
+        ser = &s_series[i];
+        if (ser->kind == kind && ser->id == id && !strcmp(ser->name, name))
+            return i;
+    }
+
+    pthread_mutex_lock(&s_seriesMutex);
+    for (i = n; i < s_nSeries; i++) {
+        ser = &s_series[i];
+        if (ser->kind == kind && ser->id == id && !strcmp(ser->name, name))
+            goto done;
+    }
+    i = -1;
+    if (s_nSeries < METRICS_MAX_SERIES) {
+        i = s_nSeries;
+        ser = &s_series[i];
+        ser->kind = kind;
+        ser->id = id;
+        strncpy(ser->name, name, METRICS_NAME_MAX - 1);
+        __sync_synchronize();
+        s_nSeries++;
+    }
+done:
+    pthread_mutex_unlock(&s_seriesMutex);
+
+    return i;
+}
+
+/**
+ * \brief series name from line prefix
+ * AT commands keep AT, one +^$% sign and the command letters,
+ * e.g. AT+CSQ, AT^GPSLOC, ATD.  URCs end at the first : or ,
+ */
+static void linePrefix(const char *line, char *name, int isAT)
+{
+    int i = 0;
+
+    if (isAT) {
+        while (i < 2 && line[i]) { name[i] = line[i]; i++; }
+        if (line[i] && strchr("+^$%&", line[i])) { name[i] = line[i]; i++; }
+        while (i < METRICS_NAME_MAX - 1 && isalpha((unsigned char)line[i])) {
+            name[i] = line[i];
+            i++;
+        }
+    } else {
+        while (i < METRICS_NAME_MAX - 1 && line[i] && line[i] != ':'
+                && line[i] != ',' && line[i] != ' ') {
+            name[i] = line[i];
+            i++;
+        }
+    }
+    name[i] = '\0';
+}
+
+/**
+ * \brief record AT command latency, command thread
+ * called from the atchannel command complete hook
+ */
+void fw100MetricsAT(const char *command, int err,
+    long long startUsec, long long endUsec)
+{
+    char name[METRICS_NAME_MAX];
+    int i;
+
+    linePrefix(command, name, 1);
+    i = seriesGet(METRICS_KIND_AT, 0, name);
+    if (i >= 0) histAdd(&s_series[i].hist, (unsigned int)(endUsec - startUsec), err < 0);
+}
+
+/**
+ * \brief record RIL request completion latency
+ * called from rilinfo.c when an issued request completes, any thread
+ */
+void fw100MetricsRequest(int request, int err, unsigned int usec)
+{
+    int i;
+
+    if (request <= 0 || request >= RRI_RQST_TABLE_SIZE) return;
+
+    i = s_requestSlot[request] - 1;
+    if (i < 0) {
+        i = seriesGet(METRICS_KIND_REQUEST, request, "");
+        if (i < 0) return;
+        s_requestSlot[request] = i + 1;
+    }
+    histAdd(&s_series[i].hist, usec, err != RIL_E_SUCCESS);
+}
+
+/**
+ * \brief record unsolicited line dispatch time, reader thread
+ */
+void fw100MetricsURC(const char *line, unsigned int usec)
+{
+    char name[METRICS_NAME_MAX];
+    int i;
+
+    linePrefix(line, name, 0);
+    i = seriesGet(METRICS_KIND_URC, 0, name);
+    if (i >= 0) histAdd(&s_series[i].hist, usec, 0);
+}
+
+/**
+ * \brief record data port dial step latency, dial thread
+ * the dialer writes the data port, not the AT channel, so its steps
+ * are kept apart from the AT command series
+ */
+void fw100MetricsDial(const char *command, int err,
+    long long startUsec, long long endUsec)
+{
+    char name[METRICS_NAME_MAX];
+    int i;
+
+    linePrefix(command, name, 1);
+    i = seriesGet(METRICS_KIND_DIAL, 0, name);
+    if (i >= 0) histAdd(&s_series[i].hist, (unsigned int)(endUsec - startUsec), err < 0);
+}
+
+// reply is built in memory and sent with MSG_NOSIGNAL, a client
+// closing early must not raise SIGPIPE in rild
+typedef struct {
+    char *buf;
+    int len;
+    int size;
+} outBuf_t;
+
+static void outWrite(outBuf_t *o, const void *p, int len)
+{
+    char *nbuf;
+
+    if (o->len + len > o->size) {
+        nbuf = realloc(o->buf, o->len + len + 4096);
+        if (NULL == nbuf) return;
+        o->buf = nbuf;
+        o->size = o->len + len + 4096;
+    }
+    memcpy(o->buf + o->len, p, len);
+    o->len += len;
+}
+
+static void outPrintf(outBuf_t *o, const char *fmt, ...)
+{
+    char line[256];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n >= (int)sizeof(line)) n = sizeof(line) - 1;
+    if (n > 0) outWrite(o, line, n);
+}
+
+/**
+ * \brief write one series as a Prometheus histogram
+ */
+static void writeHistText(outBuf_t *f, const char *metric, const char *label,
+    const char *value, const fw100Hist_t *h)
+{
+    int i;
+    unsigned int cum = 0;
+
+    for (i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        if (0 == h->bucket[i]) continue;
+        cum += h->bucket[i];
+        outPrintf(f, "%s_bucket{%s=\"%s\",le=\"%u\"} %u\n",
+            metric, label, value, histBucketHigh(i), cum);
+    }
+    // count from the buckets, a sample may be in flight
+    outPrintf(f, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %u\n", metric, label, value, cum);
+    outPrintf(f, "%s_sum{%s=\"%s\"} %llu\n", metric, label, value, h->sumUsec);
+    outPrintf(f, "%s_count{%s=\"%s\"} %u\n", metric, label, value, cum);
+}
+
+/**
+ * \brief label value of a series, request names without RIL_REQUEST_
+ */
+static const char *seriesLabel(const fw100MetricsSeries_t *ser)
+{
+    const char *value = ser->name;
+
+    if (ser->kind == METRICS_KIND_REQUEST) {
+        value = requestToString(ser->id);
+        if (NULL == value) value = "UNKNOWN";
+        else if (!strncmp(value, "RIL_REQUEST_", 12)) value += 12;
+    }
+    return value;
+}
+
+static void writeText(outBuf_t *f)
+{
+    static const char *metric[] = {
+        "fw100_at_command_usec", "fw100_request_usec", "fw100_urc_dispatch_usec",
+        "fw100_dial_step_usec" };
+    static const char *errorMetric[] = {
+        "fw100_at_command_errors_total", "fw100_request_errors_total",
+        "fw100_urc_dispatch_errors_total", "fw100_dial_step_errors_total" };
+    static const char *label[] = { "cmd", "request", "urc", "cmd" };
+    fw100PrewarmStats_t ps;
+    fw100LinkMonStats_t ls;
+    fw100UsageRecord_t u;
+    fw100DataContext_t dcs[DATA_MAX_CONTEXTS];
+    int kind;
+    int i;
+    int nCalls;
+    int active;
+    int n = s_nSeries;
+
+    outPrintf(f, "# TYPE fw100_uptime_seconds gauge\n");
+    outPrintf(f, "fw100_uptime_seconds %lld\n", (fw100NowMsec() - s_startMsec) / 1000);
+    outPrintf(f, "# TYPE fw100_at_queue_depth gauge\n");
+    outPrintf(f, "fw100_at_queue_depth %d\n", at_get_queue_depth());
+    outPrintf(f, "# TYPE fw100_radio_state gauge\n");
+    outPrintf(f, "fw100_radio_state %d\n", (int)s_ctx->sState);
+    outPrintf(f, "# TYPE fw100_screen_on gauge\n");
+    outPrintf(f, "fw100_screen_on %d\n", s_ctx->screenState == SCREEN_IS_ON);
+    outPrintf(f, "# TYPE fw100_data_call_active gauge\n");
+    outPrintf(f, "fw100_data_call_active %d\n", s_ctx->inDataCall);
+    nCalls = fw100DataContexts(dcs, DATA_MAX_CONTEXTS);
+    for (i = 0, active = 0; i < nCalls; i++)
+        active += (dcs[i].state == DATA_STATE_CONNECTED);
+    outPrintf(f, "# TYPE fw100_data_calls_active gauge\n");
+    outPrintf(f, "fw100_data_calls_active %d\n", active);
+    fw100LinkMonStats(&ls);
+    outPrintf(f, "# TYPE fw100_link_up gauge\n");
+    outPrintf(f, "fw100_link_up %d\n", ls.up);
+    outPrintf(f, "# TYPE fw100_link_rx_bytes_per_second gauge\n");
+    outPrintf(f, "fw100_link_rx_bytes_per_second %u\n", ls.rxBps);
+    outPrintf(f, "# TYPE fw100_link_tx_bytes_per_second gauge\n");
+    outPrintf(f, "fw100_link_tx_bytes_per_second %u\n", ls.txBps);
+    outPrintf(f, "# TYPE fw100_link_errors_total counter\n");
+    outPrintf(f, "fw100_link_errors_total %llu\n", ls.counters.rxErrors + ls.counters.txErrors);
+    outPrintf(f, "# TYPE fw100_link_drops_total counter\n");
+    outPrintf(f, "fw100_link_drops_total %llu\n", ls.counters.rxDropped + ls.counters.txDropped);
+    outPrintf(f, "# TYPE fw100_link_stalls_total counter\n");
+    outPrintf(f, "fw100_link_stalls_total %u\n", ls.stalls);
+    fw100UsageGet(&u);
+    outPrintf(f, "# TYPE fw100_usage_rx_bytes_total counter\n");
+    outPrintf(f, "fw100_usage_rx_bytes_total %llu\n", u.total.rxBytes + u.session.rxBytes);
+    outPrintf(f, "# TYPE fw100_usage_tx_bytes_total counter\n");
+    outPrintf(f, "fw100_usage_tx_bytes_total %llu\n", u.total.txBytes + u.session.txBytes);
+    outPrintf(f, "# TYPE fw100_usage_sessions_total counter\n");
+    outPrintf(f, "fw100_usage_sessions_total %u\n", u.total.sessions);
+    outPrintf(f, "# TYPE fw100_usage_session_seconds gauge\n");
+    outPrintf(f, "fw100_usage_session_seconds %lld\n", u.session.durationSec);
+    outPrintf(f, "# TYPE fw100_usage_session_bytes gauge\n");
+    outPrintf(f, "fw100_usage_session_bytes %llu\n", u.session.rxBytes + u.session.txBytes);
+    fw100DataPrewarmStats(&ps);
+    outPrintf(f, "# TYPE fw100_prewarm_hits_total counter\n");
+    outPrintf(f, "fw100_prewarm_hits_total %u\n", ps.hits);
+    outPrintf(f, "# TYPE fw100_prewarm_misses_total counter\n");
+    outPrintf(f, "fw100_prewarm_misses_total %u\n", ps.misses);
+    outPrintf(f, "# TYPE fw100_prewarm_saved_usec_total counter\n");
+    outPrintf(f, "fw100_prewarm_saved_usec_total %lld\n", ps.savedTotalUsec);
+    outPrintf(f, "# TYPE fw100_signal_notify_total counter\n");
+    outPrintf(f, "fw100_signal_notify_total %u\n", s_ctx->signalNotifyCnt);
+    outPrintf(f, "# TYPE fw100_signal_suppress_total counter\n");
+    outPrintf(f, "fw100_signal_suppress_total %u\n", s_ctx->signalSuppressCnt);
+
+    // each histogram, then its errors and max as families of their own
+    for (kind = METRICS_KIND_AT; kind <= METRICS_KIND_DIAL; kind++) {
+        outPrintf(f, "# TYPE %s histogram\n", metric[kind]);
+        for (i = 0; i < n; i++) {
+            if (s_series[i].kind != kind) continue;
+            writeHistText(f, metric[kind], label[kind], seriesLabel(&s_series[i]),
+                &s_series[i].hist);
+        }
+        outPrintf(f, "# TYPE %s counter\n", errorMetric[kind]);
+        for (i = 0; i < n; i++) {
+            if (s_series[i].kind != kind) continue;
+            outPrintf(f, "%s{%s=\"%s\"} %u\n", errorMetric[kind], label[kind],
+                seriesLabel(&s_series[i]), s_series[i].hist.errors);
+        }
+        outPrintf(f, "# TYPE %s_max gauge\n", metric[kind]);
+        for (i = 0; i < n; i++) {
+            if (s_series[i].kind != kind) continue;
+            outPrintf(f, "%s_max{%s=\"%s\"} %u\n", metric[kind], label[kind],
+                seriesLabel(&s_series[i]), s_series[i].hist.maxUsec);
+        }
+    }
+}
+
+static void writeSnapshot(outBuf_t *f)
+{
+    fw100MetricsSnapHdr_t hdr;
+    int n = s_nSeries;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, METRICS_SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = METRICS_SNAP_VERSION;
+    hdr.nSeries = n;
+    hdr.uptimeMsec = fw100NowMsec() - s_startMsec;
+    hdr.radioState = s_ctx->sState;
+    hdr.queueDepth = at_get_queue_depth();
+    hdr.screenState = s_ctx->screenState;
+    hdr.inDataCall = s_ctx->inDataCall;
+
+    outWrite(f, &hdr, sizeof(hdr));
+    outWrite(f, s_series, n * sizeof(s_series[0]));
+}
+
+/**
+ * \brief metrics socket server thread
+ * one client at a time, each connection serves one request
+ */
+static void *metricsLoop(void *arg)
+{
+    int sfd = (int)(intptr_t)arg;
+    int cfd;
+    int n;
+    int sent;
+    char req[32];
+    struct timeval tv;
+    outBuf_t out;
+
+    for (;;) {
+        cfd = accept(sfd, NULL, NULL);
+        if (cfd < 0) {
+            if (errno == EINTR) continue;
+            LOGE("%s:%d accept %s", __FUNCTION__, __LINE__, strerror(errno));
+            sleep(1);
+            continue;
+        }
+
+        // a client that stops reading cannot hold the thread
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        n = read(cfd, req, sizeof(req) - 1);
+        req[(n > 0) ? n : 0] = '\0';
+
+        memset(&out, 0, sizeof(out));
+        if (!strncmp(req, "snapshot", 8))
+            writeSnapshot(&out);
+        else
+            writeText(&out);
+
+        for (sent = 0; sent < out.len; sent += n) {
+            n = send(cfd, out.buf + sent, out.len - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+        }
+
+        free(out.buf);
+        close(cfd);
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief start latency recording and metrics socket
+ *
+ * \param ctx - session context, read for gauges
+ * \return 0 OK, -1 socket not available (recording continues)
+ */
+int fw100MetricsInit(fw100SessionCtx_t *ctx)
+{
+    struct sockaddr_un addr;
+    pthread_attr_t attr;
+    pthread_t tid;
+    int sfd;
+
+    s_ctx = ctx;
+    s_startMsec = fw100NowMsec();
+
+    sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sfd < 0) goto error;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, RIL_METRICS_SOCKPATH, sizeof(addr.sun_path) - 1);
+    unlink(RIL_METRICS_SOCKPATH);
+
+    if (bind(sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) goto error;
+    if (listen(sfd, 4) < 0) goto error;
+
+    // driver internals, radio group only
+#ifdef HAVE_ANDROID_OS
+    chown(RIL_METRICS_SOCKPATH, -1, AID_RADIO);
+#endif
+    chmod(RIL_METRICS_SOCKPATH, 0660);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&tid, &attr, metricsLoop, (void *)(intptr_t)sfd) != 0)
+        goto error;
+
+    return 0;
+
+error:
+    LOGE("%s:%d metrics socket %s %s", __FUNCTION__, __LINE__,
+        RIL_METRICS_SOCKPATH, strerror(errno));
+    if (sfd >= 0) close(sfd);
+    return -1;
+}
@@ -0,0 +1,581 @@
+/**
+ * \file fw100-ril-netlink.c
+ * \brief rtnetlink link state listener for the ppp interfaces
+ *
+ * A listener thread subscribes to RTMGRP_LINK, RTMGRP_IPV4_IFADDR and
+ * RTMGRP_IPV4_ROUTE and keeps the state of the ppp interfaces, one per
+ * data call context: link flags, local and peer address, and whether
+ * the default route points at it.  On start the current state is read with link, address and
+ * route dumps, after that only kernel events update it.  Every change
+ * is passed to the registered handler on the listener thread, and
+ * fw100LinkWait() waits for a state without polling.
+ *
+ * pppd brings the interface up once IPCP has finished, so link up
+ * with an address is the moment the data call is usable.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+#define LINK_RECV_SIZE	8192
+
+typedef struct {
+    char ifname[IFNAMSIZ];          // "" unused
+    int index;                      // 0 until the interface is seen
+    fw100LinkState_t state;
+    fw100LinkCounters_t counters;   // IFLA_STATS of the last link message
+    unsigned int seen;              // dump stages that reported it, 1 << stage
+} linkIf_t;
+
+static pthread_mutex_t s_linkMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_linkCond = PTHREAD_COND_INITIALIZER;
+static linkIf_t s_links[PPP_MAX_UNITS];
+static int s_nLinks;
+static fw100LinkFunc s_linkFunc;
+static int s_linkStarted;
+
+// initial state dumps, requested one after the other.  what a dump
+// does not report is gone, see linkDumpDone
+static const int s_linkDumps[] = { RTM_GETLINK, RTM_GETADDR, RTM_GETROUTE };
+static int s_linkDumpStage;
+static int s_linkDumpAgain;     // overrun during a dump
+
+#define LINK_DUMP_STAGES	((int)(sizeof(s_linkDumps) / sizeof(s_linkDumps[0])))
+
+#define LINK_SEEN_LINK	0x01
+#define LINK_SEEN_ADDR	0x02
+#define LINK_SEEN_ROUTE	0x04
+
+/**
+ * \brief request a dump of links, addresses or routes
+ * \return 0 OK, -1 error
+ */
+static int linkRequestDump(int fd, int type)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct rtgenmsg gen;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.gen));
+    req.nlh.nlmsg_type = type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq = type;
+    req.gen.rtgen_family = (type == RTM_GETLINK) ? AF_UNSPEC : AF_INET;
+
+    if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0)
+    {
+        LOGE("%s send %s", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief start the dumps, assumes s_linkMutex is held
+ */
+static void linkDumpStart(int fd)
+{
+    int i;
+
+    for (i = 0; i < s_nLinks; i++) s_links[i].seen = 0;
+    s_linkDumpAgain = 0;
+    s_linkDumpStage = 0;
+    linkRequestDump(fd, s_linkDumps[0]);
+}
+
+/**
+ * \brief interface by kernel index or name, assumes s_linkMutex is held
+ * \return link, -1 not one of ours
+ */
+static int linkFind(int index, const char *name)
+{
+    int i;
+
+    for (i = 0; i < s_nLinks; i++)
+    {
+        if (!s_links[i].ifname[0]) continue;
+        if (index && index == s_links[i].index) return i;
+        if (NULL != name && !strcmp(name, s_links[i].ifname)) return i;
+    }
+    return -1;
+}
+
+/**
+ * \brief link message, assumes s_linkMutex is held
+ */
+static void linkParseLink(struct nlmsghdr *nlh, fw100LinkState_t *next)
+{
+    struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+    struct rtattr *rta = IFLA_RTA(ifi);
+    int len = IFLA_PAYLOAD(nlh);
+    const char *name = NULL;
+    const struct rtnl_link_stats *stats = NULL;
+    fw100LinkCounters_t *c;
+    int i;
+
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        if (rta->rta_type == IFLA_IFNAME) name = RTA_DATA(rta);
+        if (rta->rta_type == IFLA_STATS && RTA_PAYLOAD(rta) >= sizeof(*stats))
+            stats = RTA_DATA(rta);
+    }
+
+    // by name first, a deleted interface may come back with a new index
+    i = linkFind(0, name);
+    if (i < 0) i = linkFind(ifi->ifi_index, NULL);
+    if (i < 0) return;
+
+    // a deleted interface's counters are only in its last message
+    if (NULL != stats)
+    {
+        c = &s_links[i].counters;
+        c->rxBytes = stats->rx_bytes;
+        c->txBytes = stats->tx_bytes;
+        c->rxPackets = stats->rx_packets;
+        c->txPackets = stats->tx_packets;
+        c->rxErrors = stats->rx_errors;
+        c->txErrors = stats->tx_errors;
+        c->rxDropped = stats->rx_dropped;
+        c->txDropped = stats->tx_dropped;
+        c->ifindex = ifi->ifi_index;
+    }
+
+    if (nlh->nlmsg_type == RTM_DELLINK)
+    {
+        s_links[i].index = 0;
+        memset(&next[i], 0, sizeof(next[i]));
+        return;
+    }
+
+    s_links[i].index = ifi->ifi_index;
+    s_links[i].seen |= LINK_SEEN_LINK;
+    next[i].flags = ifi->ifi_flags;
+    next[i].up = (ifi->ifi_flags & IFF_UP) ? 1 : 0;
+}
+
+/**
+ * \brief IPv4 address message, assumes s_linkMutex is held
+ */
+static void linkParseAddr(struct nlmsghdr *nlh, fw100LinkState_t *next)
+{
+    struct ifaddrmsg *ifa = NLMSG_DATA(nlh);
+    struct rtattr *rta = IFA_RTA(ifa);
+    int len = IFA_PAYLOAD(nlh);
+    unsigned int local = 0;
+    unsigned int address = 0;
+    const char *label = NULL;
+    int i;
+
+    if (ifa->ifa_family != AF_INET) return;
+
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        switch (rta->rta_type)
+        {
+            case IFA_LOCAL:   memcpy(&local, RTA_DATA(rta), 4); break;
+            case IFA_ADDRESS: memcpy(&address, RTA_DATA(rta), 4); break;
+            case IFA_LABEL:   label = RTA_DATA(rta); break;
+        }
+    }
+
+    i = linkFind(ifa->ifa_index, label);
+    if (i < 0) return;
+    next += i;
+
+    if (nlh->nlmsg_type == RTM_DELADDR)
+    {
+        next->addr = 0;
+        next->mask = 0;
+        next->peer = 0;
+        return;
+    }
+
+    s_links[i].seen |= LINK_SEEN_ADDR;
+
+    // point to point: IFA_LOCAL is ours, IFA_ADDRESS the peer
+    next->addr = local ? local : address;
+    next->peer = (local && address != local) ? address : 0;
+    next->mask = ifa->ifa_prefixlen
+        ? htonl(0xffffffffU << (32 - ifa->ifa_prefixlen)) : 0;
+}
+
+/**
+ * \brief IPv4 default route message, assumes s_linkMutex is held
+ */
+static void linkParseRoute(struct nlmsghdr *nlh, fw100LinkState_t *next)
+{
+    struct rtmsg *rtm = NLMSG_DATA(nlh);
+    struct rtattr *rta = RTM_RTA(rtm);
+    int len = RTM_PAYLOAD(nlh);
+    unsigned int gway = 0;
+    int oif = 0;
+    int i;
+
+    if (rtm->rtm_family != AF_INET || rtm->rtm_dst_len != 0) return;
+
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        switch (rta->rta_type)
+        {
+            case RTA_OIF:     memcpy(&oif, RTA_DATA(rta), 4); break;
+            case RTA_GATEWAY: memcpy(&gway, RTA_DATA(rta), 4); break;
+        }
+    }
+
+    i = oif ? linkFind(oif, NULL) : -1;
+    if (i < 0) return;
+    next += i;
+
+    if (nlh->nlmsg_type == RTM_DELROUTE)
+    {
+        next->defaultRoute = 0;
+        next->gway = 0;
+        return;
+    }
+
+    s_links[i].seen |= LINK_SEEN_ROUTE;
+    next->defaultRoute = 1;
+    next->gway = gway;
+}
+
+/**
+ * \brief end of a dump, assumes s_linkMutex is held
+ * after an overrun the interfaces, addresses and routes that went
+ * away while events were dropped are only missing from the dump
+ *
+ * \param stage - index in s_linkDumps
+ * \param next - state being built
+ */
+static void linkDumpDone(int stage, fw100LinkState_t *next)
+{
+    unsigned int bit = 1 << stage;
+    int i;
+
+    for (i = 0; i < s_nLinks; i++)
+    {
+        if (!s_links[i].ifname[0]) continue;
+
+        if (!(s_links[i].seen & bit))
+        {
+            switch (s_linkDumps[stage])
+            {
+                case RTM_GETLINK:
+                    s_links[i].index = 0;
+                    memset(&next[i], 0, sizeof(next[i]));
+                    break;
+
+                case RTM_GETADDR:
+                    next[i].addr = 0;
+                    next[i].mask = 0;
+                    next[i].peer = 0;
+                    break;
+
+                case RTM_GETROUTE:
+                    next[i].defaultRoute = 0;
+                    next[i].gway = 0;
+                    break;
+            }
+        }
+        s_links[i].seen &= ~bit;
+    }
+}
+
+/**
+ * \brief difference between two states as LINK_CHANGED_ bits
+ */
+static unsigned int linkChanged(const fw100LinkState_t *a, const fw100LinkState_t *b)
+{
+    unsigned int changed = 0;
+
+    if (a->up != b->up || a->flags != b->flags) changed |= LINK_CHANGED_UP;
+    if (a->addr != b->addr || a->mask != b->mask || a->peer != b->peer)
+        changed |= LINK_CHANGED_ADDR;
+    if (a->defaultRoute != b->defaultRoute || a->gway != b->gway)
+        changed |= LINK_CHANGED_ROUTE;
+
+    return changed;
+}
+
+/**
+ * \brief listener thread
+ */
+static void *linkLoop(void *arg)
+{
+    int fd = (int)(long)arg;
+    char *buf;
+    struct nlmsghdr *nlh;
+    fw100LinkState_t next[PPP_MAX_UNITS];
+    unsigned int changed[PPP_MAX_UNITS];
+    fw100LinkFunc func;
+    ssize_t len;
+    int i;
+
+    buf = malloc(LINK_RECV_SIZE);
+    if (NULL == buf) return NULL;
+
+    for (;;)
+    {
+        len = recv(fd, buf, LINK_RECV_SIZE, 0);
+        if (len < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS)
+            {
+                // events were dropped, read the state again.  the
+                // kernel runs one dump at a time, a running one is
+                // followed by another
+                LOGW("%s overrun, dumping state", __FUNCTION__);
+                pthread_mutex_lock(&s_linkMutex);
+                if (s_linkDumpStage < LINK_DUMP_STAGES)
+                    s_linkDumpAgain = 1;
+                else
+                    linkDumpStart(fd);
+                pthread_mutex_unlock(&s_linkMutex);
+                continue;
+            }
+            LOGE("%s recv %s", __FUNCTION__, strerror(errno));
+            sleep(1);
+            continue;
+        }
+
+        pthread_mutex_lock(&s_linkMutex);
+        for (i = 0; i < s_nLinks; i++) next[i] = s_links[i].state;
+
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (unsigned int)len);
+            nlh = NLMSG_NEXT(nlh, len))
+        {
+            switch (nlh->nlmsg_type)
+            {
+                case NLMSG_DONE:
+                    if (s_linkDumpStage >= LINK_DUMP_STAGES
+                        || (int)nlh->nlmsg_seq != s_linkDumps[s_linkDumpStage])
+                        break;
+                    linkDumpDone(s_linkDumpStage, next);
+                    if (++s_linkDumpStage < LINK_DUMP_STAGES)
+                        linkRequestDump(fd, s_linkDumps[s_linkDumpStage]);
+                    else if (s_linkDumpAgain)
+                        linkDumpStart(fd);
+                    break;
+
+                case RTM_NEWLINK:
+                case RTM_DELLINK:
+                    linkParseLink(nlh, next);
+                    break;
+
+                case RTM_NEWADDR:
+                case RTM_DELADDR:
+                    linkParseAddr(nlh, next);
+                    break;
+
+                case RTM_NEWROUTE:
+                case RTM_DELROUTE:
+                    linkParseRoute(nlh, next);
+                    break;
+            }
+        }
+
+        for (i = 0; i < s_nLinks; i++)
+        {
+            changed[i] = linkChanged(&s_links[i].state, &next[i]);
+            if (changed[i])
+            {
+                s_links[i].state = next[i];
+                pthread_cond_broadcast(&s_linkCond);
+            }
+        }
+        func = s_linkFunc;
+        pthread_mutex_unlock(&s_linkMutex);
+
+        for (i = 0; i < s_nLinks; i++)
+        {
+            if (!changed[i]) continue;
+            #if BUILD_DEBUG_1
+            LOGD("%s %s up=%d addr=%08x route=%d changed=%x", __FUNCTION__,
+                s_links[i].ifname, next[i].up, next[i].addr, next[i].defaultRoute, changed[i]);
+            #endif
+            if (NULL != func) func(i, &next[i], changed[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief start the listener for a list of interfaces, once
+ *
+ * \param ifnames - interface names, e.g. "ppp0", NULL entries unused
+ * \param count - list length, up to PPP_MAX_UNITS
+ * \param func - change handler, called on the listener thread with
+ * the index of the interface in the list
+ *
+ * \return 0 OK, -1 error
+ */
+int fw100LinkStart(const char *const *ifnames, int count, fw100LinkFunc func)
+{
+    struct sockaddr_nl addr;
+    pthread_attr_t attr;
+    pthread_t tid;
+    int fd = -1;
+    int i;
+
+    pthread_mutex_lock(&s_linkMutex);
+    if (s_linkStarted) goto done;
+
+    if (count > PPP_MAX_UNITS) count = PPP_MAX_UNITS;
+    for (i = 0; i < count; i++)
+    {
+        if (NULL != ifnames[i])
+            strncpy(s_links[i].ifname, ifnames[i], sizeof(s_links[i].ifname) - 1);
+    }
+    s_nLinks = count;
+    s_linkFunc = func;
+
+    fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (fd < 0)
+    {
+        LOGE("%s socket %s", __FUNCTION__, strerror(errno));
+        goto error;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOGE("%s bind %s", __FUNCTION__, strerror(errno));
+        goto error;
+    }
+
+    s_linkDumpStage = 0;
+    if (linkRequestDump(fd, s_linkDumps[0]) < 0) goto error;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (0 != pthread_create(&tid, &attr, linkLoop, (void *)(long)fd))
+    {
+        LOGE("%s thread %s", __FUNCTION__, strerror(errno));
+        goto error;
+    }
+
+    s_linkStarted = 1;
+    for (i = 0; i < s_nLinks; i++)
+    {
+        if (s_links[i].ifname[0])
+            LOGD("%s listening for %s", __FUNCTION__, s_links[i].ifname);
+    }
+
+done:
+    pthread_mutex_unlock(&s_linkMutex);
+    return 0;
+
+error:
+    if (fd >= 0) close(fd);
+    pthread_mutex_unlock(&s_linkMutex);
+    return -1;
+}
+
+/**
+ * \brief current link state
+ *
+ * \param link - index in the fw100LinkStart list
+ * \param state - returned link state, may be NULL
+ *
+ * \return 1 link up with an address, 0 otherwise
+ */
+int fw100LinkGet(int link, fw100LinkState_t *state)
+{
+    fw100LinkState_t s;
+
+    memset(&s, 0, sizeof(s));
+    pthread_mutex_lock(&s_linkMutex);
+    if (link >= 0 && link < PPP_MAX_UNITS) s = s_links[link].state;
+    pthread_mutex_unlock(&s_linkMutex);
+
+    if (NULL != state) *state = s;
+    return (s.up && s.addr) ? 1 : 0;
+}
+
+/**
+ * \brief interface counters from the last link message
+ * taken when the flags changed or the interface was deleted, so
+ * older than sysfs while the interface is there.  32 bit, they wrap
+ *
+ * \param link - index in the fw100LinkStart list
+ * \param c - returned counters
+ *
+ * \return 0 OK, -1 none seen
+ */
+int fw100LinkGetCounters(int link, fw100LinkCounters_t *c)
+{
+    memset(c, 0, sizeof(*c));
+    pthread_mutex_lock(&s_linkMutex);
+    if (link >= 0 && link < PPP_MAX_UNITS) *c = s_links[link].counters;
+    pthread_mutex_unlock(&s_linkMutex);
+
+    return c->ifindex ? 0 : -1;
+}
+
+/**
+ * \brief wait for a link to come up with an address, or go down
+ *
+ * \param link - index in the fw100LinkStart list
+ * \param up - 1 wait for up with an address, 0 for down or no address
+ * \param timeoutMsec - bound on the wait
+ * \param state - returned link state, may be NULL
+ *
+ * \return 0 reached, -1 timeout or listener not running
+ */
+int fw100LinkWait(int link, int up, int timeoutMsec, fw100LinkState_t *state)
+{
+    long long deadline = fw100NowMsec() + timeoutMsec;
+    fw100LinkState_t *s;
+    int ret = -1;
+
+    if (link < 0 || link >= PPP_MAX_UNITS) return -1;
+    s = &s_links[link].state;
+
+    pthread_mutex_lock(&s_linkMutex);
+    while (s_linkStarted)
+    {
+        if ((s->up && s->addr) == (up != 0))
+        {
+            ret = 0;
+            break;
+        }
+        if (ETIMEDOUT == fw100CondWaitUntil(&s_linkCond, &s_linkMutex, deadline))
+            break;
+    }
+    if (NULL != state) *state = *s;
+    pthread_mutex_unlock(&s_linkMutex);
+
+    return ret;
+}
@@ -0,0 +1,708 @@
+/**
+ * \file fw100-ril-ppp.c
+ * \brief pppd process supervisor
+ *
+ * pppd is spawned directly, without a shell, and with nodetach so it
+ * stays a child of rild.  The supervisor keeps its pid, and a pidfd
+ * where the kernel has pidfd_open, and a reaper thread collects the
+ * exit status as soon as pppd exits: it polls the pidfd, or without
+ * one a pipe written by the SIGCHLD handler.  Only the supervised pid
+ * is waited for, so system() elsewhere in the driver still reaps its
+ * own children.
+ *
+ * Stopping is O(1): SIGTERM to the known pid, a bounded wait for the
+ * reaper, then SIGKILL.  The pid cannot be reused before it is
+ * reaped, so it is safe to signal until the reaper clears it.
+ *
+ * With the driver dialer, a dial thread runs fw100Dial on the data
+ * port and spawns pppd with the connected tty as standard input.  A
+ * failed dial is reported to the exit handler as pppd exit 8, the
+ * code pppd gives when chat fails.  Signalling or stopping pppd while
+ * the dial runs cancels the dial.
+ *
+ * Each data call context has its own unit, pppd unit <unit> makes
+ * ppp<unit>, with its own pid, pidfd and dial thread.  The one reaper
+ * thread polls every unit's pidfd.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+// bionic before API 28 has no posix_spawn
+#ifndef HAVE_ANDROID_OS
+#define BUILD_POSIX_SPAWN	1
+#else
+#define BUILD_POSIX_SPAWN	0
+#endif
+
+#if BUILD_POSIX_SPAWN
+#include <spawn.h>
+extern char **environ;
+#endif
+
+// reaper poll without a pidfd, covers a SIGCHLD taken before the
+// pid was recorded
+#define PPP_REAP_POLL_MSEC	1000
+
+// wait status for a dial that did not get to pppd, pppd/pppd.h codes
+#define PPP_DIAL_STATUS(code)   ((code) << 8)
+#define PPP_EXIT_USER_REQUEST   5
+#define PPP_EXIT_CONNECT_FAILED 8
+
+typedef struct {
+    pid_t pid;                      // -1 not running
+    int pidfd;
+    int exitStatus;                 // wait status, -1 none yet
+    unsigned int starts;
+    int dialing;                    // dial thread running
+    volatile int dialCancel;
+    char dialPath[64];
+    int dialOptions;                // PPP_OPT_* for the dialed pppd
+} pppUnit_t;
+
+// pppd command line, see pppArgs
+typedef struct {
+    char *argv[12];
+    char unit[8];
+    char linkname[16];
+} pppArgv_t;
+
+static pthread_mutex_t s_pppMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_pppCond = PTHREAD_COND_INITIALIZER;
+static pppUnit_t s_pppUnits[PPP_MAX_UNITS] = {
+    [0 ... PPP_MAX_UNITS - 1] = { .pid = -1, .pidfd = -1, .exitStatus = -1 }
+};
+static int s_pppWakePipe[2] = { -1, -1 };
+static int s_pppHavePidfd = -1;      // -1 not probed
+static int s_pppReaperStarted;
+static fw100PppExitFunc s_pppExitFunc;
+
+/**
+ * \brief pidfd for a child, -1 when the kernel has no pidfd_open
+ */
+static int pppPidfdOpen(pid_t pid)
+{
+#ifdef __NR_pidfd_open
+    int fd = syscall(__NR_pidfd_open, pid, 0);
+
+    if (fd >= 0) fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * \brief SIGCHLD handler, wakes the reaper
+ */
+static void pppSigchld(int sig)
+{
+    int saved = errno;
+    char c = 0;
+
+    write(s_pppWakePipe[1], &c, 1);
+    errno = saved;
+}
+
+/**
+ * \brief record pppd exit, assumes s_pppMutex is held
+ */
+static void pppReaped(pppUnit_t *u, int status)
+{
+    if (WIFEXITED(status))
+        LOGD("%s pppd %d exit %d", __FUNCTION__, u->pid, WEXITSTATUS(status));
+    else if (WIFSIGNALED(status))
+        LOGD("%s pppd %d signal %d", __FUNCTION__, u->pid, WTERMSIG(status));
+
+    u->exitStatus = status;
+    u->pid = -1;
+    if (u->pidfd >= 0) close(u->pidfd);
+    u->pidfd = -1;
+
+    pthread_cond_broadcast(&s_pppCond);
+}
+
+/**
+ * \brief reaper thread
+ * waits on the pidfds or the SIGCHLD pipe, then reaps the supervised
+ * pids only
+ */
+static void *pppReaperLoop(void *arg)
+{
+    struct pollfd fds[1 + PPP_MAX_UNITS];
+    char buf[16];
+    int status[PPP_MAX_UNITS];
+    int reaped[PPP_MAX_UNITS];
+    int nfds;
+    int timeout;
+    int i;
+    pppUnit_t *u;
+    fw100PppExitFunc func;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&s_pppMutex);
+        fds[0].fd = s_pppWakePipe[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        nfds = 1;
+        timeout = -1;
+        for (i = 0; i < PPP_MAX_UNITS; i++)
+        {
+            u = &s_pppUnits[i];
+            if (u->pidfd >= 0)
+            {
+                fds[nfds].fd = u->pidfd;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                nfds++;
+            }
+            else if (u->pid > 0)
+            {
+                timeout = PPP_REAP_POLL_MSEC;
+            }
+        }
+        pthread_mutex_unlock(&s_pppMutex);
+
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR)
+        {
+            LOGE("%s poll %s", __FUNCTION__, strerror(errno));
+            sleep(1);
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            while (read(s_pppWakePipe[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+
+        pthread_mutex_lock(&s_pppMutex);
+        for (i = 0; i < PPP_MAX_UNITS; i++)
+        {
+            u = &s_pppUnits[i];
+            reaped[i] = (u->pid > 0 && u->pid == waitpid(u->pid, &status[i], WNOHANG));
+            if (reaped[i]) pppReaped(u, status[i]);
+        }
+        func = s_pppExitFunc;
+        pthread_mutex_unlock(&s_pppMutex);
+
+        // handler may call back into the supervisor
+        for (i = 0; i < PPP_MAX_UNITS && NULL != func; i++)
+        {
+            if (reaped[i]) func(i, status[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief one time setup, assumes s_pppMutex is held
+ * \return 0 OK, -1 error
+ */
+static int pppInit(void)
+{
+    struct sigaction sa;
+    pthread_attr_t attr;
+    pthread_t tid;
+    int fd;
+
+    if (s_pppReaperStarted) return 0;
+
+    if (s_pppWakePipe[0] < 0)
+    {
+        if (pipe(s_pppWakePipe) < 0)
+        {
+            LOGE("%s pipe %s", __FUNCTION__, strerror(errno));
+            return -1;
+        }
+        fcntl(s_pppWakePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(s_pppWakePipe[1], F_SETFL, O_NONBLOCK);
+        fcntl(s_pppWakePipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(s_pppWakePipe[1], F_SETFD, FD_CLOEXEC);
+    }
+
+    // probe pidfd support on ourselves, fall back to SIGCHLD
+    fd = pppPidfdOpen(getpid());
+    s_pppHavePidfd = (fd >= 0);
+    if (fd >= 0) close(fd);
+
+    if (!s_pppHavePidfd)
+    {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = pppSigchld;
+        sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGCHLD, &sa, NULL);
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (0 != pthread_create(&tid, &attr, pppReaperLoop, NULL))
+    {
+        LOGE("%s reaper thread %s", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    LOGD("%s reaper using %s", __FUNCTION__, s_pppHavePidfd ? "pidfd" : "SIGCHLD");
+    s_pppReaperStarted = 1;
+    return 0;
+}
+
+/**
+ * \brief spawn pppd, no shell
+ * the child gets an empty signal mask whatever the calling thread has
+ * blocked, so SIGTERM reaches pppd
+ *
+ * \param stdinFd - dialed tty for pppd's standard input, -1 none
+ *
+ * \return 0 OK, -1 error
+ */
+static int pppSpawn(pid_t *p_pid, char *const argv[], int stdinFd)
+{
+    sigset_t empty;
+#if BUILD_POSIX_SPAWN
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    int err;
+
+    sigemptyset(&empty);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    // dialed tty becomes pppd's terminal
+    posix_spawn_file_actions_init(&actions);
+    if (stdinFd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, stdinFd, 0);
+
+    err = posix_spawn(p_pid, PPPD_PATH, &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0)
+    {
+        LOGE("%s %s %s", __FUNCTION__, PPPD_PATH, strerror(err));
+        return -1;
+    }
+    return 0;
+#else
+    struct sigaction sa;
+    pid_t pid;
+
+    // set up before fork, the child makes async signal safe calls only
+    sigemptyset(&empty);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+
+    pid = fork();
+    if (pid < 0)
+    {
+        LOGE("%s fork %s", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // child, the reaper's SIGCHLD handler and the calling thread's
+        // mask are not pppd's
+        sigaction(SIGCHLD, &sa, NULL);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
+        if (stdinFd >= 0) dup2(stdinFd, 0);
+        execv(PPPD_PATH, argv);
+        _exit(127);
+    }
+    *p_pid = pid;
+    return 0;
+#endif
+}
+
+/**
+ * \brief wait for the supervised pid to be reaped, assumes s_pppMutex
+ * \return 0 reaped, -1 timeout
+ */
+static int pppWaitExit(pppUnit_t *u, pid_t pid, int msec)
+{
+    long long deadline = fw100NowMsec() + msec;
+
+    while (u->pid == pid)
+    {
+        if (ETIMEDOUT == fw100CondWaitUntil(&s_pppCond, &s_pppMutex, deadline))
+            break;
+    }
+
+    return (u->pid == pid) ? -1 : 0;
+}
+
+/**
+ * \brief record a spawned pppd, assumes s_pppMutex is held
+ */
+static void pppStarted(pppUnit_t *u, pid_t pid)
+{
+    char c = 0;
+
+    u->pid = pid;
+    u->pidfd = s_pppHavePidfd ? pppPidfdOpen(pid) : -1;
+    u->starts++;
+
+    // reaper picks up the new pid and pidfd
+    write(s_pppWakePipe[1], &c, 1);
+}
+
+/**
+ * \brief pppd arguments, call <peer> unit <unit> nodetach
+ * linkname ppp<unit>, options after call override the peer file.
+ * each unit has its own linkname, pppd names its pid file and, on
+ * android, its ip-up-<linkname> script after it
+ *
+ * \param a - returned command line
+ * \param options - PPP_OPT_*
+ *
+ * \return a->argv
+ */
+static char **pppArgs(pppArgv_t *a, const char *peer, int unit, int options)
+{
+    char **argv = a->argv;
+    int argc = 0;
+
+    snprintf(a->unit, sizeof(a->unit), "%d", unit);
+    snprintf(a->linkname, sizeof(a->linkname), "ppp%d", unit);
+
+    argv[argc++] = "pppd";
+    #if PLATFORM_X86
+    argv[argc++] = "debug";
+    #endif
+    argv[argc++] = "call";
+    argv[argc++] = (char *)peer;
+    argv[argc++] = "unit";
+    argv[argc++] = a->unit;
+    argv[argc++] = "nodetach";
+    argv[argc++] = "linkname";
+    argv[argc++] = a->linkname;
+    if (options & PPP_OPT_NODEFAULTROUTE) argv[argc++] = "nodefaultroute";
+    argv[argc] = NULL;
+
+    return argv;
+}
+
+/**
+ * \brief dial thread
+ * dials the data port and hands the tty to pppd
+ */
+static void *pppDialLoop(void *arg)
+{
+    int unit = (int)(long)arg;
+    pppUnit_t *u = &s_pppUnits[unit];
+    pppArgv_t args;
+    fw100PppExitFunc func = NULL;
+    int status = -1;
+    pid_t pid;
+    int fd;
+
+    fd = fw100Dial(u->dialPath, &u->dialCancel);
+
+    pthread_mutex_lock(&s_pppMutex);
+
+    if (fd >= 0 && !u->dialCancel)
+    {
+        if (pppSpawn(&pid, pppArgs(&args, PPP_DIALER_PEER, unit, u->dialOptions), fd) == 0)
+        {
+            pppStarted(u, pid);
+            LOGD("%s pppd %d call %s unit %d on %s", __FUNCTION__, pid, PPP_DIALER_PEER,
+                unit, u->dialPath);
+        }
+        else
+        {
+            status = PPP_DIAL_STATUS(PPP_EXIT_CONNECT_FAILED);
+        }
+    }
+    else
+    {
+        status = PPP_DIAL_STATUS(u->dialCancel ? PPP_EXIT_USER_REQUEST : PPP_EXIT_CONNECT_FAILED);
+    }
+
+    // pppd keeps its own copy, closing ours does not hang up
+    if (fd >= 0) close(fd);
+
+    if (status != -1)
+    {
+        u->exitStatus = status;
+        func = s_pppExitFunc;
+    }
+    u->dialing = 0;
+    pthread_cond_broadcast(&s_pppCond);
+    pthread_mutex_unlock(&s_pppMutex);
+
+    // no pppd, report the dial as its exit
+    if (NULL != func) func(unit, status);
+
+    return NULL;
+}
+
+/**
+ * \brief start pppd for a peer, unless the unit is already running
+ * pppd call <devname> unit <unit> nodetach, or with dialPath the
+ * driver dials and runs pppd call fw100-dialer on the connected tty
+ *
+ * \param unit - 0 .. PPP_MAX_UNITS - 1, the interface is ppp<unit>
+ * \param devname - /etc/ppp/peers name
+ * \param dialPath - data port to dial, NULL pppd runs chat
+ * \param options - PPP_OPT_*
+ *
+ * \return
+ * 0 started, dialing or already running
+ * -1 error
+ */
+int fw100PppStart(int unit, const char *devname, const char *dialPath, int options)
+{
+    pppArgv_t args;
+    pid_t pid;
+    pthread_attr_t attr;
+    pthread_t tid;
+    pppUnit_t *u;
+
+    if (unit < 0 || unit >= PPP_MAX_UNITS) return -1;
+    u = &s_pppUnits[unit];
+
+    pthread_mutex_lock(&s_pppMutex);
+
+    if (pppInit() < 0) goto error;
+
+    if (u->pid > 0 || u->dialing)
+    {
+        LOGD("%s pppd %d already running", __FUNCTION__, u->pid);
+        goto done;
+    }
+
+    if (NULL != dialPath)
+    {
+        strncpy(u->dialPath, dialPath, sizeof(u->dialPath) - 1);
+        u->dialCancel = 0;
+        u->dialOptions = options;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (0 != pthread_create(&tid, &attr, pppDialLoop, (void *)(long)unit))
+        {
+            LOGE("%s dial thread %s", __FUNCTION__, strerror(errno));
+            goto error;
+        }
+        u->dialing = 1;
+        LOGD("%s dialing %s", __FUNCTION__, dialPath);
+        goto done;
+    }
+
+    if (pppSpawn(&pid, pppArgs(&args, devname, unit, options), -1) < 0) goto error;
+
+    pppStarted(u, pid);
+    LOGD("%s pppd %d call %s unit %d", __FUNCTION__, pid, devname, unit);
+
+done:
+    pthread_mutex_unlock(&s_pppMutex);
+    return 0;
+
+error:
+    pthread_mutex_unlock(&s_pppMutex);
+    return -1;
+}
+
+/**
+ * \brief cancel a dial and wait for the dial thread, assumes s_pppMutex
+ * \return 0 dial ended, -1 timeout
+ */
+static int pppCancelDial(pppUnit_t *u, int msec)
+{
+    long long deadline = fw100NowMsec() + msec;
+
+    u->dialCancel = 1;
+
+    while (u->dialing)
+    {
+        if (ETIMEDOUT == fw100CondWaitUntil(&s_pppCond, &s_pppMutex, deadline))
+            break;
+    }
+
+    return u->dialing ? -1 : 0;
+}
+
+/**
+ * \brief supervised unit, NULL out of range
+ */
+static pppUnit_t *pppUnit(int unit)
+{
+    if (unit < 0 || unit >= PPP_MAX_UNITS) return NULL;
+    return &s_pppUnits[unit];
+}
+
+/**
+ * \brief stop the supervised pppd of a unit
+ * SIGTERM, wait up to termMsec for it to exit, then SIGKILL
+ *
+ * \param unit - ppp unit
+ * \param termMsec - wait after SIGTERM
+ *
+ * \return
+ * 1 pppd stopped, exit status from fw100PppExitStatus
+ * 0 no supervised pppd running
+ * -1 pppd not reaped after SIGKILL
+ */
+int fw100PppStop(int unit, int termMsec)
+{
+    pppUnit_t *u = pppUnit(unit);
+    pid_t pid;
+    int ret = 1;
+
+    if (NULL == u) return 0;
+
+    pthread_mutex_lock(&s_pppMutex);
+
+    if (u->dialing) pppCancelDial(u, termMsec);
+
+    pid = u->pid;
+    if (pid <= 0)
+    {
+        ret = 0;
+        goto done;
+    }
+
+    kill(pid, SIGTERM);
+    if (pppWaitExit(u, pid, termMsec) < 0)
+    {
+        LOGW("%s pppd %d no exit after %d msec, SIGKILL", __FUNCTION__, pid, termMsec);
+        kill(pid, SIGKILL);
+        if (pppWaitExit(u, pid, PPP_STOP_KILL_MSEC) < 0)
+        {
+            LOGE("%s pppd %d not reaped", __FUNCTION__, pid);
+            ret = -1;
+        }
+    }
+
+done:
+    pthread_mutex_unlock(&s_pppMutex);
+    return ret;
+}
+
+/**
+ * \brief signal the supervised pppd of a unit, does not wait
+ * a dial in progress is cancelled instead
+ * \return 1 signalled, 0 no supervised pppd running
+ */
+int fw100PppSignal(int unit, int sig)
+{
+    pppUnit_t *u = pppUnit(unit);
+    int ret = 0;
+
+    if (NULL == u) return 0;
+
+    pthread_mutex_lock(&s_pppMutex);
+    if (u->pid > 0)
+    {
+        kill(u->pid, sig);
+        ret = 1;
+    }
+    else if (u->dialing)
+    {
+        // dial thread reports the cancel through the exit handler
+        u->dialCancel = 1;
+        ret = 1;
+    }
+    pthread_mutex_unlock(&s_pppMutex);
+
+    return ret;
+}
+
+/**
+ * \brief set the pppd exit handler
+ * called on the reaper thread with the unit and wait status each time
+ * a supervised pppd is reaped
+ */
+void fw100PppSetExitFunc(fw100PppExitFunc func)
+{
+    pthread_mutex_lock(&s_pppMutex);
+    s_pppExitFunc = func;
+    pthread_mutex_unlock(&s_pppMutex);
+}
+
+/**
+ * \brief pppd running or being dialed for a unit
+ * a later fw100PppSignal reaches it, or its exit is reported
+ */
+int fw100PppRunning(int unit)
+{
+    pppUnit_t *u = pppUnit(unit);
+    int running;
+
+    if (NULL == u) return 0;
+
+    pthread_mutex_lock(&s_pppMutex);
+    running = (u->pid > 0 || u->dialing);
+    pthread_mutex_unlock(&s_pppMutex);
+
+    return running;
+}
+
+/**
+ * \brief supervised pppd pid of a unit
+ * \return pid, 0 not running
+ */
+int fw100PppPid(int unit)
+{
+    pppUnit_t *u = pppUnit(unit);
+    int pid;
+
+    if (NULL == u) return 0;
+
+    pthread_mutex_lock(&s_pppMutex);
+    pid = (u->pid > 0) ? u->pid : 0;
+    pthread_mutex_unlock(&s_pppMutex);
+
+    return pid;
+}
+
+/**
+ * \brief last pppd exit of a unit
+ *
+ * \param unit - ppp unit
+ * \param starts - returned number of pppd starts, may be NULL
+ *
+ * \return wait status of the last pppd exit, -1 none yet
+ */
+int fw100PppExitStatus(int unit, unsigned int *starts)
+{
+    pppUnit_t *u = pppUnit(unit);
+    int status = -1;
+
+    if (NULL == u) return -1;
+
+    pthread_mutex_lock(&s_pppMutex);
+    status = u->exitStatus;
+    if (NULL != starts) *starts = u->starts;
+    pthread_mutex_unlock(&s_pppMutex);
+
+    return status;
+}
@@ -73,43 +73,23 @@ static int callFromCLCCLine(char *line, RIL_Call *p_call);
  */
 int isRadioOn()
 {
-    ATResponse *p_response = NULL;
+    fw100PowerInfo_t power;
     int err;
     int stacken;
-    char *line;
-    char display_en, ps_en;
     LOGD("isRadioOn");
-    err = at_send_command_singleline("AT+VPON?", "+VPON:", &p_response);
+    err = at_schema_query(&fw100SchemaVpon, &power);
 
-    if (err < 0 || p_response->success == 0) {
+    if (err < 0) {
         // assume radio is off
-        goto error;
+        return -1;
     }
 
-    line = p_response->p_intermediates->line;
-
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
-
-    err = at_tok_nextbool(&line, &display_en);
-    if (err < 0) goto error;
-
-    err = at_tok_nextbool(&line, &ps_en);
-    if (err < 0) goto error;
-
-    at_response_free(p_response);
-
     // 111007 internal mode workaround
     stacken = 0;
     LOGD("%s isRadioOn ps_en=%d was isnow=%d", 
-		__FUNCTION__, ps_en, stacken);
+		__FUNCTION__, power.ps, stacken);
 
     return (int)stacken;
-
-error:
-
-    at_response_free(p_response);
-    return -1;
 }
 
 /**
@@ -501,31 +481,19 @@ static int getNetworkInfo(char *response[])
 {
     int i;
     int err;
-    int skip;
     int  display;
-    char *mcctoken;
-    char *mnctoken;
-    char mccmnc[32];
+    // response[2] points here after return
+    static char mccmnc[32];
     char *line = NULL;
-    ATResponse *p_response = NULL;
+    fw100MccMnc_t mm;
     ATResponse *p_response2 = NULL;
     fw100SessionCtx_t *ctx = fw100GetSessionCtx();
 
-    err = at_send_command_singleline("AT+VMCCMNC?","+VMCCMNC:",&p_response);
-    if (err != 0 || p_response->success == 0) {
-        goto error;
-    }
-
-    line = p_response->p_intermediates->line;
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
-    err = at_tok_nextint(&line, &skip);
-    if (err < 0) goto error;
-    err = at_tok_nextstr(&line, &mcctoken);
+    memset(&mm, 0, sizeof(mm));
+    err = at_schema_query(&fw100SchemaMccMnc, &mm);
     if (err < 0) goto error;
-    err = at_tok_nextstr(&line, &mnctoken);
 
-    sprintf(mccmnc,"%s%s",mcctoken,mnctoken); // table search string
+    sprintf(mccmnc,"%s%s",mm.mcc,mm.mnc); // table search string
 
     #if BUILD_MCCMNC_WORKAROUND
     // workaround for MCCMNC returned 310,00
@@ -576,17 +544,18 @@ static int getNetworkInfo(char *response[])
     }
 
 done:
-    strncpy(ctx->carrier, response[1], sizeof(ctx->carrier));  // save a copy 
-    if (NULL != p_response)  at_response_free(p_response);
     if (NULL != p_response2) at_response_free(p_response2);
 
-    // update ril status with carrier
-    rilWriteStatus(ctx, RIL_STATUS_FILEPATH);
+    // update ril status with carrier, only on change as the phone
+    // app polls the operator with every service state poll
+    if (strncmp(ctx->carrier, response[1], sizeof(ctx->carrier))) {
+        snprintf(ctx->carrier, sizeof(ctx->carrier), "%s", response[1]);  // save a copy 
+        rilWriteStatus(ctx, RIL_STATUS_FILEPATH);
+    }
 
     return 0;
 
 error:
-    if (NULL != p_response)  at_response_free(p_response);
     if (NULL != p_response2) at_response_free(p_response2);
     return -1;
 }
@@ -713,27 +682,17 @@ void requestRegistrationStateEVDO(int request, void *data,
     int errline = 0;
     int err = 0;
     RIL_Registration_response response;
-    int response_protocolrev = 0;
-    int response_roaming_indicator = 0;
-    ATResponse *p_response_status = NULL;
-    ATResponse *p_response_status_delay = NULL;
-    ATResponse *p_response_protocolrev = NULL;
-    ATResponse *p_response_sidnid = NULL;
-    ATResponse *p_response_roaming = NULL;
-    char *line_status = NULL;
-    char *line_protocolrev = NULL;
-    char *line_sidnid = NULL;
-    char *line_roaming = NULL;
+    fw100RegInfo_t reg;
     char *evdo_rev_a = REGISTRATION_EVDO_REV_A;
     char *cdma_1xrtt = REGISTRATION_CDMA_1XTT;
     char *network_unknown = REGISTRATION_NETWORK_UNKNOWN;
     char *default_roaming_indicator = DEFAULT_ROAMING_INDICATOR;
     char *default_val = REGISTRATION_DEFAULT_VALUE;
     char *default_prl_val = REGISTRATION_DEFAULT_PRL_VALUE;
-    int skip = 0;
 
     // NULL out unused response fields
     memset(&response, 0, sizeof(response));
+    memset(&reg, 0, sizeof(reg));
 
     // Get registration state
     // response
@@ -749,23 +708,13 @@ void requestRegistrationStateEVDO(int request, void *data,
     //    3 registration denied
     //    4 unknown
     // 
-    err = at_send_command_singleline ("AT+CREG?", "+CREG:", &p_response_status);
-    if((err != 0) || (p_response_status->success == 0))
+    err = at_schema_query(&fw100SchemaCreg, &reg);
+    if (err < 0)
     {
         LOGE("%s error in CREG", __FUNCTION__);
 	errline = __LINE__; goto error;
     }
-    line_status = p_response_status->p_intermediates->line;
-    err = at_tok_start(&line_status);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_status, &skip);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_status, &skip);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_status, &skip);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextstr(&line_status, &response.register_state);
-    if (err < 0) {errline = __LINE__; goto error;}
+    response.register_state = reg.status;
 
     // Get protocol revision
     // AT> AT^SYSINFO
@@ -773,27 +722,16 @@ void requestRegistrationStateEVDO(int request, void *data,
     //                    ^ ^
     //            roam ---| |---protocol
     //
-    err = at_send_command_singleline ("AT^SYSINFO", "^SYSINFO:", &p_response_protocolrev);
-    if((err != 0) || (p_response_protocolrev->success == 0))
+    err = at_schema_query(&fw100SchemaSysinfo, &reg);
+    if (err < 0)
     {
         LOGE("%s error in SYSINFO", __FUNCTION__);
 	errline = __LINE__; goto error;
     }
-    line_protocolrev = p_response_protocolrev->p_intermediates->line;
-    err = at_tok_start(&line_protocolrev);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_protocolrev, &skip);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_protocolrev, &skip);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_protocolrev, &response_roaming_indicator);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_protocolrev, &response_protocolrev);
-    if (err < 0) {errline = __LINE__; goto error;}
-
-    if (response_protocolrev == 8 || response_protocolrev == 4) {
+
+    if (reg.protocol == 8 || reg.protocol == 4) {
        response.radio_technology = evdo_rev_a;
-    } else if (response_protocolrev == 2){
+    } else if (reg.protocol == 2){
        response.radio_technology =  cdma_1xrtt;
     } else {
         response.radio_technology =  network_unknown;
@@ -807,40 +745,29 @@ void requestRegistrationStateEVDO(int request, void *data,
         response.radio_technology = "3";  
 
     // toggle the sense of roaming indicator
-    if(response_roaming_indicator == 1)
+    if(reg.roam == 1)
         response.roaming_indicator = "0";
     else
         response.roaming_indicator = "1";
        
     // Get System ID and Network ID
-    err = at_send_command_singleline ("AT+CSNID?", "+CSNID:", &p_response_sidnid);
-    if((err != 0) || (p_response_sidnid->success == 0))
+    err = at_schema_query(&fw100SchemaCsnid, &reg);
+    if (err < 0)
     {
         LOGE("%s error in CSNID", __FUNCTION__);
 	errline = __LINE__; goto error;
     }
-    line_sidnid = p_response_sidnid->p_intermediates->line;
-    err = at_tok_start(&line_sidnid);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextstr(&line_sidnid, &response.system_id);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextstr(&line_sidnid, &response.network_id);
-    if (err < 0) {errline = __LINE__; goto error;}
+    response.system_id = reg.sid;
+    response.network_id = reg.nid;
     
     // Get TSB-58 Roaming Indicator
-    err = at_send_command_singleline ("AT+VROM?", "+VROM:", &p_response_roaming);
-    if((err != 0) || (p_response_roaming->success == 0))
+    err = at_schema_query(&fw100SchemaVrom, &reg);
+    if (err < 0)
     {
         LOGE("%s error in VROM", __FUNCTION__);
 	errline = __LINE__; goto error;
     }
-    line_roaming = p_response_roaming->p_intermediates->line;
-    err = at_tok_start(&line_roaming);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextint(&line_roaming, &skip);
-    if (err < 0) {errline = __LINE__; goto error;}
-    err = at_tok_nextstr(&line_roaming, &response.roaming_indicator);
-    if (err < 0) {errline = __LINE__; goto error;}
+    response.roaming_indicator = reg.romIndicator;
     if(atoi(response.roaming_indicator) > 12)
     {
         response.roaming_indicator = DEFAULT_ROAMING_INDICATOR;
@@ -862,20 +789,11 @@ void requestRegistrationStateEVDO(int request, void *data,
     #endif
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(response));
-
-    at_response_free(p_response_status);
-    at_response_free(p_response_protocolrev);
-    at_response_free(p_response_sidnid);
-    at_response_free(p_response_roaming);
     return;
     
 error:
     LOGE("%s error at line %d while radio is on", __FUNCTION__, errline);
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-    at_response_free(p_response_status);
-    at_response_free(p_response_protocolrev);
-    at_response_free(p_response_sidnid);
-    at_response_free(p_response_roaming);
 }
 
 /**
@@ -938,7 +856,6 @@ void requestSetPreferredNetworkType(void *data, size_t datalen, RIL_Token t)
     char *line = NULL;
     int mode = ((int*)data)[0];
     int value = 0;
-    char *cmd;
 
     LOGD("%s mode=%d", __FUNCTION__, mode);
 
@@ -955,9 +872,7 @@ void requestSetPreferredNetworkType(void *data, size_t datalen, RIL_Token t)
         default:
             goto error;
     }
-    asprintf(&cmd, "AT^PREFMODE=%d", value);
-    err = at_send_command(cmd, NULL);
-    free(cmd);
+    err = at_send_template(&fw100CmdPrefMode, NULL, value);
 
     if (err != 0) goto error;
 
@@ -985,61 +900,25 @@ error:
  */
 void requestSignalStrengthEVDO(void *data, size_t datalen, RIL_Token t)
 {
-    ATResponse *p_response = NULL;
-    ATResponse *p_response_hdr = NULL;
-    ATResponse *p_response_cdma_ecio = NULL;
     int err = 0;
-    int err_netpar = 0;
-    int skip = 0;
-    int i = 9;
     int response[7] = {0};
-    char *line = NULL;
-    char *line_hdr = NULL;
-    char *line_cdma_ecio = NULL;
-    
-    err = at_send_command_singleline("AT+CSQ", "+CSQ:", &p_response);
+    fw100SignalInfo_t sig;
 
-    if ((err != 0) || (p_response->success == 0)) {
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        goto error;
-    }
-
-    line = p_response->p_intermediates->line;
+    memset(&sig, 0, sizeof(sig));
 
-    err = at_tok_start(&line);
+    err = at_schema_query(&fw100SchemaCsq, &sig);
     if (err < 0) goto error;
+    response[2] = sig.rssi;
 
-    err = at_tok_nextint(&line, &(response[2]));
+    err = at_schema_query(&fw100SchemaHdrCsq, &sig);
     if (err < 0) goto error;
+    response[4] = sig.hdr;
 
-    err = at_send_command_singleline("AT^HDRCSQ", "^HDRCSQ:", &p_response_hdr);
-
-    if ((err != 0) || (p_response_hdr->success == 0)) {
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        goto error;
-    }
-    line_hdr = p_response_hdr->p_intermediates->line;
-    err = at_tok_start(&line_hdr);
-    if (err < 0) goto error;
-
-    err = at_tok_nextint(&line_hdr, &(response[4]));
-    if (err < 0) goto error;
-
-    err_netpar = at_send_command_singleline ("AT+NETPAR=0", "+NETPAR:", &p_response_cdma_ecio);
-    if((err_netpar != 0) || (p_response_cdma_ecio->success == 0)) {
+    if (at_schema_query(&fw100SchemaNetpar, &sig) < 0) {
         response[3] = CDMA_ECIO_DEFAULT;
     }
     else {
-        line_cdma_ecio = p_response_cdma_ecio->p_intermediates->line;
-        err = at_tok_start(&line_cdma_ecio);
-        if (err < 0) goto error;
-        while(i) {
-            err = at_tok_nextint(&line_cdma_ecio, &skip);
-            if (err < 0) goto error;
-            i--;
-        }
-        err = at_tok_nextint(&line_cdma_ecio, &( response[3]));
-        if (err < 0) goto error;
+        response[3] = sig.ecio;
     }
     response[0] = SIGNAL_STRENGTH_DEFAULT;
     response[1] = SIGNAL_STRENGTH_DEFAULT;
@@ -1076,14 +955,11 @@ void requestSignalStrengthEVDO(void *data, size_t datalen, RIL_Token t)
     LOGD("before requestSignalStrength, evdo_dbm = %d, evdo_ecio = %d, evdo_ratio = %d",evdo_dbm,evdo_ecio,evdo_ratio);
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, response, sizeof(response));
-
-    at_response_free(p_response);
     return;
 
 error:
     LOGE("%s requestSignalStrength must never return an error when radio is on", __FUNCTION__);
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-    at_response_free(p_response);
 }
 
 /**
@@ -1106,7 +982,7 @@ void requestScreenState(void *data, size_t datalen, RIL_Token t)
   int err, screenState;
   fw100SessionCtx_t *ctx = fw100GetSessionCtx();
  
-  assert (datalen >= sizeof(int *));
+  assert (datalen >= sizeof(int));
   screenState = ((int*)data)[0];
   if(screenState == 1)
   {
@@ -1144,6 +1020,9 @@ void requestScreenState(void *data, size_t datalen, RIL_Token t)
 
   RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
 
+  // start or drop a pre-warmed data link
+  fw100DataPrewarm();
+
   return;
 
 error:
@@ -1175,7 +1054,6 @@ void requestSendSMSEVDO(void *data, size_t datalen, RIL_Token t)
     const char *smsc;
     char *pdu;
     int tpLayerLength;
-    char *cmd1;
     RIL_SMS_Response response;
     ATResponse *p_response = NULL;
 
@@ -1204,11 +1082,8 @@ void requestSendSMSEVDO(void *data, size_t datalen, RIL_Token t)
     sprintf(tmp, "smsc=%s pdu=%s ctrlz=%d nulsmsc=%d\n", smsc, pdu, ctrlz, nulsmsc);
     LOGD("%s started %s", __FUNCTION__, tmp);
 
-    asprintf(&cmd1, "AT^HCMGS=%s", smsc);
-
-    err = at_send_command_sms(cmd1, pdu, "^HCMGS:", &p_response);
+    err = at_send_template_sms(&fw100CmdSendSms, pdu, &p_response, smsc);
 
-    free(cmd1);
     if (err != 0 || p_response->success == 0)
     {
         goto error;
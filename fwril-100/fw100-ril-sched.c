@@ -0,0 +1,331 @@
+/** 
+ * \file fw100-ril-sched.c 
+ * \brief wakeup coalescing scheduler for periodic modem work
+ *
+ * Every AT command wakes the USB modem out of suspend and the CPU
+ * out of idle.  Periodic and deferrable work is registered here with
+ * a period and a slack.  A task is due at its period but may run up
+ * to slack msec late, so the scheduler sleeps until the earliest
+ * deadline and then runs every task whose window has opened in the
+ * same batch.  Periodic tasks re-arm from the batch time, so tasks
+ * that have been batched once stay aligned.
+ *
+ * The scheduler loop runs on the mainLoop thread.  Tasks may issue
+ * AT commands.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+#define MAX_SCHED_TASKS     16
+#define MAX_SCHED_OVERRIDES 16
+#define MAX_SCHED_NAME      24
+
+typedef struct
+{
+    int active;
+    char name[MAX_SCHED_NAME];
+    fw100SchedFunc func;
+    void *param;
+    int periodMsec;      // zero for one shot
+    int slackMsec;
+    long long dueMsec;   // monotonic
+} schedTask_t;
+
+typedef struct
+{
+    char name[MAX_SCHED_NAME];
+    int slackMsec;
+} schedOverride_t;
+
+static pthread_mutex_t s_schedMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_schedCond = PTHREAD_COND_INITIALIZER;
+static schedTask_t s_tasks[MAX_SCHED_TASKS];
+static schedOverride_t s_overrides[MAX_SCHED_OVERRIDES];
+static int s_schedWake;
+
+// wakeup accounting
+static long long s_schedStartMsec;
+static unsigned int s_schedWakeups;
+static unsigned int s_schedTaskRuns;
+
+/**
+ * \brief look up control file slack override for a task
+ * assumes s_schedMutex is held
+ */
+static int schedSlackFor(const char *name, int slackMsec)
+{
+    int i;
+
+    for (i = 0; i < MAX_SCHED_OVERRIDES; i++)
+    {
+        if (s_overrides[i].name[0] && !strcmp(s_overrides[i].name, name))
+            return s_overrides[i].slackMsec;
+    }
+    return slackMsec;
+}
+
+/**
+ * \brief set slack for a named task
+ * used by rilReadControl for Slack.<name>=msec entries.
+ * applies to a task already registered and to later registrations.
+ *
+ * \param name - task name
+ * \param slackMsec - allowed lateness in msec
+ */
+void fw100SchedSetSlack(const char *name, int slackMsec)
+{
+    int i;
+    int slot = -1;
+
+    if (slackMsec < 0) return;
+
+    pthread_mutex_lock(&s_schedMutex);
+
+    for (i = 0; i < MAX_SCHED_OVERRIDES; i++)
+    {
+        if (!strcmp(s_overrides[i].name, name)) { slot = i; break; }
+        if (slot < 0 && !s_overrides[i].name[0]) slot = i;
+    }
+    if (slot >= 0)
+    {
+        strncpy(s_overrides[slot].name, name, MAX_SCHED_NAME-1);
+        s_overrides[slot].slackMsec = slackMsec;
+    }
+
+    for (i = 0; i < MAX_SCHED_TASKS; i++)
+    {
+        if (s_tasks[i].active && !strcmp(s_tasks[i].name, name))
+            s_tasks[i].slackMsec = slackMsec;
+    }
+
+    pthread_mutex_unlock(&s_schedMutex);
+}
+
+/**
+ * \brief register a task
+ *
+ * \param name - task name for diagnostics and slack override
+ * \param func - task function, called on scheduler thread
+ * \param param - task parameter
+ * \param delayMsec - first due time from now
+ * \param periodMsec - repeat period, zero for one shot
+ * \param slackMsec - allowed lateness used to batch with other tasks
+ *
+ * \return
+ * task id >= 0, or -1 if task table is full
+ */
+static int schedAdd(const char *name, fw100SchedFunc func, void *param,
+    int delayMsec, int periodMsec, int slackMsec)
+{
+    int i;
+    int id = -1;
+
+    pthread_mutex_lock(&s_schedMutex);
+
+    for (i = 0; i < MAX_SCHED_TASKS; i++)
+    {
+        if (!s_tasks[i].active)
+        {
+            schedTask_t *task = &s_tasks[i];
+            memset(task, 0, sizeof(*task));
+            strncpy(task->name, name, MAX_SCHED_NAME-1);
+            task->func = func;
+            task->param = param;
+            task->periodMsec = periodMsec;
+            task->slackMsec = schedSlackFor(name, slackMsec);
+            task->dueMsec = fw100NowMsec() + delayMsec;
+            task->active = 1;
+            id = i;
+            break;
+        }
+    }
+
+    // new deadline may be earlier than the current sleep
+    s_schedWake = 1;
+    pthread_cond_signal(&s_schedCond);
+    pthread_mutex_unlock(&s_schedMutex);
+
+    if (id < 0) LOGE("%s task table full, %s dropped", __FUNCTION__, name);
+    return id;
+}
+
+/**
+ * \brief register a periodic task, first due one period from now
+ */
+int fw100SchedAdd(const char *name, fw100SchedFunc func, void *param,
+    int periodMsec, int slackMsec)
+{
+    return schedAdd(name, func, param, periodMsec, periodMsec, slackMsec);
+}
+
+/**
+ * \brief register a one shot deferrable task
+ */
+int fw100SchedOnce(const char *name, fw100SchedFunc func, void *param,
+    int delayMsec, int slackMsec)
+{
+    return schedAdd(name, func, param, delayMsec, 0, slackMsec);
+}
+
+/**
+ * \brief cancel a task by id
+ */
+void fw100SchedCancel(int id)
+{
+    if (id < 0 || id >= MAX_SCHED_TASKS) return;
+
+    pthread_mutex_lock(&s_schedMutex);
+    s_tasks[id].active = 0;
+    pthread_mutex_unlock(&s_schedMutex);
+}
+
+/**
+ * \brief wake scheduler loop early
+ * used when session is closed so mainLoop can re-open promptly
+ */
+void fw100SchedWake(void)
+{
+    pthread_mutex_lock(&s_schedMutex);
+    s_schedWake = 1;
+    pthread_cond_signal(&s_schedCond);
+    pthread_mutex_unlock(&s_schedMutex);
+}
+
+/**
+ * \brief wait until deadline or wake, assumes s_schedMutex held
+ */
+static void schedWait(long long deadlineMsec)
+{
+    if (deadlineMsec <= fw100NowMsec()) return;
+
+    while (!s_schedWake)
+    {
+        if (ETIMEDOUT == fw100CondWaitUntil(&s_schedCond, &s_schedMutex, deadlineMsec))
+            break;
+    }
+}
+
+/**
+ * \brief scheduler loop
+ * sleep to the earliest task deadline, then run every task 
+ * that is due in one batch.  returns when session is closed.
+ *
+ * \param ctx - ril driver session context
+ */
+void fw100SchedRun(fw100SessionCtx_t *ctx)
+{
+    int i;
+    int ran;
+    long long now;
+    long long deadline;
+    schedTask_t batch[MAX_SCHED_TASKS];
+    int nbatch;
+
+    if (!s_schedStartMsec) s_schedStartMsec = fw100NowMsec();
+
+    while (!ctx->s_closed)
+    {
+        pthread_mutex_lock(&s_schedMutex);
+
+        // earliest deadline is the end of the tightest window
+        deadline = fw100NowMsec() + 60000;
+        for (i = 0; i < MAX_SCHED_TASKS; i++)
+        {
+            if (s_tasks[i].active 
+                && s_tasks[i].dueMsec + s_tasks[i].slackMsec < deadline)
+                deadline = s_tasks[i].dueMsec + s_tasks[i].slackMsec;
+        }
+
+        s_schedWake = 0;
+        schedWait(deadline);
+
+        // collect every task whose window has opened
+        now = fw100NowMsec();
+        nbatch = 0;
+        for (i = 0; i < MAX_SCHED_TASKS; i++)
+        {
+            schedTask_t *task = &s_tasks[i];
+            if (!task->active || task->dueMsec > now) continue;
+
+            batch[nbatch++] = *task;
+            if (task->periodMsec)
+            {
+                // from the previous due time, slack does not add up
+                // over periods.  periods missed altogether are skipped
+                task->dueMsec += task->periodMsec;
+                if (task->dueMsec <= now)
+                    task->dueMsec += ((now - task->dueMsec) / task->periodMsec + 1)
+                        * task->periodMsec;
+            }
+            else
+            {
+                task->active = 0;
+            }
+        }
+
+        if (nbatch)
+        {
+            s_schedWakeups++;
+            s_schedTaskRuns += nbatch;
+        }
+
+        pthread_mutex_unlock(&s_schedMutex);
+
+        // run outside the lock, tasks may add or cancel tasks
+        for (ran = 0; ran < nbatch; ran++)
+        {
+            if (ctx->s_closed) break;
+            #if BUILD_DEBUG_1
+            LOGD("%s run %s", __FUNCTION__, batch[ran].name);
+            #endif
+            batch[ran].func(batch[ran].param);
+        }
+    }
+}
+
+/**
+ * \brief scheduler wakeup statistics
+ *
+ * \param wakeups - returned batch wakeups since start
+ * \param runs - returned task runs since start
+ *
+ * \return
+ * wakeups per hour since scheduler start
+ */
+unsigned int fw100SchedWakeupsPerHour(unsigned int *wakeups, unsigned int *runs)
+{
+    long long elapsed;
+    unsigned int rate = 0;
+
+    pthread_mutex_lock(&s_schedMutex);
+    elapsed = fw100NowMsec() - s_schedStartMsec;
+    if (s_schedStartMsec && elapsed > 0)
+        rate = (unsigned int)((long long)s_schedWakeups * 3600000LL / elapsed);
+    if (wakeups) *wakeups = s_schedWakeups;
+    if (runs) *runs = s_schedTaskRuns;
+    pthread_mutex_unlock(&s_schedMutex);
+
+    return rate;
+}
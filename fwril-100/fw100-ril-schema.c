@@ -0,0 +1,86 @@
+/**
+ * \file fw100-ril-schema.c
+ * \brief AT response schemas and command templates for the fw100 modem
+ *
+ * Field positions count from 0 after the prefix, e.g.
+ *   +CREG:1,4145,7,1          status is field 3
+ *   ^SYSINFO:2,255,0,8,240    roam 2, protocol 3
+ *   +NETPAR:0,1,283,4145,7,384,2,-75,-80,-7,0   ecio is field 9
+ *
+ * Command templates are sent with at_send_template, the slot
+ * arguments follow the response pointer in format order.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+#include <fw100-ril.h>
+
+// registration, requestRegistrationStateEVDO
+AT_SCHEMA(fw100SchemaCreg, "AT+CREG?", "+CREG:",
+    AT_FIELD_STR(fw100RegInfo_t, status, 3));
+
+AT_SCHEMA(fw100SchemaSysinfo, "AT^SYSINFO", "^SYSINFO:",
+    AT_FIELD_INT(fw100RegInfo_t, roam, 2),
+    AT_FIELD_INT(fw100RegInfo_t, protocol, 3));
+
+AT_SCHEMA(fw100SchemaCsnid, "AT+CSNID?", "+CSNID:",
+    AT_FIELD_STR(fw100RegInfo_t, sid, 0),
+    AT_FIELD_STR(fw100RegInfo_t, nid, 1));
+
+AT_SCHEMA(fw100SchemaVrom, "AT+VROM?", "+VROM:",
+    AT_FIELD_STR(fw100RegInfo_t, romIndicator, 1));
+
+// signal strength
+AT_SCHEMA(fw100SchemaCsq, "AT+CSQ", "+CSQ:",
+    AT_FIELD_INT(fw100SignalInfo_t, rssi, 0),
+    AT_FIELD_INT(fw100SignalInfo_t, ber, 1));
+
+AT_SCHEMA(fw100SchemaHdrCsq, "AT^HDRCSQ", "^HDRCSQ:",
+    AT_FIELD_INT(fw100SignalInfo_t, hdr, 0));
+
+AT_SCHEMA(fw100SchemaNetpar, "AT+NETPAR=0", "+NETPAR:",
+    AT_FIELD_INT(fw100SignalInfo_t, ecio, 9));
+
+// radio power, isRadioOn
+AT_SCHEMA(fw100SchemaVpon, "AT+VPON?", "+VPON:",
+    AT_FIELD_BOOL(fw100PowerInfo_t, display, 0),
+    AT_FIELD_BOOL(fw100PowerInfo_t, ps, 1));
+
+// operator, getNetworkInfo.  the mnc was never checked
+AT_SCHEMA(fw100SchemaMccMnc, "AT+VMCCMNC?", "+VMCCMNC:",
+    AT_FIELD_STR(fw100MccMnc_t, mcc, 1),
+    AT_FIELD_STR_OPT(fw100MccMnc_t, mnc, 2));
+
+// call end, fail cause.  unsolicited, there is no query
+AT_SCHEMA(fw100SchemaCend, "", "^CEND:",
+    AT_FIELD_INT(fw100CallEnd_t, callId, 0),
+    AT_FIELD_INT(fw100CallEnd_t, duration, 1),
+    AT_FIELD_INT(fw100CallEnd_t, endStatus, 2),
+    AT_FIELD_INT_OPT(fw100CallEnd_t, ccCause, 3));
+
+// command templates
+const ATCommandTemplate fw100CmdDial = { "ATD%s%s;", NO_RESULT, NULL };
+const ATCommandTemplate fw100CmdHangup = { "AT+CHLD=1%d", NO_RESULT, NULL };
+const ATCommandTemplate fw100CmdDtmf = { "AT+VTS=%c", NO_RESULT, NULL };
+const ATCommandTemplate fw100CmdWriteSms = { "AT+CMGW=%d,%d", SINGLELINE, "+CMGW:" };
+const ATCommandTemplate fw100CmdSendSms = { "AT^HCMGS=%s", SINGLELINE, "^HCMGS:" };
+const ATCommandTemplate fw100CmdDeleteSms = { "AT+CMGD=%d", NO_RESULT, NULL };
+const ATCommandTemplate fw100CmdSimIo = { "AT+CRSM=%d,%d,%d,%d,%d", SINGLELINE, "+CRSM:" };
+const ATCommandTemplate fw100CmdSimIoData = { "AT+CRSM=%d,%d,%d,%d,%d,%s", SINGLELINE, "+CRSM:" };
+const ATCommandTemplate fw100CmdPin = { "AT+CPIN=%s", SINGLELINE, "+CPIN:" };
+const ATCommandTemplate fw100CmdPin2 = { "AT+CPIN=%s,%s", SINGLELINE, "+CPIN:" };
+const ATCommandTemplate fw100CmdPrefMode = { "AT^PREFMODE=%d", NO_RESULT, NULL };
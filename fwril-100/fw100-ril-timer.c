@@ -36,12 +36,40 @@
 
 #include <fw100-ril.h>
 #include <rilinfo.h>
+#include <rillog.h>
 
 // build options
 #define BUILD_DEBUG_1	0
 
-static char pollSavedCREG[64];
-static char pollSavedCSQ[64];
+// last notified registration fields
+static int pollSavedRegValid = 0;
+static int pollSavedRegStat;
+static int pollSavedRegSid;
+static int pollSavedRegNid;
+
+// last notified signal strength
+static int pollSavedSignalValid = 0;
+static int pollSavedSignalDbm;
+static int pollSavedSignalBars;
+static long long pollSavedSignalMsec;
+
+/**
+ * \brief map CSQ rssi to signal bar level
+ * same thresholds as the phone app uses for GSM asu
+ *
+ * \param rssi - CSQ rssi 0..31, 99 unknown
+ *
+ * \return
+ * bar level 0..4
+ */
+static int rssiToBars(int rssi)
+{
+    if (rssi <= 2 || rssi == 99) return 0;
+    if (rssi >= 12) return 4;
+    if (rssi >= 8)  return 3;
+    if (rssi >= 5)  return 2;
+    return 1;
+}
 
 /**
  * \brief get registration state
@@ -65,13 +93,17 @@ static char pollSavedCSQ[64];
  * RIL_REQUEST_GPRS_REGISTRATION_STATE
  * RIL_REQUEST_OPERATOR
  *
+ * n.b. fw100 fields are n,sid,nid,stat.  Only sid, nid and stat
+ * are compared, so a change of the URC mode n does not notify.
+ *
  * "data" is NULL
  */ 
 void pollNetworkRegistration()
 {
     int err;
-    int max;
+    int n, sid, nid, stat;
     char *line;
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
     ATResponse *p_response = NULL;
 
     // Get registration state
@@ -83,22 +115,45 @@ void pollNetworkRegistration()
 
     line = p_response->p_intermediates->line;
 
-    // if no change in CREG then return
-    max = (strlen(line) > sizeof(pollSavedCREG)) ? sizeof(pollSavedCREG) : strlen(line);
-    if (!strncmp(pollSavedCREG, line, max))
-      return;
+    err = at_tok_start(&line);
+    if (err < 0) goto error;
+    err = at_tok_nextint(&line, &n);
+    if (err < 0) goto error;
+    err = at_tok_nextint(&line, &sid);
+    if (err < 0) goto error;
+    err = at_tok_nextint(&line, &nid);
+    if (err < 0) goto error;
+    err = at_tok_nextint(&line, &stat);
+    if (err < 0) goto error;
+
+    // if no change in registration fields then return
+    if (pollSavedRegValid
+        && stat == pollSavedRegStat
+        && sid == pollSavedRegSid
+        && nid == pollSavedRegNid)
+    {
+        ctx->regSuppressCnt++;
+        goto error;
+    }
 
     // save a copy 
-    strncpy(pollSavedCREG, line, sizeof(pollSavedCREG));
+    pollSavedRegValid = 1;
+    pollSavedRegStat = stat;
+    pollSavedRegSid = sid;
+    pollSavedRegNid = nid;
+    ctx->regNotifyCnt++;
 
-    #if BUILD_DEBUG_1
-    LOGD("%s pollSavedCREG=%s", __FUNCTION__, pollSavedCREG);
-    #endif
+    RLOG(RLOG_SS_TIMER, RLOG_VERBOSE, "pollNetworkRegistration stat=%d sid=%d nid=%d",
+        stat, sid, nid, 0);
 
     // notification but no data is in notification.
     // Phone app makes sync RIL request calls when notified.
     RIL_onUnsolicitedResponse (RIL_UNSOL_RESPONSE_NETWORK_STATE_CHANGED, NULL, 0);
 
+    // 1 registered home, 5 registered roaming
+    ctx->networkRegistered = (1 == stat || 5 == stat);
+    fw100DataPrewarm();
+
     if (NULL != p_response) at_response_free(p_response);
     return;
 
@@ -125,55 +180,65 @@ error:
  * RIL_EVDO_SignalStrength EVDO_SignalStrength;
  * } RIL_SignalStrength;
  * 
+ * notification filter: each poll wakes the phone process, so
+ * one step RSSI jitter is suppressed.  Notify when dBm moves more
+ * than ctx->signalDeadBand (or bar level changes if ctx->signalBarsOnly)
+ * and at least ctx->signalMinInterval seconds since last notify.
+ *
  * n.b. see fw100-ril-rqst.c requestSignalStrengthEVDO 
  * for EVDO aware version of this function.
  */
 static void pollSignalStrength()
 {
-    int max;
     int err;
+    int dbm;
+    int bars;
+    int changed;
     int notify[7];
-    char *line;
-    ATResponse *p_response = NULL;
+    long long now;
+    fw100SignalInfo_t sig;
+    fw100SessionCtx_t *ctx = fw100GetSessionCtx();
 
     memset(notify, 0, sizeof(notify));
 
-    err = at_send_command_singleline("AT+CSQ", "+CSQ:", &p_response);
-    if (err < 0 || p_response->success == 0) {
-        goto error;
-    }
+    err = at_schema_query(&fw100SchemaCsq, &sig);
+    if (err < 0) return;
 
-    line = p_response->p_intermediates->line;
+    notify[0] = sig.rssi;
+    notify[1] = sig.ber;
 
-    // if no change in CSQ then return
-    max = (strlen(line) > sizeof(pollSavedCSQ)) ? sizeof(pollSavedCSQ) : strlen(line);
-    if (!strncmp(pollSavedCSQ, line, max))
-      return;
+    dbm  = (notify[0] == 99) ? -113 : -113 + 2 * notify[0];
+    bars = rssiToBars(notify[0]);
+    now  = fw100NowMsec();
 
-    // save a copy 
-    strncpy(pollSavedCSQ, line, sizeof(pollSavedCSQ));
-
-    #if BUILD_DEBUG_1
-    LOGD("%s pollSavedCSQ=%s", __FUNCTION__, pollSavedCSQ);
-    #endif
-
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
+    // if no significant change in CSQ then return
+    if (pollSavedSignalValid)
+    {
+        if (ctx->signalBarsOnly)
+            changed = (bars != pollSavedSignalBars);
+        else
+            changed = (abs(dbm - pollSavedSignalDbm) > ctx->signalDeadBand);
+
+        if (!changed
+            || (now - pollSavedSignalMsec) < (long long)ctx->signalMinInterval * 1000)
+        {
+            ctx->signalSuppressCnt++;
+            return;
+        }
+    }
 
-    err = at_tok_nextint(&line, &(notify[0]));
-    if (err < 0) goto error;
+    // save a copy 
+    pollSavedSignalValid = 1;
+    pollSavedSignalDbm = dbm;
+    pollSavedSignalBars = bars;
+    pollSavedSignalMsec = now;
+    ctx->signalNotifyCnt++;
 
-    err = at_tok_nextint(&line, &(notify[1]));
-    if (err < 0) goto error;
+    RLOG(RLOG_SS_TIMER, RLOG_VERBOSE, "pollSignalStrength dbm=%d bars=%d",
+        dbm, bars, 0, 0);
 
     RIL_onUnsolicitedResponse ( RIL_UNSOL_SIGNAL_STRENGTH,
       notify, sizeof(notify));
-
-    if (NULL != p_response) at_response_free(p_response);
-    return;
-
-error:
-    if (NULL != p_response) at_response_free(p_response);
 }
 
 /**
@@ -199,15 +264,11 @@ void fw100ModemTimer()
         if (ctx->gpsTtyEnable)  rilWriteGPSTty(ctx, GPS_TEST_GPGSA, 0);
 #endif
 
-#if 0
     #if BUILD_DEBUG_1
     LOGD("%s dataCallIsAuto=%d", __FUNCTION__, ctx->dataCallIsAutomatic);
     #endif
-    if ((ctx->dataCallIsAutomatic) && (ctx->moduleIsActivated))
-    {
-      pppAutomatic();
-    }
-#endif
+    // always on data session, redials and health checks do not block
+    fw100KeeperPoll(ctx->dataCallIsAutomatic && ctx->moduleIsActivated);
 
 }
 
@@ -0,0 +1,200 @@
+/**
+ * \file fw100-ril-trace.c
+ * \brief request span tracing with Chrome trace-event export
+ *
+ * Spans are recorded in a ring while tracing is enabled:
+ *   request  RIL request, onRequest to RIL_onRequestComplete, keyed
+ *            by RIL_Token.  An async event: data call setup completes
+ *            on the netlink, reaper or scheduler thread, after later
+ *            requests, and rilinfo.c holds it by token until then
+ *   at       AT command, write to final response, command thread
+ *   urc      unsolicited line dispatch, reader thread
+ *   data     pppd launch and link state polling sleeps
+ *
+ * The ring is written on demand as Chrome/Perfetto trace-event JSON,
+ * load it in chrome://tracing or ui.perfetto.dev.  Spans on the same
+ * thread nest by time, so AT commands show under the request that
+ * issued them.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+// ring size, oldest spans are overwritten
+#define TRACE_RING_SIZE	2048
+#define TRACE_ARG_MAX	40
+
+typedef struct {
+    long long startUsec;
+    long long endUsec;
+    const char *cat;
+    const char *name;
+    unsigned int id;        // request token, async spans only
+    int beginTid;           // async spans, issuing thread
+    int tid;                // ending thread
+    char arg[TRACE_ARG_MAX];
+} traceSpan_t;
+
+volatile int fw100TraceEnabled = 0;
+
+static traceSpan_t s_ring[TRACE_RING_SIZE];
+static unsigned int s_next;
+static pthread_mutex_t s_traceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void traceAdd(const char *cat, const char *name, unsigned int id,
+    int beginTid, long long startUsec, long long endUsec, const char *arg)
+{
+    traceSpan_t *sp;
+
+    pthread_mutex_lock(&s_traceMutex);
+    sp = &s_ring[s_next % TRACE_RING_SIZE];
+    s_next++;
+
+    sp->startUsec = startUsec;
+    sp->endUsec = endUsec;
+    sp->cat = cat;
+    sp->name = name;
+    sp->id = id;
+    sp->tid = (int)syscall(SYS_gettid);
+    sp->beginTid = beginTid ? beginTid : sp->tid;
+    sp->arg[0] = '\0';
+    if (NULL != arg) strncat(sp->arg, arg, TRACE_ARG_MAX - 1);
+    pthread_mutex_unlock(&s_traceMutex);
+}
+
+/**
+ * \brief record a span on the calling thread
+ *
+ * \param cat - category, static string
+ * \param name - span name, static string
+ * \param startUsec - fw100NowUsec at span start
+ * \param endUsec - fw100NowUsec at span end
+ * \param arg - detail shown in the span args, copied, may be NULL
+ */
+void fw100TraceSpan(const char *cat, const char *name, long long startUsec,
+    long long endUsec, const char *arg)
+{
+    if (!fw100TraceEnabled) return;
+    traceAdd(cat, name, 0, 0, startUsec, endUsec, arg);
+}
+
+/**
+ * \brief record a RIL request span keyed by token
+ * called on the completing thread, which need not be the one that
+ * issued the request
+ *
+ * \param beginTid - thread that dispatched the request
+ */
+void fw100TraceRequest(const char *name, RIL_Token t, int beginTid,
+    long long startUsec, long long endUsec, int err)
+{
+    char arg[16];
+
+    if (!fw100TraceEnabled) return;
+    snprintf(arg, sizeof(arg), "%d", err);
+    traceAdd("request", name, (unsigned int)(uintptr_t)t, beginTid, startUsec, endUsec, arg);
+}
+
+void fw100TraceEnable(int on)
+{
+    pthread_mutex_lock(&s_traceMutex);
+    if (on && !fw100TraceEnabled) s_next = 0;
+    fw100TraceEnabled = on;
+    pthread_mutex_unlock(&s_traceMutex);
+}
+
+static void writeJsonString(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/**
+ * \brief write ring as Chrome trace-event JSON
+ *
+ * \param file - output file name
+ * \return number of spans written, -1 on file error
+ */
+int fw100TraceDump(const char *file)
+{
+    FILE *f;
+    unsigned int i;
+    unsigned int first;
+    unsigned int last;
+    int n = 0;
+    int pid = getpid();
+    traceSpan_t *sp;
+    static traceSpan_t snap[TRACE_RING_SIZE];
+
+    f = fopen(file, "wb");
+    if (NULL == f) return -1;
+
+    // copy out under the lock, format without it
+    pthread_mutex_lock(&s_traceMutex);
+    last = s_next;
+    first = (last > TRACE_RING_SIZE) ? last - TRACE_RING_SIZE : 0;
+    for (i = first; i < last; i++)
+        snap[i - first] = s_ring[i % TRACE_RING_SIZE];
+    pthread_mutex_unlock(&s_traceMutex);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (i = 0; i < last - first; i++) {
+        sp = &snap[i];
+        if (n) fprintf(f, ",\n");
+
+        if (sp->id) {
+            // async begin/end pair, shown on its own track per token,
+            // begin on the dispatch thread and end where it completed
+            fprintf(f, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"b\","
+                "\"id\":\"0x%x\",\"ts\":%lld,\"pid\":%d,\"tid\":%d},\n",
+                sp->name, sp->cat, sp->id, sp->startUsec, pid, sp->beginTid);
+            fprintf(f, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\","
+                "\"id\":\"0x%x\",\"ts\":%lld,\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"err\":%s}}",
+                sp->name, sp->cat, sp->id, sp->endUsec, pid, sp->tid, sp->arg);
+        } else {
+            fprintf(f, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                "\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d,\"args\":{\"detail\":",
+                sp->name, sp->cat, sp->startUsec,
+                sp->endUsec - sp->startUsec, pid, sp->tid);
+            writeJsonString(f, sp->arg);
+            fprintf(f, "}}");
+        }
+        n++;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    LOGD("%s %s spans=%d", __FUNCTION__, file, n);
+    return n;
+}
@@ -0,0 +1,299 @@
+/**
+ * \file fw100-ril-usage.c
+ * \brief per session and cumulative data usage, with a journal
+ *
+ * Usage is taken from the ppp0 counters the link monitor samples, so
+ * nothing here reads sysfs or /proc but once at start.  A session runs
+ * from ppp0 up to ppp0 down, and belongs to that ppp0 by interface
+ * index.  Closed sessions are added to the cumulative totals.
+ *
+ * The journal is a fixed ring of USAGE_JOURNAL_SLOTS records in
+ * RIL_USAGE_FILEPATH, small enough for one flash page.  Each write is
+ * one record over the oldest slot, the file never grows and no
+ * metadata changes.  An open session is written every
+ * USAGE_JOURNAL_MSEC while it moves data, a closed one at once and
+ * synced.  At start the valid record with the highest sequence number
+ * is restored.  pppd outlives a rild restart, so a session open in it
+ * goes on while the same ppp0 is up with counters no lower than the
+ * record's, and is counted as closed otherwise.  Consumers
+ * may read the journal, the status file or the metrics socket.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <fw100-ril.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+static pthread_mutex_t s_usageMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_usageFd = -1;
+static fw100UsageRecord_t s_usage;      // seq is the next record
+static long long s_sessionMsec;         // fw100NowMsec at session start, 0 none
+static long long s_writeMsec;           // last journal write
+static unsigned long long s_writeBytes; // session bytes at the last write
+static unsigned int s_writes;
+
+/**
+ * \brief crc32, IEEE 802.3
+ */
+static unsigned int usageCrc(const void *data, int len)
+{
+    const unsigned char *p = data;
+    unsigned int crc = 0xffffffff;
+    int i;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/**
+ * \brief add a session to the totals, assumes s_usageMutex is held
+ */
+static void usageClose(fw100UsageSession_t *session)
+{
+    fw100UsageTotals_t *t = &s_usage.total;
+
+    if (!t->sinceSec) t->sinceSec = session->startSec;
+    t->sessions++;
+    t->durationSec += session->durationSec;
+    t->rxBytes += session->rxBytes;
+    t->txBytes += session->txBytes;
+    t->rxPackets += session->rxPackets;
+    t->txPackets += session->txPackets;
+
+    s_usage.last = *session;
+    memset(session, 0, sizeof(*session));
+    s_usage.ifindex = 0;
+}
+
+/**
+ * \brief carry on a restored open session, assumes s_usageMutex is held
+ * the pppd that owned it still runs when its ppp0 is there with
+ * counters no lower than recorded, they count from zero per pppd
+ *
+ * \return 1 carried on, 0 its pppd is gone
+ */
+static int usageResume(void)
+{
+    fw100UsageSession_t *s = &s_usage.session;
+    unsigned long long rx;
+    unsigned long long tx;
+
+    if (!s_usage.ifindex || (int)if_nametoindex(PPP_IFNAME) != s_usage.ifindex) return 0;
+    if (fw100LinkReadCounter("rx_bytes", &rx) < 0 || rx < s->rxBytes) return 0;
+    if (fw100LinkReadCounter("tx_bytes", &tx) < 0 || tx < s->txBytes) return 0;
+
+    s_sessionMsec = fw100NowMsec() - (time(NULL) - s->startSec) * 1000;
+    s_writeMsec = fw100NowMsec();
+    s_writeBytes = s->rxBytes + s->txBytes;
+    return 1;
+}
+
+/**
+ * \brief write the next journal record, assumes s_usageMutex is held
+ *
+ * \param sync - asserted to flush the record to flash
+ */
+static void usageWrite(int sync)
+{
+    fw100UsageRecord_t rec;
+    off_t off;
+
+    if (s_usageFd < 0) return;
+
+    rec = s_usage;
+    rec.wallSec = time(NULL);
+    rec.crc = 0;
+    rec.crc = usageCrc(&rec, sizeof(rec));
+
+    off = (off_t)(s_usage.seq % USAGE_JOURNAL_SLOTS) * sizeof(rec);
+    if (pwrite(s_usageFd, &rec, sizeof(rec), off) != sizeof(rec))
+    {
+        LOGE("%s %s", __FUNCTION__, strerror(errno));
+        return;
+    }
+    if (sync) fdatasync(s_usageFd);
+
+    s_usage.seq++;
+    s_writes++;
+    s_writeMsec = fw100NowMsec();
+    s_writeBytes = s_usage.session.rxBytes + s_usage.session.txBytes;
+}
+
+/**
+ * \brief open the journal and restore the most recent record
+ *
+ * \param file - journal path
+ *
+ * \return 0 restored, 1 new journal, -1 error
+ */
+int fw100UsageInit(const char *file)
+{
+    fw100UsageRecord_t ring[USAGE_JOURNAL_SLOTS];
+    fw100UsageRecord_t *rec;
+    fw100UsageRecord_t *best = NULL;
+    unsigned int crc;
+    int n;
+    int i;
+    int ret = -1;
+
+    pthread_mutex_lock(&s_usageMutex);
+
+    memset(&s_usage, 0, sizeof(s_usage));
+    memcpy(s_usage.magic, USAGE_JOURNAL_MAGIC, sizeof(s_usage.magic));
+    s_usage.version = USAGE_JOURNAL_VERSION;
+
+    s_usageFd = open(file, O_RDWR | O_CREAT, 0644);
+    if (s_usageFd < 0)
+    {
+        LOGE("%s %s %s", __FUNCTION__, file, strerror(errno));
+        goto done;
+    }
+    // not inherited by pppd
+    fcntl(s_usageFd, F_SETFD, FD_CLOEXEC);
+
+    memset(ring, 0, sizeof(ring));
+    n = pread(s_usageFd, ring, sizeof(ring), 0);
+    for (i = 0; n > 0 && i < n / (int)sizeof(ring[0]); i++)
+    {
+        rec = &ring[i];
+        if (memcmp(rec->magic, USAGE_JOURNAL_MAGIC, sizeof(rec->magic))
+            || rec->version != USAGE_JOURNAL_VERSION)
+            continue;
+        crc = rec->crc;
+        rec->crc = 0;
+        if (crc != usageCrc(rec, sizeof(*rec))) continue;
+        if (NULL == best || (int)(rec->seq - best->seq) > 0) best = rec;
+    }
+
+    if (NULL == best)
+    {
+        LOGD("%s new journal %s", __FUNCTION__, file);
+        ret = 1;
+        goto done;
+    }
+
+    s_usage = *best;
+    s_usage.seq++;
+    // rild stopped with a session open, its last record counts unless
+    // its pppd is still up
+    if (s_usage.session.startSec && !usageResume()) usageClose(&s_usage.session);
+
+    LOGD("%s %s seq %u sessions %u rx %llu tx %llu%s", __FUNCTION__, file, best->seq,
+        s_usage.total.sessions, s_usage.total.rxBytes, s_usage.total.txBytes,
+        s_usage.session.startSec ? " session open" : "");
+    ret = 0;
+
+done:
+    pthread_mutex_unlock(&s_usageMutex);
+    return ret;
+}
+
+/**
+ * \brief ppp0 counters sampled, scheduler or netlink listener thread
+ * the first sample opens a session, up 0 closes it with the last
+ * counters seen, ppp0 may be gone by then
+ *
+ * \param c - ppp0 counters, counted from zero by each pppd
+ * \param up - link up
+ */
+void fw100UsageUpdate(const fw100LinkCounters_t *c, int up)
+{
+    fw100UsageSession_t *s = &s_usage.session;
+    long long now = fw100NowMsec();
+
+    pthread_mutex_lock(&s_usageMutex);
+
+    // a restored session of a ppp0 that has gone since
+    if (up && s->startSec && c->ifindex != s_usage.ifindex)
+    {
+        LOGD("%s session of ppp0 index %d closed", __FUNCTION__, s_usage.ifindex);
+        usageClose(s);
+        usageWrite(1);
+    }
+
+    if (up && !s->startSec)
+    {
+        s_usage.ifindex = c->ifindex;
+        s->startSec = time(NULL);
+        s_sessionMsec = now;
+        s_writeBytes = 0;
+        s_writeMsec = now;
+    }
+
+    if (s->startSec)
+    {
+        s->durationSec = (now - s_sessionMsec) / 1000;
+        s->rxBytes = c->rxBytes;
+        s->txBytes = c->txBytes;
+        s->rxPackets = c->rxPackets;
+        s->txPackets = c->txPackets;
+    }
+
+    if (!up && s->startSec)
+    {
+        LOGD("%s session %lld sec rx %llu tx %llu", __FUNCTION__,
+            s->durationSec, s->rxBytes, s->txBytes);
+        usageClose(s);
+        usageWrite(1);
+    }
+    else if (s->startSec && now - s_writeMsec >= USAGE_JOURNAL_MSEC
+        && s->rxBytes + s->txBytes != s_writeBytes)
+    {
+        usageWrite(0);
+    }
+
+    pthread_mutex_unlock(&s_usageMutex);
+}
+
+/**
+ * \brief current usage
+ * totals are of closed sessions, add session for the cumulative usage
+ *
+ * \param usage - returned usage, seq is the next journal record
+ *
+ * \return journal records written since start
+ */
+unsigned int fw100UsageGet(fw100UsageRecord_t *usage)
+{
+    unsigned int writes;
+
+    pthread_mutex_lock(&s_usageMutex);
+    *usage = s_usage;
+    if (usage->session.startSec)
+        usage->session.durationSec = (fw100NowMsec() - s_sessionMsec) / 1000;
+    writes = s_writes;
+    pthread_mutex_unlock(&s_usageMutex);
+
+    return writes;
+}
@@ -20,7 +20,9 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cutils/properties.h>
@@ -36,6 +38,8 @@
 
 #include <fw100-ril.h>
 #include <rilinfo.h>
+#include <rillog.h>
+#include <atcapture.h>
 
 /**
  * \brief in-place upper case string.  
@@ -65,6 +69,190 @@ char *strToUpper(char *p, int max)
     return ret;
 }
 
+/**
+ * \brief monotonic clock in milliseconds
+ * not affected by network time updates, use for intervals
+ *
+ * \return
+ * milliseconds since an arbitrary fixed point
+ */
+long long fw100NowMsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * \brief monotonic clock in usec, for latency measurement
+ */
+long long fw100NowUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * \brief condition wait to a monotonic deadline
+ * network time steps the realtime clock, not this one, so a NITZ or
+ * NTP update neither stalls nor hurries the wait
+ *
+ * \param deadlineMsec - fw100NowMsec time to give up
+ *
+ * \return 0 signalled, ETIMEDOUT deadline passed
+ */
+int fw100CondWaitUntil(pthread_cond_t *cond, pthread_mutex_t *mutex, long long deadlineMsec)
+{
+    struct timespec ts;
+
+    ts.tv_sec  = deadlineMsec / 1000;
+    ts.tv_nsec = (deadlineMsec % 1000) * 1000000L;
+
+#ifdef HAVE_ANDROID_OS
+    return pthread_cond_timedwait_monotonic_np(cond, mutex, &ts);
+#else
+    return pthread_cond_clockwait(cond, mutex, CLOCK_MONOTONIC, &ts);
+#endif
+}
+
+/**
+ * \brief parse integer value from control file line
+ * line format is Name=value
+ *
+ * \param buf - control file line
+ * \param def - value returned if line has no number
+ *
+ * \return
+ * parsed value or default
+ */
+static int controlInt(const char *buf, int def)
+{
+    char *end;
+    long val;
+    const char *p = strchr(buf, '=');
+
+    if (NULL == p) return def;
+    val = strtol(p+1, &end, 10);
+    if (end == p+1) return def;
+    return (int)val;
+}
+
+/**
+ * \brief parse control file log level line
+ * line format is LogLevel.<subsystem>=V|D|I|W|E|N
+ *
+ * \param buf - control file line
+ */
+static void controlLogLevel(const char *buf)
+{
+    char name[32];
+    int lvl;
+    const char *end;
+    int len;
+
+    if (strncmp(buf, "LogLevel.", 9)) return;
+
+    end = strchr(buf, '=');
+    len = (NULL == end) ? 0 : end - (buf + 9);
+    if (len <= 0 || len >= (int)sizeof(name)) return;
+
+    memcpy(name, buf + 9, len);
+    name[len] = 0;
+    lvl = rlogLevelFromChar(end[1]);
+    if (lvl < 0 || rlogSetLevel(name, lvl) < 0)
+        LOGW("%s:%d bad log level %s", __FUNCTION__, __LINE__, buf);
+}
+
+/**
+ * \brief parse control file AT capture lines
+ * ATCapture=Yes|No, ATCaptureSize=KBytes, ATCaptureFiles=N
+ *
+ * \param ctx - session context
+ * \param buf - control file line
+ */
+static void controlCapture(fw100SessionCtx_t *ctx, const char *buf)
+{
+    if (!strncmp(buf, "ATCapture=", 10))
+        ctx->atCapture = (strstr(buf, "Yes") || strstr(buf, "yes")) ? 1 : 0;
+
+    if (!strncmp(buf, "ATCaptureSize=", 14))
+        ctx->atCaptureKBytes = controlInt(buf, AT_CAPTURE_KBYTES_DEFAULT);
+
+    if (!strncmp(buf, "ATCaptureFiles=", 15))
+        ctx->atCaptureFiles = controlInt(buf, AT_CAPTURE_FILES_DEFAULT);
+}
+
+/**
+ * \brief parse control file span tracing line, Trace=Yes|No
+ *
+ * \param buf - control file line
+ */
+static void controlTrace(const char *buf)
+{
+    if (!strncmp(buf, "Trace=", 6))
+        fw100TraceEnable((strstr(buf, "Yes") || strstr(buf, "yes")) ? 1 : 0);
+}
+
+/**
+ * \brief parse control file AT command timeout line, ATTimeout=msec
+ *
+ * \param buf - control file line
+ */
+static void controlATTimeout(const char *buf)
+{
+    if (!strncmp(buf, "ATTimeout=", 10))
+        at_set_command_timeout(controlInt(buf, AT_COMMAND_TIMEOUT_DEFAULT));
+}
+
+/**
+ * \brief start or stop AT capture per session context
+ *
+ * \param ctx - session context
+ */
+void rilApplyCapture(fw100SessionCtx_t *ctx)
+{
+    if (ctx->atCapture)
+        atCaptureStart(RIL_ATCAPTURE_FILEPATH,
+            ctx->atCaptureKBytes * 1024, ctx->atCaptureFiles);
+    else
+        atCaptureStop();
+}
+
+/**
+ * \brief reread run time options if the control file changed
+ * called periodically, only LogLevel, ATCapture, ATTimeout and Trace
+ * lines are applied
+ *
+ * \param ctx - session context
+ * \param file - control file name
+ */
+void rilReadRuntimeControl(fw100SessionCtx_t *ctx, const char *file)
+{
+    static time_t lastMtime;
+    struct stat st;
+    FILE *f;
+    char buf[128];
+
+    if (stat(file, &st) < 0 || st.st_mtime == lastMtime) return;
+    lastMtime = st.st_mtime;
+
+    f = fopen(file, "rb");
+    if (NULL == f) return;
+    while (NULL != fgets(buf, sizeof(buf), f))
+    {
+        controlLogLevel(buf);
+        controlCapture(ctx, buf);
+        controlATTimeout(buf);
+        controlTrace(buf);
+    }
+    fclose(f);
+
+    rilApplyCapture(ctx);
+}
+
 /**
  * \brief activation helper
  *
@@ -242,6 +430,36 @@ int rilReadControl(fw100SessionCtx_t *ctx, const char *file)
             ctx->dataCallIsAutomatic = option1 + option2;
          }
 
+         //  simple yes no parsing
+         if (strstr(buf, "DataDialer"))
+         {
+            // make it case insensitive
+            option1 = (strstr(buf, "Yes")) ? 1 : 0;
+            option2 = (strstr(buf, "yes")) ? 1 : 0;
+            ctx->dataDialer = option1 + option2;
+         }
+
+         //  simple yes no parsing
+         if (strstr(buf, "LinkStallReconnect"))
+         {
+            // make it case insensitive
+            option1 = (strstr(buf, "Yes")) ? 1 : 0;
+            option2 = (strstr(buf, "yes")) ? 1 : 0;
+            ctx->linkStallReconnect = option1 + option2;
+         }
+
+         // No, Screen (or Yes) with the screen on, Always
+         if (strstr(buf, "DataPrewarm"))
+         {
+            if (strstr(buf, "Always") || strstr(buf, "always"))
+               ctx->dataPrewarm = PREWARM_ALWAYS;
+            else if (strstr(buf, "Screen") || strstr(buf, "screen")
+               || strstr(buf, "Yes") || strstr(buf, "yes"))
+               ctx->dataPrewarm = PREWARM_SCREEN;
+            else
+               ctx->dataPrewarm = PREWARM_OFF;
+         }
+
          //  simple yes no parsing
          if (strstr(buf, "AutoActivate"))
          {
@@ -251,6 +469,53 @@ int rilReadControl(fw100SessionCtx_t *ctx, const char *file)
             ctx->moduleAutoActivate = option1 + option2;
          }
 
+         // signal strength notification filter, SignalDeadBand is
+         // +/- dBm ignored, the default 2 is one CSQ step
+         if (strstr(buf, "SignalDeadBand"))
+         {
+            ctx->signalDeadBand = controlInt(buf, SIGNAL_DEAD_BAND_DEFAULT);
+         }
+
+         if (strstr(buf, "SignalMinInterval"))
+         {
+            ctx->signalMinInterval = controlInt(buf, SIGNAL_MIN_INTERVAL_DEFAULT);
+         }
+
+         //  simple yes no parsing
+         if (strstr(buf, "SignalBarsOnly"))
+         {
+            // make it case insensitive
+            option1 = (strstr(buf, "Yes")) ? 1 : 0;
+            option2 = (strstr(buf, "yes")) ? 1 : 0;
+            ctx->signalBarsOnly = option1 + option2;
+         }
+
+         // per subsystem log level, LogLevel.<subsystem>=D
+         controlLogLevel(buf);
+
+         // AT traffic capture
+         controlCapture(ctx, buf);
+
+         // AT command final response timeout
+         controlATTimeout(buf);
+
+         // request span tracing
+         controlTrace(buf);
+
+         // per task scheduler slack, Slack.<task>=msec
+         if (!strncmp(buf, "Slack.", 6))
+         {
+            char name[32];
+            char *end = strchr(buf, '=');
+            int len = (NULL == end) ? 0 : end - (buf + 6);
+            if (len > 0 && len < (int)sizeof(name))
+            {
+                memcpy(name, buf + 6, len);
+                name[len] = 0;
+                fw100SchedSetSlack(name, controlInt(buf, -1));
+            }
+         }
+
     } while (NULL != p);
 
     fclose(f);
@@ -309,6 +574,201 @@ int rilWriteStatus(fw100SessionCtx_t *ctx, const char *file)
         fprintf(f, "InDataCall=No\n");
     }
 
+    // further data call contexts, cid 2 on
+    {
+        fw100DataContext_t dcs[DATA_MAX_CONTEXTS];
+        int i;
+        int n = fw100DataContexts(dcs, DATA_MAX_CONTEXTS);
+        for (i = 0; i < n; i++)
+        {
+            if (dcs[i].cid == 1) continue;
+            fprintf(f, "DataCall.%d=%s %s %s\n", dcs[i].cid, dcs[i].ifname, dcs[i].path,
+                (dcs[i].state == DATA_STATE_CONNECTED) ? dcs[i].localIP : "Down");
+            if (dcs[i].pppPid)
+                fprintf(f, "PppPid.%d=%d\n", dcs[i].cid, dcs[i].pppPid);
+        }
+    }
+
+    // notification filter savings
+    fprintf(f, "SignalNotify=%u\n",   ctx->signalNotifyCnt);
+    fprintf(f, "SignalSuppress=%u\n", ctx->signalSuppressCnt);
+    fprintf(f, "RegNotify=%u\n",      ctx->regNotifyCnt);
+    fprintf(f, "RegSuppress=%u\n",    ctx->regSuppressCnt);
+
+    // scheduler batch wakeups
+    {
+        unsigned int wakeups, runs;
+        unsigned int rate = fw100SchedWakeupsPerHour(&wakeups, &runs);
+        fprintf(f, "WakeupsPerHour=%u\n", rate);
+        fprintf(f, "Wakeups=%u\n", wakeups);
+        fprintf(f, "TaskRuns=%u\n", runs);
+    }
+
+    // pppd supervisor
+    {
+        unsigned int starts;
+        int status = fw100PppExitStatus(PPP_UNIT_PRIMARY, &starts);
+        fprintf(f, "PppPid=%d\n", fw100PppPid(PPP_UNIT_PRIMARY));
+        fprintf(f, "PppStarts=%u\n", starts);
+        if (status != -1 && WIFEXITED(status))
+            fprintf(f, "PppExit=%d\n", WEXITSTATUS(status));
+        else if (status != -1 && WIFSIGNALED(status))
+            fprintf(f, "PppExit=signal %d\n", WTERMSIG(status));
+    }
+
+    // always on session keeper
+    {
+        fw100KeeperStats_t ks;
+        const char *kstate = fw100KeeperStats(&ks);
+        fprintf(f, "KeeperState=%s\n", kstate);
+        fprintf(f, "KeeperDials=%u\n", ks.dials);
+        fprintf(f, "KeeperReconnects=%u\n", ks.reconnects);
+        fprintf(f, "KeeperDeadLinks=%u\n", ks.deadLinks);
+        if (ks.reconnects)
+        {
+            fprintf(f, "KeeperReconnectMsec=%lld\n", ks.lastReconnectMsec);
+            fprintf(f, "KeeperReconnectAvgMsec=%lld\n", 
+                ks.reconnectTotalMsec / ks.reconnects);
+        }
+        if (ks.enabledTotalMsec > 0)
+            fprintf(f, "KeeperUptimePct=%.1f\n", 
+                100.0 * ks.upTotalMsec / ks.enabledTotalMsec);
+        if (ks.nextDialMsec >= 0)
+            fprintf(f, "KeeperNextDialMsec=%lld\n", ks.nextDialMsec);
+    }
+
+    // data port dialer
+    {
+        fw100DialStats_t ds;
+        fw100DialStats(&ds);
+        fprintf(f, "DataDialer=%s\n", (ctx->dataDialer) ? "Yes" : "No");
+        fprintf(f, "DialAttempts=%u\n", ds.attempts);
+        fprintf(f, "DialConnects=%u\n", ds.connects);
+        if (ds.attempts)
+            fprintf(f, "DialLastResult=%s\n", fw100DialResultName(ds.lastResult));
+        if (ds.lastAbort[0])
+            fprintf(f, "DialLastAbort=%s\n", ds.lastAbort);
+        if (ds.connects)
+        {
+            fprintf(f, "DialConnectMsec=%lld\n", ds.lastConnectUsec / 1000);
+            fprintf(f, "DialConnectAvgMsec=%lld\n", 
+                ds.connectTotalUsec / ds.connects / 1000);
+        }
+    }
+
+    // ppp0 throughput and stalls
+    {
+        fw100LinkMonStats_t ls;
+        fw100LinkMonStats(&ls);
+        fprintf(f, "LinkStallReconnect=%s\n", (ctx->linkStallReconnect) ? "Yes" : "No");
+        fprintf(f, "LinkRxBps=%u\n", ls.rxBps);
+        fprintf(f, "LinkTxBps=%u\n", ls.txBps);
+        fprintf(f, "LinkRxPeakBps=%u\n", ls.rxPeakBps);
+        fprintf(f, "LinkTxPeakBps=%u\n", ls.txPeakBps);
+        fprintf(f, "LinkRxBytes=%llu\n", ls.counters.rxBytes);
+        fprintf(f, "LinkTxBytes=%llu\n", ls.counters.txBytes);
+        fprintf(f, "LinkRxPackets=%llu\n", ls.counters.rxPackets);
+        fprintf(f, "LinkTxPackets=%llu\n", ls.counters.txPackets);
+        fprintf(f, "LinkErrors=%llu\n", ls.counters.rxErrors + ls.counters.txErrors);
+        fprintf(f, "LinkDrops=%llu\n", ls.counters.rxDropped + ls.counters.txDropped);
+        fprintf(f, "LinkStalls=%u\n", ls.stalls);
+        fprintf(f, "LinkStallReconnects=%u\n", ls.stallReconnects);
+        if (ls.lastStallMsec)
+            fprintf(f, "LinkLastStallSec=%lld\n", 
+                (fw100NowMsec() - ls.lastStallMsec) / 1000);
+    }
+
+    // data usage, cumulative includes the open session
+    {
+        fw100UsageRecord_t u;
+        unsigned int writes = fw100UsageGet(&u);
+        fprintf(f, "UsageSessions=%u\n", u.total.sessions);
+        fprintf(f, "UsageRxBytes=%llu\n", u.total.rxBytes + u.session.rxBytes);
+        fprintf(f, "UsageTxBytes=%llu\n", u.total.txBytes + u.session.txBytes);
+        fprintf(f, "UsageRxPackets=%llu\n", u.total.rxPackets + u.session.rxPackets);
+        fprintf(f, "UsageTxPackets=%llu\n", u.total.txPackets + u.session.txPackets);
+        fprintf(f, "UsageSec=%lld\n", u.total.durationSec + u.session.durationSec);
+        if (u.total.sinceSec)
+            fprintf(f, "UsageSince=%lld\n", u.total.sinceSec);
+        if (u.session.startSec)
+        {
+            fprintf(f, "UsageSessionStart=%lld\n", u.session.startSec);
+            fprintf(f, "UsageSessionSec=%lld\n", u.session.durationSec);
+            fprintf(f, "UsageSessionRxBytes=%llu\n", u.session.rxBytes);
+            fprintf(f, "UsageSessionTxBytes=%llu\n", u.session.txBytes);
+        }
+        if (u.last.startSec)
+        {
+            fprintf(f, "UsageLastStart=%lld\n", u.last.startSec);
+            fprintf(f, "UsageLastSec=%lld\n", u.last.durationSec);
+            fprintf(f, "UsageLastRxBytes=%llu\n", u.last.rxBytes);
+            fprintf(f, "UsageLastTxBytes=%llu\n", u.last.txBytes);
+        }
+        fprintf(f, "UsageJournalWrites=%u\n", writes);
+    }
+
+    // data link pre-warm
+    {
+        static const char *mode[] = { "No", "Screen", "Always" };
+        fw100PrewarmStats_t ps;
+        fw100DataPrewarmStats(&ps);
+        fprintf(f, "DataPrewarm=%s\n", mode[ctx->dataPrewarm]);
+        fprintf(f, "PrewarmStarts=%u\n", ps.starts);
+        fprintf(f, "PrewarmHits=%u\n", ps.hits);
+        fprintf(f, "PrewarmMisses=%u\n", ps.misses);
+        fprintf(f, "PrewarmExpired=%u\n", ps.expired);
+        if (ps.hits + ps.misses)
+            fprintf(f, "PrewarmHitPct=%.1f\n", 
+                100.0 * ps.hits / (ps.hits + ps.misses));
+        if (ps.hits)
+        {
+            fprintf(f, "PrewarmSavedMsec=%lld\n", ps.lastSavedUsec / 1000);
+            fprintf(f, "PrewarmSavedAvgMsec=%lld\n", 
+                ps.savedTotalUsec / ps.hits / 1000);
+            fprintf(f, "PrewarmSetupAvgMsec=%lld\n", 
+                ps.hitSetupTotalUsec / ps.hits / 1000);
+        }
+        if (ps.coldSetups)
+            fprintf(f, "ColdSetupAvgMsec=%lld\n", 
+                ps.coldSetupTotalUsec / ps.coldSetups / 1000);
+    }
+
+    // data call failures, most recent first
+    {
+        fw100FailEntry_t fails[FAIL_HISTORY_MAX];
+        unsigned int total;
+        int n = fw100FailHistory(fails, FAIL_HISTORY_MAX, &total);
+        int i;
+        fprintf(f, "DataFails=%u\n", total);
+        if (n) fprintf(f, "DataFailCause=0x%x\n", fails[0].cause);
+        for (i = 0; i < n; i++)
+        {
+            fprintf(f, "DataFail%d=%llds %s cause=0x%x ppp=%d end=%d cc=%d\n", i,
+                (fw100NowMsec() - fails[i].msec) / 1000,
+                (FAIL_STAGE_DROP == fails[i].stage) ? "drop" : "setup",
+                fails[i].cause,
+                (fails[i].pppStatus != -1 && WIFEXITED(fails[i].pppStatus))
+                    ? WEXITSTATUS(fails[i].pppStatus) : -1,
+                fails[i].endStatus, fails[i].ccCause);
+        }
+    }
+
+    // AT traffic capture
+    {
+        unsigned int bytes, dropped;
+        atCaptureStats(&bytes, &dropped);
+        fprintf(f, "ATCaptureBytes=%u\n", bytes);
+        fprintf(f, "ATCaptureDropped=%u\n", dropped);
+    }
+
+    // deferred log ring
+    {
+        unsigned int records, dropped;
+        rlogStats(&records, &dropped);
+        fprintf(f, "LogRecords=%u\n", records);
+        fprintf(f, "LogDropped=%u\n", dropped);
+    }
+
     fclose(f);
     ret = 0;
 
@@ -47,6 +47,7 @@
 
 #include <fw100-ril.h>  
 #include <rilinfo.h>
+#include <rillog.h>
 
 #define LOG_TAG "RIL"
 #include <utils/Log.h>
@@ -152,7 +153,7 @@ static void requestRadioPower(void *data, size_t datalen, RIL_Token t)
     int onOff;
     ATResponse *p_response = NULL;
 
-    assert (datalen >= sizeof(int *));
+    assert (datalen >= sizeof(int));
     onOff = ((int *)data)[0];
 
     if (onOff == 0 && fw100Ctx.sState != RADIO_STATE_OFF) {
@@ -272,7 +273,6 @@ static void sendCallStateChanged(void *param)
 static void requestDial(void *data, size_t datalen, RIL_Token t)
 {
     RIL_Dial *p_dial;
-    char *cmd;
     const char *clir;
     int ret;
 
@@ -285,11 +285,7 @@ static void requestDial(void *data, size_t datalen, RIL_Token t)
         case 0: clir = ""; break;   /*subscription default*/
     }
 
-    asprintf(&cmd, "ATD%s%s;", p_dial->address, clir);
-
-    ret = at_send_command(cmd, NULL);
-
-    free(cmd);
+    ret = at_send_template(&fw100CmdDial, NULL, p_dial->address, clir);
 
     /* success or failure is ignored by the upper layer here.
        it will call GET_CURRENT_CALLS and determine success that way */
@@ -299,7 +295,6 @@ static void requestDial(void *data, size_t datalen, RIL_Token t)
 static void requestWriteSmsToSim(void *data, size_t datalen, RIL_Token t)
 {
     RIL_SMS_WriteArgs *p_args;
-    char *cmd;
     int length;
     int err;
     ATResponse *p_response = NULL;
@@ -307,9 +302,8 @@ static void requestWriteSmsToSim(void *data, size_t datalen, RIL_Token t)
     p_args = (RIL_SMS_WriteArgs *)data;
 
     length = strlen(p_args->pdu)/2;
-    asprintf(&cmd, "AT+CMGW=%d,%d", length, p_args->status);
-
-    err = at_send_command_sms(cmd, p_args->pdu, "+CMGW:", &p_response);
+    err = at_send_template_sms(&fw100CmdWriteSms, p_args->pdu, &p_response,
+        length, p_args->status);
 
     if (err != 0 || p_response->success == 0) goto error;
 
@@ -330,17 +324,12 @@ static void requestHangup(void *data, size_t datalen, RIL_Token t)
     int *p_line;
 
     int ret;
-    char *cmd;
 
     p_line = (int *)data;
 
     // 3GPP 22.030 6.5.5
     // "Releases a specific active call X"
-    asprintf(&cmd, "AT+CHLD=1%d", p_line[0]);
-
-    ret = at_send_command(cmd, NULL);
-
-    free(cmd);
+    ret = at_send_template(&fw100CmdHangup, NULL, p_line[0]);
 
     /* success or failure is ignored by the upper layer here.
        it will call GET_CURRENT_CALLS and determine success that way */
@@ -371,40 +360,24 @@ static void requestHangup(void *data, size_t datalen, RIL_Token t)
  */
 static void requestSignalStrength(void *data, size_t datalen, RIL_Token t)
 {
-    ATResponse *p_response = NULL;
     int err;
     int response[7];
-    char *line;
+    fw100SignalInfo_t sig;
 
     memset(response, 0, sizeof(response));
 
-    err = at_send_command_singleline("AT+CSQ", "+CSQ:", &p_response);
-
-    if (err < 0 || p_response->success == 0) {
-        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-        goto error;
-    }
-
-    line = p_response->p_intermediates->line;
-
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
-
-    err = at_tok_nextint(&line, &(response[0]));
+    err = at_schema_query(&fw100SchemaCsq, &sig);
     if (err < 0) goto error;
 
-    err = at_tok_nextint(&line, &(response[1]));
-    if (err < 0) goto error;
+    response[0] = sig.rssi;
+    response[1] = sig.ber;
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, response, sizeof(response));
-
-    at_response_free(p_response);
     return;
 
 error:
     LOGE("requestSignalStrength must never return an error when radio is on");
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-    at_response_free(p_response);
 }
 
 /** 
@@ -576,6 +549,7 @@ static void requestSMSAcknowledge(void *data, size_t datalen, RIL_Token t)
     }
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+    return;
 error:
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
 
@@ -586,7 +560,6 @@ static void  requestSIM_IO(void *data, size_t datalen, RIL_Token t)
     ATResponse *p_response = NULL;
     RIL_SIM_IO_Response sr;
     int err;
-    char *cmd = NULL;
     RIL_SIM_IO *p_args;
     char *line;
 
@@ -595,17 +568,15 @@ static void  requestSIM_IO(void *data, size_t datalen, RIL_Token t)
     p_args = (RIL_SIM_IO *)data;
 
     if (p_args->data == NULL) {
-        asprintf(&cmd, "AT+CRSM=%d,%d,%d,%d,%d",
+        err = at_send_template(&fw100CmdSimIo, &p_response,
                     p_args->command, p_args->fileid,
                     p_args->p1, p_args->p2, p_args->p3);
     } else {
-        asprintf(&cmd, "AT+CRSM=%d,%d,%d,%d,%d,%s",
+        err = at_send_template(&fw100CmdSimIoData, &p_response,
                     p_args->command, p_args->fileid,
                     p_args->p1, p_args->p2, p_args->p3, p_args->data);
     }
 
-    err = at_send_command_singleline(cmd, "+CRSM:", &p_response);
-
     if (err < 0 || p_response->success == 0) {
         goto error;
     }
@@ -628,13 +599,11 @@ static void  requestSIM_IO(void *data, size_t datalen, RIL_Token t)
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, &sr, sizeof(sr));
     at_response_free(p_response);
-    free(cmd);
 
     return;
 error:
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
     at_response_free(p_response);
-    free(cmd);
 
 }
 
@@ -642,19 +611,16 @@ static void  requestEnterSimPin(void*  data, size_t  datalen, RIL_Token  t)
 {
     ATResponse   *p_response = NULL;
     int           err;
-    char*         cmd = NULL;
     const char**  strings = (const char**)data;;
 
     if ( datalen == sizeof(char*) ) {
-        asprintf(&cmd, "AT+CPIN=%s", strings[0]);
+        err = at_send_template(&fw100CmdPin, &p_response, strings[0]);
     } else if ( datalen == 2*sizeof(char*) ) {
-        asprintf(&cmd, "AT+CPIN=%s,%s", strings[0], strings[1]);
+        err = at_send_template(&fw100CmdPin2, &p_response,
+                    strings[0], strings[1]);
     } else
         goto error;
 
-    err = at_send_command_singleline(cmd, "+CPIN:", &p_response);
-    free(cmd);
-
     if (err < 0 || p_response->success == 0) {
 error:
         RIL_onRequestComplete(t, RIL_E_PASSWORD_INCORRECT, NULL, 0);
@@ -698,10 +664,8 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
     ATResponse *p_response;
     int err;
 
-    char tmp[164];
-    sprintf(tmp, "state=%d token=%p req=%d %s\n", fw100Ctx.sState, t,
-      request, requestToString(request));
-    LOGD("onRequest: %s", tmp);
+    // per request counters, dump with OEM_HOOK_STRINGS RIL_STATS_DUMP_CMD
+    requestStatsBegin(request, t);
 
 #if 0
     // filter request not supported in this profile
@@ -866,10 +830,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
 
         case RIL_REQUEST_DTMF: {
             char c = ((char *)data)[0];
-            char *cmd;
-            asprintf(&cmd, "AT+VTS=%c", (int)c);
-            at_send_command(cmd, NULL);
-            free(cmd);
+            at_send_template(&fw100CmdDtmf, NULL, (int)c);
             RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
             break;
         }
@@ -973,6 +934,38 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
 
             LOGD("got OEM_HOOK_STRINGS: 0x%8p %lu", data, (long)datalen);
 
+            cur = (const char **)data;
+            if (datalen >= sizeof(char *) && NULL != cur[0]
+                && 0 == strcmp(cur[0], RIL_STATS_DUMP_CMD))
+            {
+                if (requestStatsDump(RIL_STATS_FILEPATH) < 0)
+                    RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+                else
+                    RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+                break;
+            }
+
+            if (datalen >= 2 * sizeof(char *) && NULL != cur[0] && NULL != cur[1]
+                && 0 == strcmp(cur[0], RIL_TRACE_CMD))
+            {
+                err = 0;
+                if (0 == strcmp(cur[1], "dump"))
+                    err = fw100TraceDump(RIL_TRACE_FILEPATH);
+                else
+                    fw100TraceEnable(atoi(cur[1]) ? 1 : 0);
+                RIL_onRequestComplete(t, (err < 0) ?
+                    RIL_E_GENERIC_FAILURE : RIL_E_SUCCESS, NULL, 0);
+                break;
+            }
+
+            if (datalen >= 2 * sizeof(char *) && NULL != cur[0] && NULL != cur[1]
+                && 0 == strcmp(cur[0], RIL_ATCAPTURE_CMD))
+            {
+                fw100Ctx.atCapture = atoi(cur[1]) ? 1 : 0;
+                rilApplyCapture(&fw100Ctx);
+                RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+                break;
+            }
 
             for (i = (datalen / sizeof (char *)), cur = (const char **)data ;
                     i > 0 ; cur++, i --) {
@@ -989,11 +982,9 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             break;
 
         case RIL_REQUEST_DELETE_SMS_ON_SIM: {
-            char * cmd;
             p_response = NULL;
-            asprintf(&cmd, "AT+CMGD=%d", ((int *)data)[0]);
-            err = at_send_command(cmd, &p_response);
-            free(cmd);
+            err = at_send_template(&fw100CmdDeleteSms, &p_response,
+                    ((int *)data)[0]);
             if (err < 0 || p_response->success == 0) {
                 RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
             } else {
@@ -1289,7 +1280,11 @@ static void pollSIMState (void *param)
         return;
 
         case SIM_NOT_READY:
-            RIL_requestTimedCallback (pollSIMState, NULL, &fw100Ctx.TIMEVAL_SIMPOLL);
+            // deferrable, batch with other periodic modem traffic
+            fw100SchedOnce("simpoll", pollSIMState, NULL,
+                fw100Ctx.TIMEVAL_SIMPOLL.tv_sec * 1000 
+                + fw100Ctx.TIMEVAL_SIMPOLL.tv_usec / 1000,
+                SCHED_SIMPOLL_SLACK_MSEC);
         return;
 
         case SIM_READY:
@@ -1400,13 +1395,13 @@ static void waitForClose()
 }
 
 /**
- * \brief Called by atchannel when an unsolicited line appears
+ * \brief unsolicited line handler
  * This is called on atchannel's reader thread. AT commands may
  * not be issued here
  * 
  * \param s - modem AT string 
  */
-static void onUnsolicited (const char *s, const char *sms_pdu)
+static void dispatchUnsolicited (const char *s, const char *sms_pdu)
 {
     char *line = NULL;
     int err;
@@ -1441,6 +1436,8 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
                 || strStartsWith(s,"+CCWA")
     ) {
         LOGD ("%s:%d bypassed CALL_STATE_CHANGED\n", __FUNCTION__, __LINE__);
+        // drives data call teardown after ATH
+        if (strStartsWith(s,"NO CARRIER")) fw100DataNoCarrier();
         #if 0
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
@@ -1475,6 +1472,8 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
     }
     // over the air activation 
     else if (strStartsWith(s, "^CEND:")) {
+        // end reason explains a data call failure
+        fw100FailCallEnd(s);
     }
 
     // GPS NMEA
@@ -1484,12 +1483,39 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
     }
 }
 
+/**
+ * \brief Called by atchannel when an unsolicited line appears
+ * times the dispatch for the URC latency histograms
+ */
+static void onUnsolicited (const char *s, const char *sms_pdu)
+{
+    long long start = fw100NowUsec();
+    long long end;
+
+    dispatchUnsolicited(s, sms_pdu);
+    end = fw100NowUsec();
+    fw100MetricsURC(s, (unsigned int)(end - start));
+    fw100TraceSpan("urc", "URC", start, end, s);
+}
+
+/**
+ * \brief Called by atchannel when a command completes
+ * command thread, feeds AT latency histograms and trace
+ */
+static void onATCommandComplete(const char *command, int err,
+    long long startUsec, long long endUsec)
+{
+    fw100MetricsAT(command, err, startUsec, endUsec);
+    fw100TraceSpan("at", "AT", startUsec, endUsec, command);
+}
+
 /* Called on command or reader thread */
 static void onATReaderClosed()
 {
     LOGI("AT channel closed\n");
     at_close();
     fw100Ctx.s_closed = 1;
+    fw100SchedWake();
 
     setRadioState (RADIO_STATE_UNAVAILABLE);
 }
@@ -1501,6 +1527,7 @@ static void onATTimeout()
     at_close();
 
     fw100Ctx.s_closed = 1;
+    fw100SchedWake();
 
     /* FIXME cause a radio reset here */
 
@@ -1510,7 +1537,7 @@ static void onATTimeout()
 static void usage(char *s)
 {
     char tmp[128];
-    sprintf(tmp, "%s -d /dev/data_device -a /dev/atctrl_device\n", __FILE__);
+    sprintf(tmp, "%s -d /dev/data_device [-d /dev/data_device ..] -a /dev/atctrl_device\n", __FILE__);
     LOGD("%s %s\n", __FUNCTION__, tmp);
 }
 
@@ -1617,6 +1644,35 @@ done:
     return ret;
 }
 
+/**
+ * \brief periodic activation check, scheduler task
+ */
+static void activateTask(void *param)
+{
+    if (!fw100Ctx.moduleIsActivated) activateHelper(1);
+}
+
+/**
+ * \brief periodic modem state and services, scheduler task
+ * handles CREG, COPS, CSQ, PPP if screen state active
+ */
+static void modemTimerTask(void *param)
+{
+    if (fw100Ctx.screenState == SCREEN_IS_ON)
+        fw100ModemTimer();
+}
+
+/**
+ * \brief periodic status file refresh, scheduler task
+ * also picks up log level and capture changes in the control file.
+ * large slack, always batched with other modem work
+ */
+static void statusTask(void *param)
+{
+    rilReadRuntimeControl(&fw100Ctx, RIL_CONTROL_FILEPATH);
+    rilWriteStatus(&fw100Ctx, RIL_STATUS_FILEPATH);
+}
+
 /**
  * \brief main loop opens and monitors AT serial port 
  * kicks off readerLoop thread if modem is opened OK
@@ -1629,20 +1685,31 @@ static void *mainLoop(void *param)
     int ret;
     char tmp[128];
 
-    AT_DUMP("== ", "entering mainLoop()", -1 );
-
     sprintf(tmp, "starting at:%s data:%s\n", fw100Ctx.s_atctrl_path, 
        fw100Ctx.s_data_path);
     LOGD("%s %s", __FUNCTION__, tmp);
 
     at_set_on_reader_closed(onATReaderClosed);
     at_set_on_timeout(onATTimeout);
+    at_set_on_command_complete(onATCommandComplete);
 
     // one time create GPS ptty.  do this early to allow 
     // gps framework to open the port.  This makes a virtual tty
     // to output unsolicited GPS fix NMEA strings from modem.
     if (fw100Ctx.gpsTtyEnable) rilWriteGPSTty(&fw100Ctx, NULL, 1);
 
+    // ppp link state is reported by netlink, not polled
+    if (fw100DataInit() < 0) LOGE("%s link listener not started", __FUNCTION__);
+
+    // periodic modem work, batched by the scheduler into shared
+    // wakeup windows.  tasks persist across AT channel re-open.
+    fw100SchedAdd("activate", activateTask, NULL,
+        SCHED_ACTIVATE_PERIOD_MSEC, SCHED_ACTIVATE_SLACK_MSEC);
+    fw100SchedAdd("modemtimer", modemTimerTask, NULL,
+        SCHED_MODEMTIMER_PERIOD_MSEC, SCHED_MODEMTIMER_SLACK_MSEC);
+    fw100SchedAdd("status", statusTask, NULL,
+        SCHED_STATUS_PERIOD_MSEC, SCHED_STATUS_SLACK_MSEC);
+
     for (;;) {
         fd = -1;
         while  (fd < 0) {
@@ -1724,23 +1791,10 @@ check_fd:
 
         RIL_requestTimedCallback(initializeCallback, NULL, &fw100Ctx.TIMEVAL_0);
 
-        // top sleep gives initializeCallback a chance to dispatch
-	do 
-	{ 
-		sleep(10);
-
-                // check activation status
-                if (!fw100Ctx.moduleIsActivated) activateHelper(1);
-
-                // check if session is closed
-		if (fw100Ctx.s_closed) break;
-
-		// modem state and services timer handles CREG, COPS, CSQ, PPP 
-                // if screen state active
-                if (fw100Ctx.screenState == 1)
-                   fw100ModemTimer();
-
-	} while (1);
+        // run periodic tasks until session is closed.
+        // first batch is one period out, which gives 
+        // initializeCallback a chance to dispatch
+        fw100SchedRun(&fw100Ctx);
 
         LOGD("%s Re-open after close\n", __FUNCTION__);
     }
@@ -1783,7 +1837,8 @@ static void initSessionContext(fw100SessionCtx_t *ctx)
   rc = pthread_mutex_init(&ctx->s_state_mutex, NULL);
   rc = pthread_cond_init(&ctx->s_state_cond, NULL);
   
-  ctx->s_port = -1;
+  // -p loopback port, else -1
+  if (ctx->s_port == 0) ctx->s_port = -1;
   
   /* trigger change to this with s_state_cond */
   ctx->s_closed = 0;
@@ -1802,8 +1857,18 @@ static void initSessionContext(fw100SessionCtx_t *ctx)
   ctx->TIMEVAL_0.tv_usec = 0;
 
   ctx->screenState = SCREEN_IS_OFF;
+
+  ctx->signalDeadBand = SIGNAL_DEAD_BAND_DEFAULT;
+  ctx->signalMinInterval = SIGNAL_MIN_INTERVAL_DEFAULT;
+  ctx->signalBarsOnly = 0;
+  ctx->atCapture = 0;
+  ctx->atCaptureKBytes = AT_CAPTURE_KBYTES_DEFAULT;
+  ctx->atCaptureFiles = AT_CAPTURE_FILES_DEFAULT;
   ctx->inDataCall = DATA_STATE_DISCONNECTED;
   ctx->dataCallIsAutomatic = 0;
+  ctx->dataDialer = DATA_DIALER_DEFAULT;
+  ctx->dataPrewarm = DATA_PREWARM_DEFAULT;
+  ctx->linkStallReconnect = LINK_STALL_RECONNECT_DEFAULT;
 
   // turn on GPS NMEA output from module
   // this might be dynamically controlled on/off 
@@ -1818,7 +1883,10 @@ static void initSessionContext(fw100SessionCtx_t *ctx)
   ctx->gpsTtyFD = -1;
 
   // search pointer to devname in dev_path
+  // -d may be omitted when testing the AT port alone
+  if (NULL == ctx->s_data_path) ctx->s_data_path = RIL_DATA_PATH_DEFAULT;
   ctx->s_data_devname = trim_path(ctx->s_data_path);
+  if (0 == ctx->s_data_count) ctx->s_data_paths[ctx->s_data_count++] = ctx->s_data_path;
 
   // activation related
   ctx->moduleAutoActivate = 1;
@@ -1827,6 +1895,7 @@ static void initSessionContext(fw100SessionCtx_t *ctx)
 
   // read run-time preferences
   rilReadControl(ctx, RIL_CONTROL_FILEPATH);
+  rilApplyCapture(ctx);
 
 }
 
@@ -1838,8 +1907,10 @@ static void initSessionContext(fw100SessionCtx_t *ctx)
  *  \param argv argument vector
  * 
  *  argument list:
- *  data device node: -d /dev/ttyUSB0
+ *  data device node: -d /dev/ttyUSB0, repeated for a data call
+ *  context per port, up to DATA_MAX_CONTEXTS
  *  AT control device node: -a /dev/ttyUSB2
+ *  either may be a tools/fw100-sim pty: -a /tmp/fw100-at -d /tmp/fw100-data
  */
 const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **argv)
 {
@@ -1869,8 +1940,16 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
                 break;
 
             case 'd':
-                fw100Ctx.s_data_path = optarg;
-                LOGI("Opening device %s\n", fw100Ctx.s_data_path);
+                // each -d is a data call context, the first is cid 1
+                if (fw100Ctx.s_data_count >= DATA_MAX_CONTEXTS)
+                {
+                    LOGE("%s more than %d data ports, %s ignored", __FUNCTION__,
+                        DATA_MAX_CONTEXTS, optarg);
+                    break;
+                }
+                fw100Ctx.s_data_paths[fw100Ctx.s_data_count++] = optarg;
+                if (NULL == fw100Ctx.s_data_path) fw100Ctx.s_data_path = optarg;
+                LOGI("Opening device %s\n", optarg);
                 break;
 
             case 's':
@@ -1885,7 +1964,7 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
         }
     }
 
-    if (fw100Ctx.s_port < 0 && fw100Ctx.s_atctrl_path == NULL) {
+    if (fw100Ctx.s_port <= 0 && fw100Ctx.s_atctrl_path == NULL) {
         usage(argv[0]);
         return NULL;
     }
@@ -1893,6 +1972,15 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
     // options are OK, initialize session context
     initSessionContext(&fw100Ctx);
 
+    // deferred logging, levels were read with the control file
+    rlogInit();
+
+    // latency histograms and metrics socket
+    fw100MetricsInit(&fw100Ctx);
+
+    // data usage totals from the journal, before any link is seen
+    fw100UsageInit(RIL_USAGE_FILEPATH);
+
     pthread_attr_init (&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
     ret = pthread_create(&fw100Ctx.s_tid_mainloop, &attr, mainLoop, NULL);
@@ -8,9 +8,10 @@
 #define _fw100_ril_h_included
 
 extern const struct RIL_Env *s_rilenv;
+// completions and unsolicited responses are counted in rilinfo.c
 #define RIL_onRequestComplete(t, e, response, responselen) \
-  s_rilenv->OnRequestComplete(t,e, response, responselen)
-#define RIL_onUnsolicitedResponse(a,b,c) s_rilenv->OnUnsolicitedResponse(a,b,c)
+  rilOnRequestComplete(t,e, response, responselen)
+#define RIL_onUnsolicitedResponse(a,b,c) rilOnUnsolicitedResponse(a,b,c)
 #define RIL_requestTimedCallback(a,b,c) s_rilenv->RequestTimedCallback(a,b,c)
 
 // registration response
@@ -65,6 +66,25 @@ typedef enum {
 #define DATA_STATE_DISCONNECTED 0
 #define DATA_STATE_CONNECTED    1
 
+// data call contexts, one per -d data port.  cid 1 is the first port
+// and ppp0, cid N the Nth port and ppp<N-1>
+#define DATA_MAX_CONTEXTS       4
+
+// unsolicited notification filter defaults
+// signal strength is reported when dBm moves more than the dead
+// band either way (or bar level changes) and not more often than
+// min interval
+#define SIGNAL_DEAD_BAND_DEFAULT     2  // +/- dBm, one CSQ step
+#define SIGNAL_MIN_INTERVAL_DEFAULT  30 // seconds
+
+// AT traffic capture defaults, see atcapture.h
+#define AT_CAPTURE_KBYTES_DEFAULT    1024
+#define AT_CAPTURE_FILES_DEFAULT     4
+
+// AT command final response timeout, 0 waits forever.
+// on expiry the channel is closed and reopened
+#define AT_COMMAND_TIMEOUT_DEFAULT   0  // msec
+
 // max attempts to auto activate
 // clear by system restart
 #define MAX_AUTO_ACTIVATE_RETRY	6
@@ -85,6 +105,8 @@ typedef struct
   const char *s_atctrl_path;
   const char *s_data_path;     // example /dev/ttyUSB0
   const char *s_data_devname;  // node name only for ppp example ttyUSB0
+  const char *s_data_paths[DATA_MAX_CONTEXTS];  // every -d, [0] is s_data_path
+  int         s_data_count;
   int         s_device_socket;
  
   pthread_t s_tid_mainloop;
@@ -108,9 +130,27 @@ typedef struct
 
   int screenState;  
 
-  // data call management
+  // signal strength and registration notification filter
+  int signalDeadBand;           // +/- dBm change ignored
+  int signalBarsOnly;           // asserted to notify on bar level change only
+  int signalMinInterval;        // min seconds between signal notifications
+  unsigned int signalNotifyCnt;
+  unsigned int signalSuppressCnt;
+  unsigned int regNotifyCnt;
+  unsigned int regSuppressCnt;
+
+  // AT traffic capture, run time control
+  int atCapture;                // asserted to capture AT channel bytes
+  int atCaptureKBytes;          // rotate trace file at this size
+  int atCaptureFiles;           // trace files kept
+
+  // data call management, cid 1.  other contexts, see fw100DataContexts
   int inDataCall;
   int dataCallIsAutomatic;
+  int dataDialer;               // asserted to dial in the driver, not with chat
+  int dataPrewarm;              // PREWARM_*
+  int networkRegistered;        // +CREG stat home or roaming
+  int linkStallReconnect;       // asserted to restart a stalled data call
   char dataCallLocalIP[64];
   char dataCallGateway[64];
 
@@ -133,21 +173,43 @@ typedef struct
 
 } fw100SessionCtx_t;
 
+// data port when RIL_Init has no -d
+#define RIL_DATA_PATH_DEFAULT "/dev/ttyUSB0"
+
 // path to control and status files
 #define RIL_CONTROL_FILEPATH "/opt/fusion/fwril-control.txt"
 #define RIL_STATUS_FILEPATH "/opt/fusion/fwril-status.txt"
+#define RIL_STATS_FILEPATH "/opt/fusion/fwril-stats.txt"
+
+// OEM_HOOK_STRINGS command, writes per request stats to RIL_STATS_FILEPATH
+#define RIL_STATS_DUMP_CMD "FWRIL_DUMPSTATS"
+#define RIL_ATCAPTURE_FILEPATH "/opt/fusion/fwril-at.cap"
+
+// OEM_HOOK_STRINGS command, second string "1" starts "0" stops AT capture
+#define RIL_ATCAPTURE_CMD "FWRIL_ATCAPTURE"
+#define RIL_TRACE_FILEPATH "/opt/fusion/fwril-trace.json"
+
+// OEM_HOOK_STRINGS command, second string "1" starts "0" stops span
+// tracing, "dump" writes RIL_TRACE_FILEPATH
+#define RIL_TRACE_CMD "FWRIL_TRACE"
 #define RIL_GPS_FIFOPATH "/opt/fusion/gpsfifo"
 
 // helpers
 extern const char *requestToString(int request);
 extern fw100SessionCtx_t *fw100GetSessionCtx(void);
+extern const char *trim_path(const char *filepath);
 extern int isRadioOn(void);
 
 // utility functions
 int rilReadControl(fw100SessionCtx_t *ctx, const char *file);
+void rilReadRuntimeControl(fw100SessionCtx_t *ctx, const char *file);
+void rilApplyCapture(fw100SessionCtx_t *ctx);
 int rilWriteStatus(fw100SessionCtx_t *ctx, const char *file);
 int rilWriteGPS(fw100SessionCtx_t *ctx, const char *file, const char *gpsinfo);
 char *strToUpper(char *p, int max);
+long long fw100NowMsec(void);
+long long fw100NowUsec(void);
+int fw100CondWaitUntil(pthread_cond_t *cond, pthread_mutex_t *mutex, long long deadlineMsec);
 
 // GPS
 int rilWriteGPSFifo(fw100SessionCtx_t *ctx, const char *file, const char *gpsinfo);
@@ -176,8 +238,403 @@ extern void requestDataCallFailCause(void *data, size_t datalen, RIL_Token t);
 extern void fw100ModemTimer(void);
 extern int  pppAutomatic(void);
 
+// pppd supervisor, see fw100-ril-ppp.c
+#ifndef PPPD_PATH
+#if PLATFORM_X86
+#define PPPD_PATH "/usr/sbin/pppd"
+#else
+#define PPPD_PATH "/system/bin/pppd"
+#endif
+#endif
+#define PPP_STOP_TERM_MSEC  3000    // SIGTERM to SIGKILL
+#define PPP_STOP_KILL_MSEC  1000    // SIGKILL to giving up
+#define PPP_HANGUP_MSEC     2000    // ATH to NO CARRIER or pppd exit
+#define PPP_LINK_DOWN_MSEC  1000    // pppd exit to ppp0 down
+
+// pppd peer for a tty dialed by the driver, no device and no connect
+#define PPP_DIALER_PEER     "fw100-dialer"
+
+// fw100PppStart options
+#define PPP_OPT_NODEFAULTROUTE  0x01    // the driver adds the default route
+
+// one supervised pppd per unit, pppd unit <unit> makes ppp<unit>
+#define PPP_MAX_UNITS       DATA_MAX_CONTEXTS
+#define PPP_UNIT_PRIMARY    0       // cid 1 on the AT port's modem
+
+typedef void (*fw100PppExitFunc)(int unit, int status);
+int  fw100PppStart(int unit, const char *devname, const char *dialPath, int options);
+int  fw100PppStop(int unit, int termMsec);
+int  fw100PppSignal(int unit, int sig);
+void fw100PppSetExitFunc(fw100PppExitFunc func);
+int  fw100PppPid(int unit);
+int  fw100PppRunning(int unit);
+int  fw100PppExitStatus(int unit, unsigned int *starts);
+
+// data port dialer, see fw100-ril-dialer.c
+#define DATA_DIALER_DEFAULT 0       // dial with chat, DataDialer=Yes in the driver
+#define DIAL_STEP_MSEC      1000    // ATZ, AT
+#define DIAL_CONNECT_MSEC   30000   // ATD to CONNECT, as the chat script TIMEOUT
+
+#define DIAL_OK             0
+#define DIAL_ERR_OPEN       -1
+#define DIAL_ERR_IO         -2
+#define DIAL_ERR_TIMEOUT    -3
+#define DIAL_ERR_ABORT      -4      // modem answered NO CARRIER, BUSY, ..
+#define DIAL_ERR_CANCEL     -5
+
+typedef struct {
+    unsigned int attempts;
+    unsigned int connects;
+    int lastResult;                 // DIAL_OK, DIAL_ERR_*
+    char lastAbort[16];             // modem answer of the last abort
+    long long lastConnectUsec;      // ATD to CONNECT
+    long long connectTotalUsec;
+} fw100DialStats_t;
+
+int  fw100Dial(const char *path, volatile int *cancel);
+const char *fw100DialResultName(int result);
+void fw100DialStats(fw100DialStats_t *stats);
+
+// rtnetlink link state listener, see fw100-ril-netlink.c
+#define PPP_IFNAME          "ppp0"     // PPP_UNIT_PRIMARY
+#define PPP_IFNAME_FMT      "ppp%d"
+#define PPP_LINK_UP_MSEC    30000   // SETUP_DATA_CALL bound
+
+#define LINK_CHANGED_UP     0x1     // flags
+#define LINK_CHANGED_ADDR   0x2     // local, peer address or mask
+#define LINK_CHANGED_ROUTE  0x4     // default route via the interface
+
+typedef struct {
+    int up;                 // IFF_UP
+    unsigned int flags;     // interface flags
+    unsigned int addr;      // local address, network order, 0 none
+    unsigned int mask;
+    unsigned int peer;      // point to point peer
+    int defaultRoute;       // default route points at the interface
+    unsigned int gway;      // default route gateway, 0 none
+} fw100LinkState_t;
+
+// link is the index of the interface in fw100LinkStart's list
+typedef void (*fw100LinkFunc)(int link, const fw100LinkState_t *state, unsigned int changed);
+int  fw100LinkStart(const char *const *ifnames, int count, fw100LinkFunc func);
+int  fw100LinkGet(int link, fw100LinkState_t *state);
+int  fw100LinkWait(int link, int up, int timeoutMsec, fw100LinkState_t *state);
+
+// data call fail cause and history, see fw100-ril-failcause.c
+#define FAIL_HISTORY_MAX        8
+#define FAIL_CEND_WINDOW_MSEC   10000   // ^CEND this recent explains a failure
+
+#define FAIL_STAGE_SETUP        0       // data call did not come up
+#define FAIL_STAGE_DROP         1       // connected data call lost
+
+typedef struct {
+    long long msec;         // fw100NowMsec at failure
+    int stage;              // FAIL_STAGE_*
+    int cause;              // RIL_LastDataCallActivateFailCause
+    int pppStatus;          // pppd wait status, -1 pppd did not exit
+    int endStatus;          // ^CEND end status, -1 none
+    int ccCause;            // ^CEND call control cause, -1 none
+} fw100FailEntry_t;
+
+void fw100FailCallEnd(const char *line);
+int  fw100FailRecord(int stage, int pppStatus);
+int  fw100FailLastCause(void);
+int  fw100FailIsPermanent(int cause);
+int  fw100FailHistory(fw100FailEntry_t *entries, int max, unsigned int *total);
+
+// always on data session keeper, see fw100-ril-keeper.c
+#define KEEPER_BACKOFF_MIN_MSEC 5000    // first redial
+#define KEEPER_BACKOFF_MAX_MSEC 300000  // redial cap, and after a permanent cause
+#define KEEPER_STABLE_MSEC      60000   // session this long resets the backoff
+#define KEEPER_RX_IDLE_MSEC     60000   // transmit unanswered this long is a dead link
+#define KEEPER_PROBE_IDLE_MSEC  120000  // idle this long sends a probe
+
+#define KEEPER_OFF              0
+#define KEEPER_IDLE             1       // waiting to redial
+#define KEEPER_DIALING          2
+#define KEEPER_UP               3
+
+typedef struct {
+    unsigned int dials;
+    unsigned int reconnects;        // sessions brought up
+    unsigned int deadLinks;         // restarted by the health check
+    long long lastReconnectMsec;    // down to up, last session
+    long long reconnectTotalMsec;
+    long long upTotalMsec;          // session time while enabled
+    long long enabledTotalMsec;
+    long long nextDialMsec;         // until the redial, -1 none
+    long long enabledSinceMsec;
+    long long sessionStartMsec;
+    long long downSinceMsec;
+} fw100KeeperStats_t;
+
+void fw100KeeperPoll(int enable);
+void fw100KeeperLink(int up);
+void fw100KeeperPppExit(void);
+const char *fw100KeeperStats(fw100KeeperStats_t *stats);
+
+// ppp0 throughput and stall monitor, see fw100-ril-linkmon.c
+#define LINKMON_PERIOD_MSEC         5000
+#define LINKMON_SLACK_MSEC          1000
+#define LINKMON_WINDOW              12      // samples in the throughput window
+#define LINKMON_STALL_MSEC          20000   // sending with nothing received this long
+#define LINKMON_STALL_TX_PACKETS    3       // .. at least this many packets
+#define LINK_STALL_RECONNECT_DEFAULT 0       // stalls are counted only
+
+typedef struct {
+    unsigned long long rxBytes;
+    unsigned long long txBytes;
+    unsigned long long rxPackets;
+    unsigned long long txPackets;
+    unsigned long long rxErrors;
+    unsigned long long txErrors;
+    unsigned long long rxDropped;
+    unsigned long long txDropped;
+    int ifindex;                    // interface counted, 0 unknown
+} fw100LinkCounters_t;
+
+typedef struct {
+    int up;                         // sampling
+    fw100LinkCounters_t counters;   // last sample
+    unsigned int rxBps;             // window average, bytes per second
+    unsigned int txBps;
+    unsigned int rxPeakBps;         // best sample interval this session
+    unsigned int txPeakBps;
+    unsigned int samples;
+    unsigned int stalls;
+    unsigned int stallReconnects;
+    long long lastStallMsec;        // fw100NowMsec, 0 none
+} fw100LinkMonStats_t;
+
+int  fw100LinkReadCounter(const char *name, unsigned long long *value);
+int  fw100LinkGetCounters(int link, fw100LinkCounters_t *c);    // fw100-ril-netlink.c
+void fw100LinkMonLink(int up);
+void fw100LinkMonStats(fw100LinkMonStats_t *stats);
+
+// data usage accounting and journal, see fw100-ril-usage.c
+#define RIL_USAGE_FILEPATH      "/opt/fusion/fwril-usage.bin"
+#define USAGE_JOURNAL_MAGIC     "FWUSAGE1"
+#define USAGE_JOURNAL_VERSION   1
+#define USAGE_JOURNAL_SLOTS     16      // record ring, fits one 4 KB page
+#define USAGE_JOURNAL_MSEC      60000   // open session written this often
+
+typedef struct {
+  long long startSec;           // wall clock, 0 none
+  long long durationSec;
+  unsigned long long rxBytes;
+  unsigned long long txBytes;
+  unsigned long long rxPackets;
+  unsigned long long txPackets;
+} fw100UsageSession_t;
+
+typedef struct {
+  long long sinceSec;           // wall clock start of the first session
+  unsigned int sessions;
+  unsigned int pad;
+  long long durationSec;
+  unsigned long long rxBytes;
+  unsigned long long txBytes;
+  unsigned long long rxPackets;
+  unsigned long long txPackets;
+} fw100UsageTotals_t;
+
+// journal record, native byte order, in slot seq % USAGE_JOURNAL_SLOTS
+typedef struct {
+  char magic[8];
+  unsigned int version;
+  unsigned int seq;
+  unsigned int crc;             // crc32 of the record with crc 0
+  int ifindex;                  // ppp0 of the open session, 0 none
+  long long wallSec;            // written at
+  fw100UsageTotals_t total;     // closed sessions
+  fw100UsageSession_t session;  // open session
+  fw100UsageSession_t last;     // last closed session
+} fw100UsageRecord_t;
+
+int  fw100UsageInit(const char *file);
+void fw100UsageUpdate(const fw100LinkCounters_t *c, int up);
+unsigned int fw100UsageGet(fw100UsageRecord_t *usage);
+
+// packet data, see fw100-ril-data.c
+#define PREWARM_OFF             0
+#define PREWARM_SCREEN          1       // registered with the screen on
+#define PREWARM_ALWAYS          2       // registered
+#define DATA_PREWARM_DEFAULT    PREWARM_OFF
+#define PREWARM_IDLE_MSEC       120000  // unclaimed pre-warmed link is dropped
+#define PREWARM_PROPERTY        "net." PPP_IFNAME ".prewarm"    // 1 ip-up-ppp leaves net.dns*
+
+typedef struct {
+    unsigned int starts;            // links pre-warmed
+    unsigned int hits;              // SETUP_DATA_CALL found one up or coming up
+    unsigned int misses;            // SETUP_DATA_CALL found none
+    unsigned int expired;           // dropped unclaimed
+    long long savedTotalUsec;       // link bring up not waited for
+    long long lastSavedUsec;
+    long long hitSetupTotalUsec;    // SETUP_DATA_CALL to response, hits
+    unsigned int coldSetups;
+    long long coldSetupTotalUsec;   // SETUP_DATA_CALL to response, no pre-warm
+} fw100PrewarmStats_t;
+
+// data call context, see fw100DataContexts
+typedef struct {
+    int cid;
+    const char *path;               // data port
+    char ifname[16];
+    int state;                      // DATA_STATE_*
+    char localIP[64];
+    char gateway[64];
+    int pppPid;                     // 0 not running
+} fw100DataContext_t;
+
+int  fw100DataInit(void);
+int  fw100DataContexts(fw100DataContext_t *list, int max);
+void fw100DataNoCarrier(void);
+void fw100DataRestart(void);
+int  fw100DataDialPending(void);
+void fw100DataPrewarm(void);
+void fw100DataPrewarmStats(fw100PrewarmStats_t *stats);
+
 // activation
 int activateHelper(int options);
 
+// wakeup coalescing scheduler, see fw100-ril-sched.c
+// default period and slack for the mainLoop periodic tasks
+#define SCHED_ACTIVATE_PERIOD_MSEC   10000
+#define SCHED_ACTIVATE_SLACK_MSEC    5000
+#define SCHED_MODEMTIMER_PERIOD_MSEC 10000
+#define SCHED_MODEMTIMER_SLACK_MSEC  5000
+#define SCHED_SIMPOLL_SLACK_MSEC     500
+#define SCHED_STATUS_PERIOD_MSEC     300000
+#define SCHED_STATUS_SLACK_MSEC      60000
+
+typedef void (*fw100SchedFunc)(void *param);
+int  fw100SchedAdd(const char *name, fw100SchedFunc func, void *param, int periodMsec, int slackMsec);
+int  fw100SchedOnce(const char *name, fw100SchedFunc func, void *param, int delayMsec, int slackMsec);
+void fw100SchedCancel(int id);
+void fw100SchedSetSlack(const char *name, int slackMsec);
+void fw100SchedWake(void);
+void fw100SchedRun(fw100SessionCtx_t *ctx);
+unsigned int fw100SchedWakeupsPerHour(unsigned int *wakeups, unsigned int *runs);
+
+// latency histograms and metrics socket, see fw100-ril-metrics.c
+// log-linear buckets, 4 per power of 2, cover 0 to 2^32 usec
+#define RIL_METRICS_SOCKPATH "/opt/fusion/fwril-metrics.sock"
+#define METRICS_HIST_SUB      4
+#define METRICS_HIST_BUCKETS  124
+#define METRICS_MAX_SERIES    96
+#define METRICS_NAME_MAX      16
+
+#define METRICS_KIND_AT       0 // AT command by prefix
+#define METRICS_KIND_REQUEST  1 // RIL request by ID
+#define METRICS_KIND_URC      2 // unsolicited line by prefix
+#define METRICS_KIND_DIAL     3 // data port dial step by command
+
+typedef struct {
+  unsigned int count;
+  unsigned int errors;
+  unsigned long long sumUsec;
+  unsigned int maxUsec;
+  unsigned int bucket[METRICS_HIST_BUCKETS];
+} fw100Hist_t;
+
+// binary snapshot, "snapshot" request on the metrics socket
+// header followed by nSeries fw100MetricsSeries_t, native byte order
+#define METRICS_SNAP_MAGIC    "FWMETRC1"
+#define METRICS_SNAP_VERSION  1
+
+typedef struct {
+  char magic[8];
+  unsigned int version;
+  unsigned int nSeries;
+  long long uptimeMsec;
+  int radioState;
+  int queueDepth;
+  int screenState;
+  int inDataCall;
+} fw100MetricsSnapHdr_t;
+
+typedef struct {
+  int kind;
+  int id;                       // request ID, or 0
+  char name[METRICS_NAME_MAX];  // AT or URC prefix
+  fw100Hist_t hist;
+} fw100MetricsSeries_t;
+
+int  fw100MetricsInit(fw100SessionCtx_t *ctx);
+void fw100MetricsAT(const char *command, int err, long long startUsec, long long endUsec);
+void fw100MetricsRequest(int request, int err, unsigned int usec);
+void fw100MetricsURC(const char *line, unsigned int usec);
+void fw100MetricsDial(const char *command, int err, long long startUsec, long long endUsec);
+
+// span tracing, see fw100-ril-trace.c
+// trace calls are no-ops unless tracing is enabled
+extern volatile int fw100TraceEnabled;
+void fw100TraceEnable(int on);
+void fw100TraceSpan(const char *cat, const char *name, long long startUsec,
+    long long endUsec, const char *arg);
+void fw100TraceRequest(const char *name, RIL_Token t, int beginTid,
+    long long startUsec, long long endUsec, int err);
+int  fw100TraceDump(const char *file);
+
+// AT response schemas and command templates, see fw100-ril-schema.c
+#include <atchannel.h>
+#include <atschema.h>
+
+typedef struct {
+    char status[8];         // +CREG registration status
+    int roam;               // ^SYSINFO
+    int protocol;           // ^SYSINFO protocol revision
+    char sid[8];            // +CSNID
+    char nid[8];
+    char romIndicator[8];   // +VROM TSB-58 roaming indicator
+} fw100RegInfo_t;
+
+typedef struct {
+    int rssi;               // +CSQ
+    int ber;
+    int hdr;                // ^HDRCSQ
+    int ecio;               // +NETPAR
+} fw100SignalInfo_t;
+
+typedef struct {
+    int display;            // +VPON
+    int ps;
+} fw100PowerInfo_t;
+
+typedef struct {
+    char mcc[8];            // +VMCCMNC
+    char mnc[8];
+} fw100MccMnc_t;
+
+typedef struct {
+    int callId;             // ^CEND
+    int duration;
+    int endStatus;
+    int ccCause;
+} fw100CallEnd_t;
+
+extern const ATSchema fw100SchemaCreg;
+extern const ATSchema fw100SchemaSysinfo;
+extern const ATSchema fw100SchemaCsnid;
+extern const ATSchema fw100SchemaVrom;
+extern const ATSchema fw100SchemaCsq;
+extern const ATSchema fw100SchemaHdrCsq;
+extern const ATSchema fw100SchemaNetpar;
+extern const ATSchema fw100SchemaVpon;
+extern const ATSchema fw100SchemaMccMnc;
+extern const ATSchema fw100SchemaCend;
+
+extern const ATCommandTemplate fw100CmdDial;
+extern const ATCommandTemplate fw100CmdHangup;
+extern const ATCommandTemplate fw100CmdDtmf;
+extern const ATCommandTemplate fw100CmdWriteSms;
+extern const ATCommandTemplate fw100CmdSendSms;
+extern const ATCommandTemplate fw100CmdDeleteSms;
+extern const ATCommandTemplate fw100CmdSimIo;
+extern const ATCommandTemplate fw100CmdSimIoData;
+extern const ATCommandTemplate fw100CmdPin;
+extern const ATCommandTemplate fw100CmdPin2;
+extern const ATCommandTemplate fw100CmdPrefMode;
+
 #endif  // _fw100_ril_h_included
 
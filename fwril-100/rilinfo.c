@@ -10,125 +10,343 @@
  *
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <telephony/ril.h>
 #include <rilinfo.h>
 
+#include <fw100-ril.h>
+
+// table entry generators, name is the stringized ID
+#define RRI(id, profile)  [id] = {id, profile, #id, {0, 0, 0, 0}}
+#define RUI(id)           [(id) - RIL_UNSOL_RESPONSE_BASE] = {id, #id, 0}
+
 /**
  * \brief ril request info table
- * table is sparse 
+ * table is dense, indexed by request ID.  
+ * holes have id zero and are not supported.
  */
-static ril_request_info_t ril_request_info [] = 
+static ril_request_info_t ril_request_info [RRI_RQST_TABLE_SIZE] = 
 {
-	 {RIL_REQUEST_GET_SIM_STATUS,            RRI_PROFILE_NS, "RIL_REQUEST_GET_SIM_STATUS"},
-         {RIL_REQUEST_GET_CURRENT_CALLS,         RRI_PROFILE_1,  "RIL_REQUEST_GET_CURRENT_CALLS"},
-         {RIL_REQUEST_DIAL,                      RRI_PROFILE_NS,  "RIL_REQUEST_DIAL"},
-         {RIL_REQUEST_SCREEN_STATE,              RRI_PROFILE_1,  "RIL_REQUEST_SCREEN_STATE"}, 
-         {RIL_REQUEST_EXIT_EMERGENCY_CALLBACK_MODE, RRI_PROFILE_2, "RIL_REQUEST_EXIT_EMERGENCY_CALLBACK_MODE"},
-         {RIL_REQUEST_SET_MUTE,                  RRI_PROFILE_2,  "RIL_REQUEST_SET_MUTE"},
-         {RIL_REQUEST_CDMA_FLASH,                RRI_PROFILE_1,  "RIL_REQUEST_CDMA_FLASH"},
-         {RIL_REQUEST_HANGUP,                    RRI_PROFILE_NS,  "RIL_REQUEST_HANGUP"},
-         {RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND, RRI_PROFILE_1, "RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND"},
-         {RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND, RRI_PROFILE_1, "RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND"},
-         {RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE, RRI_PROFILE_1, "RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE"},
-         {RIL_REQUEST_ANSWER,                    RRI_PROFILE_1,  "RIL_REQUEST_ANSWER"},
-         {RIL_REQUEST_CONFERENCE,                RRI_PROFILE_2,  "RIL_REQUEST_CONFERENCE"},
-         {RIL_REQUEST_UDUB,                      RRI_PROFILE_1,  "RIL_REQUEST_UDUB"},
-         {RIL_REQUEST_SEPARATE_CONNECTION,       RRI_PROFILE_1,  "RIL_REQUEST_SEPARATE_CONNECTION"},
-         {RIL_REQUEST_SIGNAL_STRENGTH,           RRI_PROFILE_1,  "RIL_REQUEST_SIGNAL_STRENGTH"},
-         {RIL_REQUEST_REGISTRATION_STATE,        RRI_PROFILE_1,  "RIL_REQUEST_REGISTRATION_STATE"},
-         {RIL_REQUEST_GPRS_REGISTRATION_STATE,   RRI_PROFILE_1,  "RIL_REQUEST_GPRS_REGISTRATION_STATE"},
-         {RIL_REQUEST_OPERATOR,                  RRI_PROFILE_1,  "RIL_REQUEST_OPERATOR"},
-         {RIL_REQUEST_CDMA_SUBSCRIPTION,         RRI_PROFILE_1,  "RIL_REQUEST_CDMA_SUBSCRIPTION"},
-         {RIL_REQUEST_DEVICE_IDENTITY,           RRI_PROFILE_1,  "RIL_REQUEST_DEVICE_IDENTITY"},
-         {RIL_REQUEST_RADIO_POWER,               RRI_PROFILE_1,  "RIL_REQUEST_RADIO_POWER"},
-         {RIL_REQUEST_QUERY_FACILITY_LOCK,       RRI_PROFILE_1,  "RIL_REQUEST_QUERY_FACILITY_LOCK"},
-         {RIL_REQUEST_SET_FACILITY_LOCK,         RRI_PROFILE_1,  "RIL_REQUEST_SET_FACILITY_LOCK"},
-         {RIL_REQUEST_DTMF,                      RRI_PROFILE_NS, "RIL_REQUEST_DTMF"}, 
-         {RIL_REQUEST_DTMF_START,                RRI_PROFILE_NS, "RIL_REQUEST_DTMF_START"},
-         {RIL_REQUEST_DTMF_STOP,                 RRI_PROFILE_NS, "RIL_REQUEST_DTMF_STOP"},
-         {RIL_REQUEST_CDMA_BURST_DTMF,           RRI_PROFILE_NS, "RIL_REQUEST_CDMA_BURST_DTMF"},
-         {RIL_REQUEST_SEND_SMS,                  RRI_PROFILE_NS, "RIL_REQUEST_SEND_SMS"},
-         {RIL_REQUEST_SETUP_DATA_CALL,           RRI_PROFILE_1,  "RIL_REQUEST_SETUP_DATA_CALL"},
-         {RIL_REQUEST_LAST_DATA_CALL_FAIL_CAUSE, RRI_PROFILE_1,  "RIL_REQUEST_LAST_DATA_CALL_FAIL_CAUSE"},
-         {RIL_REQUEST_DEACTIVATE_DATA_CALL,      RRI_PROFILE_1,  "RIL_REQUEST_DEACTIVATE_DATA_CALL"},
-         {RIL_REQUEST_SMS_ACKNOWLEDGE,           RRI_PROFILE_1,  "RIL_REQUEST_SMS_ACKNOWLEDGE"},
-         {RIL_REQUEST_GET_IMSI,                  RRI_PROFILE_1,  "RIL_REQUEST_GET_IMSI"},
-         {RIL_REQUEST_BASEBAND_VERSION,          RRI_PROFILE_1,  "RIL_REQUEST_BASEBAND_VERSION"},
-         {RIL_REQUEST_GET_IMEI,                  RRI_PROFILE_1,  "RIL_REQUEST_GET_IMEI"},
-         {RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE, RRI_PROFILE_1, "RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE"},
-         {RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE, RRI_PROFILE_1, "RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE"},
-         {RIL_REQUEST_SIM_IO,                    RRI_PROFILE_NS, "RIL_REQUEST_SIM_IO"},
-         {RIL_REQUEST_SEND_USSD,                 RRI_PROFILE_1,  "RIL_REQUEST_SEND_USSD"},
-         {RIL_REQUEST_CANCEL_USSD,               RRI_PROFILE_1,  "RIL_REQUEST_CANCEL_USSD"},
-
-         {RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE, RRI_PROFILE_1, "RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE"},
-         {RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC, RRI_PROFILE_1, "RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC"},
-         {RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL,  RRI_PROFILE_1,  "RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL"},
-         {RIL_REQUEST_QUERY_AVAILABLE_NETWORKS,  RRI_PROFILE_1,  "RIL_REQUEST_QUERY_AVAILABLE_NETWORKS"},
-
-         {RIL_REQUEST_DATA_CALL_LIST,            RRI_PROFILE_1,  "RIL_REQUEST_DATA_CALL_LIST"},
-         {RIL_REQUEST_OEM_HOOK_RAW,              RRI_PROFILE_NS, "RIL_REQUEST_OEM_HOOK_RAW"},
-         {RIL_REQUEST_OEM_HOOK_STRINGS,          RRI_PROFILE_NS, "RIL_REQUEST_OEM_HOOK_STRINGS"},
-         {RIL_REQUEST_WRITE_SMS_TO_SIM,          RRI_PROFILE_NS, "RIL_REQUEST_WRITE_SMS_TO_SIM"},
-         {RIL_REQUEST_DELETE_SMS_ON_SIM,         RRI_PROFILE_NS, "RIL_REQUEST_DELETE_SMS_ON_SIM"},
-         {RIL_REQUEST_ENTER_SIM_PIN,             RRI_PROFILE_NS, "RIL_REQUEST_ENTER_SIM_PIN"},
-         {RIL_REQUEST_ENTER_SIM_PIN2,            RRI_PROFILE_NS, "RIL_REQUEST_ENTER_SIM_PIN2"},
-         {RIL_REQUEST_ENTER_SIM_PUK2,            RRI_PROFILE_NS, "RIL_REQUEST_ENTER_SIM_PUK2"},
-         {RIL_REQUEST_CHANGE_SIM_PIN,            RRI_PROFILE_NS, "RIL_REQUEST_CHANGE_SIM_PIN"},
-         {RIL_REQUEST_CHANGE_SIM_PIN2,           RRI_PROFILE_NS, "RIL_REQUEST_CHANGE_SIM_PIN2"},
-         {RIL_REQUEST_ENTER_SIM_PUK,             RRI_PROFILE_NS, "RIL_REQUEST_ENTER_SIM_PUK"},
-         {RIL_REQUEST_CDMA_SEND_SMS,             RRI_PROFILE_1,  "RIL_REQUEST_CDMA_SEND_SMS"},
-         {RIL_REQUEST_CDMA_WRITE_SMS_TO_RUIM,    RRI_PROFILE_NS, "RIL_REQUEST_CDMA_WRITE_SMS_TO_RUIM"},
-         {RIL_REQUEST_CDMA_DELETE_SMS_ON_RUIM,   RRI_PROFILE_NS, "RIL_REQUEST_CDMA_DELETE_SMS_ON_RUIM"},
-         {RIL_REQUEST_CDMA_SMS_ACKNOWLEDGE,      RRI_PROFILE_1,  "RIL_REQUEST_CDMA_SMS_ACKNOWLEDGE"},
-         {RIL_REQUEST_STK_SET_PROFILE,           RRI_PROFILE_NS, "RIL_REQUEST_STK_SET_PROFILE"},
-         {RIL_REQUEST_STK_SEND_ENVELOPE_COMMAND, RRI_PROFILE_NS, "RIL_REQUEST_STK_SEND_ENVELOPE_COMMAND"},
-         {RIL_REQUEST_STK_SEND_TERMINAL_RESPONSE,RRI_PROFILE_NS, "RIL_REQUEST_STK_SEND_TERMINAL_RESPONSE"},
-         {RIL_REQUEST_CDMA_SET_PREFERRED_VOICE_PRIVACY_MODE, RRI_PROFILE_2, "RIL_REQUEST_CDMA_SET_PREFERRED_VOICE_PRIVACY_MODE"},
-         {RIL_REQUEST_CDMA_QUERY_PREFERRED_VOICE_PRIVACY_MODE, RRI_PROFILE_2, "RIL_REQUEST_CDMA_QUERY_PREFERRED_VOICE_PRIVACY_MODE"},
-	 {0, 0, ""}
+	RRI(RIL_REQUEST_GET_SIM_STATUS,                          RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_GET_CURRENT_CALLS,                       RRI_PROFILE_1),
+	RRI(RIL_REQUEST_DIAL,                                    RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_SCREEN_STATE,                            RRI_PROFILE_1),
+	RRI(RIL_REQUEST_EXIT_EMERGENCY_CALLBACK_MODE,            RRI_PROFILE_2),
+	RRI(RIL_REQUEST_SET_MUTE,                                RRI_PROFILE_2),
+	RRI(RIL_REQUEST_CDMA_FLASH,                              RRI_PROFILE_1),
+	RRI(RIL_REQUEST_HANGUP,                                  RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND,            RRI_PROFILE_1),
+	RRI(RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND,     RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE,    RRI_PROFILE_1),
+	RRI(RIL_REQUEST_ANSWER,                                  RRI_PROFILE_1),
+	RRI(RIL_REQUEST_CONFERENCE,                              RRI_PROFILE_2),
+	RRI(RIL_REQUEST_UDUB,                                    RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SEPARATE_CONNECTION,                     RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SIGNAL_STRENGTH,                         RRI_PROFILE_1),
+	RRI(RIL_REQUEST_REGISTRATION_STATE,                      RRI_PROFILE_1),
+	RRI(RIL_REQUEST_GPRS_REGISTRATION_STATE,                 RRI_PROFILE_1),
+	RRI(RIL_REQUEST_OPERATOR,                                RRI_PROFILE_1),
+	RRI(RIL_REQUEST_CDMA_SUBSCRIPTION,                       RRI_PROFILE_1),
+	RRI(RIL_REQUEST_DEVICE_IDENTITY,                         RRI_PROFILE_1),
+	RRI(RIL_REQUEST_RADIO_POWER,                             RRI_PROFILE_1),
+	RRI(RIL_REQUEST_QUERY_FACILITY_LOCK,                     RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SET_FACILITY_LOCK,                       RRI_PROFILE_1),
+	RRI(RIL_REQUEST_DTMF,                                    RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_DTMF_START,                              RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_DTMF_STOP,                               RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_CDMA_BURST_DTMF,                         RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_SEND_SMS,                                RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_SETUP_DATA_CALL,                         RRI_PROFILE_1),
+	RRI(RIL_REQUEST_LAST_DATA_CALL_FAIL_CAUSE,               RRI_PROFILE_1),
+	RRI(RIL_REQUEST_DEACTIVATE_DATA_CALL,                    RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SMS_ACKNOWLEDGE,                         RRI_PROFILE_1),
+	RRI(RIL_REQUEST_GET_IMSI,                                RRI_PROFILE_1),
+	RRI(RIL_REQUEST_BASEBAND_VERSION,                        RRI_PROFILE_1),
+	RRI(RIL_REQUEST_GET_IMEI,                                RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE,              RRI_PROFILE_1),
+	RRI(RIL_REQUEST_GET_PREFERRED_NETWORK_TYPE,              RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SIM_IO,                                  RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_SEND_USSD,                               RRI_PROFILE_1),
+	RRI(RIL_REQUEST_CANCEL_USSD,                             RRI_PROFILE_1),
+	RRI(RIL_REQUEST_QUERY_NETWORK_SELECTION_MODE,            RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC,         RRI_PROFILE_1),
+	RRI(RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL,            RRI_PROFILE_1),
+	RRI(RIL_REQUEST_QUERY_AVAILABLE_NETWORKS,                RRI_PROFILE_1),
+	RRI(RIL_REQUEST_DATA_CALL_LIST,                          RRI_PROFILE_1),
+	RRI(RIL_REQUEST_OEM_HOOK_RAW,                            RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_OEM_HOOK_STRINGS,                        RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_WRITE_SMS_TO_SIM,                        RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_DELETE_SMS_ON_SIM,                       RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_ENTER_SIM_PIN,                           RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_ENTER_SIM_PIN2,                          RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_ENTER_SIM_PUK2,                          RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_CHANGE_SIM_PIN,                          RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_CHANGE_SIM_PIN2,                         RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_ENTER_SIM_PUK,                           RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_CDMA_SEND_SMS,                           RRI_PROFILE_1),
+	RRI(RIL_REQUEST_CDMA_WRITE_SMS_TO_RUIM,                  RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_CDMA_DELETE_SMS_ON_RUIM,                 RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_CDMA_SMS_ACKNOWLEDGE,                    RRI_PROFILE_1),
+	RRI(RIL_REQUEST_STK_SET_PROFILE,                         RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_STK_SEND_ENVELOPE_COMMAND,               RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_STK_SEND_TERMINAL_RESPONSE,              RRI_PROFILE_NS),
+	RRI(RIL_REQUEST_CDMA_SET_PREFERRED_VOICE_PRIVACY_MODE,   RRI_PROFILE_2),
+	RRI(RIL_REQUEST_CDMA_QUERY_PREFERRED_VOICE_PRIVACY_MODE, RRI_PROFILE_2),
 };
 
 /**
- *  \brief linear search for request ID, returning name
+ * \brief ril unsolicited info table
+ * table is dense, indexed by ID - RIL_UNSOL_RESPONSE_BASE
+ */
+static ril_unsol_info_t ril_unsol_info [RRI_UNSOL_TABLE_SIZE] = 
+{
+	RUI(RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED),
+	RUI(RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED),
+	RUI(RIL_UNSOL_RESPONSE_NETWORK_STATE_CHANGED),
+	RUI(RIL_UNSOL_RESPONSE_NEW_SMS),
+	RUI(RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT),
+	RUI(RIL_UNSOL_RESPONSE_NEW_SMS_ON_SIM),
+	RUI(RIL_UNSOL_ON_USSD),
+	RUI(RIL_UNSOL_ON_USSD_REQUEST),
+	RUI(RIL_UNSOL_NITZ_TIME_RECEIVED),
+	RUI(RIL_UNSOL_SIGNAL_STRENGTH),
+	RUI(RIL_UNSOL_DATA_CALL_LIST_CHANGED),
+	RUI(RIL_UNSOL_SUPP_SVC_NOTIFICATION),
+	RUI(RIL_UNSOL_STK_SESSION_END),
+	RUI(RIL_UNSOL_STK_PROACTIVE_COMMAND),
+	RUI(RIL_UNSOL_STK_EVENT_NOTIFY),
+	RUI(RIL_UNSOL_STK_CALL_SETUP),
+	RUI(RIL_UNSOL_SIM_SMS_STORAGE_FULL),
+	RUI(RIL_UNSOL_SIM_REFRESH),
+	RUI(RIL_UNSOL_CALL_RING),
+	RUI(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED),
+	RUI(RIL_UNSOL_RESPONSE_CDMA_NEW_SMS),
+	RUI(RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS),
+	RUI(RIL_UNSOL_CDMA_RUIM_SMS_STORAGE_FULL),
+	RUI(RIL_UNSOL_RESTRICTED_STATE_CHANGED),
+	RUI(RIL_UNSOL_ENTER_EMERGENCY_CALLBACK_MODE),
+	RUI(RIL_UNSOL_CDMA_CALL_WAITING),
+	RUI(RIL_UNSOL_CDMA_OTA_PROVISION_STATUS),
+	RUI(RIL_UNSOL_CDMA_INFO_REC),
+	RUI(RIL_UNSOL_OEM_HOOK_RAW),
+};
+
+// requests issued and not yet completed.  a request may complete on
+// the reader, netlink, reaper or scheduler thread after later ones
+// have been dispatched, so each is held by token until it completes
+#define RRI_INFLIGHT_MAX	16
+
+typedef struct
+{
+	RIL_Token token;		// NULL free
+	long long startUsec;
+	int tid;			// dispatch thread, for the trace
+	ril_request_info_t *info;
+} ril_inflight_t;
+
+static ril_inflight_t s_inflight[RRI_INFLIGHT_MAX];
+static pthread_mutex_t s_statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long long nowUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ *  \brief direct index request ID, returning name
  *
  *  \param request - enumerated RIL request ID
- *  \return request name string, or NULL on search fail
+ *  \return request name string, or NULL if not in table
  */ 
 const char *requestToString(int request)
 {
-	ril_request_info_t *info = ril_request_info;
-	do 
-	{
-		if (request == info->id) 
-			return info->name;
-		info++;
-
-	} while (info->id != 0);
+	const ril_request_info_t *info = requestInfo(request);
 
-	return NULL;
+	return (NULL == info) ? NULL : info->name;
 }
 
 /**
- *  \brief linear search for request ID, returning descriptor
+ *  \brief direct index request ID, returning descriptor
  *
  *  \param request - enumerated RIL request ID
- *  \return pointer to request info structure, or NULL on search fail
+ *  \return pointer to request info structure, or NULL if not in table
  */ 
 const ril_request_info_t *requestInfo(int request)
 {
-	ril_request_info_t *info = ril_request_info;
-	do 
+	if (request <= 0 || request >= RRI_RQST_TABLE_SIZE) 
+		return NULL;
+	if (ril_request_info[request].id != request) 
+		return NULL;
+
+	return &ril_request_info[request];
+}
+
+/**
+ *  \brief direct index unsolicited ID, returning name
+ *
+ *  \param unsol - enumerated RIL_UNSOL ID
+ *  \return unsolicited name string, or NULL if not in table
+ */ 
+const char *unsolToString(int unsol)
+{
+	int idx = unsol - RIL_UNSOL_RESPONSE_BASE;
+
+	if (idx < 0 || idx >= RRI_UNSOL_TABLE_SIZE) 
+		return NULL;
+	if (ril_unsol_info[idx].id != unsol) 
+		return NULL;
+
+	return ril_unsol_info[idx].name;
+}
+
+/**
+ *  \brief mark start of request dispatch
+ *  called from onRequest on the RIL dispatch thread.  a full table
+ *  drops the oldest request, one the driver never completed
+ *
+ *  \param request - enumerated RIL request ID
+ *  \param t - request token
+ */ 
+void requestStatsBegin(int request, RIL_Token t)
+{
+	ril_request_info_t *info = (ril_request_info_t *) requestInfo(request);
+	ril_inflight_t *slot = NULL;
+	int i;
+
+	if (NULL == info) return;
+
+	pthread_mutex_lock(&s_statsMutex);
+	info->stats.count++;
+	if (NULL == t)
+	{
+		pthread_mutex_unlock(&s_statsMutex);
+		return;
+	}
+	for (i = 0; i < RRI_INFLIGHT_MAX; i++)
+	{
+		if (NULL == s_inflight[i].token)
+		{
+			slot = &s_inflight[i];
+			break;
+		}
+		if (NULL == slot || s_inflight[i].startUsec < slot->startUsec)
+			slot = &s_inflight[i];
+	}
+	slot->token = t;
+	slot->info = info;
+	slot->startUsec = nowUsec();
+	slot->tid = (int)syscall(SYS_gettid);
+	pthread_mutex_unlock(&s_statsMutex);
+}
+
+/**
+ *  \brief account request completion, any thread
+ *  the completion of an issued request records latency, and errors
+ *  other than RIL_E_SUCCESS, and frees its entry
+ */ 
+static void requestStatsComplete(RIL_Token t, RIL_Errno e)
+{
+	ril_request_info_t *info = NULL;
+	unsigned int usec = 0;
+	long long start = 0;
+	long long end = nowUsec();
+	int tid = 0;
+	int i;
+
+	if (NULL == t) return;
+
+	pthread_mutex_lock(&s_statsMutex);
+	for (i = 0; i < RRI_INFLIGHT_MAX; i++)
 	{
-		if (request == info->id) 
-			return info;
-		info++;
+		if (s_inflight[i].token != t) continue;
+		info = s_inflight[i].info;
+		start = s_inflight[i].startUsec;
+		tid = s_inflight[i].tid;
+		s_inflight[i].token = NULL;
+
+		usec = (unsigned int)(end - start);
+		info->stats.totalUsec += usec;
+		if (usec > info->stats.maxUsec) info->stats.maxUsec = usec;
+		if (e != RIL_E_SUCCESS) info->stats.errors++;
+		break;
+	}
+	pthread_mutex_unlock(&s_statsMutex);
+
+	if (NULL == info) return;
+
+	fw100MetricsRequest(info->id, e, usec);
+	fw100TraceRequest(info->name, t, tid, start, end, e);
+}
+
+/**
+ *  \brief counted wrapper for libril OnRequestComplete
+ *  see RIL_onRequestComplete in fw100-ril.h
+ */ 
+void rilOnRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responselen)
+{
+	requestStatsComplete(t, e);
+	s_rilenv->OnRequestComplete(t, e, response, responselen);
+}
 
-	} while (info->id != 0);
+/**
+ *  \brief counted wrapper for libril OnUnsolicitedResponse
+ *  may be called on reader thread and others
+ */ 
+void rilOnUnsolicitedResponse(int unsolResponse, const void *data, size_t datalen)
+{
+	int idx = unsolResponse - RIL_UNSOL_RESPONSE_BASE;
 
-	return NULL;
+	if (idx >= 0 && idx < RRI_UNSOL_TABLE_SIZE) 
+		__sync_fetch_and_add(&ril_unsol_info[idx].count, 1);
+
+	s_rilenv->OnUnsolicitedResponse(unsolResponse, data, datalen);
 }
 
+/**
+ *  \brief write per request and unsolicited statistics 
+ *
+ *  \param file - name of file to write
+ *  \return 0 OK, -1 error writing file
+ */ 
+int requestStatsDump(const char *file)
+{
+	int i;
+	FILE *f;
+	const ril_request_info_t *info;
+
+	f = fopen(file, "wb");
+	if (NULL == f) return -1;
+
+	fprintf(f, "%-52s %8s %6s %10s %10s\n", 
+		"request", "count", "errors", "avg_usec", "max_usec");
+	for (i = 0; i < RRI_RQST_TABLE_SIZE; i++)
+	{
+		info = &ril_request_info[i];
+		if (info->id == 0 || info->stats.count == 0) continue;
+		fprintf(f, "%-52s %8u %6u %10llu %10u\n", 
+			info->name, info->stats.count, info->stats.errors,
+			info->stats.totalUsec / info->stats.count,
+			info->stats.maxUsec);
+	}
+
+	fprintf(f, "\n%-52s %8s\n", "unsolicited", "count");
+	for (i = 0; i < RRI_UNSOL_TABLE_SIZE; i++)
+	{
+		if (ril_unsol_info[i].id == 0 || ril_unsol_info[i].count == 0) continue;
+		fprintf(f, "%-52s %8u\n", ril_unsol_info[i].name, ril_unsol_info[i].count);
+	}
+
+	fclose(f);
+	return 0;
+}
@@ -17,18 +17,44 @@
 // this product profile
 #define RRI_MY_PROFILE  RRI_PROFILE_1
 
-// highest RIL request in rilinfo.c ril_request_info table
-#define RRI_RQST_MAX RIL_REQUEST_CDMA_QUERY_PREFERRED_VOICE_PRIVACY_MODE
+// dense table sizes in rilinfo.c, indexed by request ID 
+// and by unsolicited ID - RIL_UNSOL_RESPONSE_BASE
+#define RRI_RQST_TABLE_SIZE  128
+#define RRI_UNSOL_TABLE_SIZE 40
+
+// per request live counters
+typedef struct ril_request_stats
+{
+	unsigned int count;
+	unsigned int errors;
+	unsigned long long totalUsec;
+	unsigned int maxUsec;
+} ril_request_stats_t;
 
 typedef struct ril_request_info
 {
 	int id;
 	int profile;
-	const char name[MAX_RRI_NAME+1];
+	const char *name;
+	ril_request_stats_t stats;
 } ril_request_info_t;
 
+typedef struct ril_unsol_info
+{
+	int id;
+	const char *name;
+	unsigned int count;
+} ril_unsol_info_t;
+
 const char *requestToString(int request);
 const ril_request_info_t *requestInfo(int request);
+const char *unsolToString(int unsol);
+
+// per request statistics
+void requestStatsBegin(int request, RIL_Token t);
+int  requestStatsDump(const char *file);
+void rilOnRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responselen);
+void rilOnUnsolicitedResponse(int unsolResponse, const void *data, size_t datalen);
 
 #endif // _rilinfo_h_included
 
@@ -0,0 +1,306 @@
+/**
+ * \file rillog.c
+ * \brief deferred binary log ring
+ *
+ * Producers reserve a slot with a compare and swap on the ring head,
+ * fill it and publish it by writing the slot sequence number.  When
+ * the ring is full the record is dropped and counted, the producer
+ * never blocks.  The flusher thread consumes published slots in
+ * order and sleeps when the ring is empty; a producer wakes it only
+ * on the first record after it went idle.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <time.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#include <rillog.h>
+
+// build options
+#define BUILD_DEBUG_1	0
+
+// ring size, must be a power of 2
+#define RLOG_RING_SIZE	1024
+#define RLOG_RING_MASK	(RLOG_RING_SIZE - 1)
+
+// a record flushed later than this is tagged with its age
+#define RLOG_LAG_MSEC	20
+
+typedef struct rlog_rec
+{
+	volatile unsigned int seq;	// published sequence + 1
+	unsigned char ss;
+	unsigned char lvl;
+	short len;			// string length, -1 integer record
+	const char *tag;
+	const char *fmt;		// format ID
+	long long usec;
+	union {
+		int arg[4];
+		char str[RLOG_STR_MAX + 1];
+	} u;
+} rlog_rec_t;
+
+// default levels match the previous LOGD output
+unsigned char rlog_level[RLOG_SS_MAX] =
+{
+	RLOG_DEBUG,	// RLOG_SS_AT
+	RLOG_DEBUG,	// RLOG_SS_RIL
+	RLOG_DEBUG,	// RLOG_SS_DATA
+	RLOG_DEBUG,	// RLOG_SS_GPS
+	RLOG_DEBUG,	// RLOG_SS_TIMER
+};
+
+static const char *rlog_names[RLOG_SS_MAX] =
+{
+	"at", "ril", "data", "gps", "timer"
+};
+
+static rlog_rec_t s_ring[RLOG_RING_SIZE];
+static volatile unsigned int s_head;
+static volatile unsigned int s_tail;
+static volatile unsigned int s_dropped;
+static volatile unsigned int s_records;
+static volatile int s_idle;
+static int s_started;
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+
+static long long nowUsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ *  \brief reserve a ring slot
+ *  \return slot pointer, or NULL if the ring is full
+ */
+static rlog_rec_t *reserve(unsigned int *seq)
+{
+	unsigned int head;
+
+	do {
+		head = s_head;
+		if (head - s_tail >= RLOG_RING_SIZE) {
+			__sync_fetch_and_add(&s_dropped, 1);
+			return NULL;
+		}
+	} while (!__sync_bool_compare_and_swap(&s_head, head, head + 1));
+
+	*seq = head;
+	return &s_ring[head & RLOG_RING_MASK];
+}
+
+/**
+ *  \brief publish slot, wake flusher if idle
+ */
+static void publish(rlog_rec_t *rec, unsigned int seq)
+{
+	__sync_synchronize();
+	rec->seq = seq + 1;
+	__sync_synchronize();
+
+	if (s_idle && __sync_bool_compare_and_swap(&s_idle, 1, 0)) {
+		pthread_mutex_lock(&s_mutex);
+		pthread_cond_signal(&s_cond);
+		pthread_mutex_unlock(&s_mutex);
+	}
+}
+
+/**
+ *  \brief log integer arguments record, see RLOG
+ */
+void rlogWrite(int ss, int lvl, const char *tag, const char *fmt,
+    int a0, int a1, int a2, int a3)
+{
+	unsigned int seq;
+	rlog_rec_t *rec;
+
+	if (!s_started) {
+		__android_log_print(lvl, tag, fmt, a0, a1, a2, a3);
+		return;
+	}
+
+	if (NULL == (rec = reserve(&seq)))
+		return;
+
+	rec->ss = ss;
+	rec->lvl = lvl;
+	rec->len = -1;
+	rec->tag = tag;
+	rec->fmt = fmt;
+	rec->usec = nowUsec();
+	rec->u.arg[0] = a0;
+	rec->u.arg[1] = a1;
+	rec->u.arg[2] = a2;
+	rec->u.arg[3] = a3;
+
+	publish(rec, seq);
+}
+
+/**
+ *  \brief log string argument record, see RLOG_STR
+ *  \param len - string length, or -1 to use strlen
+ */
+void rlogWriteStr(int ss, int lvl, const char *tag, const char *fmt,
+    const char *s, int len)
+{
+	unsigned int seq;
+	rlog_rec_t *rec;
+
+	if (!s_started) {
+		__android_log_print(lvl, tag, fmt, s);
+		return;
+	}
+
+	if (NULL == (rec = reserve(&seq)))
+		return;
+
+	if (len < 0) len = strlen(s);
+	if (len > RLOG_STR_MAX) len = RLOG_STR_MAX;
+
+	rec->ss = ss;
+	rec->lvl = lvl;
+	rec->len = len;
+	rec->tag = tag;
+	rec->fmt = fmt;
+	rec->usec = nowUsec();
+	memcpy(rec->u.str, s, len);
+	rec->u.str[len] = '\0';
+
+	publish(rec, seq);
+}
+
+/**
+ *  \brief format and write one record to logcat
+ */
+static void flushRecord(rlog_rec_t *rec)
+{
+	char buf[512];
+	int lagMsec;
+
+	if (rec->len < 0)
+		snprintf(buf, sizeof(buf), rec->fmt,
+			rec->u.arg[0], rec->u.arg[1], rec->u.arg[2], rec->u.arg[3]);
+	else
+		snprintf(buf, sizeof(buf), rec->fmt, rec->u.str);
+
+	lagMsec = (int)((nowUsec() - rec->usec) / 1000);
+	if (lagMsec > RLOG_LAG_MSEC)
+		__android_log_print(rec->lvl, rec->tag, "%s [-%dms]", buf, lagMsec);
+	else
+		__android_log_print(rec->lvl, rec->tag, "%s", buf);
+
+	s_records++;
+}
+
+/**
+ *  \brief flusher thread, drains published records in order
+ */
+static void *flusherLoop(void *arg)
+{
+	rlog_rec_t *rec;
+
+	for (;;)
+	{
+		rec = &s_ring[s_tail & RLOG_RING_MASK];
+
+		if (rec->seq == s_tail + 1) {
+			flushRecord(rec);
+			__sync_synchronize();
+			s_tail++;
+			continue;
+		}
+
+		// empty, or next slot reserved but not yet published
+		pthread_mutex_lock(&s_mutex);
+		s_idle = 1;
+		__sync_synchronize();
+		while (s_idle && rec->seq != s_tail + 1)
+			pthread_cond_wait(&s_cond, &s_mutex);
+		s_idle = 0;
+		pthread_mutex_unlock(&s_mutex);
+	}
+
+	return NULL;
+}
+
+/**
+ *  \brief start flusher thread
+ *  records logged before init are written synchronously
+ */
+void rlogInit(void)
+{
+	pthread_t tid;
+	pthread_attr_t attr;
+
+	if (s_started) return;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&tid, &attr, flusherLoop, NULL) != 0) {
+		LOGE("%s:%d cannot start log flusher", __FUNCTION__, __LINE__);
+		return;
+	}
+	s_started = 1;
+}
+
+/**
+ *  \brief map control file level character V D I W E N to level
+ *  \return level, or -1 if not recognized
+ */
+int rlogLevelFromChar(char c)
+{
+	switch (c) {
+		case 'V': case 'v': return RLOG_VERBOSE;
+		case 'D': case 'd': return RLOG_DEBUG;
+		case 'I': case 'i': return RLOG_INFO;
+		case 'W': case 'w': return RLOG_WARN;
+		case 'E': case 'e': return RLOG_ERROR;
+		case 'N': case 'n': return RLOG_OFF;
+	}
+	return -1;
+}
+
+/**
+ *  \brief set subsystem level by name
+ *  \return 0 OK, -1 unknown subsystem
+ */
+int rlogSetLevel(const char *name, int lvl)
+{
+	int i;
+
+	for (i = 0; i < RLOG_SS_MAX; i++) {
+		if (0 == strcmp(name, rlog_names[i])) {
+			rlog_level[i] = lvl;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ *  \brief flushed and dropped record counts
+ */
+void rlogStats(unsigned int *records, unsigned int *dropped)
+{
+	*records = s_records;
+	*dropped = s_dropped;
+}
@@ -0,0 +1,59 @@
+/**
+ *
+ * \file rillog.h
+ * \brief deferred binary log ring include file
+ *
+ * Hot path log calls store the format string pointer and up to
+ * four integer arguments, or one copied string, in a lock free
+ * ring.  A background flusher formats the records and writes them
+ * to logcat.  Format strings must be literals.  RLOG arguments are
+ * stored as int, so the format may use only int conversions (%d %u
+ * %x %c), never %s, %p or %ld; name the function in the format
+ * literal, or log one string with RLOG_STR.
+ */
+
+#ifndef _rillog_h_included
+#define _rillog_h_included
+
+// log subsystems, levels set per subsystem in control file LogLevel.<name>
+#define RLOG_SS_AT	0 // atchannel traffic
+#define RLOG_SS_RIL	1 // request dispatch and unsolicited
+#define RLOG_SS_DATA	2 // packet data
+#define RLOG_SS_GPS	3 // gps nmea
+#define RLOG_SS_TIMER	4 // modem timer polls
+#define RLOG_SS_MAX	5
+
+// levels, same values as android log priorities
+#define RLOG_VERBOSE	2
+#define RLOG_DEBUG	3
+#define RLOG_INFO	4
+#define RLOG_WARN	5
+#define RLOG_ERROR	6
+#define RLOG_OFF	8
+
+// longest string copied into a record, longer strings are truncated
+#define RLOG_STR_MAX	100
+
+extern unsigned char rlog_level[RLOG_SS_MAX];
+
+#define RLOG_ON(ss, lvl)  ((lvl) >= rlog_level[ss])
+
+// int arguments, unused arguments are 0
+#define RLOG(ss, lvl, fmt, a0, a1, a2, a3) \
+    do { if (RLOG_ON(ss, lvl)) rlogWrite(ss, lvl, LOG_TAG, fmt, \
+        (int)(a0), (int)(a1), (int)(a2), (int)(a3)); } while (0)
+
+// single string argument, copied up to RLOG_STR_MAX bytes
+#define RLOG_STR(ss, lvl, fmt, s, len) \
+    do { if (RLOG_ON(ss, lvl)) rlogWriteStr(ss, lvl, LOG_TAG, fmt, s, len); } while (0)
+
+void rlogInit(void);
+void rlogWrite(int ss, int lvl, const char *tag, const char *fmt,
+    int a0, int a1, int a2, int a3);
+void rlogWriteStr(int ss, int lvl, const char *tag, const char *fmt,
+    const char *s, int len);
+int  rlogSetLevel(const char *name, int lvl);
+int  rlogLevelFromChar(char c);
+void rlogStats(unsigned int *records, unsigned int *dropped);
+
+#endif // _rillog_h_included
@@ -0,0 +1,74 @@
+# fw100 ril host tools
+
+LOCAL_PATH:= $(call my-dir)
+
+# AT capture trace decoder
+include $(CLEAR_VARS)
+LOCAL_MODULE:= at-trace-decode
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES:= at-trace-decode.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+include $(BUILD_HOST_EXECUTABLE)
+
+# radio log replay on a pty
+include $(CLEAR_VARS)
+LOCAL_MODULE:= fw100-replay
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES:= fw100-replay.c fwtool-pty.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)
+LOCAL_CFLAGS := -D_GNU_SOURCE
+include $(BUILD_HOST_EXECUTABLE)
+
+# FW100 modem simulator on a pty
+include $(CLEAR_VARS)
+LOCAL_MODULE:= fw100-sim
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES:= fw100-sim.c fwtool-pty.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)
+LOCAL_CFLAGS := -D_GNU_SOURCE
+include $(BUILD_HOST_EXECUTABLE)
+
+# request load generator, driver sources with a stub RIL_Env
+include $(CLEAR_VARS)
+LOCAL_MODULE:= fw100-bench
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES:= fw100-bench.c fw100-bench-env.c fw100-bench-stubs.c \
+    $(addprefix ../,$(fw100_ril_src_files))
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/.. $(LOCAL_PATH)
+LOCAL_CFLAGS := -D_GNU_SOURCE -DRIL_SHLIB
+LOCAL_LDLIBS += -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# AT channel fault injection and recovery time benchmark
+include $(CLEAR_VARS)
+LOCAL_MODULE:= fw100-faultbench
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES:= fw100-faultbench.c fw100-bench-env.c fw100-bench-stubs.c \
+    $(addprefix ../,$(fw100_ril_src_files))
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/.. $(LOCAL_PATH)
+LOCAL_CFLAGS := -D_GNU_SOURCE -DRIL_SHLIB
+LOCAL_LDLIBS += -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# AT reader, tokenizer and dispatch microbenchmarks, includes
+# atchannel.c and fw100-ril.c to reach their static functions
+include $(CLEAR_VARS)
+LOCAL_MODULE:= fw100-microbench
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES:= fw100-microbench.c fw100-bench-stubs.c \
+    $(addprefix ../,$(filter-out atchannel.c fw100-ril.c,$(fw100_ril_src_files)))
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_CFLAGS := -D_GNU_SOURCE -DRIL_SHLIB
+LOCAL_LDLIBS += -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# concurrent data context setup and throughput benchmark, root and pppd
+include $(CLEAR_VARS)
+LOCAL_MODULE:= fw100-databench
+LOCAL_MODULE_TAGS := debug
+LOCAL_SRC_FILES:= fw100-databench.c fw100-bench-env.c fwtool-pty.c fw100-bench-stubs.c \
+    $(addprefix ../,$(fw100_ril_src_files))
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/.. $(LOCAL_PATH)
+LOCAL_CFLAGS := -D_GNU_SOURCE -DRIL_SHLIB
+LOCAL_LDLIBS += -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,143 @@
+/**
+ * \file at-trace-decode.c
+ * \brief convert AT capture trace files to logcat style text
+ *
+ * usage: at-trace-decode [<trace.N> ...] <trace>
+ *
+ * Output matches the AT> / AT< lines written by atchannel.c, e.g.
+ *   01-01 00:00:12.351 D/AT      ( 1070): AT> ATE0Q0V1
+ * RX bytes are split into lines on CR/LF, TX lines end at CR or ^Z.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <atcapture.h>
+
+#define MAX_LINE 0x1000
+
+typedef struct line_buf
+{
+	int len;
+	char buf[MAX_LINE + 1];
+} line_buf_t;
+
+static line_buf_t s_line[2];
+
+static void printLine(const at_cap_file_hdr_t *fh, uint64_t usec,
+    const char *prefix, const char *line, const char *suffix)
+{
+	uint64_t wall = fh->wallUsec + (usec - fh->monoUsec);
+	time_t sec = (time_t)(wall / 1000000);
+	struct tm tm;
+	char stamp[32];
+
+	localtime_r(&sec, &tm);
+	strftime(stamp, sizeof(stamp), "%m-%d %H:%M:%S", &tm);
+	printf("%s.%03u D/AT      (%5u): %s%s%s\n", stamp,
+		(unsigned int)((wall / 1000) % 1000), fh->pid, prefix, line, suffix);
+}
+
+static void flushLine(const at_cap_file_hdr_t *fh, uint64_t usec, int dir,
+    const char *suffix)
+{
+	line_buf_t *l = &s_line[dir];
+
+	l->buf[l->len] = '\0';
+	if (l->len > 0 || dir == AT_CAP_TX)
+		printLine(fh, usec, dir == AT_CAP_RX ? "AT< " : "AT> ", l->buf, suffix);
+	l->len = 0;
+}
+
+static void decodeBytes(const at_cap_file_hdr_t *fh, const at_cap_rec_hdr_t *rh,
+    const char *data)
+{
+	line_buf_t *l = &s_line[rh->dir];
+	int i;
+	char c;
+
+	for (i = 0; i < rh->len; i++) {
+		c = data[i];
+		if (rh->dir == AT_CAP_RX && (c == '\r' || c == '\n')) {
+			flushLine(fh, rh->usec, AT_CAP_RX, "");
+		} else if (rh->dir == AT_CAP_TX && c == '\r') {
+			flushLine(fh, rh->usec, AT_CAP_TX, "");
+		} else if (rh->dir == AT_CAP_TX && c == '\032') {
+			flushLine(fh, rh->usec, AT_CAP_TX, "^Z");
+		} else if (l->len < MAX_LINE) {
+			l->buf[l->len++] = c;
+		}
+	}
+}
+
+static int decodeFile(const char *name)
+{
+	FILE *f;
+	at_cap_file_hdr_t fh;
+	at_cap_rec_hdr_t rh;
+	char *data;
+	char note[64];
+	int ret = -1;
+
+	f = fopen(name, "rb");
+	if (NULL == f) {
+		fprintf(stderr, "cannot open %s\n", name);
+		return -1;
+	}
+
+	data = malloc(0x10000);
+	if (NULL == data) goto done;
+
+	if (fread(&fh, sizeof(fh), 1, f) != 1
+		|| memcmp(fh.magic, AT_CAP_MAGIC, sizeof(fh.magic))
+		|| fh.version != AT_CAP_VERSION) {
+		fprintf(stderr, "%s is not an AT capture trace\n", name);
+		goto done;
+	}
+
+	while (fread(&rh, sizeof(rh), 1, f) == 1) {
+		if (rh.dir > AT_CAP_TX || fread(data, 1, rh.len, f) != rh.len) {
+			fprintf(stderr, "%s truncated record\n", name);
+			break;
+		}
+		if (rh.lost) {
+			snprintf(note, sizeof(note), "-- %u records lost --", rh.lost);
+			printLine(&fh, rh.usec, "", note, "");
+			s_line[0].len = 0;
+			s_line[1].len = 0;
+		}
+		decodeBytes(&fh, &rh, data);
+	}
+	ret = 0;
+
+done:
+	free(data);
+	fclose(f);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	int ret = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <trace> [<trace> ...]\n", argv[0]);
+		return 1;
+	}
+
+	// pass rotated files oldest first, trace.3 trace.2 trace.1 trace
+	for (i = 1; i < argc; i++)
+		if (decodeFile(argv[i]) < 0) ret = 1;
+
+	return ret;
+}
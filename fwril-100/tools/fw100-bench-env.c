@@ -0,0 +1,141 @@
+/**
+ * \file fw100-bench-env.c
+ * \brief stub rild environment for the host benchmarks
+ *
+ * The benchmark supplies OnRequestComplete and OnUnsolicitedResponse.
+ * RequestTimedCallback queues the callback for a timer thread that
+ * runs each one when due, in due order, as the rild event loop does.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <telephony/ril.h>
+
+#include <fw100-bench-env.h>
+
+#define MAX_TIMERS	64
+
+typedef struct {
+	RIL_TimedCallback callback;
+	void *param;
+	long long due;
+} benchTimer_t;
+
+static benchTimer_t s_timers[MAX_TIMERS];
+static int s_nTimers;
+static pthread_mutex_t s_timerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_timerCond = PTHREAD_COND_INITIALIZER;
+
+static struct RIL_Env s_benchEnv;
+
+long long benchNowUsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * \brief pthread_cond_timedwait for at most usec
+ * \return 0 signalled, ETIMEDOUT
+ */
+int benchCondWait(pthread_cond_t *cond, pthread_mutex_t *mutex, long long usec)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += usec / 1000000;
+	ts.tv_nsec += (usec % 1000000) * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	return pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+/**
+ * \brief rild timed callback, run on the timer thread
+ */
+static void benchRequestTimedCallback(RIL_TimedCallback callback, void *param,
+    const struct timeval *relativeTime)
+{
+	long long due = benchNowUsec();
+
+	if (NULL != relativeTime)
+		due += (long long)relativeTime->tv_sec * 1000000 + relativeTime->tv_usec;
+
+	pthread_mutex_lock(&s_timerMutex);
+	if (s_nTimers < MAX_TIMERS) {
+		s_timers[s_nTimers].callback = callback;
+		s_timers[s_nTimers].param = param;
+		s_timers[s_nTimers].due = due;
+		s_nTimers++;
+		pthread_cond_signal(&s_timerCond);
+	} else {
+		fprintf(stderr, "timer table full\n");
+	}
+	pthread_mutex_unlock(&s_timerMutex);
+}
+
+static void *timerLoop(void *arg)
+{
+	benchTimer_t run;
+	long long now;
+	int i;
+	int first;
+
+	pthread_mutex_lock(&s_timerMutex);
+	for (;;) {
+		now = benchNowUsec();
+		first = -1;
+		for (i = 0; i < s_nTimers; i++)
+			if (first < 0 || s_timers[i].due < s_timers[first].due)
+				first = i;
+
+		if (first >= 0 && s_timers[first].due <= now) {
+			run = s_timers[first];
+			s_timers[first] = s_timers[--s_nTimers];
+			pthread_mutex_unlock(&s_timerMutex);
+			run.callback(run.param);
+			pthread_mutex_lock(&s_timerMutex);
+			continue;
+		}
+
+		benchCondWait(&s_timerCond, &s_timerMutex,
+			(first >= 0) ? s_timers[first].due - now : 1000000);
+	}
+	return NULL;
+}
+
+/**
+ * \brief start the timer thread
+ * \return the RIL_Env to pass to RIL_Init, NULL thread not started
+ */
+const struct RIL_Env *benchEnvStart(
+	void (*onRequestComplete)(RIL_Token t, RIL_Errno e, void *response, size_t responselen),
+	void (*onUnsolicitedResponse)(int unsolResponse, const void *data, size_t datalen))
+{
+	pthread_t tid;
+
+	s_benchEnv.OnRequestComplete = onRequestComplete;
+	s_benchEnv.OnUnsolicitedResponse = onUnsolicitedResponse;
+	s_benchEnv.RequestTimedCallback = benchRequestTimedCallback;
+
+	if (pthread_create(&tid, NULL, timerLoop, NULL) != 0) {
+		perror("pthread_create");
+		return NULL;
+	}
+	return &s_benchEnv;
+}
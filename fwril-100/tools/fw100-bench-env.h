@@ -0,0 +1,20 @@
+/**
+ *
+ * \file fw100-bench-env.h
+ * \brief stub rild environment for the host benchmarks
+ */
+
+#ifndef _fw100_bench_env_h_included
+#define _fw100_bench_env_h_included
+
+#include <pthread.h>
+
+#include <telephony/ril.h>
+
+long long benchNowUsec(void);
+int  benchCondWait(pthread_cond_t *cond, pthread_mutex_t *mutex, long long usec);
+const struct RIL_Env *benchEnvStart(
+	void (*onRequestComplete)(RIL_Token t, RIL_Errno e, void *response, size_t responselen),
+	void (*onUnsolicitedResponse)(int unsolResponse, const void *data, size_t datalen));
+
+#endif // _fw100_bench_env_h_included
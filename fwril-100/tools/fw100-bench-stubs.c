@@ -0,0 +1,116 @@
+/**
+ * \file fw100-bench-stubs.c
+ * \brief host stand-ins for the libcutils, liblog and libnetutils
+ * calls made by the driver, so the driver sources link into
+ * fw100-bench without the Android libraries
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <cutils/sockets.h>
+
+#define MAX_PROPS	32
+
+// log priority printed to stderr, higher is quieter
+int benchLogLevel = 99;
+
+static struct {
+	char key[PROPERTY_KEY_MAX];
+	char value[PROPERTY_VALUE_MAX];
+} s_props[MAX_PROPS];
+static int s_nProps;
+static pthread_mutex_t s_propMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (prio < benchLogLevel) return 0;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "%s: ", tag);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+	return 0;
+}
+
+int property_get(const char *key, char *value, const char *default_value)
+{
+	int i;
+
+	pthread_mutex_lock(&s_propMutex);
+	for (i = 0; i < s_nProps; i++) {
+		if (!strcmp(s_props[i].key, key)) {
+			strcpy(value, s_props[i].value);
+			pthread_mutex_unlock(&s_propMutex);
+			return strlen(value);
+		}
+	}
+	pthread_mutex_unlock(&s_propMutex);
+
+	if (NULL == default_value) default_value = "";
+	snprintf(value, PROPERTY_VALUE_MAX, "%s", default_value);
+	return strlen(value);
+}
+
+int property_set(const char *key, const char *value)
+{
+	int i;
+
+	pthread_mutex_lock(&s_propMutex);
+	for (i = 0; i < s_nProps; i++)
+		if (!strcmp(s_props[i].key, key))
+			break;
+	if (i == MAX_PROPS) {
+		pthread_mutex_unlock(&s_propMutex);
+		return -1;
+	}
+	if (i == s_nProps) s_nProps++;
+	snprintf(s_props[i].key, PROPERTY_KEY_MAX, "%s", key);
+	snprintf(s_props[i].value, PROPERTY_VALUE_MAX, "%s", value);
+	pthread_mutex_unlock(&s_propMutex);
+	return 0;
+}
+
+int socket_loopback_client(int port, int type)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	fd = socket(AF_INET, type, 0);
+	if (fd < 0) return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int socket_local_client(const char *name, int namespaceId, int type)
+{
+	errno = ENOSYS;
+	return -1;
+}
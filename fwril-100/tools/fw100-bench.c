@@ -0,0 +1,431 @@
+/**
+ * \file fw100-bench.c
+ * \brief host request load generator for the RIL driver
+ *
+ * usage: fw100-bench [-a atpath] [-d datapath] [-m mix] [-r rate]
+ *                    [-t seconds] [-w seconds] [-v]
+ *
+ *   -a path   AT port (default /tmp/fw100-at, run tools/fw100-sim)
+ *   -d path   data port (default /tmp/fw100-data)
+ *   -m mix    poll, boot or a list REQUEST[:weight],... e.g.
+ *             SIGNAL_STRENGTH:4,OPERATOR (default poll)
+ *   -r rate   requests per second, 0 back to back (default 10)
+ *   -t sec    measured run time (default 30)
+ *   -w sec    warmup, not measured (default 2)
+ *   -v        driver log to stderr, -vv verbose
+ *
+ * The driver sources are linked with a stub RIL_Env and the host
+ * stand-ins in fw100-bench-stubs.c.  Like rild, one event thread
+ * calls onRequest; requests are issued on a fixed schedule and the
+ * latency is measured from the scheduled time to OnRequestComplete,
+ * so a slow request delays and is charged to the ones queued behind
+ * it.  The mix is issued in order, weight N repeats a request N
+ * times, e.g. the phone app service state poll
+ *   OPERATOR,REGISTRATION_STATE,GPRS_REGISTRATION_STATE,SIGNAL_STRENGTH
+ *
+ * Heap allocations are counted on every thread (glibc hosts) while
+ * onRequest runs, including the reader thread handling the responses,
+ * and reported per request; the harness's own allocations are not
+ * counted.  Background scheduler work that lands inside a request is
+ * charged to it, the summary line counts the whole measured run.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <rilinfo.h>
+#include <fw100-bench-env.h>
+
+#define MAX_MIX		64
+
+typedef struct {
+	int request;
+	unsigned int issued;
+	unsigned int errors;
+	unsigned int samples;
+	unsigned int size;
+	unsigned int *usec;		// latency samples
+	unsigned long allocs;		// heap allocations while measured
+} benchType_t;
+
+typedef struct {
+	benchType_t *type;
+	long long scheduled;
+	int measured;
+} benchToken_t;
+
+extern int benchLogLevel;
+
+static const char *s_mixPoll =
+	"OPERATOR,REGISTRATION_STATE,GPRS_REGISTRATION_STATE,SIGNAL_STRENGTH";
+static const char *s_mixBoot =
+	"BASEBAND_VERSION,GET_IMEI,GET_IMEISV,DEVICE_IDENTITY,CDMA_SUBSCRIPTION,"
+	"GET_CURRENT_CALLS,SIGNAL_STRENGTH,REGISTRATION_STATE";
+
+static benchType_t s_types[RRI_RQST_TABLE_SIZE];
+static benchType_t *s_mix[MAX_MIX];
+static int s_nMix;
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int s_outstanding;
+static unsigned int s_unsol;
+static int s_measuring;
+
+static volatile unsigned long s_allocs;
+static __thread volatile int s_harnessAlloc;	// set around the harness's own allocations
+
+/*
+ * allocation counter, glibc routes its own internal allocations
+ * (strdup, asprintf) through a replaced malloc
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+void *malloc(size_t size)
+{
+	if (!s_harnessAlloc) __sync_fetch_and_add(&s_allocs, 1);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	if (!s_harnessAlloc) __sync_fetch_and_add(&s_allocs, 1);
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	if (!s_harnessAlloc) __sync_fetch_and_add(&s_allocs, 1);
+	return __libc_realloc(p, size);
+}
+
+void free(void *p)
+{
+	__libc_free(p);
+}
+#endif
+
+static void addSample(benchType_t *type, unsigned int usec)
+{
+	unsigned int *p;
+
+	if (type->samples == type->size) {
+		type->size = type->size ? type->size * 2 : 1024;
+		s_harnessAlloc = 1;
+		p = realloc(type->usec, type->size * sizeof(*p));
+		s_harnessAlloc = 0;
+		if (NULL == p) return;
+		type->usec = p;
+	}
+	type->usec[type->samples++] = usec;
+}
+
+static void benchOnRequestComplete(RIL_Token t, RIL_Errno e, void *response,
+    size_t responselen)
+{
+	benchToken_t *tok = (benchToken_t *)t;
+	long long end = benchNowUsec();
+
+	pthread_mutex_lock(&s_mutex);
+	if (NULL != tok->type && tok->measured) {
+		addSample(tok->type, (unsigned int)(end - tok->scheduled));
+		if (e != RIL_E_SUCCESS) tok->type->errors++;
+	}
+	s_outstanding--;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_mutex);
+
+	free(tok);
+}
+
+static void benchOnUnsolicitedResponse(int unsolResponse, const void *data,
+    size_t datalen)
+{
+	__sync_fetch_and_add(&s_unsol, 1);
+}
+
+/**
+ * \brief request ID by name, with or without RIL_REQUEST_
+ * \return request ID, -1 not found
+ */
+static int requestByName(const char *name)
+{
+	const char *s;
+	int i;
+
+	for (i = 0; i < RRI_RQST_TABLE_SIZE; i++) {
+		s = requestToString(i);
+		if (NULL == s) continue;
+		if (!strcmp(s, name)) return i;
+		if (!strncmp(s, "RIL_REQUEST_", 12) && !strcmp(s + 12, name)) return i;
+	}
+	return -1;
+}
+
+/**
+ * \brief parse a mix, REQUEST[:weight],...
+ * \return 0 OK, -1 error
+ */
+static int parseMix(const char *spec)
+{
+	char buf[512];
+	char *tok;
+	char *save;
+	char *colon;
+	int request;
+	int weight;
+
+	if (!strcmp(spec, "poll")) spec = s_mixPoll;
+	else if (!strcmp(spec, "boot")) spec = s_mixBoot;
+
+	snprintf(buf, sizeof(buf), "%s", spec);
+	for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		weight = 1;
+		if (NULL != (colon = strchr(tok, ':'))) {
+			*colon = '\0';
+			weight = atoi(colon + 1);
+		}
+		request = requestByName(tok);
+		if (request < 0) {
+			fprintf(stderr, "unknown request %s\n", tok);
+			return -1;
+		}
+		s_types[request].request = request;
+		while (weight-- > 0 && s_nMix < MAX_MIX)
+			s_mix[s_nMix++] = &s_types[request];
+	}
+	return (s_nMix > 0) ? 0 : -1;
+}
+
+/**
+ * \brief issue one request on the calling (event) thread
+ */
+static void issue(const RIL_RadioFunctions *funcs, benchType_t *type,
+    long long scheduled, int measured)
+{
+	benchToken_t *tok;
+	int on = 1;
+	void *data = NULL;
+	size_t datalen = 0;
+	unsigned long allocs;
+
+	s_harnessAlloc = 1;
+	tok = calloc(1, sizeof(*tok));
+	s_harnessAlloc = 0;
+	if (NULL == tok) return;
+	tok->type = type;
+	tok->scheduled = scheduled;
+	tok->measured = measured;
+
+	// requests taking an int argument
+	if (type->request == RIL_REQUEST_RADIO_POWER
+		|| type->request == RIL_REQUEST_SCREEN_STATE
+		|| type->request == RIL_REQUEST_HANGUP
+		|| type->request == RIL_REQUEST_DELETE_SMS_ON_SIM) {
+		data = &on;
+		datalen = sizeof(on);
+	}
+
+	pthread_mutex_lock(&s_mutex);
+	s_outstanding++;
+	if (measured) type->issued++;
+	pthread_mutex_unlock(&s_mutex);
+
+	allocs = s_allocs;
+	funcs->onRequest(type->request, data, datalen, (RIL_Token)tok);
+	allocs = s_allocs - allocs;
+
+	if (measured) {
+		pthread_mutex_lock(&s_mutex);
+		type->allocs += allocs;
+		pthread_mutex_unlock(&s_mutex);
+	}
+}
+
+static int cmpUint(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+static double percentileMsec(benchType_t *type, double p)
+{
+	unsigned int i;
+
+	if (type->samples == 0) return 0;
+	i = (unsigned int)(p * (type->samples - 1) + 0.5);
+	return type->usec[i] / 1000.0;
+}
+
+static void report(double seconds, unsigned long allocs)
+{
+	benchType_t *type;
+	unsigned int total = 0;
+	int i;
+
+	printf("%-40s %8s %6s %9s %9s %9s %9s %7s\n",
+		"request", "count", "errors", "p50 ms", "p99 ms", "p999 ms", "max ms",
+		"allocs");
+	for (i = 0; i < RRI_RQST_TABLE_SIZE; i++) {
+		type = &s_types[i];
+		if (type->issued == 0) continue;
+		qsort(type->usec, type->samples, sizeof(type->usec[0]), cmpUint);
+		printf("%-40s %8u %6u %9.2f %9.2f %9.2f %9.2f %7.2f\n",
+			requestToString(i), type->samples, type->errors,
+			percentileMsec(type, 0.50), percentileMsec(type, 0.99),
+			percentileMsec(type, 0.999), percentileMsec(type, 1.0),
+			type->issued ? (double)type->allocs / type->issued : 0);
+		total += type->samples;
+	}
+	printf("completed %u in %.1f s, %.1f requests/s, unsolicited %u\n",
+		total, seconds, total / seconds, s_unsol);
+	printf("heap allocations %lu, %.2f per request\n",
+		allocs, total ? (double)allocs / total : 0);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-a atpath] [-d datapath] [-m mix] [-r rate] "
+		"[-t seconds] [-w seconds] [-v]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *atPath = "/tmp/fw100-at";
+	const char *dataPath = "/tmp/fw100-data";
+	const char *mix = "poll";
+	double rate = 10;
+	int seconds = 30;
+	int warmup = 2;
+	int opt;
+	int i;
+	long long start;
+	long long end;
+	long long next;
+	long long now;
+	long long interval;
+	char *rilArgv[6];
+	const RIL_RadioFunctions *funcs;
+	const struct RIL_Env *env;
+	benchType_t power;
+	struct timespec ts;
+	unsigned long allocs = 0;
+
+	while (-1 != (opt = getopt(argc, argv, "a:d:m:r:t:w:v"))) {
+		switch (opt) {
+			case 'a': atPath = optarg; break;
+			case 'd': dataPath = optarg; break;
+			case 'm': mix = optarg; break;
+			case 'r': rate = atof(optarg); break;
+			case 't': seconds = atoi(optarg); break;
+			case 'w': warmup = atoi(optarg); break;
+			case 'v': benchLogLevel = (benchLogLevel > 4) ? 4 : 2; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (parseMix(mix) < 0) usage(argv[0]);
+
+	env = benchEnvStart(benchOnRequestComplete, benchOnUnsolicitedResponse);
+	if (NULL == env)
+		return 1;
+
+	// RIL_Init parses its own options
+	rilArgv[0] = "fw100-bench";
+	rilArgv[1] = "-a";
+	rilArgv[2] = (char *)atPath;
+	rilArgv[3] = "-d";
+	rilArgv[4] = (char *)dataPath;
+	rilArgv[5] = NULL;
+	optind = 1;
+	funcs = RIL_Init(env, 5, rilArgv);
+	if (NULL == funcs) {
+		fprintf(stderr, "RIL_Init failed\n");
+		return 1;
+	}
+
+	// wait for the AT channel, then radio on as the phone app does
+	for (i = 0; i < 300 && funcs->onStateRequest() == RADIO_STATE_UNAVAILABLE; i++)
+		usleep(100000);
+	if (funcs->onStateRequest() == RADIO_STATE_UNAVAILABLE) {
+		fprintf(stderr, "modem not available on %s\n", atPath);
+		return 1;
+	}
+	memset(&power, 0, sizeof(power));
+	power.request = RIL_REQUEST_RADIO_POWER;
+	issue(funcs, &power, benchNowUsec(), 0);
+	for (i = 0; i < 100 && funcs->onStateRequest() == RADIO_STATE_OFF; i++)
+		usleep(100000);
+
+	fprintf(stderr, "mix %s, %.1f requests/s, %d s after %d s warmup\n",
+		mix, rate, seconds, warmup);
+
+	interval = (rate > 0) ? (long long)(1000000 / rate) : 0;
+	start = benchNowUsec();
+	end = start + (long long)(warmup + seconds) * 1000000;
+	next = start;
+
+	for (i = 0; ; ) {
+		now = benchNowUsec();
+		if (now >= end) break;
+
+		if (interval) {
+			if (next > now) {
+				usleep(next - now);
+				continue;
+			}
+		} else {
+			// back to back, wait for the previous request
+			pthread_mutex_lock(&s_mutex);
+			while (s_outstanding > 0)
+				pthread_cond_wait(&s_cond, &s_mutex);
+			pthread_mutex_unlock(&s_mutex);
+			next = benchNowUsec();
+		}
+
+		if (!s_measuring && next >= start + (long long)warmup * 1000000) {
+			s_measuring = 1;
+			start = next;
+			allocs = s_allocs;
+		}
+		issue(funcs, s_mix[i++ % s_nMix], next, s_measuring);
+		next += interval;
+	}
+
+	// drain outstanding completions
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 10;
+	pthread_mutex_lock(&s_mutex);
+	while (s_outstanding > 0)
+		if (pthread_cond_timedwait(&s_cond, &s_mutex, &ts) == ETIMEDOUT)
+			break;
+	if (s_outstanding)
+		fprintf(stderr, "%u requests not completed\n", s_outstanding);
+	pthread_mutex_unlock(&s_mutex);
+
+	report((benchNowUsec() - start) / 1000000.0, s_allocs - allocs);
+	return 0;
+}
@@ -0,0 +1,601 @@
+/**
+ * \file fw100-databench.c
+ * \brief concurrent data context setup time and throughput benchmark
+ *
+ * usage: fw100-databench [-a atpath] [-n contexts] [-t seconds]
+ *                        [-P pppd] [-v]
+ *
+ *   -a path   AT port (default /tmp/fw100-at, run tools/fw100-sim)
+ *   -n count  data contexts, 1 to DATA_MAX_CONTEXTS (default 2)
+ *   -t sec    measured transfer time (default 10)
+ *   -P path   peer pppd (default /usr/sbin/pppd)
+ *   -v        driver log to stderr, -vv verbose
+ *
+ * Runs as root on a host with pppd and etcs/ppp/peers/fw100-dialer
+ * installed in /etc/ppp/peers.  The driver sources are linked as in
+ * fw100-bench, with one -d port per context.  Each data port is a pty
+ * linked at /tmp/fw100-data.<cid> that answers AT commands with OK
+ * and ATD with CONNECT, then relays to a second pty where the peer
+ * pppd runs in its own network namespace and assigns 10.64.<cid>.2,
+ * gateway 10.64.<cid>.1.  A discard sink listens in that namespace.
+ *
+ * SETUP_DATA_CALL is issued once per context, one at a time as the
+ * phone app does, and timed to OnRequestComplete.  One sender thread
+ * per context then writes TCP to its gateway, bound to the context's
+ * address and interface, for the measured time.  Delivered bytes are
+ * those written less those still queued (SIOCOUTQ) at the end.  The
+ * table reports each context's setup time and throughput and the
+ * aggregate, then each cid is deactivated and timed to its interface
+ * going away.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <fw100-ril.h>
+#include <fw100-bench-env.h>
+#include <fwtool-pty.h>
+
+#define MAX_CHUNK	4096
+#define SINK_PORT	5009
+#define SEND_CHUNK	65536
+#define REQUEST_USEC	(60 * 1000000LL)
+
+typedef struct {
+	int cid;
+	char link[64];			// driver side data port
+	int driver;			// pty master, driver side
+	int peer;			// pty master, peer pppd side
+	char peerTty[64];
+	long long setupUsec;		// -1 failed
+	long long deactUsec;		// to the interface gone, -1 failed
+	char ifname[IFNAMSIZ];
+	char address[64];
+	char gateway[64];
+	unsigned long long written;
+	unsigned long long queued;	// SIOCOUTQ at the end
+	pthread_t relay;
+	pthread_t sender;
+} benchContext_t;
+
+extern int benchLogLevel;
+
+static benchContext_t s_ctx[DATA_MAX_CONTEXTS];
+static int s_nCtx = 2;
+
+// one request outstanding at a time, like the rild event thread
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static int s_done;
+static int s_err;
+static char s_resp[3][64];		// SETUP_DATA_CALL cid, ifname, address
+static RIL_Data_Call_Response s_list[DATA_MAX_CONTEXTS];
+static char s_listAddress[DATA_MAX_CONTEXTS][64];
+static int s_nList;
+
+static const RIL_RadioFunctions *s_funcs;
+static volatile long long s_sendEnd;
+
+static void copyString(char *dst, const char *src, int len)
+{
+	snprintf(dst, len, "%s", (NULL != src) ? src : "");
+}
+
+static void benchOnRequestComplete(RIL_Token t, RIL_Errno e, void *response,
+    size_t responselen)
+{
+	RIL_Data_Call_Response *list = response;
+	char **strings = response;
+	int request = (int)(long)t;
+	int i;
+
+	if (request == 0) return;	// unmeasured RADIO_POWER
+
+	pthread_mutex_lock(&s_mutex);
+	s_err = e;
+	if (e == RIL_E_SUCCESS && request == RIL_REQUEST_SETUP_DATA_CALL
+		&& responselen >= 3 * sizeof(char *)) {
+		for (i = 0; i < 3; i++)
+			copyString(s_resp[i], strings[i], sizeof(s_resp[i]));
+	}
+	if (e == RIL_E_SUCCESS && request == RIL_REQUEST_DATA_CALL_LIST) {
+		s_nList = responselen / sizeof(*list);
+		if (s_nList > DATA_MAX_CONTEXTS) s_nList = DATA_MAX_CONTEXTS;
+		for (i = 0; i < s_nList; i++) {
+			s_list[i] = list[i];
+			copyString(s_listAddress[i], list[i].address, sizeof(s_listAddress[i]));
+		}
+	}
+	s_done = 1;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_mutex);
+}
+
+static void benchOnUnsolicitedResponse(int unsolResponse, const void *data,
+    size_t datalen)
+{
+}
+
+/**
+ * \brief issue a request and wait for its completion
+ * \return microseconds to OnRequestComplete, -1 failed or no answer
+ */
+static long long request(int req, void *data, size_t datalen)
+{
+	long long start;
+	long long t = -1;
+
+	pthread_mutex_lock(&s_mutex);
+	s_done = 0;
+	s_err = RIL_E_GENERIC_FAILURE;
+	pthread_mutex_unlock(&s_mutex);
+
+	start = benchNowUsec();
+	s_funcs->onRequest(req, data, datalen, (RIL_Token)(long)req);
+
+	pthread_mutex_lock(&s_mutex);
+	while (!s_done && benchNowUsec() - start < REQUEST_USEC)
+		benchCondWait(&s_cond, &s_mutex, 10000);
+	if (s_done && s_err == RIL_E_SUCCESS) t = benchNowUsec() - start;
+	pthread_mutex_unlock(&s_mutex);
+	return t;
+}
+
+/**
+ * \brief write all of buf to a non blocking pty master
+ * \return 0 OK, -1 error
+ */
+static int writeAll(int fd, const char *buf, int n)
+{
+	struct pollfd pfd;
+	int off = 0;
+	int w;
+
+	while (off < n) {
+		w = write(fd, buf + off, n - off);
+		if (w < 0) {
+			if (errno == EAGAIN) {
+				pfd.fd = fd;
+				pfd.events = POLLOUT;
+				poll(&pfd, 1, 100);
+				continue;
+			}
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		off += w;
+	}
+	return 0;
+}
+
+/**
+ * \brief data port for one context
+ * answers the dialer in command mode, then relays both ways between
+ * the driver's pppd and the peer pppd
+ */
+static void *relayLoop(void *arg)
+{
+	benchContext_t *c = arg;
+	struct pollfd pfd[2];
+	char cmd[256];
+	char buf[MAX_CHUNK];
+	int len = 0;
+	int online = 0;
+	int n;
+
+	for (;;) {
+		pfd[0].fd = c->driver;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = c->peer;
+		pfd[1].events = online ? POLLIN : 0;
+		if (poll(pfd, 2, 1000) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		if (!online && (pfd[0].revents & POLLIN)) {
+			while (ptyReadLine(c->driver, cmd, sizeof(cmd), &len) == 1) {
+				if (!strncmp(cmd, "ATD", 3)) {
+					ptyWriteLine(c->driver, "CONNECT");
+					online = 1;
+					break;
+				}
+				if (!strncmp(cmd, "AT", 2)) ptyWriteLine(c->driver, "OK");
+			}
+			continue;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			n = read(c->driver, buf, sizeof(buf));
+			if (n > 0) writeAll(c->peer, buf, n);
+		}
+		if (pfd[1].revents & POLLIN) {
+			n = read(c->peer, buf, sizeof(buf));
+			if (n > 0) writeAll(c->driver, buf, n);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * \brief peer network namespace, forked child
+ * peer pppd per context and the discard sink, never returns
+ */
+static void peerNamespace(const char *pppd, int ready)
+{
+	struct sockaddr_in sa;
+	struct pollfd pfd[64];
+	struct ifreq ifr;
+	char addrs[64];
+	char buf[SEND_CHUNK];
+	char *argv[16];
+	int nfd = 1;
+	int one = 1;
+	int sock;
+	int i;
+	int j;
+
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	if (unshare(CLONE_NEWNET) < 0) {
+		perror("unshare");
+		_exit(1);
+	}
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&ifr, 0, sizeof(ifr));
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "lo");
+	ioctl(sock, SIOCGIFFLAGS, &ifr);
+	ifr.ifr_flags |= IFF_UP;
+	ioctl(sock, SIOCSIFFLAGS, &ifr);
+	close(sock);
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(SINK_PORT);
+	if (sock < 0 || bind(sock, (struct sockaddr *)&sa, sizeof(sa)) < 0
+		|| listen(sock, DATA_MAX_CONTEXTS) < 0) {
+		perror("sink");
+		_exit(1);
+	}
+
+	for (i = 0; i < s_nCtx; i++) {
+		snprintf(addrs, sizeof(addrs), "10.64.%d.1:10.64.%d.2",
+			s_ctx[i].cid, s_ctx[i].cid);
+		j = 0;
+		argv[j++] = (char *)pppd;
+		argv[j++] = s_ctx[i].peerTty;
+		argv[j++] = "local";
+		argv[j++] = "noauth";
+		argv[j++] = "nodetach";
+		argv[j++] = "noccp";
+		argv[j++] = "novj";
+		argv[j++] = "nodefaultroute";
+		argv[j++] = "lcp-echo-interval";
+		argv[j++] = "0";
+		argv[j++] = addrs;
+		argv[j] = NULL;
+		if (0 == fork()) {
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+			if (benchLogLevel > 4) {
+				close(1);
+				close(2);
+			}
+			execv(pppd, argv);
+			perror(pppd);
+			_exit(1);
+		}
+	}
+	write(ready, "", 1);
+	close(ready);
+
+	pfd[0].fd = sock;
+	pfd[0].events = POLLIN;
+	for (;;) {
+		if (poll(pfd, nfd, -1) < 0) continue;
+		if ((pfd[0].revents & POLLIN) && nfd < 64) {
+			pfd[nfd].fd = accept(sock, NULL, NULL);
+			pfd[nfd].events = POLLIN;
+			if (pfd[nfd].fd >= 0) nfd++;
+		}
+		for (i = 1; i < nfd; i++) {
+			if (!pfd[i].revents) continue;
+			if (read(pfd[i].fd, buf, sizeof(buf)) > 0) continue;
+			close(pfd[i].fd);
+			pfd[i--] = pfd[--nfd];
+		}
+	}
+}
+
+/**
+ * \brief TCP sender for one context until s_sendEnd
+ */
+static void *sendLoop(void *arg)
+{
+	benchContext_t *c = arg;
+	struct sockaddr_in sa;
+	struct pollfd pfd;
+	socklen_t len = sizeof(int);
+	char *buf;
+	int sock;
+	int queued = 0;
+	int err = 0;
+	long long n;
+
+	buf = calloc(1, SEND_CHUNK);
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (NULL == buf || sock < 0) goto done;
+
+	if (setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, c->ifname,
+		strlen(c->ifname) + 1) < 0)
+		perror(c->ifname);
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	inet_pton(AF_INET, c->address, &sa.sin_addr);
+	if (bind(sock, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		perror(c->address);
+
+	// connect within the measured time, a dead link gives up with it
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	sa.sin_port = htons(SINK_PORT);
+	inet_pton(AF_INET, c->gateway, &sa.sin_addr);
+	if (connect(sock, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		err = errno;
+	if (err == EINPROGRESS) {
+		pfd.fd = sock;
+		pfd.events = POLLOUT;
+		n = s_sendEnd - benchNowUsec();
+		if (poll(&pfd, 1, (n > 0) ? n / 1000 : 0) == 1)
+			getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+		else
+			err = ETIMEDOUT;
+	}
+	if (err) {
+		fprintf(stderr, "cid %d connect %s: %s\n", c->cid, c->gateway, strerror(err));
+		goto done;
+	}
+
+	while (benchNowUsec() < s_sendEnd) {
+		n = write(sock, buf, SEND_CHUNK);
+		if (n > 0) {
+			c->written += n;
+			continue;
+		}
+		if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+		usleep(1000);
+	}
+	if (ioctl(sock, SIOCOUTQ, &queued) == 0 && queued > 0)
+		c->queued = queued;
+
+done:
+	if (sock >= 0) close(sock);
+	free(buf);
+	return NULL;
+}
+
+static double mbps(unsigned long long bytes, long long usec)
+{
+	return (usec > 0) ? bytes * 8.0 / usec : 0;
+}
+
+static void printMsec(long long usec)
+{
+	if (usec < 0)
+		printf(" %9s", "-");
+	else
+		printf(" %9.1f", usec / 1000.0);
+}
+
+static void report(long long duration)
+{
+	unsigned long long total = 0;
+	unsigned long long bytes;
+	benchContext_t *c;
+	int i;
+
+	printf("%d contexts, %lld sec transfer\n", s_nCtx, duration / 1000000);
+	printf("%3s %-6s %-15s %9s %9s %12s %8s\n",
+		"cid", "if", "address", "setup ms", "down ms", "bytes", "Mbps");
+	for (i = 0; i < s_nCtx; i++) {
+		c = &s_ctx[i];
+		bytes = c->written - c->queued;
+		total += bytes;
+		printf("%3d %-6s %-15s", c->cid, c->ifname[0] ? c->ifname : "-",
+			c->address[0] ? c->address : "-");
+		printMsec(c->setupUsec);
+		printMsec(c->deactUsec);
+		printf(" %12llu %8.2f\n", bytes, mbps(bytes, duration));
+	}
+	printf("%-36s %12llu %8.2f\n", "aggregate", total, mbps(total, duration));
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-a atpath] [-n contexts] [-t seconds] "
+		"[-P pppd] [-v]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *atPath = "/tmp/fw100-at";
+	const char *pppd = "/usr/sbin/pppd";
+	char *setup[7] = { "0", "0", "internet", "", "", "0", "IP" };
+	char *deact[2] = { NULL, "0" };
+	char cidString[8];
+	char slave[64];
+	char *rilArgv[4 + 2 * DATA_MAX_CONTEXTS];
+	long long duration = 10;
+	long long t;
+	benchContext_t *c;
+	const struct RIL_Env *env;
+	pid_t child;
+	int ready[2];
+	int rilArgc = 0;
+	int on = 1;
+	int opt;
+	int i;
+
+	while (-1 != (opt = getopt(argc, argv, "a:n:t:P:v"))) {
+		switch (opt) {
+			case 'a': atPath = optarg; break;
+			case 'n': s_nCtx = atoi(optarg); break;
+			case 't': duration = atoll(optarg); break;
+			case 'P': pppd = optarg; break;
+			case 'v': benchLogLevel = (benchLogLevel > 4) ? 4 : 2; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (s_nCtx < 1 || s_nCtx > DATA_MAX_CONTEXTS || duration <= 0)
+		usage(argv[0]);
+	duration *= 1000000;
+	if (geteuid() != 0)
+		fprintf(stderr, "not root, pppd and the peer namespace will fail\n");
+
+	for (i = 0; i < s_nCtx; i++) {
+		c = &s_ctx[i];
+		c->cid = i + 1;
+		c->setupUsec = -1;
+		c->deactUsec = -1;
+		snprintf(c->link, sizeof(c->link), "/tmp/fw100-data.%d", c->cid);
+		c->driver = ptyOpen(c->link, slave, sizeof(slave));
+		c->peer = ptyOpen(NULL, c->peerTty, sizeof(c->peerTty));
+		if (c->driver < 0 || c->peer < 0) return 1;
+	}
+
+	if (pipe(ready) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	child = fork();
+	if (child == 0) {
+		close(ready[0]);
+		peerNamespace(pppd, ready[1]);
+	}
+	close(ready[1]);
+	if (child < 0 || read(ready[0], &opt, 1) != 1) {
+		fprintf(stderr, "peer namespace failed\n");
+		return 1;
+	}
+	close(ready[0]);
+
+	for (i = 0; i < s_nCtx; i++)
+		pthread_create(&s_ctx[i].relay, NULL, relayLoop, &s_ctx[i]);
+	env = benchEnvStart(benchOnRequestComplete, benchOnUnsolicitedResponse);
+	if (NULL == env)
+		goto done;
+
+	// RIL_Init parses its own options, one -d per context
+	rilArgv[rilArgc++] = "fw100-databench";
+	rilArgv[rilArgc++] = "-a";
+	rilArgv[rilArgc++] = (char *)atPath;
+	for (i = 0; i < s_nCtx; i++) {
+		rilArgv[rilArgc++] = "-d";
+		rilArgv[rilArgc++] = s_ctx[i].link;
+	}
+	rilArgv[rilArgc] = NULL;
+	optind = 1;
+	s_funcs = RIL_Init(env, rilArgc, rilArgv);
+	if (NULL == s_funcs) {
+		fprintf(stderr, "RIL_Init failed\n");
+		goto done;
+	}
+
+	for (i = 0; i < 300 && s_funcs->onStateRequest() == RADIO_STATE_UNAVAILABLE; i++)
+		usleep(100000);
+	if (s_funcs->onStateRequest() == RADIO_STATE_UNAVAILABLE) {
+		fprintf(stderr, "modem not available on %s\n", atPath);
+		goto done;
+	}
+	s_funcs->onRequest(RIL_REQUEST_RADIO_POWER, &on, sizeof(on), (RIL_Token)0);
+	for (i = 0; i < 300 && s_funcs->onStateRequest() == RADIO_STATE_OFF; i++)
+		usleep(100000);
+	// registration follows radio on
+	sleep(1);
+
+	for (i = 0; i < s_nCtx; i++) {
+		c = &s_ctx[i];
+		c->setupUsec = request(RIL_REQUEST_SETUP_DATA_CALL, setup, sizeof(setup));
+		if (c->setupUsec < 0) {
+			fprintf(stderr, "SETUP_DATA_CALL %d failed\n", i + 1);
+			continue;
+		}
+		// contexts are taken in order, the response names the one used
+		c = &s_ctx[atoi(s_resp[0]) - 1];
+		if (c != &s_ctx[i]) {
+			c->setupUsec = s_ctx[i].setupUsec;
+			s_ctx[i].setupUsec = -1;
+		}
+		snprintf(c->ifname, sizeof(c->ifname), "%.*s", IFNAMSIZ - 1, s_resp[1]);
+		copyString(c->address, s_resp[2], sizeof(c->address));
+		snprintf(c->gateway, sizeof(c->gateway), "10.64.%d.1", c->cid);
+	}
+
+	if (request(RIL_REQUEST_DATA_CALL_LIST, NULL, 0) >= 0) {
+		for (i = 0; i < s_nList; i++)
+			fprintf(stderr, "cid %d active %d %s\n", s_list[i].cid,
+				s_list[i].active, s_listAddress[i]);
+	}
+
+	s_sendEnd = benchNowUsec() + duration;
+	for (i = 0; i < s_nCtx; i++)
+		if (s_ctx[i].setupUsec >= 0)
+			pthread_create(&s_ctx[i].sender, NULL, sendLoop, &s_ctx[i]);
+	for (i = 0; i < s_nCtx; i++)
+		if (s_ctx[i].setupUsec >= 0)
+			pthread_join(s_ctx[i].sender, NULL);
+
+	for (i = 0; i < s_nCtx; i++) {
+		if (s_ctx[i].setupUsec < 0) continue;
+		snprintf(cidString, sizeof(cidString), "%d", s_ctx[i].cid);
+		deact[0] = cidString;
+		t = benchNowUsec();
+		if (request(RIL_REQUEST_DEACTIVATE_DATA_CALL, deact, sizeof(deact)) < 0)
+			continue;
+		// the request returns at once, the teardown ends with the interface
+		while (if_nametoindex(s_ctx[i].ifname) && benchNowUsec() - t < REQUEST_USEC)
+			usleep(5000);
+		if (!if_nametoindex(s_ctx[i].ifname)) s_ctx[i].deactUsec = benchNowUsec() - t;
+	}
+
+	report(duration);
+
+done:
+	kill(child, SIGTERM);
+	waitpid(child, NULL, 0);
+	for (i = 0; i < s_nCtx; i++) {
+		ptyClose(s_ctx[i].driver, s_ctx[i].link);
+		ptyClose(s_ctx[i].peer, NULL);
+	}
+	return 0;
+}
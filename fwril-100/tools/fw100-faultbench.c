@@ -0,0 +1,530 @@
+/**
+ * \file fw100-faultbench.c
+ * \brief AT channel fault injection and recovery time benchmark
+ *
+ * usage: fw100-faultbench [-a atpath] [-d datapath] [-f faults]
+ *                         [-D msec] [-T msec] [-r rate] [-g msec]
+ *                         [-m seconds] [-s usec] [-v]
+ *
+ *   -a path   AT port (default /tmp/fw100-at, run tools/fw100-sim)
+ *   -d path   data port (default /tmp/fw100-data)
+ *   -f list   faults to run in order, comma separated (default all)
+ *             drop      final OK / ERROR lines are lost
+ *             garbage   random bytes inserted into the read stream
+ *             stall     reads block
+ *             eof       end of file in the middle of a line
+ *             vanish    read error and the device node goes away
+ *             slowwrite each written byte is delayed
+ *   -D msec   fault duration, eof is a single event (default 3000)
+ *   -T msec   AT command timeout, 0 waits forever (default 5000)
+ *   -r rate   SIGNAL_STRENGTH requests per second (default 5)
+ *   -g msec   healthy time between faults (default 3000)
+ *   -m sec    give up waiting for recovery (default 60)
+ *   -s usec   slowwrite delay per byte (default 20000)
+ *   -v        driver log to stderr, -vv verbose
+ *
+ * The driver sources are linked as in fw100-bench, with the channel
+ * read and write calls replaced through at_set_channel_io.  One
+ * event thread issues RIL_REQUEST_SIGNAL_STRENGTH at a fixed rate
+ * and sends RADIO_POWER whenever the radio comes back off, as the
+ * phone app does.  For each fault the table reports
+ *   detect    injection to the channel being closed by onATTimeout
+ *             or onATReaderClosed, - if it never closed
+ *   recover   end of the fault to the first successful request
+ *             issued after it
+ *   failed    requests that failed or got no answer meanwhile
+ *   closes    AT channel closes seen
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <telephony/ril.h>
+
+#include <atchannel.h>
+#include <fw100-ril.h>
+#include <fw100-bench-env.h>
+
+#define MAX_RECORDS	0x10000
+#define MAX_FAULTS	16
+#define MAX_CHUNK	1024
+
+enum {
+	FAULT_NONE = 0,
+	FAULT_DROP,
+	FAULT_GARBAGE,
+	FAULT_STALL,
+	FAULT_EOF,
+	FAULT_VANISH,
+	FAULT_SLOWWRITE
+};
+
+typedef struct {
+	long long issued;
+	long long completed;	// 0 no answer yet
+	int err;
+} benchRecord_t;
+
+typedef struct {
+	int fault;
+	long long detectUsec;	// -1 channel not closed
+	long long recoverUsec;	// -1 not recovered
+	unsigned int failed;
+	unsigned int closes;
+} faultResult_t;
+
+extern int benchLogLevel;
+
+static const char *s_faultNames[] = {
+	"none", "drop", "garbage", "stall", "eof", "vanish", "slowwrite"
+};
+
+static benchRecord_t s_records[MAX_RECORDS];
+static int s_nRecords;
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+
+static const RIL_RadioFunctions *s_funcs;
+static long long s_interval;
+
+// injected fault, set by main, read by the channel hooks
+static volatile int s_fault;
+static volatile long long s_faultEnd;
+static volatile int s_eofState;
+static volatile int s_vanishRead;
+static int s_slowUsec = 20000;
+
+// channel close count and time of the first close in a fault
+static volatile unsigned int s_closes;
+static volatile long long s_firstClose;
+
+static int faultActive(int fault)
+{
+	return s_fault == fault && benchNowUsec() < s_faultEnd;
+}
+
+/**
+ * \brief remove final result lines from a read chunk
+ * \return bytes left
+ */
+static ssize_t dropFinals(char *buf, ssize_t n)
+{
+	char *line = buf;
+	char *end = buf + n;
+	char *out = buf;
+	char *p;
+	size_t len;
+
+	while (line < end) {
+		for (p = line; p < end && *p != '\r' && *p != '\n'; p++);
+		len = p - line;
+		if ((len == 2 && !memcmp(line, "OK", 2))
+			|| (len == 5 && !memcmp(line, "ERROR", 5))) {
+			line = p;
+			continue;
+		}
+		if (p < end) p++;
+		memmove(out, line, p - line);
+		out += p - line;
+		line = p;
+	}
+	return out - buf;
+}
+
+static ssize_t faultRead(int fd, void *buf, size_t count)
+{
+	char *b = buf;
+	ssize_t n;
+	int i;
+	int at;
+	int k;
+
+	if (s_fault == FAULT_VANISH && s_vanishRead) {
+		s_vanishRead = 0;
+		errno = EIO;
+		return -1;
+	}
+
+	if (s_fault == FAULT_EOF && s_eofState == 2) {
+		s_eofState = 0;
+		return 0;
+	}
+
+	// hold the reader until the stall ends or the driver gives up
+	while (faultActive(FAULT_STALL)) {
+		if (fw100GetSessionCtx()->s_closed) {
+			errno = EBADF;
+			return -1;
+		}
+		usleep(10000);
+	}
+
+	for (;;) {
+		n = read(fd, buf, (count > MAX_CHUNK) ? MAX_CHUNK : count);
+		if (n <= 0) return n;
+
+		if (faultActive(FAULT_DROP)) {
+			n = dropFinals(b, n);
+			if (n == 0) continue;	// 0 would look like EOF
+		}
+		break;
+	}
+
+	if (faultActive(FAULT_GARBAGE) && n < (ssize_t)count) {
+		k = 1 + rand() % 8;
+		if (n + k > (ssize_t)count) k = count - n;
+		at = rand() % (n + 1);
+		memmove(b + at + k, b + at, n - at);
+		for (i = 0; i < k; i++) b[at + i] = 1 + rand() % 255;
+		n += k;
+	}
+
+	if (s_fault == FAULT_EOF && s_eofState == 1) {
+		// half a line, then end of file on the next read
+		s_eofState = 2;
+		if (n > 1) n /= 2;
+	}
+
+	return n;
+}
+
+static ssize_t faultWrite(int fd, const void *buf, size_t count)
+{
+	if (faultActive(FAULT_VANISH)) {
+		errno = EIO;
+		return -1;
+	}
+	if (faultActive(FAULT_SLOWWRITE) && count > 0) {
+		usleep(s_slowUsec);
+		return write(fd, buf, 1);
+	}
+	return write(fd, buf, count);
+}
+
+static const ATChannelIo s_faultIo = { faultRead, faultWrite };
+
+static void benchOnRequestComplete(RIL_Token t, RIL_Errno e, void *response,
+    size_t responselen)
+{
+	long idx = (long)t;
+
+	if (idx < 0) return;	// unmeasured RADIO_POWER
+
+	pthread_mutex_lock(&s_mutex);
+	s_records[idx].completed = benchNowUsec();
+	s_records[idx].err = e;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_mutex);
+}
+
+static void benchOnUnsolicitedResponse(int unsolResponse, const void *data,
+    size_t datalen)
+{
+	if (unsolResponse == RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED
+		&& NULL != s_funcs
+		&& s_funcs->onStateRequest() == RADIO_STATE_UNAVAILABLE) {
+		if (s_firstClose == 0) s_firstClose = benchNowUsec();
+		__sync_fetch_and_add(&s_closes, 1);
+	}
+}
+
+/**
+ * \brief event thread, steady SIGNAL_STRENGTH load, radio kept on
+ */
+static void *eventLoop(void *arg)
+{
+	long long next = benchNowUsec();
+	long long now;
+	long idx;
+	int on = 1;
+
+	for (;;) {
+		now = benchNowUsec();
+		if (next > now) {
+			usleep(next - now);
+			continue;
+		}
+		// a request stuck in the driver delays the ones behind it
+		next = ((next + s_interval) > now) ? next + s_interval : now;
+
+		if (s_funcs->onStateRequest() == RADIO_STATE_OFF) {
+			s_funcs->onRequest(RIL_REQUEST_RADIO_POWER, &on, sizeof(on),
+				(RIL_Token)-1L);
+			continue;
+		}
+
+		pthread_mutex_lock(&s_mutex);
+		if (s_nRecords == MAX_RECORDS) {
+			pthread_mutex_unlock(&s_mutex);
+			break;
+		}
+		idx = s_nRecords++;
+		s_records[idx].issued = benchNowUsec();
+		pthread_mutex_unlock(&s_mutex);
+
+		s_funcs->onRequest(RIL_REQUEST_SIGNAL_STRENGTH, NULL, 0, (RIL_Token)idx);
+	}
+	return NULL;
+}
+
+/**
+ * \brief wait for a request issued at or after since to succeed
+ * \return completion time, -1 none before deadline
+ */
+static long long waitSuccess(long long since, long long deadline)
+{
+	long long t = -1;
+	int i;
+
+	pthread_mutex_lock(&s_mutex);
+	for (;;) {
+		for (i = s_nRecords - 1; i >= 0 && s_records[i].issued >= since; i--)
+			if (s_records[i].completed && s_records[i].err == RIL_E_SUCCESS)
+				t = s_records[i].completed;
+		if (t >= 0 || benchNowUsec() >= deadline) break;
+
+		benchCondWait(&s_cond, &s_mutex, 10000);
+	}
+	pthread_mutex_unlock(&s_mutex);
+	return t;
+}
+
+/**
+ * \brief requests touched by the fault that failed or got no answer
+ */
+static unsigned int countFailed(long long start, long long end)
+{
+	unsigned int failed = 0;
+	int i;
+
+	pthread_mutex_lock(&s_mutex);
+	for (i = 0; i < s_nRecords; i++) {
+		if (s_records[i].issued >= end) continue;
+		if (s_records[i].completed == 0) {
+			if (s_records[i].issued >= start) failed++;
+			continue;
+		}
+		if (s_records[i].completed < start) continue;
+		if (s_records[i].err != RIL_E_SUCCESS) failed++;
+	}
+	pthread_mutex_unlock(&s_mutex);
+	return failed;
+}
+
+/**
+ * \brief inject one fault and measure recovery
+ */
+static void runFault(int fault, const char *atPath, long long duration,
+    long long maxWait, faultResult_t *res)
+{
+	char gone[256];
+	long long start;
+	long long end;
+	long long ok;
+	unsigned int closes = s_closes;
+
+	memset(res, 0, sizeof(*res));
+	res->fault = fault;
+	snprintf(gone, sizeof(gone), "%s.gone", atPath);
+
+	s_firstClose = 0;
+	start = benchNowUsec();
+	s_faultEnd = start + duration;
+	s_eofState = (fault == FAULT_EOF) ? 1 : 0;
+	s_vanishRead = (fault == FAULT_VANISH) ? 1 : 0;
+	s_fault = fault;
+
+	if (fault == FAULT_VANISH && rename(atPath, gone) < 0)
+		perror(atPath);
+
+	if (fault == FAULT_EOF) {
+		// single event, over once the reader has seen it
+		while (s_eofState != 0 && benchNowUsec() < start + maxWait)
+			usleep(1000);
+		end = benchNowUsec();
+	} else {
+		usleep(duration);
+		end = benchNowUsec();
+	}
+
+	if (fault == FAULT_VANISH && rename(gone, atPath) < 0)
+		perror(gone);
+	s_fault = FAULT_NONE;
+
+	ok = waitSuccess(end, end + maxWait);
+
+	res->closes = s_closes - closes;
+	res->detectUsec = s_firstClose ? s_firstClose - start : -1;
+	res->recoverUsec = (ok >= 0) ? ok - end : -1;
+	res->failed = countFailed(start, (ok >= 0) ? ok : benchNowUsec());
+}
+
+static int faultByName(const char *name)
+{
+	int i;
+
+	for (i = FAULT_DROP; i <= FAULT_SLOWWRITE; i++)
+		if (!strcmp(s_faultNames[i], name))
+			return i;
+	return -1;
+}
+
+static void printMsec(long long usec)
+{
+	if (usec < 0)
+		printf(" %10s", "-");
+	else
+		printf(" %10.1f", usec / 1000.0);
+}
+
+static void report(faultResult_t *res, int n, long long duration,
+    long long timeout)
+{
+	int i;
+
+	printf("AT command timeout %lld ms, fault duration %lld ms\n",
+		timeout, duration / 1000);
+	printf("%-10s %10s %10s %8s %7s\n",
+		"fault", "detect ms", "recover ms", "failed", "closes");
+	for (i = 0; i < n; i++) {
+		printf("%-10s", s_faultNames[res[i].fault]);
+		printMsec(res[i].detectUsec);
+		if (res[i].recoverUsec < 0)
+			printf(" %10s", "never");
+		else
+			printMsec(res[i].recoverUsec);
+		printf(" %8u %7u\n", res[i].failed, res[i].closes);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-a atpath] [-d datapath] [-f faults] [-D msec] "
+		"[-T msec] [-r rate] [-g msec] [-m seconds] [-s usec] [-v]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *atPath = "/tmp/fw100-at";
+	const char *dataPath = "/tmp/fw100-data";
+	char faultList[256] = "drop,garbage,stall,eof,vanish,slowwrite";
+	int faults[MAX_FAULTS];
+	int nFaults = 0;
+	faultResult_t results[MAX_FAULTS];
+	int nResults = 0;
+	long long duration = 3000;
+	long long timeout = 5000;
+	long long gap = 3000;
+	long long maxWait = 60;
+	double rate = 5;
+	char *rilArgv[6];
+	char *tok;
+	char *save;
+	const struct RIL_Env *env;
+	pthread_t tid;
+	long long t;
+	int opt;
+	int i;
+
+	while (-1 != (opt = getopt(argc, argv, "a:d:f:D:T:r:g:m:s:v"))) {
+		switch (opt) {
+			case 'a': atPath = optarg; break;
+			case 'd': dataPath = optarg; break;
+			case 'f': snprintf(faultList, sizeof(faultList), "%s", optarg); break;
+			case 'D': duration = atoll(optarg); break;
+			case 'T': timeout = atoll(optarg); break;
+			case 'r': rate = atof(optarg); break;
+			case 'g': gap = atoll(optarg); break;
+			case 'm': maxWait = atoll(optarg); break;
+			case 's': s_slowUsec = atoi(optarg); break;
+			case 'v': benchLogLevel = (benchLogLevel > 4) ? 4 : 2; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (rate <= 0) usage(argv[0]);
+
+	for (tok = strtok_r(faultList, ",", &save); tok && nFaults < MAX_FAULTS;
+		tok = strtok_r(NULL, ",", &save)) {
+		faults[nFaults] = faultByName(tok);
+		if (faults[nFaults] < 0) {
+			fprintf(stderr, "unknown fault %s\n", tok);
+			usage(argv[0]);
+		}
+		nFaults++;
+	}
+
+	duration *= 1000;
+	gap *= 1000;
+	maxWait *= 1000000;
+	s_interval = (long long)(1000000 / rate);
+	srand(1);
+
+	at_set_channel_io(&s_faultIo);
+	at_set_command_timeout(timeout);
+
+	env = benchEnvStart(benchOnRequestComplete, benchOnUnsolicitedResponse);
+	if (NULL == env)
+		return 1;
+
+	// RIL_Init parses its own options
+	rilArgv[0] = "fw100-faultbench";
+	rilArgv[1] = "-a";
+	rilArgv[2] = (char *)atPath;
+	rilArgv[3] = "-d";
+	rilArgv[4] = (char *)dataPath;
+	rilArgv[5] = NULL;
+	optind = 1;
+	s_funcs = RIL_Init(env, 5, rilArgv);
+	if (NULL == s_funcs) {
+		fprintf(stderr, "RIL_Init failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < 300 && s_funcs->onStateRequest() == RADIO_STATE_UNAVAILABLE; i++)
+		usleep(100000);
+	if (s_funcs->onStateRequest() == RADIO_STATE_UNAVAILABLE) {
+		fprintf(stderr, "modem not available on %s\n", atPath);
+		return 1;
+	}
+
+	pthread_create(&tid, NULL, eventLoop, NULL);
+
+	for (i = 0; i < nFaults; i++) {
+		// healthy before each fault
+		t = benchNowUsec();
+		if (waitSuccess(t, t + maxWait) < 0) {
+			fprintf(stderr, "driver not answering, stopping before %s\n",
+				s_faultNames[faults[i]]);
+			break;
+		}
+		usleep(gap);
+
+		fprintf(stderr, "fault %s\n", s_faultNames[faults[i]]);
+		runFault(faults[i], atPath, duration, maxWait, &results[nResults]);
+		nResults++;
+		if (results[nResults - 1].recoverUsec < 0) {
+			fprintf(stderr, "no recovery from %s, stopping\n",
+				s_faultNames[faults[i]]);
+			break;
+		}
+	}
+
+	report(results, nResults, duration, timeout);
+	return 0;
+}
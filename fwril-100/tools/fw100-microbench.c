@@ -0,0 +1,833 @@
+/**
+ * \file fw100-microbench.c
+ * \brief microbenchmarks for the AT line reader, tokenizer and
+ * unsolicited dispatch
+ *
+ * usage: fw100-microbench [-f radio.log] [-t msec] [-J out.json]
+ *                         [-b baseline.json] [-T percent]
+ *
+ *   -f log     add a corpus of the AT< lines in a logcat -b radio file
+ *   -t msec    minimum time per measurement (default 200)
+ *   -J file    write results as JSON, "-" for stdout
+ *   -b file    compare with a JSON baseline, exit 2 when a benchmark
+ *              is slower by more than -T percent (default 10)
+ *
+ * Benchmarks, each run over every corpus:
+ *   findNextEOL   line scan over an in-memory CR LF framed buffer
+ *   readline      atchannel readline from a file of framed lines
+ *   at_tok        at_tok_start then every field, nextint or nextstr
+ *   at_fields     at_tok_fields then every field by index, no copy of
+ *                 the line; lines without a prefix are skipped
+ *   at_tok_last   last field only, walking every field before it
+ *   at_fields_last  last field only, by index
+ *   processLine   classification with no command pending (URC path)
+ *   processCmd    processLine of response + OK with a SINGLELINE
+ *                 command pending, the at_send_command path
+ *   parse_chain   registration and signal responses through the
+ *                 at_tok_next* chains the handlers used before
+ *   parse_schema  the same responses through at_schema_parse
+ *   onUnsolicited fw100-ril.c dispatch including metrics and the
+ *                 RIL_onUnsolicitedResponse wrapper
+ *
+ * Reported per line: ns (median of 5), heap allocations, and cache
+ * misses when perf_event_open is available.  The static functions
+ * are reached by including atchannel.c and fw100-ril.c in this file.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include "../atchannel.c"
+#undef LOG_TAG
+#undef NUM_ELEMS
+#undef MAX_AT_RESPONSE
+#include "../fw100-ril.c"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define MAX_CORPORA	8
+#define MAX_CORPUS_LINES	4096
+#define MAX_RESULTS	64
+#define RUNS		5
+
+typedef struct {
+	const char *name;
+	int nLines;
+	const char *lines[MAX_CORPUS_LINES];
+} corpus_t;
+
+typedef struct {
+	const char *name;
+	const char *corpus;
+	double nsPerLine;
+	double allocsPerLine;
+	double missesPerLine;	// -1 not available
+} result_t;
+
+typedef long long (*benchFunc_t)(corpus_t *c, long long iterations);
+
+// registration and signal polling responses, from radio-07.log
+static const char *s_regLines[] = {
+	"+CREG:1,4145,7,1",
+	"+CSQ:20,99",
+	"^SYSINFO:2,255,0,8,240",
+	"+CSNID:4145,7",
+	"+VROM:0,1",
+	"^HDRCSQ:60",
+	"+NETPAR:0,1,283,4145,7,384,2,-75,-80,-7,0",
+	"+VMCCMNC:0,310,120",
+	"+COPS:0",
+	NULL
+};
+
+// one NMEA burst, from radio-02-gps.log
+static const char *s_nmeaLines[] = {
+	"$GPGGA,234014.000,3307.055350,N,11718.467958,W,1,4,2.37,65.754,M,-35.160,M,,*5B",
+	"$GPGLL,3307.055350,N,11718.467958,W,234014.000,A,A*45",
+	"$GPGSA,A,3,22,03,19,09,,,,,,,,,2.55,2.37,0.94*09",
+	"$GPGST,234014.000,0.000,62,19,178,62,19,73*5D",
+	"$GPGSV,2,1,05,22,64,340,34,03,39,259,29,19,31,303,42,09,22,066,33*74",
+	"$GPGSV,2,2,05,06,,,26*7E",
+	"$GPRMC,234014.000,A,3307.055350,N,11718.467958,W,1.078,2.3,141211,,,A*7B",
+	"$GPVTG,2.3,T,,M,1.078,N,1.997,K,A*04",
+	"$GPZDA,234014.000,14,12,2011,,*52",
+	NULL
+};
+
+// SMS deliver, +CMT header line then PDU
+static const char *s_smsLines[] = {
+	"+CMT: ,29",
+	"07912160130300F4040B915121551532F400001140208132850A0CC8329BFD065DDF72363904",
+	"+CMT: ,29",
+	"07912160130300F4040B915121551532F400001140208132950A0CD4F29C0E8AC966B49C0D",
+	NULL
+};
+
+static corpus_t s_corpora[MAX_CORPORA];
+static int s_nCorpora;
+static result_t s_results[MAX_RESULTS];
+static int s_nResults;
+static long long s_minNsec = 200000000LL;
+
+static volatile unsigned long s_allocs;
+static volatile unsigned long s_sink;
+static int s_perfFd = -1;
+
+/*
+ * allocation counter, glibc routes its own internal allocations
+ * (strdup, asprintf) through a replaced malloc
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+void *malloc(size_t size)
+{
+	s_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	s_allocs++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	s_allocs++;
+	return __libc_realloc(p, size);
+}
+
+void free(void *p)
+{
+	__libc_free(p);
+}
+#endif
+
+static long long nowNsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void perfOpen(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	s_perfFd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perfStart(void)
+{
+	if (s_perfFd < 0) return;
+	ioctl(s_perfFd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(s_perfFd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static long long perfStop(void)
+{
+	long long count = -1;
+
+	if (s_perfFd < 0) return -1;
+	ioctl(s_perfFd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(s_perfFd, &count, sizeof(count)) != sizeof(count)) return -1;
+	return count;
+}
+
+static void corpusAdd(const char *name, const char **lines)
+{
+	corpus_t *c = &s_corpora[s_nCorpora++];
+
+	c->name = name;
+	for (c->nLines = 0; lines[c->nLines] && c->nLines < MAX_CORPUS_LINES; c->nLines++)
+		c->lines[c->nLines] = lines[c->nLines];
+}
+
+/**
+ * \brief corpus from the AT< lines of a logcat file
+ * \return 0 OK, -1 error
+ */
+static int corpusLoad(const char *file)
+{
+	FILE *f;
+	char buf[1024];
+	char *p;
+	corpus_t *c;
+
+	f = fopen(file, "r");
+	if (NULL == f) {
+		perror(file);
+		return -1;
+	}
+	c = &s_corpora[s_nCorpora];
+	c->name = "log";
+	c->nLines = 0;
+	while (NULL != fgets(buf, sizeof(buf), f) && c->nLines < MAX_CORPUS_LINES) {
+		if (NULL == (p = strstr(buf, "): AT< "))) continue;
+		p += 7;
+		p[strcspn(p, "\r\n")] = '\0';
+		if (*p == '\0') continue;
+		c->lines[c->nLines++] = strdup(p);
+	}
+	fclose(f);
+	if (c->nLines == 0) {
+		fprintf(stderr, "%s: no AT< lines\n", file);
+		return -1;
+	}
+	s_nCorpora++;
+	return 0;
+}
+
+static void noopUnsol(const char *s, const char *sms_pdu)
+{
+	s_sink += (unsigned char)s[0];
+}
+
+static void benchOnRequestComplete(RIL_Token t, RIL_Errno e, void *response,
+    size_t responselen)
+{
+}
+
+static void benchOnUnsolicitedResponse(int unsolResponse, const void *data,
+    size_t datalen)
+{
+	s_sink += unsolResponse;
+}
+
+static void benchRequestTimedCallback(RIL_TimedCallback callback, void *param,
+    const struct timeval *relativeTime)
+{
+}
+
+static const struct RIL_Env s_benchEnv = {
+	benchOnRequestComplete,
+	benchOnUnsolicitedResponse,
+	benchRequestTimedCallback
+};
+
+/**
+ * \brief corpus as CR LF framed text, as the modem sends it
+ */
+static char *frame(corpus_t *c, int repeat, int *len)
+{
+	char *buf;
+	int size = 0;
+	int off = 0;
+	int i;
+	int r;
+
+	for (i = 0; i < c->nLines; i++)
+		size += strlen(c->lines[i]) + 4;
+	buf = malloc((size_t)size * repeat + 1);
+	if (NULL == buf) return NULL;
+
+	for (r = 0; r < repeat; r++)
+		for (i = 0; i < c->nLines; i++)
+			off += sprintf(buf + off, "\r\n%s\r\n", c->lines[i]);
+	*len = off;
+	return buf;
+}
+
+static long long benchFindNextEOL(corpus_t *c, long long iterations)
+{
+	static char *buf;
+	static corpus_t *framed;
+	int len;
+	char *cur;
+	char *eol;
+	long long lines = 0;
+
+	if (framed != c) {
+		free(buf);
+		buf = frame(c, 1, &len);
+		framed = c;
+	}
+
+	while (lines < iterations) {
+		cur = buf;
+		for (;;) {
+			while (*cur == '\r' || *cur == '\n') cur++;
+			if (*cur == '\0') break;
+			eol = findNextEOL(cur);
+			if (NULL == eol) break;
+			s_sink += eol - cur;
+			cur = eol + 1;
+			lines++;
+		}
+	}
+	return lines;
+}
+
+static long long benchReadline(corpus_t *c, long long iterations)
+{
+	static char path[] = "/tmp/fw100-microbench-XXXXXX";
+	static corpus_t *framed;
+	static int fd = -1;
+	char *buf;
+	int len;
+	long long lines = 0;
+	const char *line;
+
+	// about 1 MByte of framed lines, written once per corpus
+	if (framed != c) {
+		if (fd >= 0) close(fd);
+		strcpy(path + strlen(path) - 6, "XXXXXX");
+		buf = frame(c, 1, &len);
+		free(buf);
+		buf = frame(c, (1 << 20) / len + 1, &len);
+		fd = mkstemp(path);
+		if (NULL == buf || fd < 0 || write(fd, buf, len) != len) {
+			perror(path);
+			exit(1);
+		}
+		free(buf);
+		unlink(path);
+		framed = c;
+	}
+
+	while (lines < iterations) {
+		lseek(fd, 0, SEEK_SET);
+		s_fd = fd;
+		s_ATBufferCur = s_ATBuffer;
+		s_ATBuffer[0] = '\0';
+		while (NULL != (line = readline())) {
+			s_sink += line[0];
+			lines++;
+		}
+	}
+	s_fd = -1;
+	return lines;
+}
+
+static long long benchAtTok(corpus_t *c, long long iterations)
+{
+	char buf[MAX_AT_RESPONSE];
+	char *cur;
+	char *str;
+	int val;
+	int i;
+	long long lines = 0;
+
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++) {
+			strcpy(buf, c->lines[i]);
+			cur = buf;
+			if (at_tok_start(&cur) < 0) {
+				// no prefix, NMEA and PDU lines split on commas
+				cur = buf;
+			}
+			while (at_tok_hasmore(&cur)) {
+				if (isdigit((unsigned char)*cur) || *cur == '-') {
+					if (at_tok_nextint(&cur, &val) == 0) s_sink += val;
+				} else if (at_tok_nextstr(&cur, &str) == 0 && NULL != str) {
+					s_sink += str[0];
+				}
+			}
+		}
+		lines += c->nLines;
+	}
+	return lines;
+}
+
+static long long benchAtFields(corpus_t *c, long long iterations)
+{
+	ATTokFields f;
+	char str[64];
+	const char *p;
+	int val;
+	int i;
+	int k;
+	long long lines = 0;
+
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++) {
+			if (at_tok_fields(&f, c->lines[i]) < 0) continue;
+			for (k = 0; k < f.count; k++) {
+				p = at_tok_field(&f, k, NULL);
+				if (isdigit((unsigned char)*p) || *p == '-') {
+					if (at_tok_field_int(&f, k, &val) == 0) s_sink += val;
+				} else if (at_tok_field_str(&f, k, str, sizeof(str)) >= 0) {
+					s_sink += str[0];
+				}
+			}
+		}
+		lines += c->nLines;
+	}
+	return lines;
+}
+
+static long long benchAtTokLast(corpus_t *c, long long iterations)
+{
+	char buf[MAX_AT_RESPONSE];
+	char *cur;
+	char *str;
+	int i;
+	long long lines = 0;
+
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++) {
+			strcpy(buf, c->lines[i]);
+			cur = buf;
+			if (at_tok_start(&cur) < 0) continue;
+			str = NULL;
+			while (at_tok_hasmore(&cur))
+				at_tok_nextstr(&cur, &str);
+			if (NULL != str) s_sink += str[0];
+		}
+		lines += c->nLines;
+	}
+	return lines;
+}
+
+static long long benchAtFieldsLast(corpus_t *c, long long iterations)
+{
+	ATTokFields f;
+	const char *p;
+	int i;
+	long long lines = 0;
+
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++) {
+			if (at_tok_fields(&f, c->lines[i]) <= 0) continue;
+			p = at_tok_field(&f, f.count - 1, NULL);
+			s_sink += p[0];
+		}
+		lines += c->nLines;
+	}
+	return lines;
+}
+
+/**
+ * \brief hand written at_tok chains as in the handlers before the
+ * schemas, keyed by prefix.  The line is copied, at_tok writes into it
+ * \return 0 parsed, -1 error or prefix not handled
+ */
+static int chainParse(const char *src, fw100RegInfo_t *reg,
+    fw100SignalInfo_t *sig, fw100MccMnc_t *mm)
+{
+	char buf[MAX_AT_RESPONSE];
+	char *line = buf;
+	char *str;
+	int skip;
+	int i;
+
+	strcpy(buf, src);
+	if (at_tok_start(&line) < 0) return -1;
+
+	if (strStartsWith(src, "+CREG:")) {
+		for (i = 0; i < 3; i++)
+			if (at_tok_nextint(&line, &skip) < 0) return -1;
+		if (at_tok_nextstr(&line, &str) < 0) return -1;
+		snprintf(reg->status, sizeof(reg->status), "%s", str);
+	} else if (strStartsWith(src, "^SYSINFO:")) {
+		if (at_tok_nextint(&line, &skip) < 0) return -1;
+		if (at_tok_nextint(&line, &skip) < 0) return -1;
+		if (at_tok_nextint(&line, &reg->roam) < 0) return -1;
+		if (at_tok_nextint(&line, &reg->protocol) < 0) return -1;
+	} else if (strStartsWith(src, "+CSNID:")) {
+		if (at_tok_nextstr(&line, &str) < 0) return -1;
+		snprintf(reg->sid, sizeof(reg->sid), "%s", str);
+		if (at_tok_nextstr(&line, &str) < 0) return -1;
+		snprintf(reg->nid, sizeof(reg->nid), "%s", str);
+	} else if (strStartsWith(src, "+VROM:")) {
+		if (at_tok_nextint(&line, &skip) < 0) return -1;
+		if (at_tok_nextstr(&line, &str) < 0) return -1;
+		snprintf(reg->romIndicator, sizeof(reg->romIndicator), "%s", str);
+	} else if (strStartsWith(src, "+CSQ:")) {
+		if (at_tok_nextint(&line, &sig->rssi) < 0) return -1;
+		if (at_tok_nextint(&line, &sig->ber) < 0) return -1;
+	} else if (strStartsWith(src, "^HDRCSQ:")) {
+		if (at_tok_nextint(&line, &sig->hdr) < 0) return -1;
+	} else if (strStartsWith(src, "+NETPAR:")) {
+		for (i = 0; i < 9; i++)
+			if (at_tok_nextint(&line, &skip) < 0) return -1;
+		if (at_tok_nextint(&line, &sig->ecio) < 0) return -1;
+	} else if (strStartsWith(src, "+VMCCMNC:")) {
+		if (at_tok_nextint(&line, &skip) < 0) return -1;
+		if (at_tok_nextstr(&line, &str) < 0) return -1;
+		snprintf(mm->mcc, sizeof(mm->mcc), "%s", str);
+		if (at_tok_nextstr(&line, &str) < 0) return -1;
+		snprintf(mm->mnc, sizeof(mm->mnc), "%s", str);
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * \brief the same responses through the fw100-ril-schema.c schemas
+ */
+static int schemaParse(const char *src, fw100RegInfo_t *reg,
+    fw100SignalInfo_t *sig, fw100MccMnc_t *mm)
+{
+	if (strStartsWith(src, "+CREG:"))
+		return at_schema_parse(&fw100SchemaCreg, src, reg);
+	if (strStartsWith(src, "^SYSINFO:"))
+		return at_schema_parse(&fw100SchemaSysinfo, src, reg);
+	if (strStartsWith(src, "+CSNID:"))
+		return at_schema_parse(&fw100SchemaCsnid, src, reg);
+	if (strStartsWith(src, "+VROM:"))
+		return at_schema_parse(&fw100SchemaVrom, src, reg);
+	if (strStartsWith(src, "+CSQ:"))
+		return at_schema_parse(&fw100SchemaCsq, src, sig);
+	if (strStartsWith(src, "^HDRCSQ:"))
+		return at_schema_parse(&fw100SchemaHdrCsq, src, sig);
+	if (strStartsWith(src, "+NETPAR:"))
+		return at_schema_parse(&fw100SchemaNetpar, src, sig);
+	if (strStartsWith(src, "+VMCCMNC:"))
+		return at_schema_parse(&fw100SchemaMccMnc, src, mm);
+	return -1;
+}
+
+static long long benchParse(corpus_t *c, long long iterations,
+    int (*parse)(const char *, fw100RegInfo_t *, fw100SignalInfo_t *,
+        fw100MccMnc_t *))
+{
+	fw100RegInfo_t reg;
+	fw100SignalInfo_t sig;
+	fw100MccMnc_t mm;
+	int i;
+	long long lines = 0;
+
+	memset(&reg, 0, sizeof(reg));
+	memset(&sig, 0, sizeof(sig));
+	memset(&mm, 0, sizeof(mm));
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++)
+			if (parse(c->lines[i], &reg, &sig, &mm) == 0)
+				s_sink += reg.protocol + sig.ecio + reg.sid[0];
+		lines += c->nLines;
+	}
+	return lines;
+}
+
+static long long benchParseChain(corpus_t *c, long long iterations)
+{
+	return benchParse(c, iterations, chainParse);
+}
+
+static long long benchParseSchema(corpus_t *c, long long iterations)
+{
+	return benchParse(c, iterations, schemaParse);
+}
+
+static long long benchProcessLine(corpus_t *c, long long iterations)
+{
+	int i;
+	long long lines = 0;
+
+	s_unsolHandler = noopUnsol;
+	sp_response = NULL;
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++)
+			processLine(c->lines[i]);
+		lines += c->nLines;
+	}
+	s_unsolHandler = NULL;
+	return lines;
+}
+
+static long long benchProcessCmd(corpus_t *c, long long iterations)
+{
+	char prefix[32];
+	int i;
+	long long lines = 0;
+
+	s_unsolHandler = noopUnsol;
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++) {
+			snprintf(prefix, sizeof(prefix), "%.*s",
+				(int)strcspn(c->lines[i], ":,"), c->lines[i]);
+			sp_response = at_response_new();
+			s_type = SINGLELINE;
+			s_responsePrefix = prefix;
+			processLine(c->lines[i]);
+			processLine("OK");
+			at_response_free(sp_response);
+			sp_response = NULL;
+		}
+		lines += c->nLines;
+	}
+	s_responsePrefix = NULL;
+	s_unsolHandler = NULL;
+	return lines;
+}
+
+static long long benchOnUnsolicited(corpus_t *c, long long iterations)
+{
+	int i;
+	long long lines = 0;
+
+	while (lines < iterations) {
+		for (i = 0; i < c->nLines; i++) {
+			// SMS header line carries the PDU line, as readerLoop does
+			if (isSMSUnsolicited(c->lines[i]) && i + 1 < c->nLines) {
+				onUnsolicited(c->lines[i], c->lines[i + 1]);
+				i++;
+			} else {
+				onUnsolicited(c->lines[i], NULL);
+			}
+		}
+		lines += c->nLines;
+	}
+	return lines;
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+/**
+ * \brief calibrate then measure one benchmark on one corpus
+ */
+static void run(const char *name, benchFunc_t func, corpus_t *c)
+{
+	result_t *res;
+	double ns[RUNS];
+	double allocs = 0;
+	double misses = 0;
+	long long iterations = c->nLines;
+	long long lines;
+	long long t;
+	long long m;
+	unsigned long a;
+	int r;
+
+	// grow until one run takes the minimum time
+	for (;;) {
+		t = nowNsec();
+		lines = func(c, iterations);
+		t = nowNsec() - t;
+		if (t >= s_minNsec || iterations > (1LL << 40)) break;
+		iterations *= (t > 0 && t < s_minNsec / 8) ? 8 : 2;
+	}
+
+	for (r = 0; r < RUNS; r++) {
+		a = s_allocs;
+		perfStart();
+		t = nowNsec();
+		lines = func(c, iterations);
+		t = nowNsec() - t;
+		m = perfStop();
+		ns[r] = (double)t / lines;
+		allocs = (double)(s_allocs - a) / lines;
+		misses = (m < 0) ? -1 : (double)m / lines;
+	}
+	qsort(ns, RUNS, sizeof(ns[0]), cmpDouble);
+
+	if (s_nResults >= MAX_RESULTS) return;
+	res = &s_results[s_nResults++];
+	res->name = name;
+	res->corpus = c->name;
+	res->nsPerLine = ns[RUNS / 2];
+	res->allocsPerLine = allocs;
+	res->missesPerLine = misses;
+}
+
+static void writeJson(const char *file)
+{
+	FILE *f;
+	int i;
+	result_t *res;
+
+	f = strcmp(file, "-") ? fopen(file, "w") : stdout;
+	if (NULL == f) {
+		perror(file);
+		return;
+	}
+	fprintf(f, "{\"results\":[\n");
+	for (i = 0; i < s_nResults; i++) {
+		res = &s_results[i];
+		fprintf(f, "{\"name\":\"%s\",\"corpus\":\"%s\",\"ns_per_line\":%.1f,"
+			"\"allocs_per_line\":%.2f,\"cache_misses_per_line\":",
+			res->name, res->corpus, res->nsPerLine, res->allocsPerLine);
+		if (res->missesPerLine < 0) fprintf(f, "null");
+		else fprintf(f, "%.2f", res->missesPerLine);
+		fprintf(f, "}%s\n", (i + 1 < s_nResults) ? "," : "");
+	}
+	fprintf(f, "]}\n");
+	if (f != stdout) fclose(f);
+}
+
+/**
+ * \brief baseline ns/line for a benchmark, one result per line as
+ * written by writeJson
+ * \return ns per line, -1 not in baseline
+ */
+static double baselineLookup(const char *file, const char *name, const char *corpus)
+{
+	FILE *f;
+	char buf[512];
+	char n[64];
+	char c[64];
+	double ns;
+	double ret = -1;
+
+	f = fopen(file, "r");
+	if (NULL == f) return -1;
+	while (NULL != fgets(buf, sizeof(buf), f)) {
+		if (sscanf(buf, "{\"name\":\"%63[^\"]\",\"corpus\":\"%63[^\"]\",\"ns_per_line\":%lf",
+			n, c, &ns) == 3 && !strcmp(n, name) && !strcmp(c, corpus)) {
+			ret = ns;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static void benchUsage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f radio.log] [-t msec] [-J out.json] "
+		"[-b baseline.json] [-T percent]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		benchFunc_t func;
+		int responses;	// response corpora only
+	} benches[] = {
+		{ "findNextEOL",   benchFindNextEOL,   0 },
+		{ "readline",      benchReadline,      0 },
+		{ "at_tok",        benchAtTok,         0 },
+		{ "at_fields",     benchAtFields,      0 },
+		{ "at_tok_last",   benchAtTokLast,     0 },
+		{ "at_fields_last", benchAtFieldsLast, 0 },
+		{ "processLine",   benchProcessLine,   0 },
+		{ "processCmd",    benchProcessCmd,    1 },
+		{ "parse_chain",   benchParseChain,    1 },
+		{ "parse_schema",  benchParseSchema,   1 },
+		{ "onUnsolicited", benchOnUnsolicited, 0 },
+	};
+	const char *json = NULL;
+	const char *baseline = NULL;
+	double threshold = 10;
+	double base;
+	double delta;
+	int regressions = 0;
+	int opt;
+	int b;
+	int i;
+	result_t *res;
+
+	while (-1 != (opt = getopt(argc, argv, "f:t:J:b:T:"))) {
+		switch (opt) {
+			case 'f':
+				if (s_nCorpora >= MAX_CORPORA || corpusLoad(optarg) < 0) return 1;
+				break;
+			case 't': s_minNsec = atoll(optarg) * 1000000LL; break;
+			case 'J': json = optarg; break;
+			case 'b': baseline = optarg; break;
+			case 'T': threshold = atof(optarg); break;
+			default: benchUsage(argv[0]);
+		}
+	}
+	corpusAdd("reg", s_regLines);
+	corpusAdd("nmea", s_nmeaLines);
+	corpusAdd("sms", s_smsLines);
+
+	// driver state as after RIL_Init, with the radio on
+	s_rilenv = &s_benchEnv;
+	fw100Ctx.sState = RADIO_STATE_SIM_READY;
+	perfOpen();
+
+	for (b = 0; b < (int)(sizeof(benches) / sizeof(benches[0])); b++)
+		for (i = 0; i < s_nCorpora; i++)
+			if (!benches[b].responses || !strcmp(s_corpora[i].name, "reg"))
+				run(benches[b].name, benches[b].func, &s_corpora[i]);
+
+	printf("%-14s %-6s %10s %12s %14s", "benchmark", "corpus", "ns/line",
+		"allocs/line", "misses/line");
+	if (baseline) printf(" %10s %8s", "baseline", "delta");
+	printf("\n");
+
+	for (i = 0; i < s_nResults; i++) {
+		res = &s_results[i];
+		printf("%-14s %-6s %10.1f %12.2f ", res->name, res->corpus,
+			res->nsPerLine, res->allocsPerLine);
+		if (res->missesPerLine < 0) printf("%14s", "-");
+		else printf("%14.2f", res->missesPerLine);
+		if (baseline) {
+			base = baselineLookup(baseline, res->name, res->corpus);
+			if (base > 0) {
+				delta = 100.0 * (res->nsPerLine - base) / base;
+				printf(" %10.1f %+7.1f%%", base, delta);
+				if (delta > threshold) {
+					printf(" SLOWER");
+					regressions++;
+				}
+			} else {
+				printf(" %10s", "-");
+			}
+		}
+		printf("\n");
+	}
+
+	if (json) writeJson(json);
+	return regressions ? 2 : 0;
+}
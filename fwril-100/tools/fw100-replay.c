@@ -0,0 +1,376 @@
+/**
+ * \file fw100-replay.c
+ * \brief replay captured radio logs as a scripted modem on a pty
+ *
+ * usage: fw100-replay [-s scale] [-n loops] [-u] [-L link] <radio.log>
+ *
+ *   -s scale  timing scale, 1 recorded timing, 0.5 twice as fast,
+ *             0 no delay (default 1)
+ *   -n loops  URC mode passes over the log (default 1)
+ *   -u        URC mode, stream every recorded unsolicited line at
+ *             recorded timing, answer all commands OK
+ *   -L link   symlink to the pty slave, e.g. /tmp/fw100-at
+ *
+ * The log is logcat -b radio output with the atchannel lines
+ *   01-01 00:00:12.679 D/AT      ( 1070): AT> AT^MEID
+ *   01-01 00:00:12.695 D/AT      ( 1070): AT< ^MEID:0xa10000157f81a9
+ *
+ * Each AT> line starts an exchange.  AT< lines up to the final
+ * result are its response, AT< lines after the final result are
+ * unsolicited and replayed relative to the command.  In the default
+ * lockstep mode a command from the driver is matched to the next
+ * exchange, or resynchronized a few exchanges ahead, or answered
+ * from the first exchange with the same command anywhere in the
+ * log.  Unmatched commands get ERROR and are counted.
+ *
+ * Point the driver at the slave, e.g. rild -l libril-fusion-100.so
+ * -- -a /tmp/fw100-at -d /dev/null
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <fwtool-pty.h>
+
+#define MAX_LOG_LINES	0x10000
+#define MAX_PENDING	4096
+#define RESYNC_WINDOW	8
+
+#define DIR_TX		0 // AT> host to modem
+#define DIR_RX		1 // AT< modem to host
+
+typedef struct {
+	long long msec;
+	int dir;
+	char *text;
+} logLine_t;
+
+typedef struct {
+	int line;		// AT> line, -1 for lines before first command
+	int firstRsp;
+	int nRsp;
+	int firstUrc;
+	int nUrc;
+} exchange_t;
+
+typedef struct {
+	long long due;
+	const char *text;
+} pending_t;
+
+static logLine_t s_lines[MAX_LOG_LINES];
+static int s_nLines;
+static exchange_t s_exch[MAX_LOG_LINES];
+static int s_nExch;
+
+static pending_t s_pending[MAX_PENDING];
+static int s_nPending;
+
+static double s_scale = 1.0;
+static volatile int s_quit;
+
+// replay statistics
+static unsigned int s_matched;
+static unsigned int s_resync;
+static unsigned int s_lookup;
+static unsigned int s_mismatch;
+static unsigned int s_urcSent;
+static unsigned int s_rspSent;
+
+static const char *s_finals[] = {
+	"OK", "ERROR", "+CME ERROR:", "+CMS ERROR:", "NO CARRIER",
+	"CONNECT", "NO ANSWER", "BUSY", "NO DIALTONE", NULL
+};
+
+static int isFinal(const char *line)
+{
+	int i;
+
+	for (i = 0; s_finals[i]; i++)
+		if (!strncmp(line, s_finals[i], strlen(s_finals[i])))
+			return 1;
+	return 0;
+}
+
+/**
+ * \brief parse one logcat line, MM-DD HH:MM:SS.mmm D/AT ( pid): AT> text
+ * \return 1 atchannel line stored, 0 other line
+ */
+static int parseLine(char *buf)
+{
+	int mon, day, hh, mm, ss, ms;
+	char *p;
+	int dir;
+	int n;
+
+	if (sscanf(buf, "%d-%d %d:%d:%d.%d", &mon, &day, &hh, &mm, &ss, &ms) != 6)
+		return 0;
+	if (NULL == strstr(buf, " D/AT "))
+		return 0;
+
+	if (NULL != (p = strstr(buf, "): AT> ")))
+		dir = DIR_TX;
+	else if (NULL != (p = strstr(buf, "): AT< ")))
+		dir = DIR_RX;
+	else
+		return 0;
+	p += 7;
+
+	n = strlen(p);
+	while (n > 0 && (p[n-1] == '\n' || p[n-1] == '\r')) p[--n] = '\0';
+	if (dir == DIR_RX && n == 0) return 0;
+
+	if (s_nLines >= MAX_LOG_LINES) return 0;
+	s_lines[s_nLines].msec = ((((long long)day * 24 + hh) * 60 + mm) * 60 + ss) * 1000 + ms;
+	s_lines[s_nLines].dir = dir;
+	s_lines[s_nLines].text = strdup(p);
+	s_nLines++;
+	return 1;
+}
+
+/**
+ * \brief split log lines into command exchanges
+ */
+static void buildExchanges(void)
+{
+	int i;
+	int final = 1;
+	exchange_t *ex;
+
+	// lines before the first command are unsolicited
+	ex = &s_exch[0];
+	memset(ex, 0, sizeof(*ex));
+	ex->line = -1;
+	ex->firstUrc = 0;
+	s_nExch = 1;
+
+	for (i = 0; i < s_nLines; i++) {
+		if (s_lines[i].dir == DIR_TX) {
+			ex = &s_exch[s_nExch++];
+			memset(ex, 0, sizeof(*ex));
+			ex->line = i;
+			ex->firstRsp = i + 1;
+			ex->firstUrc = i + 1;
+			final = 0;
+			continue;
+		}
+		if (!final) {
+			ex->nRsp++;
+			ex->firstUrc = i + 1;
+			final = isFinal(s_lines[i].text);
+		} else {
+			ex->nUrc++;
+		}
+	}
+}
+
+static long long scaled(long long msec)
+{
+	return (long long)(msec * s_scale);
+}
+
+static void schedule(long long due, const char *text)
+{
+	int i;
+
+	if (s_nPending >= MAX_PENDING) return;
+
+	// keep sorted by due time, equal times in insertion order
+	for (i = s_nPending; i > 0 && s_pending[i-1].due > due; i--)
+		s_pending[i] = s_pending[i-1];
+	s_pending[i].due = due;
+	s_pending[i].text = text;
+	s_nPending++;
+}
+
+/**
+ * \brief queue response and unsolicited lines of an exchange
+ */
+static void playExchange(int e, long long now)
+{
+	exchange_t *ex = &s_exch[e];
+	long long base = (ex->line >= 0) ? s_lines[ex->line].msec : s_lines[0].msec;
+	int i;
+
+	for (i = 0; i < ex->nRsp; i++) {
+		schedule(now + scaled(s_lines[ex->firstRsp + i].msec - base),
+			s_lines[ex->firstRsp + i].text);
+		s_rspSent++;
+	}
+	for (i = 0; i < ex->nUrc; i++) {
+		schedule(now + scaled(s_lines[ex->firstUrc + i].msec - base),
+			s_lines[ex->firstUrc + i].text);
+		s_urcSent++;
+	}
+}
+
+/**
+ * \brief find the exchange for a command from the driver
+ * \return exchange index, -1 not in log
+ */
+static int matchCommand(const char *cmd, int *next)
+{
+	int e;
+
+	for (e = *next; e < s_nExch && e < *next + RESYNC_WINDOW; e++) {
+		if (!strcmp(s_lines[s_exch[e].line].text, cmd)) {
+			if (e == *next) s_matched++;
+			else s_resync++;
+			*next = e + 1;
+			return e;
+		}
+	}
+
+	for (e = 1; e < s_nExch; e++) {
+		if (!strcmp(s_lines[s_exch[e].line].text, cmd)) {
+			s_lookup++;
+			return e;
+		}
+	}
+
+	s_mismatch++;
+	return -1;
+}
+
+/**
+ * \brief queue every unsolicited line for URC mode
+ */
+static void playAllUrc(long long now)
+{
+	int e;
+	int i;
+	long long base = s_lines[0].msec;
+
+	for (e = 0; e < s_nExch; e++)
+		for (i = 0; i < s_exch[e].nUrc; i++) {
+			schedule(now + scaled(s_lines[s_exch[e].firstUrc + i].msec - base),
+				s_lines[s_exch[e].firstUrc + i].text);
+			s_urcSent++;
+		}
+}
+
+static void onSignal(int sig)
+{
+	s_quit = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s scale] [-n loops] [-u] [-L link] <radio.log>\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	FILE *f;
+	char buf[1024];
+	char slave[64];
+	char cmd[1024];
+	int cmdLen = 0;
+	const char *link = NULL;
+	int urcMode = 0;
+	int loops = 1;
+	int next = 1;
+	int master;
+	int opt;
+	int timeout;
+	int e;
+	long long now;
+	struct pollfd pfd;
+
+	while (-1 != (opt = getopt(argc, argv, "s:n:uL:"))) {
+		switch (opt) {
+			case 's': s_scale = atof(optarg); break;
+			case 'n': loops = atoi(optarg); break;
+			case 'u': urcMode = 1; break;
+			case 'L': link = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc) usage(argv[0]);
+
+	f = fopen(argv[optind], "r");
+	if (NULL == f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	while (NULL != fgets(buf, sizeof(buf), f))
+		parseLine(buf);
+	fclose(f);
+
+	if (s_nLines == 0) {
+		fprintf(stderr, "%s: no AT> / AT< lines\n", argv[optind]);
+		return 1;
+	}
+	buildExchanges();
+	fprintf(stderr, "%d lines, %d commands\n", s_nLines, s_nExch - 1);
+
+	master = ptyOpen(link, slave, sizeof(slave));
+	if (master < 0) return 1;
+	fprintf(stderr, "modem on %s\n", slave);
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	now = ptyNowMsec();
+	if (urcMode)
+		playAllUrc(now);
+	else
+		playExchange(0, now);
+
+	while (!s_quit) {
+		now = ptyNowMsec();
+
+		while (s_nPending > 0 && s_pending[0].due <= now) {
+			ptyWriteLine(master, s_pending[0].text);
+			s_nPending--;
+			memmove(s_pending, s_pending + 1, s_nPending * sizeof(s_pending[0]));
+		}
+
+		if (urcMode && s_nPending == 0) {
+			if (--loops <= 0) break;
+			playAllUrc(now);
+			continue;
+		}
+
+		timeout = (s_nPending > 0) ? (int)(s_pending[0].due - now) : -1;
+		pfd.fd = master;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, timeout) <= 0) continue;
+
+		while (ptyReadLine(master, cmd, sizeof(cmd), &cmdLen) == 1) {
+			if (cmd[0] == '\0') continue;
+			if (urcMode) {
+				ptyWriteLine(master, "OK");
+				continue;
+			}
+			e = matchCommand(cmd, &next);
+			if (e < 0) {
+				fprintf(stderr, "no match: %s\n", cmd);
+				ptyWriteLine(master, "ERROR");
+			} else {
+				playExchange(e, ptyNowMsec());
+			}
+		}
+	}
+
+	fprintf(stderr, "matched=%u resync=%u lookup=%u mismatch=%u rsp=%u urc=%u\n",
+		s_matched, s_resync, s_lookup, s_mismatch, s_rspSent, s_urcSent);
+
+	ptyClose(master, link);
+	return (s_mismatch > 0) ? 2 : 0;
+}
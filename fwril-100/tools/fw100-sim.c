@@ -0,0 +1,731 @@
+/**
+ * \file fw100-sim.c
+ * \brief FW100 modem simulator on a pty
+ *
+ * usage: fw100-sim [-f script] [-L atlink] [-D datalink] [-l msec]
+ *                  [-j msec] [-u msec] [-c carrier] [-m mdn] [-r seed]
+ *
+ *   -f script  script file, see below
+ *   -L link    AT port symlink (default /tmp/fw100-at)
+ *   -D link    data port symlink (default /tmp/fw100-data)
+ *   -l msec    command latency (default 20)
+ *   -j msec    latency jitter, uniform 0..msec added (default 0)
+ *   -u msec    mean interval of random signal and registration
+ *              changes, 0 off (default 0)
+ *   -c carrier sprint or vzw (default sprint)
+ *   -m mdn     MDN, 0000000000 leaves the module unactivated and
+ *              a vzw module then answers AT+CDV=*22899 with an
+ *              OTASP call (default 8585550100)
+ *   -r seed    random seed (default 1)
+ *
+ * The AT port implements the FW100 dialect used by the driver,
+ * +VPON ^MEID +VMDN ^SYSINFO ^HDRCSQ +NETPAR +CSNID +VROM +CSQ
+ * +CREG $QCMIPGETP ^GPSLOC (NMEA output) and +CDV=*22899 (^OTACMSG
+ * sequence).  Other commands are answered OK and counted.  The data
+ * port answers ATZ and ATD#777 with CONNECT and sinks PPP bytes until
+ * ATH on the AT port or a scripted drop, then sends NO CARRIER.
+ *
+ * Script lines, # comments:
+ *   latency <prefix> <msec> [jitter]   per command latency
+ *   fault <prefix> <kind> <percent>    kind error cme timeout garbage slow
+ *   urc <msec> <line>                  send line every msec
+ *   set <key> <value>                  rssi hdr ecio creg sid nid roam
+ *                                      otasp (8 ok, else failure code)
+ *                                      connect (msec) drop (msec after
+ *                                      CONNECT, 0 never)
+ * Prefixes match the start of the command, e.g. AT+CSQ, AT^, ATD.
+ *
+ * Point the driver at the simulator,
+ *   rild -l libril-fusion-100.so -- -a /tmp/fw100-at -d /tmp/fw100-data
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fwtool-pty.h>
+
+#define MAX_PENDING	1024
+#define MAX_RULES	64
+#define MAX_URCS	16
+#define MAX_LINE	512
+
+#define FAULT_NONE	0
+#define FAULT_ERROR	1
+#define FAULT_CME	2
+#define FAULT_TIMEOUT	3
+#define FAULT_GARBAGE	4
+#define FAULT_SLOW	5
+
+#define PORT_AT		0
+#define PORT_DATA	1
+
+typedef struct {
+	char prefix[32];
+	int latency;		// -1 use default
+	int jitter;
+	int fault;
+	int percent;
+	unsigned int hits;
+	unsigned int faults;
+} rule_t;
+
+typedef struct {
+	int period;
+	long long due;
+	char line[MAX_LINE];
+} urc_t;
+
+typedef struct {
+	long long due;
+	int port;
+	int action;		// ACTION_LINE or a state change
+	char line[MAX_LINE];
+} pending_t;
+
+#define ACTION_LINE	0
+#define ACTION_ONLINE	1	// data port enters online mode
+#define ACTION_OFFLINE	2	// data port leaves online mode
+#define ACTION_MDN	3	// OTASP assigned the MDN
+
+static const char *s_faultNames[] = {
+	"none", "error", "cme", "timeout", "garbage", "slow", NULL
+};
+
+static rule_t s_rules[MAX_RULES];
+static int s_nRules;
+static urc_t s_urcs[MAX_URCS];
+static int s_nUrcs;
+static pending_t s_pending[MAX_PENDING];
+static int s_nPending;
+static int s_fd[2];
+
+static volatile int s_quit;
+
+// modem state
+static int s_latency = 20;
+static int s_jitter = 0;
+static int s_changeMsec = 0;
+static const char *s_carrier = "sprint";
+static char s_mdn[16] = "8585550100";
+static const char *s_activatedMdn = "8585550199";
+static const char *s_meid = "A10000157F81A9";
+static int s_power = 1;
+static int s_rssi = 20;
+static int s_hdr = 60;
+static int s_ecio = -7;
+static int s_cregMode = 0;
+static int s_creg = 1;
+static int s_sid = 4145;
+static int s_nid = 7;
+static int s_roam = 0;
+static int s_otaspResult = 8;
+static int s_gpsInterval = 0;
+static long long s_gpsDue;
+static int s_connectMsec = 1000;
+static int s_dropMsec = 0;
+static long long s_dropDue;
+static int s_online;
+static int s_dialing;
+
+// statistics
+static unsigned int s_commands;
+static unsigned int s_unknown;
+static unsigned int s_faults;
+static unsigned int s_urcSent;
+static unsigned int s_nmeaSent;
+static unsigned int s_calls;
+static unsigned int s_dataBytes;
+
+/**
+ * \brief queue a response line or state change
+ */
+static void schedule(long long due, int port, int action, const char *line)
+{
+	int i;
+
+	if (s_nPending >= MAX_PENDING) return;
+
+	// keep sorted by due time, equal times in insertion order
+	for (i = s_nPending; i > 0 && s_pending[i-1].due > due; i--)
+		s_pending[i] = s_pending[i-1];
+	s_pending[i].due = due;
+	s_pending[i].port = port;
+	s_pending[i].action = action;
+	snprintf(s_pending[i].line, MAX_LINE, "%s", (NULL != line) ? line : "");
+	s_nPending++;
+}
+
+static int startsWith(const char *s, const char *prefix)
+{
+	return !strncasecmp(s, prefix, strlen(prefix));
+}
+
+static rule_t *findRule(const char *cmd)
+{
+	int i;
+	rule_t *best = NULL;
+
+	// longest matching prefix wins
+	for (i = 0; i < s_nRules; i++)
+		if (startsWith(cmd, s_rules[i].prefix)
+			&& (NULL == best || strlen(s_rules[i].prefix) > strlen(best->prefix)))
+			best = &s_rules[i];
+	return best;
+}
+
+static rule_t *addRule(const char *prefix)
+{
+	int i;
+	rule_t *r;
+
+	for (i = 0; i < s_nRules; i++)
+		if (!strcasecmp(s_rules[i].prefix, prefix))
+			return &s_rules[i];
+	if (s_nRules >= MAX_RULES) return NULL;
+
+	r = &s_rules[s_nRules++];
+	memset(r, 0, sizeof(*r));
+	snprintf(r->prefix, sizeof(r->prefix), "%s", prefix);
+	r->latency = -1;
+	return r;
+}
+
+/**
+ * \brief NMEA sentence with checksum
+ */
+static void nmea(char *out, int size, const char *body)
+{
+	unsigned char sum = 0;
+	const char *p;
+
+	for (p = body; *p; p++) sum ^= (unsigned char)*p;
+	snprintf(out, size, "$%s*%02X", body, sum);
+}
+
+/**
+ * \brief queue one GPS fix, a slow walk around a fixed point
+ */
+static void sendFix(long long now)
+{
+	char body[MAX_LINE - 8];
+	char line[MAX_LINE];
+	time_t t = time(NULL);
+	struct tm tm;
+	char hms[16];
+	char dmy[8];
+	double lat = 3307.055350 + (rand() % 1000) / 100000.0;
+	double lon = 11718.467958 + (rand() % 1000) / 100000.0;
+
+	gmtime_r(&t, &tm);
+	strftime(hms, sizeof(hms), "%H%M%S.000", &tm);
+	strftime(dmy, sizeof(dmy), "%d%m%y", &tm);
+
+	snprintf(body, sizeof(body),
+		"GPGGA,%s,%.6f,N,%.6f,W,1,6,1.37,98.400,M,-33.610,M,,", hms, lat, lon);
+	nmea(line, sizeof(line), body);
+	schedule(now, PORT_AT, ACTION_LINE, line);
+
+	snprintf(body, sizeof(body),
+		"GPRMC,%s,A,%.6f,N,%.6f,W,0.000,0.0,%s,,,A", hms, lat, lon, dmy);
+	nmea(line, sizeof(line), body);
+	schedule(now, PORT_AT, ACTION_LINE, line);
+
+	nmea(line, sizeof(line), "GPGSA,A,3,22,03,19,09,06,14,,,,,,,2.55,2.37,0.94");
+	schedule(now, PORT_AT, ACTION_LINE, line);
+
+	nmea(line, sizeof(line), "GPVTG,0.0,T,,M,0.000,N,0.000,K,A");
+	schedule(now, PORT_AT, ACTION_LINE, line);
+
+	s_nmeaSent += 4;
+}
+
+/**
+ * \brief queue the OTASP call progress and ^OTACMSG sequence
+ * the driver waits for 5 ^OTACMSG lines and checks the last for MSG:8
+ */
+static void startOtasp(long long now)
+{
+	char line[64];
+	int i;
+
+	schedule(now + 200, PORT_AT, ACTION_LINE, "^ORIG:0,4");
+	schedule(now + 1200, PORT_AT, ACTION_LINE, "^CONN:0,4");
+	for (i = 1; i < 5; i++) {
+		snprintf(line, sizeof(line), "^OTACMSG: MSG:%d", i);
+		schedule(now + 1200 + i * 1000, PORT_AT, ACTION_LINE, line);
+	}
+	snprintf(line, sizeof(line), "^OTACMSG: MSG:%d", s_otaspResult);
+	if (s_otaspResult == 8)
+		schedule(now + 6200, PORT_AT, ACTION_MDN, s_activatedMdn);
+	schedule(now + 6200, PORT_AT, ACTION_LINE, line);
+	schedule(now + 7000, PORT_AT, ACTION_LINE, "^CEND:1,0,29,,0");
+	s_urcSent += 8;
+}
+
+/**
+ * \brief build the response for an AT port command
+ * \return 1 answered OK after the intermediate lines, 0 final in lines
+ */
+static int atResponse(const char *cmd, char lines[][MAX_LINE], int *n, long long due)
+{
+	int v;
+	int rate;
+
+	*n = 0;
+
+	if (startsWith(cmd, "AT+VPON?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+VPON:%d,%d", s_power, s_power);
+	} else if (startsWith(cmd, "AT+CPON")) {
+		s_power = 1;
+	} else if (startsWith(cmd, "AT+CPOF")) {
+		s_power = 0;
+	} else if (startsWith(cmd, "AT^MEID")) {
+		snprintf(lines[(*n)++], MAX_LINE, "^MEID:0x%s", s_meid);
+	} else if (startsWith(cmd, "AT+GSN")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+GSN:0x80F81A9C");
+	} else if (startsWith(cmd, "AT+VGMUID?")) {
+		snprintf(lines[(*n)++], MAX_LINE,
+			"+VGMUID:0,0x80F81A9C,N/A,N/A,0x80cdbb31,0x80cdbb31,0x%s", s_meid);
+	} else if (startsWith(cmd, "AT+CGMM")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+CGMM:FW 1000p");
+	} else if (startsWith(cmd, "AT+GMR")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+GMR: \"1.0.12\"");
+	} else if (startsWith(cmd, "AT^HWVER")) {
+		snprintf(lines[(*n)++], MAX_LINE, "^HWVER:1.0");
+	} else if (startsWith(cmd, "AT+VMDN?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+VMDN:%s", s_mdn);
+	} else if (startsWith(cmd, "AT+VMCCMNC?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+VMCCMNC:0,310,%s",
+			strcmp(s_carrier, "vzw") ? "120" : "004");
+	} else if (startsWith(cmd, "AT$QCMIPGETP")) {
+		snprintf(lines[(*n)++], MAX_LINE,
+			"1,1,\"0.0.0.0\",\"68.28.15.12\",\"68.28.31.12\",\"%s@%s\",\"%s@%s\",0,0,1234,1,1234",
+			s_meid, strcmp(s_carrier, "vzw") ? "hcm.sprintpcs.com" : "vzw3g.com",
+			s_meid, strcmp(s_carrier, "vzw") ? "hcm.sprintpcs.com" : "vzw3g.com");
+	} else if (startsWith(cmd, "AT+CSQ")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+CSQ:%d,99", s_rssi);
+	} else if (startsWith(cmd, "AT^HDRCSQ")) {
+		snprintf(lines[(*n)++], MAX_LINE, "^HDRCSQ:%d", s_hdr);
+	} else if (startsWith(cmd, "AT+NETPAR=")) {
+		// driver skips 9 fields, the 10th is Ec/Io
+		snprintf(lines[(*n)++], MAX_LINE, "+NETPAR:0,1,283,%d,%d,384,2,-75,-80,%d,0",
+			s_sid, s_nid, s_ecio);
+	} else if (startsWith(cmd, "AT+CREG?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+CREG:%d,%d,%d,%d",
+			s_cregMode, s_sid, s_nid, s_creg);
+	} else if (startsWith(cmd, "AT+CREG=")) {
+		s_cregMode = atoi(cmd + 8);
+	} else if (startsWith(cmd, "AT^SYSINFO")) {
+		snprintf(lines[(*n)++], MAX_LINE, "^SYSINFO:%d,255,%d,8,240",
+			(s_creg == 1 || s_creg == 5) ? 2 : 0, s_roam);
+	} else if (startsWith(cmd, "AT+CSNID?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+CSNID:%d,%d", s_sid, s_nid);
+	} else if (startsWith(cmd, "AT+VROM?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+VROM:%d,1", s_roam);
+	} else if (startsWith(cmd, "AT+COPS?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+COPS:0");
+	} else if (startsWith(cmd, "AT+CPIN?")) {
+		snprintf(lines[(*n)++], MAX_LINE, "+CPIN: READY");
+	} else if (startsWith(cmd, "AT^GPSLOC=")) {
+		// AT^GPSLOC=0 off, AT^GPSLOC=1,<seconds>
+		v = atoi(cmd + 10);
+		rate = (NULL != strchr(cmd, ',')) ? atoi(strchr(cmd, ',') + 1) : 1;
+		s_gpsInterval = v ? ((rate > 0) ? rate : 1) * 1000 : 0;
+		s_gpsDue = due + s_gpsInterval;
+	} else if (startsWith(cmd, "AT+CDV=*22899")) {
+		if (strcmp(s_carrier, "vzw") || strncmp(s_mdn, "000", 3)) {
+			snprintf(lines[(*n)++], MAX_LINE, "ERROR");
+			return 0;
+		}
+		startOtasp(due);
+	} else if (startsWith(cmd, "ATH")) {
+		if (s_online || s_dialing) {
+			schedule(due, PORT_DATA, ACTION_OFFLINE, NULL);
+			schedule(due, PORT_DATA, ACTION_LINE, "NO CARRIER");
+		}
+	} else if (!startsWith(cmd, "AT")) {
+		snprintf(lines[(*n)++], MAX_LINE, "ERROR");
+		return 0;
+	} else if (!(startsWith(cmd, "ATE") || startsWith(cmd, "ATS")
+		|| !strcasecmp(cmd, "AT") || strchr(cmd, '='))) {
+		// plain set commands are accepted silently, others noted
+		s_unknown++;
+		fprintf(stderr, "unknown: %s\n", cmd);
+	}
+
+	return 1;
+}
+
+/**
+ * \brief answer one AT port command with latency and faults applied
+ */
+static void atCommand(const char *cmd, long long now)
+{
+	char lines[4][MAX_LINE];
+	rule_t *r = findRule(cmd);
+	int latency = s_latency;
+	int jitter = s_jitter;
+	int fault = FAULT_NONE;
+	int ok;
+	int n;
+	int i;
+	long long due;
+
+	s_commands++;
+
+	if (NULL != r) {
+		r->hits++;
+		if (r->latency >= 0) {
+			latency = r->latency;
+			jitter = r->jitter;
+		}
+		if (r->fault != FAULT_NONE && (rand() % 100) < r->percent) {
+			fault = r->fault;
+			r->faults++;
+			s_faults++;
+		}
+	}
+
+	due = now + latency + ((jitter > 0) ? rand() % (jitter + 1) : 0);
+
+	switch (fault) {
+		case FAULT_ERROR:
+			schedule(due, PORT_AT, ACTION_LINE, "ERROR");
+			return;
+		case FAULT_CME:
+			schedule(due, PORT_AT, ACTION_LINE, "+CME ERROR: 100");
+			return;
+		case FAULT_TIMEOUT:
+			// no answer, the driver times out
+			return;
+		case FAULT_SLOW:
+			due += 10 * (latency + 100);
+			break;
+	}
+
+	ok = atResponse(cmd, lines, &n, due);
+	for (i = 0; i < n; i++) {
+		if (fault == FAULT_GARBAGE) {
+			// truncated, corrupted intermediate line
+			lines[i][strlen(lines[i]) / 2] = '\0';
+			lines[i][0] ^= 0x20;
+		}
+		schedule(due, PORT_AT, ACTION_LINE, lines[i]);
+	}
+	if (ok) schedule(due, PORT_AT, ACTION_LINE, "OK");
+}
+
+/**
+ * \brief answer one data port command in command mode
+ */
+static void dataCommand(const char *cmd, long long now)
+{
+	long long due = now + s_latency;
+
+	if (startsWith(cmd, "ATD")) {
+		if (strstr(cmd, "#777") && s_power && (s_creg == 1 || s_creg == 5)) {
+			s_dialing = 1;
+			s_calls++;
+			due += s_connectMsec;
+			schedule(due, PORT_DATA, ACTION_LINE, "CONNECT");
+			schedule(due, PORT_DATA, ACTION_ONLINE, NULL);
+		} else {
+			schedule(due + s_connectMsec, PORT_DATA, ACTION_LINE, "NO CARRIER");
+		}
+	} else if (startsWith(cmd, "AT")) {
+		schedule(due, PORT_DATA, ACTION_LINE, "OK");
+	}
+}
+
+/**
+ * \brief random walk of signal and registration, sends +CREG when enabled
+ */
+static void randomChange(long long now)
+{
+	char line[64];
+
+	s_rssi += (rand() % 5) - 2;
+	if (s_rssi < 0) s_rssi = 0;
+	if (s_rssi > 31) s_rssi = 31;
+	s_hdr = (rand() % 5) * 20;
+
+	// occasional registration loss and recovery
+	if ((rand() % 10) == 0) {
+		s_creg = (s_creg == 1) ? 2 : 1;
+		if (s_cregMode) {
+			snprintf(line, sizeof(line), "+CREG: %d", s_creg);
+			schedule(now, PORT_AT, ACTION_LINE, line);
+			s_urcSent++;
+		}
+	}
+}
+
+static int parseFault(const char *name)
+{
+	int i;
+
+	for (i = 0; s_faultNames[i]; i++)
+		if (!strcmp(name, s_faultNames[i]))
+			return i;
+	return -1;
+}
+
+/**
+ * \brief read script file
+ * \return 0 OK, -1 error
+ */
+static int readScript(const char *file)
+{
+	FILE *f;
+	char buf[MAX_LINE + 64];
+	char word[32];
+	char arg1[32];
+	char arg2[32];
+	int a;
+	int b;
+	int n;
+	int lineNo = 0;
+	rule_t *r;
+
+	f = fopen(file, "r");
+	if (NULL == f) {
+		perror(file);
+		return -1;
+	}
+
+	while (NULL != fgets(buf, sizeof(buf), f)) {
+		lineNo++;
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (buf[0] == '#' || sscanf(buf, "%31s", word) != 1)
+			continue;
+
+		if (!strcmp(word, "latency")) {
+			b = 0;
+			if (sscanf(buf, "%*s %31s %d %d", arg1, &a, &b) < 2) goto bad;
+			if (NULL == (r = addRule(arg1))) goto bad;
+			r->latency = a;
+			r->jitter = b;
+		} else if (!strcmp(word, "fault")) {
+			if (sscanf(buf, "%*s %31s %31s %d", arg1, arg2, &a) != 3) goto bad;
+			if (NULL == (r = addRule(arg1))) goto bad;
+			if ((r->fault = parseFault(arg2)) < 0) goto bad;
+			r->percent = a;
+		} else if (!strcmp(word, "urc")) {
+			if (s_nUrcs >= MAX_URCS
+				|| sscanf(buf, "%*s %d %n", &a, &n) != 1 || a <= 0) goto bad;
+			s_urcs[s_nUrcs].period = a;
+			snprintf(s_urcs[s_nUrcs].line, MAX_LINE, "%s", buf + n);
+			s_nUrcs++;
+		} else if (!strcmp(word, "set")) {
+			if (sscanf(buf, "%*s %31s %31s", arg1, arg2) != 2) goto bad;
+			a = atoi(arg2);
+			if (!strcmp(arg1, "rssi")) s_rssi = a;
+			else if (!strcmp(arg1, "hdr")) s_hdr = a;
+			else if (!strcmp(arg1, "ecio")) s_ecio = a;
+			else if (!strcmp(arg1, "creg")) s_creg = a;
+			else if (!strcmp(arg1, "sid")) s_sid = a;
+			else if (!strcmp(arg1, "nid")) s_nid = a;
+			else if (!strcmp(arg1, "roam")) s_roam = a;
+			else if (!strcmp(arg1, "otasp")) s_otaspResult = a;
+			else if (!strcmp(arg1, "connect")) s_connectMsec = a;
+			else if (!strcmp(arg1, "drop")) s_dropMsec = a;
+			else goto bad;
+		} else {
+			goto bad;
+		}
+		continue;
+bad:
+		fprintf(stderr, "%s:%d bad line: %s\n", file, lineNo, buf);
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static void onSignal(int sig)
+{
+	s_quit = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f script] [-L atlink] [-D datalink] [-l msec] "
+		"[-j msec] [-u msec] [-c carrier] [-m mdn] [-r seed]\n", name);
+	exit(1);
+}
+
+/**
+ * \brief write due lines and apply due state changes
+ */
+static void runPending(long long now)
+{
+	pending_t *p;
+
+	while (s_nPending > 0 && s_pending[0].due <= now) {
+		p = &s_pending[0];
+		switch (p->action) {
+			case ACTION_LINE:
+				ptyWriteLine(s_fd[p->port], p->line);
+				break;
+			case ACTION_ONLINE:
+				if (s_dialing) {
+					s_online = 1;
+					s_dialing = 0;
+					s_dropDue = s_dropMsec ? now + s_dropMsec : 0;
+				}
+				break;
+			case ACTION_OFFLINE:
+				s_online = 0;
+				s_dialing = 0;
+				s_dropDue = 0;
+				break;
+			case ACTION_MDN:
+				snprintf(s_mdn, sizeof(s_mdn), "%.15s", p->line);
+				break;
+		}
+		s_nPending--;
+		memmove(s_pending, s_pending + 1, s_nPending * sizeof(s_pending[0]));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *link[2] = { "/tmp/fw100-at", "/tmp/fw100-data" };
+	const char *script = NULL;
+	char slave[2][64];
+	char cmd[2][MAX_LINE];
+	int cmdLen[2] = { 0, 0 };
+	char junk[512];
+	int opt;
+	int i;
+	int n;
+	int timeout;
+	long long now;
+	long long next;
+	long long changeDue = 0;
+	struct pollfd pfd[2];
+
+	srand(1);
+	while (-1 != (opt = getopt(argc, argv, "f:L:D:l:j:u:c:m:r:"))) {
+		switch (opt) {
+			case 'f': script = optarg; break;
+			case 'L': link[PORT_AT] = optarg; break;
+			case 'D': link[PORT_DATA] = optarg; break;
+			case 'l': s_latency = atoi(optarg); break;
+			case 'j': s_jitter = atoi(optarg); break;
+			case 'u': s_changeMsec = atoi(optarg); break;
+			case 'c': s_carrier = optarg; break;
+			case 'm': snprintf(s_mdn, sizeof(s_mdn), "%s", optarg); break;
+			case 'r': srand(atoi(optarg)); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (NULL != script && readScript(script) < 0) return 1;
+
+	for (i = 0; i < 2; i++) {
+		s_fd[i] = ptyOpen(link[i], slave[i], sizeof(slave[i]));
+		if (s_fd[i] < 0) return 1;
+		fprintf(stderr, "%s port on %s -> %s\n", i ? "data" : "AT", link[i], slave[i]);
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	now = ptyNowMsec();
+	for (i = 0; i < s_nUrcs; i++)
+		s_urcs[i].due = now + s_urcs[i].period;
+	if (s_changeMsec)
+		changeDue = now + 1 + rand() % (2 * s_changeMsec);
+
+	while (!s_quit) {
+		now = ptyNowMsec();
+
+		// timed events
+		for (i = 0; i < s_nUrcs; i++) {
+			if (s_urcs[i].due > now) continue;
+			schedule(now, PORT_AT, ACTION_LINE, s_urcs[i].line);
+			s_urcSent++;
+			s_urcs[i].due += s_urcs[i].period;
+		}
+		if (s_gpsInterval && s_gpsDue <= now) {
+			sendFix(now);
+			s_gpsDue += s_gpsInterval;
+			if (s_gpsDue < now) s_gpsDue = now + s_gpsInterval;
+		}
+		if (changeDue && changeDue <= now) {
+			randomChange(now);
+			changeDue = now + 1 + rand() % (2 * s_changeMsec);
+		}
+		if (s_online && s_dropDue && s_dropDue <= now) {
+			schedule(now, PORT_DATA, ACTION_OFFLINE, NULL);
+			schedule(now, PORT_DATA, ACTION_LINE, "NO CARRIER");
+			s_dropDue = 0;
+		}
+
+		runPending(now);
+
+		// sleep to the next event
+		next = now + 1000;
+		if (s_nPending > 0 && s_pending[0].due < next) next = s_pending[0].due;
+		for (i = 0; i < s_nUrcs; i++)
+			if (s_urcs[i].due < next) next = s_urcs[i].due;
+		if (s_gpsInterval && s_gpsDue < next) next = s_gpsDue;
+		if (changeDue && changeDue < next) next = changeDue;
+		if (s_dropDue && s_dropDue < next) next = s_dropDue;
+		timeout = (next > now) ? (int)(next - now) : 0;
+
+		for (i = 0; i < 2; i++) {
+			pfd[i].fd = s_fd[i];
+			pfd[i].events = POLLIN;
+			pfd[i].revents = 0;
+		}
+		if (poll(pfd, 2, timeout) <= 0) continue;
+		now = ptyNowMsec();
+
+		if (pfd[PORT_AT].revents & POLLIN) {
+			while (ptyReadLine(s_fd[PORT_AT], cmd[PORT_AT], MAX_LINE, &cmdLen[PORT_AT]) == 1)
+				if (cmd[PORT_AT][0] != '\0')
+					atCommand(cmd[PORT_AT], now);
+		}
+
+		if (pfd[PORT_DATA].revents & POLLIN) {
+			if (s_online) {
+				// PPP frames from the host, counted and dropped
+				while ((n = read(s_fd[PORT_DATA], junk, sizeof(junk))) > 0)
+					s_dataBytes += n;
+			} else {
+				while (ptyReadLine(s_fd[PORT_DATA], cmd[PORT_DATA], MAX_LINE,
+					&cmdLen[PORT_DATA]) == 1)
+					if (cmd[PORT_DATA][0] != '\0')
+						dataCommand(cmd[PORT_DATA], now);
+			}
+		}
+	}
+
+	fprintf(stderr, "commands=%u unknown=%u faults=%u urc=%u nmea=%u calls=%u databytes=%u\n",
+		s_commands, s_unknown, s_faults, s_urcSent, s_nmeaSent, s_calls, s_dataBytes);
+	for (i = 0; i < s_nRules; i++)
+		fprintf(stderr, "  %-16s hits=%u faults=%u\n",
+			s_rules[i].prefix, s_rules[i].hits, s_rules[i].faults);
+
+	for (i = 0; i < 2; i++)
+		ptyClose(s_fd[i], link[i]);
+	return 0;
+}
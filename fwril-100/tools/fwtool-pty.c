@@ -0,0 +1,172 @@
+/**
+ * \file fwtool-pty.c
+ * \brief pseudo-terminal helpers for the host modem tools
+ *
+ * The tool holds the master side.  The slave is opened once here
+ * and set raw so the line discipline does not echo or translate
+ * CR, and kept open so the master does not see EIO while the
+ * driver closes and reopens the port.
+ *
+ *  \if license
+ *  Copyright (c) 2011 Cypherbridge Systems, LLC.
+ *  www.cypherbridge.com
+ *  info@cypherbridge.com
+ *  \endif
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fwtool-pty.h>
+
+#define PTY_MAX	8	// fw100-databench, two per data context
+
+// slave fd held open per master
+static struct {
+	int master;
+	int slave;
+} s_pty[PTY_MAX] = { [0 ... PTY_MAX - 1] = {-1, -1} };
+
+/**
+ * \brief open pty pair
+ *
+ * \param link - optional symlink to the slave, e.g. /tmp/fw100-at, or NULL
+ * \param slaveName - returned slave device name
+ * \param len - size of slaveName
+ * \return master fd (non blocking), -1 on error
+ */
+int ptyOpen(const char *link, char *slaveName, int len)
+{
+	int master;
+	int slave;
+	int i;
+	struct termios ios;
+
+	for (i = 0; i < PTY_MAX && s_pty[i].master >= 0; i++)
+		;
+	if (i == PTY_MAX) {
+		fprintf(stderr, "too many ptys\n");
+		return -1;
+	}
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+		perror("ptmx");
+		return -1;
+	}
+	snprintf(slaveName, len, "%s", ptsname(master));
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+	slave = open(slaveName, O_RDWR | O_NOCTTY);
+	if (slave < 0) {
+		perror(slaveName);
+		close(master);
+		return -1;
+	}
+	tcgetattr(slave, &ios);
+	cfmakeraw(&ios);
+	tcsetattr(slave, TCSANOW, &ios);
+	s_pty[i].master = master;
+	s_pty[i].slave = slave;
+
+	if (NULL != link) {
+		unlink(link);
+		if (symlink(slaveName, link) < 0)
+			perror(link);
+	}
+
+	return master;
+}
+
+void ptyClose(int master, const char *link)
+{
+	int i;
+
+	if (NULL != link) unlink(link);
+	for (i = 0; i < PTY_MAX; i++) {
+		if (s_pty[i].master != master) continue;
+		close(s_pty[i].slave);
+		s_pty[i].master = -1;
+		s_pty[i].slave = -1;
+	}
+	close(master);
+}
+
+long long ptyNowMsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * \brief write a modem response line framed as CR LF line CR LF
+ */
+int ptyWriteLine(int fd, const char *line)
+{
+	char buf[1024];
+	int n;
+	int off = 0;
+	int w;
+	struct pollfd pfd;
+
+	n = snprintf(buf, sizeof(buf), "\r\n%s\r\n", line);
+	if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+
+	while (off < n) {
+		w = write(fd, buf + off, n - off);
+		if (w < 0) {
+			if (errno == EAGAIN) {
+				// reader is behind, wait for room
+				pfd.fd = fd;
+				pfd.events = POLLOUT;
+				poll(&pfd, 1, 100);
+				continue;
+			}
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		off += w;
+	}
+	return 0;
+}
+
+/**
+ * \brief accumulate host bytes into a command line
+ * call when fd is readable, commands end at CR (or ^Z for SMS PDUs)
+ *
+ * \param buf - line buffer, persists across calls
+ * \param size - size of buf
+ * \param len - bytes held in buf, persists across calls
+ * \return 1 a complete line is in buf, 0 need more, -1 read error
+ */
+int ptyReadLine(int fd, char *buf, int size, int *len)
+{
+	char c;
+	int n;
+
+	for (;;) {
+		n = read(fd, &c, 1);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && errno == EAGAIN) return 0;
+		if (n <= 0) return -1;
+
+		if (c == '\r' || c == '\032') {
+			buf[*len] = '\0';
+			*len = 0;
+			return 1;
+		}
+		if (c == '\n') continue;
+		if (*len < size - 1) buf[(*len)++] = c;
+	}
+}
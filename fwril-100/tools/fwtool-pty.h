@@ -0,0 +1,16 @@
+/**
+ *
+ * \file fwtool-pty.h
+ * \brief pseudo-terminal helpers for the host modem tools
+ */
+
+#ifndef _fwtool_pty_h_included
+#define _fwtool_pty_h_included
+
+int  ptyOpen(const char *link, char *slaveName, int len);
+void ptyClose(int master, const char *link);
+long long ptyNowMsec(void);
+int  ptyWriteLine(int fd, const char *line);
+int  ptyReadLine(int fd, char *buf, int size, int *len);
+
+#endif // _fwtool_pty_h_included